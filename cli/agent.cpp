@@ -0,0 +1,117 @@
+﻿#include "agent.h"
+#include "CommandLineOption.hpp"
+#include "common.h"
+#include "KeyAgent.h"
+#include "PasswordManagement.h"
+#include <atomic>
+#include <csignal>
+
+namespace {
+
+    const OptionDetail od_ttl = {
+        .name = "ttl ",
+        .summary = "鍵を保持する時間(秒)",
+        .detail = "エージェントが鍵を保持して応答する時間(秒)であり、経過すると鍵を消去して終了する\n"
+        "時間は起動時から数え、応答しても延長しない"
+    };
+
+    const OptionDetail od_stop = {
+        .name = "stop",
+        .summary = "起動中のエージェントを停止",
+        .detail = "DBに対応する起動中のエージェントに停止を要求する"
+    };
+
+    /// <summary>
+    /// シグナルを受け取るとtrueにする停止の要求
+    /// </summary>
+    std::atomic<bool> stop_requested = false;
+
+    extern "C" void requestStop(int) {
+        stop_requested.store(true);
+    }
+}
+
+void agent(int argc, const char* argv[], const std::filesystem::path& db, std::ostream& os) {
+    option::CommandLineOption clo;
+    clo.add_options()
+        .l(od_help.name, od_help.summary)
+        .l(od_help_with_target.name, option::Value<std::string>().name("option"), od_help_with_target.summary)
+        .l(od_ttl.name, option::Value<long long>(900).constraint([](long long x) { return x > 0; }).name("sec"), od_ttl.summary)
+        .l(od_stop.name, od_stop.summary);
+
+    const option::OptionMap& map = clo.map();
+    // 引数を伴わずに実行するため引数が存在するときのみ解析する
+    if (argc != 0) {
+        // コマンドライン引数の解析の実行
+        clo.parse(argc, argv, false);
+
+        if (auto temp = map.luse(od_help_with_target.name); temp) {
+            // コマンドライン引数に対する説明の表示
+            auto target = temp.as<std::string>();
+            std::string detail;
+            if (target == od_help.name) {
+                detail = od_help.detail;
+            }
+            else if (target == od_help_with_target.name) {
+                detail = od_help_with_target.detail;
+            }
+            else if (target == od_ttl.name) {
+                detail = od_ttl.detail;
+            }
+            else if (target == od_stop.name) {
+                detail = od_stop.detail;
+            }
+            else {
+                std::cerr << target << " に該当する説明は存在しません" << std::endl;
+                return;
+            }
+            std::cout << detail << std::endl;
+            return;
+        }
+        else if (auto temp = map.luse(od_help.name); temp) {
+            // コマンド一覧を表示
+            std::cout << "Options:" << std::endl;
+            std::cout << clo.description() << std::endl;
+            return;
+        }
+
+        // 入力値の評価
+        map.validate();
+    }
+
+    auto conn = SQLite(db);
+    auto pm = pwm::PasswordManagement(db, conn);
+    auto path = pwm::keyAgentPath(pm.vault());
+
+    if (map.luse(od_stop.name)) {
+        if (!pwm::stopKeyAgent(path)) {
+            throw std::runtime_error("起動中のエージェントが存在しません");
+        }
+        os << "stopped: " << path.string() << std::endl;
+        return;
+    }
+
+    // パスフレーズから鍵を導出してエージェントへ複製した後は破棄する
+    std::optional<pwm::KeyAgent> key_agent;
+    {
+        auto passphrase = readPassphrase();
+        if (!passphrase) {
+            throw std::invalid_argument(std::format("環境変数{0}にパスフレーズを設定してください", env_passphrase));
+        }
+        auto keys = pm.deriveKeys(passphrase.value());
+        key_agent.emplace(path, keys);
+        for (auto& x : keys) {
+            std::ranges::fill(x.key, std::byte{ 0 });
+        }
+        std::ranges::fill(passphrase.value(), u8'\0');
+    }
+
+    auto ttl = std::chrono::seconds(map.luse(od_ttl.name).as<long long>());
+    std::signal(SIGINT, requestStop);
+    std::signal(SIGTERM, requestStop);
+    os << "socket: " << path.string() << '\n';
+    os << "ttl: " << ttl.count() << "s" << std::endl;
+    auto served = key_agent->serve(ttl, stop_requested);
+    key_agent.reset();
+    os << "served: " << served << std::endl;
+}
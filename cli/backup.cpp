@@ -0,0 +1,256 @@
+﻿#include "backup.h"
+#include "CommandLineOption.hpp"
+#include "common.h"
+#include "PageCipherVfs.h"
+#include "SQLiteConnection.h"
+#include "UringSink.h"
+
+namespace {
+
+    const OptionDetail od_pages = {
+        .name = "pages ",
+        .summary = "1度に複製するページ数",
+        .detail = "1度のステップで複製するページ数であり、ステップの間はロックを解放する\n"
+        "小さくするほど他のコネクションの待ち時間は短くなり、バックアップの完了までの時間は長くなる"
+    };
+
+    const OptionDetail od_pause = {
+        .name = "pause ",
+        .summary = "ステップの間で待機する時間(ミリ秒)",
+        .detail = "他のコネクションがロックを取得できるようステップの間で待機する時間(ミリ秒)\n"
+        "0を指定したときはスレッドを譲るのみとする"
+    };
+
+    const OptionDetail od_no_snapshot = {
+        .name = "no-snapshot",
+        .summary = "開始時点のスナップショットを維持しない",
+        .detail = "DBがWALモードのときも読み取りトランザクションを維持せずにステップごとに最新の内容を複製する\n"
+        "省略時は開始時点の内容を複製するため書き込みによる複製し直しが起きないが、複製中はWALのファイルが大きくなりうる"
+    };
+
+    const OptionDetail od_progress = {
+        .name = "progress",
+        .summary = "進捗を表示",
+        .detail = "複製を終えたページ数と全体のページ数を1秒ごとに標準エラー出力へ表示する"
+    };
+
+    const OptionDetail od_io = {
+        .name = "io ",
+        .summary = "ファイルへの書き込み方式",
+        .detail = "以下のようなファイルへの書き込み方式を指定する\n"
+        "  sync    SQLiteがページごとに複製先のファイルへ書き込む\n"
+        "  uring   メモリ上のDBへ複製してから、DBファイルの内容を整列したブロックとしてio_uringにより非同期に書き込む\n"
+        "          (DBのサイズの2倍程度のメモリを使用する。io_uringを利用できない環境ではブロックごとにpwriteで書き込む)"
+    };
+
+    const OptionDetail od_queue_depth = {
+        .name = "queue-depth ",
+        .summary = "--io uringで同時に書き込み中とするブロックの数",
+        .detail = "--io uringを指定したときに同時に書き込み中とする1MiBのブロックの数"
+    };
+
+    const OptionDetail od_force = {
+        .name = "force",
+        .summary = "既存のファイルを置き換える",
+        .detail = "複製先のファイルが既に存在するときに置き換える(省略時は失敗する)"
+    };
+
+    const OptionDetail od_dest = {
+        .name = "dest",
+        .summary = "複製先のファイルのパス",
+        .detail = "複製先のファイルのパス\n"
+        "複製は末尾に.partialを付したファイルへ行い、完了後に置き換えるため中断されても既存のファイルは残る"
+    };
+
+    /// <summary>
+    /// DBファイルの内容をページごとに暗号化して書き込む
+    /// </summary>
+    /// <param name="sink">出力先</param>
+    /// <param name="cipher">ページの暗号化に用いる鍵</param>
+    /// <param name="image">平文のDBファイルの内容</param>
+    void writeSealed(OutputSink& sink, SQLitePageCipher& cipher, std::span<const std::byte> image) {
+        constexpr auto page_size = SQLitePageCipher::page_size;
+        if (image.size() % page_size != 0 || (!image.empty() && (image[16] != std::byte{ page_size >> 8 }
+            || image[17] != std::byte{ 0 } || image[20] != std::byte{ SQLitePageCipher::reserve_size }))) {
+            throw std::runtime_error("ページのサイズあるいは予約領域が暗号化に対応しないDBは暗号化して複製できません");
+        }
+        // 複数のページをまとめて暗号化してから書き込む
+        std::vector<std::byte> sealed(page_size * 256);
+        for (std::size_t offset = 0; offset < image.size();) {
+            auto n = std::min(sealed.size(), image.size() - offset);
+            for (std::size_t i = 0; i < n; i += page_size) {
+                cipher.seal(SQLitePageCipher::FileKind::database, static_cast<std::int64_t>(offset + i),
+                    image.subspan(offset + i, page_size), std::span(sealed).subspan(i, page_size));
+            }
+            sink.write(std::span(sealed).first(n));
+            offset += n;
+        }
+    }
+}
+
+void backup(int argc, const char* argv[], const std::filesystem::path& db, std::ostream& os) {
+    option::CommandLineOption clo;
+    clo.add_options()
+        .l(od_help.name, od_help.summary)
+        .l(od_help_with_target.name, option::Value<std::string>().name("option"), od_help_with_target.summary)
+        .l(od_pages.name, option::Value<long long>(SQLiteBackupOptions{}.pages_per_step)
+            .constraint([](long long x) { return x > 0 && x <= std::numeric_limits<int>::max(); }).name("n"), od_pages.summary)
+        .l(od_pause.name, option::Value<long long>(SQLiteBackupOptions{}.pause.count())
+            .constraint([](long long x) { return x >= 0; }).name("ms"), od_pause.summary)
+        .l(od_no_snapshot.name, od_no_snapshot.summary)
+        .l(od_progress.name, od_progress.summary)
+        .l(od_io.name, option::Value<std::string>("sync")
+            .constraint([](const std::string& x) { return x == "sync" || x == "uring"; }).name("method"), od_io.summary)
+        .l(od_queue_depth.name, option::Value<long long>(8).constraint([](long long x) { return x > 0 && x <= 4096; }).name("n"), od_queue_depth.summary)
+        .l(od_force.name, od_force.summary)
+        .u(option::Value<std::string>().name(od_dest.name), od_dest.summary);
+
+    if (argc == 0) {
+        // 引数が存在しないときは説明を表示
+        std::cout << "Options:" << std::endl;
+        std::cout << clo.description() << std::endl;
+        return;
+    }
+
+    const option::OptionMap& map = clo.map();
+    // コマンドライン引数の解析の実行
+    clo.parse(argc, argv, false);
+
+    if (auto temp = map.luse(od_help_with_target.name); temp) {
+        // コマンドライン引数に対する説明の表示
+        auto target = temp.as<std::string>();
+        std::string detail;
+        if (target == od_help.name) {
+            detail = od_help.detail;
+        }
+        else if (target == od_help_with_target.name) {
+            detail = od_help_with_target.detail;
+        }
+        else if (target == od_pages.name) {
+            detail = od_pages.detail;
+        }
+        else if (target == od_pause.name) {
+            detail = od_pause.detail;
+        }
+        else if (target == od_no_snapshot.name) {
+            detail = od_no_snapshot.detail;
+        }
+        else if (target == od_progress.name) {
+            detail = od_progress.detail;
+        }
+        else if (target == od_io.name) {
+            detail = od_io.detail;
+        }
+        else if (target == od_queue_depth.name) {
+            detail = od_queue_depth.detail;
+        }
+        else if (target == od_force.name) {
+            detail = od_force.detail;
+        }
+        else if (target == od_dest.name) {
+            detail = od_dest.detail;
+        }
+        else {
+            std::cerr << target << " に該当する説明は存在しません" << std::endl;
+            return;
+        }
+        std::cout << detail << std::endl;
+        return;
+    }
+    else if (auto temp = map.luse(od_help.name); temp) {
+        // コマンド一覧を表示
+        std::cout << "Options:" << std::endl;
+        std::cout << clo.description() << std::endl;
+        return;
+    }
+
+    // 入力値の評価
+    map.validate();
+
+    auto file = map.unnamed_options().as<std::string>();
+    auto dest = std::filesystem::path(std::bit_cast<const char8_t*>(file.c_str()));
+    if (!std::filesystem::exists(db)) {
+        throw std::runtime_error("複製元のDBが存在しません");
+    }
+    if (std::filesystem::exists(dest) && !map.luse(od_force.name)) {
+        throw std::runtime_error(file + " は既に存在します(置き換えるには--forceを指定する)");
+    }
+    if (std::filesystem::exists(dest) && std::filesystem::equivalent(db, dest)) {
+        throw std::invalid_argument("複製元と同じファイルへは複製できません");
+    }
+
+    SQLiteBackupOptions options{
+        .pages_per_step = static_cast<int>(map.use(od_pages.name).as<long long>()),
+        .pause = std::chrono::milliseconds(map.use(od_pause.name).as<long long>()),
+        .snapshot = !map.luse(od_no_snapshot.name)
+    };
+    const bool show_progress = static_cast<bool>(map.luse(od_progress.name));
+    const bool uring = map.use(od_io.name).as<std::string>() == "uring";
+    std::optional<bool> async_io;
+
+    // 一時ファイルへ複製してから置き換える
+    auto partial = dest;
+    partial += ".partial";
+    std::filesystem::remove(partial);
+    auto begin = std::chrono::steady_clock::now();
+    auto last_report = begin;
+    SQLiteBackupProgress result;
+    try {
+        // 複製元は読み取り専用で開き、他のコネクションの書き込みを妨げない
+        SQLite src(db, { .read_only = true });
+        auto report = [&](const SQLiteBackupProgress& progress) {
+            auto now = std::chrono::steady_clock::now();
+            if (show_progress && (now - last_report >= std::chrono::seconds(1) || progress.copied == progress.total)) {
+                last_report = now;
+                std::cerr << std::format("progress: {0}/{1} pages ({2:.1f}%)", progress.copied, progress.total,
+                    progress.total > 0 ? progress.copied * 100.0 / progress.total : 100.0) << std::endl;
+            }
+        };
+        if (uring) {
+            // メモリ上のDBへ複製することでスナップショットを確定させてから、ファイルへの書き込みはSQLiteを介さずに行う
+            SQLite mem(":memory:");
+            result = src.backup(mem, options, report);
+            std::shared_ptr<SQLitePageCipher> cipher;
+            if (SQLiteConnection::default_page_cipher_provider) {
+                // 複製先を新たに作成する場合と同じく新たな塩から導出した鍵で暗号化する
+                cipher = SQLiteConnection::default_page_cipher_provider(partial);
+            }
+            UringSink sink(partial, false, { .queue_depth = static_cast<unsigned>(map.use(od_queue_depth.name).as<long long>()) });
+            async_io = sink.async();
+            mem.serialize([&](std::span<const std::byte> image) {
+                if (cipher) {
+                    writeSealed(sink, *cipher, image);
+                }
+                else {
+                    sink.write(image);
+                }
+            });
+            sink.flush();
+        }
+        else {
+            SQLite dst(partial);
+            result = src.backup(dst, options, report);
+        }
+    }
+    catch (...) {
+        std::error_code ec;
+        std::filesystem::remove(partial, ec);
+        throw;
+    }
+    std::filesystem::rename(partial, dest);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+    // 複製したページ数とスループットの出力
+    auto bytes = std::filesystem::file_size(dest);
+    os << "pages: " << result.copied << '\n';
+    os << "bytes: " << bytes << '\n';
+    os << "steps: " << result.steps << '\n';
+    os << "restarts: " << result.restarts << '\n';
+    os << "busy-retries: " << result.busy << '\n';
+    if (async_io) {
+        os << "io: " << (async_io.value() ? "uring" : "pwrite") << '\n';
+    }
+    os << "elapsed: " << std::format("{0:.3f}", elapsed.count()) << "s" << '\n';
+    os << "pages-per-sec: " << std::format("{0:.0f}", elapsed.count() > 0 ? result.copied / elapsed.count() : 0.0) << '\n';
+    os << "mib-per-sec: " << std::format("{0:.1f}", elapsed.count() > 0 ? bytes / elapsed.count() / (1 << 20) : 0.0) << std::endl;
+}
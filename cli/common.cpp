@@ -1,5 +1,8 @@
 ﻿#include "common.h"
+#include "KeyAgent.h"
 #include <bit>
+#include <cstdlib>
+#include <memory>
 
 const OptionDetail od_help = {
     .name = "help",
@@ -13,6 +16,66 @@ const OptionDetail od_help_with_target = {
     .detail = "コマンドラインオプションについてのヘルプ"
 };
 
+const std::unordered_map<std::u8string_view, int> col_map = {
+    { col_list::service, pwm::table::passwords::c_service::index },
+    { col_list::name, pwm::table::passwords::c_name::index },
+    { col_list::user, pwm::table::passwords::c_user::index },
+    { col_list::password, pwm::table::passwords::c_password::index },
+    { col_list::memo, pwm::table::passwords::c_memo::index },
+    { col_list::registered_at, pwm::table::passwords::c_registered_at::index },
+    { col_list::update_at, pwm::table::passwords::c_update_at::index },
+    { col_list::id, pwm::table::passwords::c_id::index },
+    { col_list::version, pwm::table::passwords::c_version::index }
+};
+
+SQLite openForRead(const std::filesystem::path& db, bool immutable) {
+    if (std::filesystem::exists(db)) {
+        // 単一のスレッドからのみ利用するため排他制御も行わない
+        auto conn = SQLite(db, { .read_only = true, .immutable = immutable, .no_mutex = true });
+        if (pwm::PasswordManagement::ready(conn)) {
+            return conn;
+        }
+    }
+    return SQLite(db);
+}
+
+std::optional<std::u8string> readPassphrase(const char* name) {
+#if defined(_MSC_VER)
+    char* value = nullptr;
+    std::size_t size = 0;
+    if (_dupenv_s(&value, &size, name) != 0 || value == nullptr) {
+        return std::nullopt;
+    }
+    std::unique_ptr<char, decltype(&std::free)> holder(value, std::free);
+#else
+    const char* value = std::getenv(name);
+    if (value == nullptr) {
+        return std::nullopt;
+    }
+#endif
+    return std::u8string(std::bit_cast<const char8_t*>(value));
+}
+
+void unlockVault(pwm::PasswordManagement& pm) {
+    auto passphrase = readPassphrase();
+    // エージェントが起動していれば鍵の導出を省略する
+    if (auto keys = pwm::fetchAgentKeys(pwm::keyAgentPath(pm.vault())); keys) {
+        try {
+            pm.unlock(keys.value());
+            return;
+        }
+        catch (const std::runtime_error&) {
+            // 鍵が更新された後の古いエージェントであればパスフレーズから導出する
+            if (!passphrase) {
+                throw;
+            }
+        }
+    }
+    if (passphrase) {
+        pm.unlock(passphrase.value());
+    }
+}
+
 namespace cond {
 
     const OptionDetail od_service = {
@@ -54,6 +117,13 @@ namespace cond {
         .detail = "パスワード情報の更新日時"
     };
 
+    const OptionDetail od_id = {
+        .name = "id ",
+        .summary = "パスワード情報の主キー",
+        .detail = "パスワード情報の主キーであり、getコマンドでidを取得対象とすることで得られる\n"
+        "指定されたときは他の検索条件をすべて無視する"
+    };
+
     option::AddOptions& addCond(option::AddOptions x) {
         return x.l(od_service.name, option::Value<std::string>().name("service"), od_service.summary)
             .l(od_user.name, option::Value<std::string>().name("user"), od_user.summary)
@@ -81,6 +151,9 @@ namespace cond {
         else if (target == od_update_at.name) {
             p = std::addressof(od_update_at.detail);
         }
+        else if (target == od_id.name) {
+            p = std::addressof(od_id.detail);
+        }
         if (p != nullptr) {
             x = *p;
             return true;
@@ -217,4 +290,16 @@ namespace cond {
 
         return data;
     }
+
+    option::AddOptions& addIdCond(option::AddOptions x) {
+        return x.l(od_id.name, option::Value<long long>().unlimited().name("id"), od_id.summary);
+    }
+
+    std::optional<std::vector<std::int64_t>> getIds(const option::OptionMap& map) {
+        if (auto temp = map.use(od_id.name); temp) {
+            auto ids = temp.as<std::vector<long long>>();
+            return std::vector<std::int64_t>(ids.begin(), ids.end());
+        }
+        return std::nullopt;
+    }
 }
\ No newline at end of file
@@ -2,6 +2,9 @@
 
 #include "CommandLineOption.hpp"
 #include "PasswordManagement.h"
+#include <optional>
+#include <string>
+#include <unordered_map>
 
 /// <summary>
 /// オプション名と変数名を紐づけるための構造体
@@ -31,6 +34,60 @@ extern const OptionDetail od_help;
 /// </summary>
 extern const OptionDetail od_help_with_target;
 
+/// <summary>
+/// 表示可能なカラムの一覧についての列挙
+/// </summary>
+struct col_list {
+    static constexpr std::u8string_view service = u8"srv";
+    static constexpr std::u8string_view user = u8"user";
+    static constexpr std::u8string_view name = u8"name";
+    static constexpr std::u8string_view password = u8"pw";
+    static constexpr std::u8string_view memo = u8"memo";
+    static constexpr std::u8string_view registered_at = u8"reg";
+    static constexpr std::u8string_view update_at = u8"upd";
+    static constexpr std::u8string_view id = u8"id";
+    static constexpr std::u8string_view version = u8"ver";
+};
+
+/// <summary>
+/// カラム名からpasswordsのカラムに関連付けられたインデックスへの対応
+/// </summary>
+extern const std::unordered_map<std::u8string_view, int> col_map;
+
+/// <summary>
+/// 読み取りのみを行うコマンドのためにDBとのコネクションを確立する
+/// </summary>
+/// <remarks>
+/// 最新のスキーマのDBが存在すれば読み取り専用で開き、そうでなければ通常どおり開いてテーブルを構築する
+/// </remarks>
+/// <param name="db">DBデータへのパス</param>
+/// <param name="immutable">trueなら他から書き込まれない不変なファイルとして開く</param>
+/// <returns>SQLiteに関する操作の起点となるオブジェクト</returns>
+SQLite openForRead(const std::filesystem::path& db, bool immutable = false);
+
+/// <summary>
+/// パスフレーズを受け取る環境変数の名称
+/// </summary>
+inline constexpr const char* env_passphrase = "PWM_PASSPHRASE";
+
+/// <summary>
+/// DBファイル全体をページ単位で暗号化するパスフレーズを受け取る環境変数の名称
+/// </summary>
+inline constexpr const char* env_db_passphrase = "PWM_DB_PASSPHRASE";
+
+/// <summary>
+/// 環境変数からパスフレーズを取得する
+/// </summary>
+/// <param name="name">環境変数の名称</param>
+/// <returns>パスフレーズ(設定されていなければnullopt)</returns>
+std::optional<std::u8string> readPassphrase(const char* name = env_passphrase);
+
+/// <summary>
+/// エージェントが起動していれば受け取った鍵で、環境変数PWM_PASSPHRASEが設定されていればその値をパスフレーズとしてパスワードの暗号化と復号を有効にする
+/// </summary>
+/// <param name="pm">パスワード管理を行うオブジェクト</param>
+void unlockVault(pwm::PasswordManagement& pm);
+
 /// <summary>
 /// 検索条件に関する名前空間
 /// </summary>
@@ -57,4 +114,18 @@ namespace cond {
     /// <param name="map">コマンドライン引数の解析結果</param>
     /// <returns>抽出条件を示すオブジェクト</returns>
     pwm::GetParam getGetParam(const option::OptionMap& map);
+
+    /// <summary>
+    /// 主キーによる指定のためのオプションの追加
+    /// </summary>
+    /// <param name="x"></param>
+    /// <returns>オプションの追加の記述のためのET</returns>
+    option::AddOptions& addIdCond(option::AddOptions x);
+
+    /// <summary>
+    /// mapから主キーの一覧を取得
+    /// </summary>
+    /// <param name="map">コマンドライン引数の解析結果</param>
+    /// <returns>主キーの一覧(主キーが指定されていなければnullopt)</returns>
+    std::optional<std::vector<std::int64_t>> getIds(const option::OptionMap& map);
 }
@@ -0,0 +1,126 @@
+﻿#include "complete.h"
+#include "CommandLineOption.hpp"
+#include "common.h"
+#include "CompletionIndex.h"
+#include "PageCipherVfs.h"
+#include <unordered_map>
+
+namespace {
+
+    const OptionDetail od_col = {
+        .name = "col ",
+        .summary = "補完する対象項目",
+        .detail = "以下のような補完する対象項目を指定する\n"
+        "  srv     サービス名\n"
+        "  name    名称"
+    };
+
+    const OptionDetail od_limit = {
+        .name = "limit ",
+        .summary = "補完候補の最大件数",
+        .detail = "補完候補として出力する最大件数"
+    };
+
+    const OptionDetail od_prefix = {
+        .name = "prefix",
+        .summary = "補完する文字列の接頭辞",
+        .detail = "補完する文字列の接頭辞であり、これに前方一致する値を昇順に出力する\n"
+        "ページ単位で暗号化したDBでは平文の補完用の索引をDBの外へ書き出さず、DBを直接検索する"
+    };
+
+    /// <summary>
+    /// 補完可能なカラム名からpasswordsのカラムに関連付けられたインデックスへの対応
+    /// </summary>
+    const std::unordered_map<std::u8string_view, int> target_map = {
+        { col_list::service, pwm::table::passwords::c_service::index },
+        { col_list::name, pwm::table::passwords::c_name::index }
+    };
+}
+
+void complete(int argc, const char* argv[], const std::filesystem::path& db, std::ostream& os) {
+    option::CommandLineOption clo;
+    clo.add_options()
+        .l(od_help.name, od_help.summary)
+        .l(od_help_with_target.name, option::Value<std::string>().name("option"), od_help_with_target.summary)
+        .l(od_col.name, option::Value<std::string>(std::bit_cast<char*>(col_list::service.data()))
+            .constraint([](const std::string& x) { return target_map.contains(std::bit_cast<char8_t*>(x.data())); }).name("col"), od_col.summary)
+        .l(od_limit.name, option::Value<unsigned long long>(100).name("limit"), od_limit.summary)
+        .u(option::Value<std::string>("").name(od_prefix.name), od_prefix.summary);
+
+    const option::OptionMap& map = clo.map();
+    // コマンドライン引数の解析の実行
+    clo.parse(argc, argv, false);
+
+    if (auto temp = map.luse(od_help_with_target.name); temp) {
+        // コマンドライン引数に対する説明の表示
+        auto target = temp.as<std::string>();
+        std::string detail;
+        if (target == od_help.name) {
+            detail = od_help.detail;
+        }
+        else if (target == od_help_with_target.name) {
+            detail = od_help_with_target.detail;
+        }
+        else if (target == od_col.name) {
+            detail = od_col.detail;
+        }
+        else if (target == od_limit.name) {
+            detail = od_limit.detail;
+        }
+        else if (target == od_prefix.name) {
+            detail = od_prefix.detail;
+        }
+        else {
+            std::cerr << target << " に該当する説明は存在しません" << std::endl;
+            return;
+        }
+        std::cout << detail << std::endl;
+        return;
+    }
+    else if (auto temp = map.luse(od_help.name); temp) {
+        // コマンド一覧を表示
+        std::cout << "Options:" << std::endl;
+        std::cout << clo.description() << std::endl;
+        return;
+    }
+
+    // 入力値の評価
+    map.validate();
+
+    if (!std::filesystem::exists(db)) {
+        // DBが存在しなければ補完候補も存在しない
+        return;
+    }
+    auto col = target_map.at(std::bit_cast<char8_t*>(map.use(od_col.name).as<std::string>().data()));
+    auto prefix = map.unnamed_options().as<std::string>();
+    auto limit = map.use(od_limit.name).as<unsigned long long>();
+    auto prefix_view = std::u8string_view(std::bit_cast<const char8_t*>(prefix.data()), prefix.size());
+
+    if (!isPlainDatabase(db)) {
+        // 暗号化したDBの値を平文の索引として書き出さないよう、以前の索引を削除してDBを直接検索する
+        std::error_code ec;
+        std::filesystem::remove(pwm::CompletionIndex::path(db), ec);
+        auto conn = openForRead(db);
+        auto pm = pwm::PasswordManagement(db, conn);
+        unsigned long long count = 0;
+        for (auto x : pm.distinct(col, prefix_view)) {
+            auto value = x.get<SQLiteData::string_type>(0).value();
+            if (count++ == limit || !value.starts_with(prefix_view)) {
+                break;
+            }
+            os << std::string_view(std::bit_cast<const char*>(value.data()), value.size()) << '\n';
+        }
+        return;
+    }
+    if (!pwm::CompletionIndex::fresh(db)) {
+        // DBが更新されているときにのみSQLiteを開いて索引を再構築する
+        auto conn = openForRead(db);
+        auto pm = pwm::PasswordManagement(db, conn);
+        pwm::CompletionIndex::build(db, pm);
+    }
+
+    auto index = pwm::CompletionIndex(db);
+    for (const auto& x : index.complete(col, prefix_view, limit)) {
+        os << std::string_view(std::bit_cast<const char*>(x.data()), x.size()) << '\n';
+    }
+}
@@ -9,6 +9,7 @@ void del(int argc, const char* argv[], const std::filesystem::path& db, std::ost
         .l(od_help.name, od_help.summary)
         .l(od_help_with_target.name, option::Value<std::string>().name("option"), od_help_with_target.summary);
     cond::addCond(clo.add_options());
+    cond::addIdCond(clo.add_options());
 
     if (argc == 0) {
         // 引数が存在しないときは説明を表示
@@ -49,12 +50,17 @@ void del(int argc, const char* argv[], const std::filesystem::path& db, std::ost
     // 入力値の評価
     map.validate();
 
-    // 検索条件を示すデータの構築
-    pwm::GetParam data = cond::getGetParam(map);
-
     // DBとのコネクションを確立してデータの削除を行う
     auto conn = SQLite(db);
     auto pm = pwm::PasswordManagement(db, conn);
-    pm.remove(data);
+    if (auto ids = cond::getIds(map); ids) {
+        // 主キーが指定されたときは主キーによる削除を行う
+        pm.removeById(ids.value());
+    }
+    else {
+        // 検索条件を示すデータの構築
+        pwm::GetParam data = cond::getGetParam(map);
+        pm.remove(data);
+    }
 
 }
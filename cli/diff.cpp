@@ -0,0 +1,92 @@
+﻿#include "diff.h"
+#include "CommandLineOption.hpp"
+#include "common.h"
+#include "PasswordManagement.h"
+
+namespace {
+
+    const OptionDetail od_peer = {
+        .name = "peer",
+        .summary = "比較先のDBのパス",
+        .detail = "比較先のDBのパス\n"
+        "主キーの範囲ごとのマークル木を根から比較し、ハッシュ値の異なる範囲の行のみを比較する\n"
+        "主キーで行を突き合わせるため、バックアップなど同じDBを複製したものとの比較に用いる"
+    };
+
+    /// <summary>
+    /// 主キーの一覧を出力する
+    /// </summary>
+    void writeIds(std::ostream& os, std::string_view label, const std::vector<std::int64_t>& ids) {
+        for (auto id : ids) {
+            os << label << ": " << id << '\n';
+        }
+    }
+}
+
+void diff(int argc, const char* argv[], const std::filesystem::path& db, std::ostream& os) {
+    option::CommandLineOption clo;
+    clo.add_options()
+        .l(od_help.name, od_help.summary)
+        .l(od_help_with_target.name, option::Value<std::string>().name("option"), od_help_with_target.summary)
+        .u(option::Value<std::string>().name(od_peer.name), od_peer.summary);
+
+    if (argc == 0) {
+        // 引数が存在しないときは説明を表示
+        std::cout << "Options:" << std::endl;
+        std::cout << clo.description() << std::endl;
+        return;
+    }
+
+    const option::OptionMap& map = clo.map();
+    // コマンドライン引数の解析の実行
+    clo.parse(argc, argv, false);
+
+    if (auto temp = map.luse(od_help_with_target.name); temp) {
+        // コマンドライン引数に対する説明の表示
+        auto target = temp.as<std::string>();
+        std::string detail;
+        if (target == od_help.name) {
+            detail = od_help.detail;
+        }
+        else if (target == od_help_with_target.name) {
+            detail = od_help_with_target.detail;
+        }
+        else if (target == od_peer.name) {
+            detail = od_peer.detail;
+        }
+        else {
+            std::cerr << target << " に該当する説明は存在しません" << std::endl;
+            return;
+        }
+        std::cout << detail << std::endl;
+        return;
+    }
+    else if (auto temp = map.luse(od_help.name); temp) {
+        // コマンド一覧を表示
+        std::cout << "Options:" << std::endl;
+        std::cout << clo.description() << std::endl;
+        return;
+    }
+
+    // 入力値の評価
+    map.validate();
+
+    auto file = map.unnamed_options().as<std::string>();
+    auto peer = std::filesystem::path(std::bit_cast<const char8_t*>(file.c_str()));
+
+    // DBとのコネクションを確立して比較を行う
+    auto begin = std::chrono::steady_clock::now();
+    auto conn = SQLite(db);
+    auto pm = pwm::PasswordManagement(db, conn);
+    auto result = pm.diff(peer);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+    // 異なる行の主キーと比較の件数の出力
+    writeIds(os, "local-only", result.local_only);
+    writeIds(os, "peer-only", result.peer_only);
+    writeIds(os, "changed", result.changed);
+    os << "nodes: " << result.nodes << '\n';
+    os << "buckets: " << result.buckets << '\n';
+    os << "differences: " << result.local_only.size() + result.peer_only.size() + result.changed.size() << '\n';
+    os << "elapsed: " << std::format("{0:.3f}", elapsed.count()) << "s" << std::endl;
+}
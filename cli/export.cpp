@@ -0,0 +1,500 @@
+﻿#include "export.h"
+#include "CommandLineOption.hpp"
+#include "common.h"
+#include "PasswordManagement.h"
+#include "RecordWriter.h"
+#include "ChunkArchive.h"
+#include "UringSink.h"
+#include <limits>
+#include <memory>
+#include <unordered_map>
+
+namespace {
+
+    const OptionDetail od_format = {
+        .name = "format ",
+        .summary = "出力の形式",
+        .detail = "以下のような出力の形式を指定する(省略時は拡張子が.jsonlあるいは.ndjsonであればjsonl、.pwmxであればbinary、それ以外はcsv)\n"
+        "拡張子が.pwmcであればこの形式で書き出したものをチャンクに分割して格納する\n"
+        "  csv     1行目をヘッダとするRFC 4180形式のCSV(NULLは空のフィールドとする)\n"
+        "  jsonl   1行に1つのオブジェクトを記述したJSON Lines\n"
+        "  binary  長さを前置した独自のバイナリ形式"
+    };
+
+    const OptionDetail od_col = {
+        .name = "col ",
+        .summary = "出力する対象項目",
+        .detail = "以下のような出力する対象項目を指定する(省略時はすべて)\n"
+        "  id      主キー\n"
+        "  srv     サービス名\n"
+        "  user    ユーザ名\n"
+        "  name    名称\n"
+        "  pw      パスワード\n"
+        "  memo    メモ\n"
+        "  reg     登録日時(UTC)\n"
+        "  upd     更新日時(UTC)\n"
+        "  ver     行のバージョン"
+    };
+
+    const OptionDetail od_buffer = {
+        .name = "buffer ",
+        .summary = "出力のバッファのサイズ(KiB)",
+        .detail = "出力をまとめて書き込むためのバッファのサイズ(KiB)であり、使用するメモリはこれに比例して一定となる"
+    };
+
+    const OptionDetail od_io = {
+        .name = "io ",
+        .summary = "ファイルへの書き込み方式",
+        .detail = "以下のようなファイルへの書き込み方式を指定する\n"
+        "  sync    書き込みごとにシステムコールの完了を待つ\n"
+        "  uring   --bufferのサイズの整列したブロックをio_uringにより非同期に書き込み、書き込み中に次の整形を進める\n"
+        "          (io_uringを利用できない環境ではブロックごとにpwriteで書き込む)"
+    };
+
+    const OptionDetail od_queue_depth = {
+        .name = "queue-depth ",
+        .summary = "--io uringで同時に書き込み中とするブロックの数",
+        .detail = "--io uringを指定したときに同時に書き込み中とするブロックの数であり、\n"
+        "使用するメモリはこれと--bufferの積となる"
+    };
+
+    const OptionDetail od_sync_every = {
+        .name = "sync-every ",
+        .summary = "--io uringで永続化する間隔(MiB)",
+        .detail = "--io uringを指定したときにこのサイズ(MiB)を書き込むごとにそれまでの書き込みを永続化する\n"
+        "0であれば書き込みの完了後に1度のみ永続化する"
+    };
+
+    const OptionDetail od_immutable = {
+        .name = "immutable",
+        .summary = "DBを不変なファイルとして開く",
+        .detail = "DBを他から書き込まれることのない不変なファイルとして開き、ロックや変更の検知を行わない\n"
+        "読み取り専用の複製などに対して利用する(書き込まれているファイルに指定すると誤った結果となりうる)"
+    };
+
+    const OptionDetail od_threads = {
+        .name = "threads ",
+        .summary = "並列に読み取りと整形を行うスレッドの数",
+        .detail = "主キーの範囲で分割したチャンクごとにDBからの読み取り、整形、圧縮を行うワーカーのスレッドの数\n"
+        "2以上を指定するとワーカーと同数の読み取り用のコネクションを同一のスナップショットで開き、\n"
+        "チャンクは主キーの順に出力するため出力の内容はスレッドの数によらず同一となる"
+    };
+
+    const OptionDetail od_chunk_ids = {
+        .name = "chunk-ids ",
+        .summary = "1つのチャンクが受け持つ主キーの幅",
+        .detail = "1つのチャンクが受け持つ主キーの幅であり、同時に処理するチャンクの数はスレッドの数の2倍に制限されるため\n"
+        "使用するメモリはおおむね(チャンクの出力のサイズ)×(スレッドの数の2倍)となる"
+    };
+
+    const OptionDetail od_compress = {
+        .name = "compress ",
+        .summary = ".pwmcのチャンクの圧縮方式",
+        .detail = "拡張子が.pwmcのファイルへ書き出すときのチャンクの圧縮方式を指定する\n"
+        "  lz      LZ77系の高速な圧縮(圧縮により小さくならないチャンクは圧縮しない)\n"
+        "  none    圧縮しない"
+    };
+
+    const OptionDetail od_resume = {
+        .name = "resume",
+        .summary = "中断された.pwmcへの書き出しを再開",
+        .detail = "中断された拡張子が.pwmcのファイルへの書き出しを最後の正常なチャンクの直後から再開する\n"
+        "壊れたチャンク以降は破棄し、既存のチャンクとは形式と対象項目が一致している必要がある\n"
+        "再開前後のチャンクはそれぞれ別のスナップショットから読み取ったものとなる"
+    };
+
+    const OptionDetail od_file = {
+        .name = "file",
+        .summary = "出力先のファイルのパス",
+        .detail = "出力先のファイルのパス(省略あるいは-を指定したときは標準出力へ出力する)\n"
+        "ファイルへ出力したときは書き込みの完了後にストレージへ永続化する\n"
+        "拡張子が.pwmcであればチャンクに分割し、各チャンクの主キーの範囲とインデックスを付して格納する\n"
+        "(importはこれを展開しながら読み込める)"
+    };
+
+    const std::unordered_map<std::string_view, pwm::RecordFormat> format_map = {
+        { "csv", pwm::RecordFormat::csv },
+        { "jsonl", pwm::RecordFormat::jsonl },
+        { "binary", pwm::RecordFormat::binary }
+    };
+
+    const std::unordered_map<std::string_view, pwm::ChunkCompression> compress_map = {
+        { "lz", pwm::ChunkCompression::lz },
+        { "none", pwm::ChunkCompression::none }
+    };
+
+    /// <summary>
+    /// 1件分の取得結果を書き込む
+    /// </summary>
+    /// <param name="writer">書き込み先</param>
+    /// <param name="e">1件分の取得結果</param>
+    /// <param name="cols">取得対象(passwordsのカラムに関連付けられたインデックス)</param>
+    void writeRecord(pwm::RecordWriter& writer, SQLiteData& e, const std::vector<int>& cols) {
+        using pws = pwm::table::passwords;
+        writer.beginRow();
+        for (int i = 0; i < static_cast<int>(cols.size()); ++i) {
+            // カラムごとに決められた型で出力する
+            switch (cols[i]) {
+            case pws::c_password::index:
+                if (auto x = e.get<SQLiteData::blob_type>(i); x) {
+                    writer.blob(x.value());
+                }
+                else {
+                    writer.null();
+                }
+                break;
+            case pws::c_id::index:
+            case pws::c_version::index:
+                writer.integer(e.get<SQLiteData::integer_type>(i).value());
+                break;
+            default:
+                if (auto x = e.get<SQLiteData::string_type>(i); x) {
+                    writer.text(x.value());
+                }
+                else {
+                    writer.null();
+                }
+                break;
+            }
+        }
+        writer.endRow();
+    }
+
+    /// <summary>
+    /// チャンクごとの整形の結果
+    /// </summary>
+    struct ChunkSlot {
+        /// <summary>
+        /// 整形したバイト列
+        /// </summary>
+        MemorySink raw;
+        /// <summary>
+        /// 圧縮したフレーム(.pwmcへ書き出す場合)
+        /// </summary>
+        pwm::ChunkFrame frame;
+        /// <summary>
+        /// 含まれるレコードの数
+        /// </summary>
+        std::uint32_t rows = 0;
+    };
+}
+
+void export_(int argc, const char* argv[], const std::filesystem::path& db, std::ostream& os) {
+    option::CommandLineOption clo;
+    clo.add_options()
+        .l(od_help.name, od_help.summary)
+        .l(od_help_with_target.name, option::Value<std::string>().name("option"), od_help_with_target.summary)
+        .l(od_format.name, option::Value<std::string>("")
+            .constraint([](const std::string& x) { return x.length() == 0 || format_map.contains(x); }).name("format"), od_format.summary)
+        .l(od_col.name, option::Value<std::string>({
+            std::bit_cast<char*>(col_list::id.data()),
+            std::bit_cast<char*>(col_list::service.data()),
+            std::bit_cast<char*>(col_list::user.data()),
+            std::bit_cast<char*>(col_list::name.data()),
+            std::bit_cast<char*>(col_list::password.data()),
+            std::bit_cast<char*>(col_list::memo.data()),
+            std::bit_cast<char*>(col_list::registered_at.data()),
+            std::bit_cast<char*>(col_list::update_at.data()),
+            std::bit_cast<char*>(col_list::version.data())
+        }).unlimited().constraint([](const std::string& x) { return col_map.contains(std::bit_cast<char8_t*>(x.data())); }).name("col"), od_col.summary)
+        .l(od_buffer.name, option::Value<long long>(static_cast<long long>(BufferedWriter::default_capacity >> 10))
+            .constraint([](long long x) { return x > 0; }).name("kib"), od_buffer.summary)
+        .l(od_io.name, option::Value<std::string>("sync")
+            .constraint([](const std::string& x) { return x == "sync" || x == "uring"; }).name("method"), od_io.summary)
+        .l(od_queue_depth.name, option::Value<long long>(8).constraint([](long long x) { return x > 0 && x <= 4096; }).name("n"), od_queue_depth.summary)
+        .l(od_sync_every.name, option::Value<long long>(0).constraint([](long long x) { return x >= 0; }).name("mib"), od_sync_every.summary)
+        .l(od_immutable.name, od_immutable.summary)
+        .l(od_threads.name, option::Value<long long>(1).constraint([](long long x) { return x > 0; }).name("n"), od_threads.summary)
+        .l(od_chunk_ids.name, option::Value<long long>(10000).constraint([](long long x) { return x > 0; }).name("n"), od_chunk_ids.summary)
+        .l(od_compress.name, option::Value<std::string>("lz")
+            .constraint([](const std::string& x) { return compress_map.contains(x); }).name("method"), od_compress.summary)
+        .l(od_resume.name, od_resume.summary)
+        .u(option::Value<std::string>("").name(od_file.name), od_file.summary);
+    cond::addCond(clo.add_options());
+
+    const option::OptionMap& map = clo.map();
+    // コマンドライン引数の解析の実行
+    clo.parse(argc, argv, false);
+
+    if (auto temp = map.luse(od_help_with_target.name); temp) {
+        // コマンドライン引数に対する説明の表示
+        auto target = temp.as<std::string>();
+        std::string detail;
+        if (target == od_help.name) {
+            detail = od_help.detail;
+        }
+        else if (target == od_help_with_target.name) {
+            detail = od_help_with_target.detail;
+        }
+        else if (target == od_format.name) {
+            detail = od_format.detail;
+        }
+        else if (target == od_col.name) {
+            detail = od_col.detail;
+        }
+        else if (target == od_buffer.name) {
+            detail = od_buffer.detail;
+        }
+        else if (target == od_io.name) {
+            detail = od_io.detail;
+        }
+        else if (target == od_queue_depth.name) {
+            detail = od_queue_depth.detail;
+        }
+        else if (target == od_sync_every.name) {
+            detail = od_sync_every.detail;
+        }
+        else if (target == od_immutable.name) {
+            detail = od_immutable.detail;
+        }
+        else if (target == od_threads.name) {
+            detail = od_threads.detail;
+        }
+        else if (target == od_chunk_ids.name) {
+            detail = od_chunk_ids.detail;
+        }
+        else if (target == od_compress.name) {
+            detail = od_compress.detail;
+        }
+        else if (target == od_resume.name) {
+            detail = od_resume.detail;
+        }
+        else if (target == od_file.name) {
+            detail = od_file.detail;
+        }
+        else if (cond::getDetail(target, detail));
+        else {
+            std::cerr << target << " に該当する説明は存在しません" << std::endl;
+            return;
+        }
+        std::cout << detail << std::endl;
+        return;
+    }
+    else if (auto temp = map.luse(od_help.name); temp) {
+        // コマンド一覧を表示
+        std::cout << "Options:" << std::endl;
+        std::cout << clo.description() << std::endl;
+        return;
+    }
+
+    // 入力値の評価
+    map.validate();
+
+    // 検索条件を示すデータの構築
+    pwm::GetParam data = cond::getGetParam(map);
+
+    // 出力の形式の決定
+    auto file = map.unnamed_options().as<std::string>();
+    auto format = map.use(od_format.name).as<std::string>();
+    if (format.length() == 0) {
+        auto ext = std::filesystem::path(file).extension();
+        format = ext == ".jsonl" || ext == ".ndjson" ? "jsonl" : ext == ".pwmx" ? "binary" : "csv";
+    }
+    auto names = map.use(od_col.name).as<std::vector<std::string>>();
+    std::vector<int> cols;
+    std::vector<std::u8string> col_names;
+    for (const auto& x : names) {
+        cols.push_back(col_map.at(std::bit_cast<char8_t*>(x.data())));
+        col_names.emplace_back(std::bit_cast<const char8_t*>(x.c_str()));
+    }
+
+    auto record_format = format_map.at(format);
+    const auto threads = static_cast<std::size_t>(map.use(od_threads.name).as<long long>());
+    const bool immutable = static_cast<bool>(map.luse(od_immutable.name));
+    const bool archive = std::filesystem::path(file).extension() == ".pwmc";
+    const bool resume = static_cast<bool>(map.luse(od_resume.name));
+    if (resume && !archive) {
+        throw std::invalid_argument("--resumeは拡張子が.pwmcのファイルへの書き出しでのみ指定できます");
+    }
+    if (immutable && threads > 1) {
+        throw std::invalid_argument("--immutableは--threadsに2以上を指定した場合と併用できません");
+    }
+
+    // 出力先の決定(標準出力へ出力するときは統計情報を標準エラー出力へ表示する)
+    bool to_stdout = file.length() == 0 || file == "-";
+    std::ostream& stats = to_stdout ? std::cerr : os;
+
+    // ファイルへの書き込み方式の決定
+    const auto buffer_size = static_cast<std::size_t>(map.use(od_buffer.name).as<long long>()) << 10;
+    const bool uring = map.use(od_io.name).as<std::string>() == "uring";
+    std::optional<bool> async_io;
+    FileSinkFactory open_file = [](const std::filesystem::path& path, bool append) {
+        return std::make_unique<FileSink>(path, append);
+    };
+    if (uring) {
+        UringOptions options{
+            .queue_depth = static_cast<unsigned>(map.use(od_queue_depth.name).as<long long>()),
+            .block_size = buffer_size,
+            .sync_interval = static_cast<std::uint64_t>(map.use(od_sync_every.name).as<long long>()) << 20
+        };
+        open_file = [options, &async_io](const std::filesystem::path& path, bool append) {
+            auto sink = std::make_unique<UringSink>(path, append, options);
+            async_io = sink->async();
+            return sink;
+        };
+    }
+
+    if (archive || threads > 1) {
+        // チャンクに分割して並列に整形する
+        std::optional<SQLitePool> pool;
+        std::optional<SQLite> conn;
+        std::optional<pwm::PasswordManagement> pm;
+        if (threads > 1) {
+            pool.emplace(db, threads);
+            pm.emplace(db, pool.value());
+        }
+        else {
+            conn.emplace(openForRead(db, immutable));
+            pm.emplace(db, conn.value());
+        }
+        unlockVault(pm.value());
+
+        // ヘッダとフッタは独立したバイト列として整形する
+        auto render = [&](void (pwm::RecordWriter::*part)()) {
+            MemorySink mem;
+            BufferedWriter out(mem, 4096);
+            pwm::RecordWriter writer(out, record_format, col_names);
+            (writer.*part)();
+            out.flush();
+            return mem.data();
+        };
+        const auto header = render(&pwm::RecordWriter::header);
+        const auto footer = render(&pwm::RecordWriter::footer);
+
+        auto begin = std::chrono::steady_clock::now();
+        const auto compression = compress_map.at(map.use(od_compress.name).as<std::string>());
+        const auto path = std::filesystem::path(std::bit_cast<const char8_t*>(file.c_str()));
+        std::optional<pwm::ChunkArchiveWriter> archive_writer;
+        std::unique_ptr<OutputSink> sink;
+        std::optional<BufferedWriter> out;
+        std::int64_t begin_id = std::numeric_limits<std::int64_t>::min();
+        bool remaining = true;
+        if (!archive) {
+            if (to_stdout) {
+                sink = std::make_unique<StreamSink>(os);
+            }
+            else {
+                sink = open_file(path, false);
+            }
+            out.emplace(*sink, buffer_size);
+            out->write(header);
+        }
+        else if (resume) {
+            // 最後の正常なチャンクの主キーの範囲の続きから再開する
+            archive_writer.emplace(path, record_format, header, open_file);
+            if (const auto& last = archive_writer->chunks().back(); last.rows != 0) {
+                remaining = last.last_id != std::numeric_limits<std::int64_t>::max();
+                begin_id = remaining ? last.last_id + 1 : last.last_id;
+            }
+            stats << "resumed-chunks: " << archive_writer->chunks().size() << '\n';
+        }
+        else {
+            archive_writer.emplace(path, record_format, compression, open_file);
+            archive_writer->write(pwm::ChunkArchive::encode(header, compression, 0, 0, 0));
+        }
+
+        // ワーカーが整形と圧縮を行い、呼び出し元のスレッドが主キーの順に書き込む
+        const std::size_t window = threads * 2;
+        std::vector<ChunkSlot> slots(window);
+        std::uint64_t rows = 0;
+        std::uint64_t raw_bytes = header.size() + footer.size();
+        std::uint64_t chunks = 0;
+        if (remaining) {
+            pm->scanChunks(data, cols, begin_id, map.use(od_chunk_ids.name).as<long long>(), threads, window,
+                [&](const pwm::ScanChunk& chunk, SQLiteView& view) {
+                    auto& slot = slots[chunk.index % window];
+                    slot.raw.clear();
+                    slot.rows = 0;
+                    {
+                        BufferedWriter chunk_out(slot.raw, 1 << 16);
+                        pwm::RecordWriter writer(chunk_out, record_format, col_names);
+                        for (auto e : view) {
+                            writeRecord(writer, e, cols);
+                            ++slot.rows;
+                        }
+                        chunk_out.flush();
+                    }
+                    if (archive && slot.rows != 0) {
+                        slot.frame = pwm::ChunkArchive::encode(slot.raw.data(), compression, slot.rows, chunk.first_id, chunk.last_id);
+                    }
+                },
+                [&](const pwm::ScanChunk& chunk) {
+                    auto& slot = slots[chunk.index % window];
+                    // 該当する行の無い範囲は書き出さない
+                    if (slot.rows == 0) {
+                        return;
+                    }
+                    if (archive) {
+                        archive_writer->write(slot.frame);
+                    }
+                    else {
+                        out->write(slot.raw.data());
+                    }
+                    rows += slot.rows;
+                    raw_bytes += slot.raw.data().size();
+                    ++chunks;
+                });
+        }
+
+        std::uint64_t bytes;
+        if (archive) {
+            archive_writer->write(pwm::ChunkArchive::encode(footer, compression, 0, 0, 0));
+            archive_writer->finish();
+            bytes = archive_writer->bytes();
+        }
+        else {
+            out->write(footer);
+            out->flush();
+            bytes = out->bytes();
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+        // 処理件数とスループットの出力(スループットは整形後の圧縮前のバイト数による)
+        stats << "rows: " << rows << '\n';
+        stats << "chunks: " << chunks << '\n';
+        stats << "raw-bytes: " << raw_bytes << '\n';
+        stats << "bytes: " << bytes << '\n';
+        stats << "elapsed: " << std::format("{0:.3f}", elapsed.count()) << "s" << '\n';
+        stats << "mib-per-sec: " << std::format("{0:.1f}", elapsed.count() > 0 ? raw_bytes / elapsed.count() / (1 << 20) : 0.0) << '\n';
+        if (async_io) {
+            stats << "io: " << (async_io.value() ? "uring" : "pwrite") << '\n';
+        }
+        stats << std::flush;
+        return;
+    }
+
+    std::unique_ptr<OutputSink> sink;
+    if (to_stdout) {
+        sink = std::make_unique<StreamSink>(os);
+    }
+    else {
+        sink = open_file(std::filesystem::path(std::bit_cast<const char8_t*>(file.c_str())), false);
+    }
+    BufferedWriter out(*sink, buffer_size);
+    pwm::RecordWriter writer(out, record_format, std::move(col_names));
+
+    // DBとのコネクションを可能であれば読み取り専用で確立して1行ずつ書き出す
+    auto conn = openForRead(db, immutable);
+    auto pm = pwm::PasswordManagement(db, conn);
+    unlockVault(pm);
+    auto begin = std::chrono::steady_clock::now();
+    std::uint64_t rows = 0;
+    writer.header();
+    for (auto e : pm.get(data, cols)) {
+        writeRecord(writer, e, cols);
+        ++rows;
+    }
+    writer.footer();
+    out.flush();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+    // 処理件数とスループットの出力
+    stats << "rows: " << rows << '\n';
+    stats << "bytes: " << out.bytes() << '\n';
+    stats << "elapsed: " << std::format("{0:.3f}", elapsed.count()) << "s" << '\n';
+    stats << "mib-per-sec: " << std::format("{0:.1f}", elapsed.count() > 0 ? out.bytes() / elapsed.count() / (1 << 20) : 0.0) << '\n';
+    if (async_io) {
+        stats << "io: " << (async_io.value() ? "uring" : "pwrite") << '\n';
+    }
+    stats << std::flush;
+}
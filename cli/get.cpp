@@ -2,7 +2,9 @@
 #include "CommandLineOption.hpp"
 #include "common.h"
 #include "PasswordManagement.h"
+#include "BoundedQueue.h"
 #include <unordered_map>
+#include <thread>
 
 namespace {
 
@@ -16,30 +18,101 @@ namespace {
         "  pw      パスワード\n"
         "  memo    メモ\n"
         "  reg     登録日時\n"
-        "  upd     更新日時"
+        "  upd     更新日時\n"
+        "  id      主キー\n"
+        "  ver     行のバージョン"
     };
 
-    /// <summary>
-    /// 表示可能なカラムの一覧についての列挙
-    /// </summary>
-    struct col_list {
-        static constexpr std::u8string_view service = u8"srv";
-        static constexpr std::u8string_view user = u8"user";
-        static constexpr std::u8string_view name = u8"name";
-        static constexpr std::u8string_view password = u8"pw";
-        static constexpr std::u8string_view memo = u8"memo";
-        static constexpr std::u8string_view registered_at = u8"reg";
-        static constexpr std::u8string_view update_at = u8"upd";
+    const OptionDetail od_immutable = {
+        .name = "immutable",
+        .summary = "DBを不変なファイルとして開く",
+        .detail = "DBを他から書き込まれることのない不変なファイルとして開き、ロックや変更の検知を行わない\n"
+        "読み取り専用の複製などに対して利用する(書き込まれているファイルに指定すると誤った結果となりうる)"
+    };
+
+    const OptionDetail od_pipeline = {
+        .name = "pipeline",
+        .summary = "取得と出力を並行に実行",
+        .detail = "DBからの行の読み取りを別のスレッドで行い、読み取った行をまとめて出力側へ受け渡す\n"
+        "件数の多い取得においてDBの読み取りと出力の整形を重ね合わせる"
     };
-    const std::unordered_map<std::u8string_view, int> col_map = {
-        { col_list::service, pwm::table::passwords::c_service::index },
-        { col_list::name, pwm::table::passwords::c_name::index },
-        { col_list::user, pwm::table::passwords::c_user::index },
-        { col_list::password, pwm::table::passwords::c_password::index },
-        { col_list::memo, pwm::table::passwords::c_memo::index },
-        { col_list::registered_at, pwm::table::passwords::c_registered_at::index },
-        { col_list::update_at, pwm::table::passwords::c_update_at::index }
+
+    const OptionDetail od_batch = {
+        .name = "batch ",
+        .summary = "--pipelineで1度に受け渡す行数",
+        .detail = "--pipelineを指定したときに読み取り側から出力側へ1度に受け渡す行数"
     };
+
+    const OptionDetail od_depth = {
+        .name = "depth ",
+        .summary = "--pipelineで滞留可能なまとまりの数",
+        .detail = "--pipelineを指定したときに出力されずに滞留できる行のまとまりの数の上限\n"
+        "上限に達すると読み取り側は出力側が追いつくまで待機する"
+    };
+
+    const OptionDetail od_pipeline_stats = {
+        .name = "pipeline-stats",
+        .summary = "--pipelineの滞留状況を表示",
+        .detail = "--pipelineを指定したときに以下の統計情報を標準エラー出力へ表示する\n"
+        "  batches       受け渡した行のまとまりの数\n"
+        "  max-depth     滞留した行のまとまりの数の最大値\n"
+        "  mean-depth    出力側が取り出す直前に滞留していた行のまとまりの数の平均\n"
+        "  full-waits    滞留の上限に達したため読み取り側が待機した回数\n"
+        "  empty-waits   滞留が無いため出力側が待機した回数"
+    };
+
+    /// <summary>
+    /// 1行分の取得結果を出力する
+    /// </summary>
+    /// <param name="os">出力ストリーム</param>
+    /// <param name="e">1行分の取得結果(SQLiteDataあるいはSQLiteRow)</param>
+    /// <param name="cols">取得対象(passwordsのカラムに関連付けられたインデックス)</param>
+    template <class Row>
+    void writeRow(std::ostream& os, Row& e, const std::vector<int>& cols) {
+        using pws = pwm::table::passwords;
+        int cnt = 0;
+        for (int col : cols) {
+            if (cnt > 0) {
+                os << ",";
+            }
+            // カラムごとに決められた型で出力する
+            switch (col) {
+            case pws::c_service::index:
+            case pws::c_name::index:
+            case pws::c_user::index:
+            case pws::c_encryption::index:
+            case pws::c_memo::index:
+                os << std::bit_cast<char*>(e.template get<typename Row::string_type>(cnt).value_or(u8"null").data());
+                break;
+            case pws::c_registered_at::index:
+            case pws::c_update_at::index:
+            {
+                // ロケールで補正した時刻を出力する
+                std::stringstream ss(std::bit_cast<char*>(e.template get<typename Row::string_type>(cnt).value().data()));
+                std::chrono::utc_seconds t;
+                const std::chrono::time_zone* time_zone = std::chrono::current_zone();
+                std::chrono::from_stream(ss, "%Y-%m-%d-%H-%M-%S", t);
+                os << std::format("{:%Y-%m-%d %H:%M:%S}", t + time_zone->get_info(std::chrono::utc_clock::to_sys(t)).offset);
+                break;
+            }
+            case pws::c_password::index:
+            {
+                auto optional = e.template get<typename Row::blob_type>(cnt);
+                typename Row::blob_type blob = optional.value();
+                // 現状はBLOBも文字列化して出力する
+                os << std::string(blob.begin(), blob.end());
+                break;
+            }
+            case pws::c_id::index:
+            case pws::c_version::index:
+                os << e.template get<typename Row::integer_type>(cnt).value();
+                break;
+            }
+            ++cnt;
+        }
+        // 行ごとにフラッシュすると出力が律速となるため改行のみ出力する
+        os << '\n';
+    }
 }
 
 void get(int argc, const char* argv[], const std::filesystem::path& db, std::ostream& os) {
@@ -51,7 +124,12 @@ void get(int argc, const char* argv[], const std::filesystem::path& db, std::ost
             std::bit_cast<char*>(col_list::service.data()),
             std::bit_cast<char*>(col_list::user.data()),
             std::bit_cast<char*>(col_list::password.data())
-        }).unlimited().constraint([](const std::string& x) { return col_map.contains(std::bit_cast<char8_t*>(x.data())); }).name("col"), od_col.summary);
+        }).unlimited().constraint([](const std::string& x) { return col_map.contains(std::bit_cast<char8_t*>(x.data())); }).name("col"), od_col.summary)
+        .l(od_immutable.name, od_immutable.summary)
+        .l(od_pipeline.name, od_pipeline.summary)
+        .l(od_batch.name, option::Value<long long>(256).constraint([](long long x) { return x > 0; }).name("rows"), od_batch.summary)
+        .l(od_depth.name, option::Value<long long>(8).constraint([](long long x) { return x > 0; }).name("n"), od_depth.summary)
+        .l(od_pipeline_stats.name, od_pipeline_stats.summary);
     cond::addCond(clo.add_options());
 
     if (argc == 0) {
@@ -78,6 +156,21 @@ void get(int argc, const char* argv[], const std::filesystem::path& db, std::ost
         else if (target == od_col.name) {
             detail = od_col.detail;
         }
+        else if (target == od_immutable.name) {
+            detail = od_immutable.detail;
+        }
+        else if (target == od_pipeline.name) {
+            detail = od_pipeline.detail;
+        }
+        else if (target == od_batch.name) {
+            detail = od_batch.detail;
+        }
+        else if (target == od_depth.name) {
+            detail = od_depth.detail;
+        }
+        else if (target == od_pipeline_stats.name) {
+            detail = od_pipeline_stats.detail;
+        }
         else if (cond::getDetail(target, detail));
         else {
             std::cerr << target << " に該当する説明は存在しません" << std::endl;
@@ -99,53 +192,70 @@ void get(int argc, const char* argv[], const std::filesystem::path& db, std::ost
     // 検索条件を示すデータの構築
     pwm::GetParam data = cond::getGetParam(map);
 
-    // DBとのコネクションを確立してデータの取得を行う
-    auto conn = SQLite(db);
+    // DBとのコネクションを可能であれば読み取り専用で確立してデータの取得を行う
+    auto conn = openForRead(db, static_cast<bool>(map.luse(od_immutable.name)));
     auto pm = pwm::PasswordManagement(db, conn);
-    using pws = pwm::table::passwords;
+    unlockVault(pm);
     using namespace std::ranges;
     // 入力として与えられる文字列からインデックスへの変換
     auto cols = map.use(od_col.name).as<std::vector<std::string>>() |
         views::transform([](const std::string& x) {
             return col_map.at(std::bit_cast<char8_t*>(x.data()));
         }) | to<std::vector<int>>();
-    for (auto e : pm.get(data, cols)) {
-        int cnt = 0;
-        for (int col : cols) {
-            if (cnt > 0) {
-                os << ",";
-            }
-            // カラムごとに決められた型で出力する
-            switch (col) {
-            case pws::c_service::index:
-            case pws::c_name::index:
-            case pws::c_user::index:
-            case pws::c_encryption::index:
-            case pws::c_memo::index:
-                os << std::bit_cast<char*>(e.get<SQLiteData::string_type>(cnt).value_or(u8"null").data());
-                break;
-            case pws::c_registered_at::index:
-            case pws::c_update_at::index:
-            {
-                // ロケールで補正した時刻を出力する
-                std::stringstream ss(std::bit_cast<char*>(e.get<SQLiteData::string_type>(cnt).value().data()));
-                std::chrono::utc_seconds t;
-                const std::chrono::time_zone* time_zone = std::chrono::current_zone();
-                std::chrono::from_stream(ss, "%Y-%m-%d-%H-%M-%S", t);
-                os << std::format("{:%Y-%m-%d %H:%M:%S}", t + time_zone->get_info(std::chrono::utc_clock::to_sys(t)).offset);
-                break;
+    if (!map.luse(od_pipeline.name)) {
+        for (auto e : pm.get(data, cols)) {
+            writeRow(os, e, cols);
+        }
+        return;
+    }
+
+    // 読み取り側のスレッドで行をまとめて複製し、出力側へ受け渡す
+    const auto batch_size = static_cast<std::size_t>(map.use(od_batch.name).as<long long>());
+    BoundedQueue<std::vector<SQLiteRow>> queue(static_cast<std::size_t>(map.use(od_depth.name).as<long long>()));
+    std::thread producer([&] {
+        try {
+            std::vector<SQLiteRow> batch;
+            batch.reserve(batch_size);
+            for (auto e : pm.get(data, cols)) {
+                batch.emplace_back(e);
+                if (batch.size() == batch_size) {
+                    if (!queue.push(std::move(batch))) {
+                        return;
+                    }
+                    batch = {};
+                    batch.reserve(batch_size);
+                }
             }
-            case pws::c_password::index:
-            {
-                auto optional = e.get<SQLiteData::blob_type>(cnt);
-                SQLiteData::blob_type blob = optional.value();
-                // 現状はBLOBも文字列化して出力する
-                os << std::string(blob.begin(), blob.end());
-                break;
+            if (!batch.empty()) {
+                queue.push(std::move(batch));
             }
+            queue.close();
+        }
+        catch (...) {
+            queue.close(std::current_exception());
+        }
+    });
+    try {
+        while (auto batch = queue.pop()) {
+            for (auto& e : batch.value()) {
+                writeRow(os, e, cols);
             }
-            ++cnt;
         }
-        os << std::endl;
+    }
+    catch (...) {
+        // 読み取り側を中断させてから例外を伝播する
+        queue.close();
+        producer.join();
+        throw;
+    }
+    producer.join();
+
+    if (map.luse(od_pipeline_stats.name)) {
+        auto stats = queue.stats();
+        std::cerr << "batches: " << stats.pops << std::endl;
+        std::cerr << "max-depth: " << stats.max_depth << std::endl;
+        std::cerr << "mean-depth: " << std::format("{0:.2f}", stats.meanDepth()) << std::endl;
+        std::cerr << "full-waits: " << stats.full_waits << std::endl;
+        std::cerr << "empty-waits: " << stats.empty_waits << std::endl;
     }
 }
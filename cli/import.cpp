@@ -0,0 +1,485 @@
+﻿#include "import.h"
+#include "CommandLineOption.hpp"
+#include "common.h"
+#include "ChunkArchive.h"
+#include "CsvTokenizer.h"
+#include "PasswordManagement.h"
+#include <fstream>
+#include <unordered_map>
+
+namespace {
+
+    const OptionDetail od_format = {
+        .name = "format ",
+        .summary = "入力の形式",
+        .detail = "以下のような入力の形式を指定する(省略時は拡張子が.jsonlあるいは.ndjsonであればjsonl、それ以外はcsv)\n"
+        "拡張子が.pwmcであればexportでチャンクに分割して書き出したものを展開しながら読み込み、格納された形式に従う\n"
+        "  csv     1行目をヘッダとするRFC 4180形式のCSV\n"
+        "  jsonl   1行に1つのオブジェクトを記述したJSON Lines"
+    };
+
+    const OptionDetail od_on_conflict = {
+        .name = "on-conflict ",
+        .summary = "既存のパスワード情報と重複した場合の動作",
+        .detail = "サービス名とユーザ名の組あるいは名称が既存のパスワード情報と重複した場合の動作を指定する\n"
+        "  fail       中断する(それまでにコミットしたチャンクは挿入されたままとなる)\n"
+        "  skip       挿入せずに読み飛ばす\n"
+        "  overwrite  既存のパスワード情報を上書きする"
+    };
+
+    const OptionDetail od_chunk = {
+        .name = "chunk ",
+        .summary = "1つのトランザクションで挿入する件数",
+        .detail = "1つのトランザクションで挿入する件数であり、この件数ごとにコミットする"
+    };
+
+    const OptionDetail od_scan = {
+        .name = "scan ",
+        .summary = "CSVの区切り文字等の探索に用いる命令セット",
+        .detail = "CSVの引用符、区切り文字、改行の探索に用いる命令セットを指定する(性能の比較のためのものである)\n"
+        "  auto    実行環境で利用可能な最速の命令セット\n"
+        "  scalar  1バイトずつ判定する\n"
+        "  sse2    SSE2により16バイトずつ判定する\n"
+        "  avx2    AVX2により32バイトずつ判定する"
+    };
+
+    const OptionDetail od_dry_run = {
+        .name = "dry-run",
+        .summary = "解析のみを行い挿入しない",
+        .detail = "入力の解析と挿入情報の構築のみを行いDBへは挿入しない(解析のスループットを出力する)"
+    };
+
+    const OptionDetail od_file = {
+        .name = "file",
+        .summary = "入力ファイルのパス",
+        .detail = "入力ファイルのパス(省略あるいは-を指定したときは標準入力から読み込む)\n"
+        "各レコードの以下の項目を挿入する(それ以外の項目は無視する)\n"
+        "  srv     サービス名(必須)\n"
+        "  user    ユーザ名(必須)\n"
+        "  name    名称\n"
+        "  pw      パスワード\n"
+        "  memo    メモ"
+    };
+
+    /// <summary>
+    /// 入力の形式についての列挙
+    /// </summary>
+    struct format_list {
+        static constexpr std::string_view csv = "csv";
+        static constexpr std::string_view jsonl = "jsonl";
+    };
+
+    const std::unordered_map<std::string_view, pwm::CsvScanMode> scan_map = {
+        { "auto", pwm::CsvScanMode::automatic },
+        { "scalar", pwm::CsvScanMode::scalar },
+        { "sse2", pwm::CsvScanMode::sse2 },
+        { "avx2", pwm::CsvScanMode::avx2 }
+    };
+
+    const std::unordered_map<std::string_view, pwm::ConflictPolicy> conflict_map = {
+        { "fail", pwm::ConflictPolicy::fail },
+        { "skip", pwm::ConflictPolicy::skip },
+        { "overwrite", pwm::ConflictPolicy::overwrite }
+    };
+
+    /// <summary>
+    /// 挿入情報へ項目を設定する
+    /// </summary>
+    /// <param name="data">挿入情報</param>
+    /// <param name="col">passwordsのカラムに関連付けられたインデックス(挿入できない項目は無視する)</param>
+    /// <param name="value">項目の値(空であれば省略されたものとみなす)</param>
+    void setField(pwm::InsertParam& data, int col, std::u8string_view value) {
+        using pws = pwm::table::passwords;
+        switch (col) {
+        case pws::c_service::index: data.service = value; break;
+        case pws::c_user::index: data.user = value; break;
+        case pws::c_name::index: if (!value.empty()) { data.name = value; } break;
+        case pws::c_password::index: data.password.assign(value.begin(), value.end()); break;
+        case pws::c_memo::index: if (!value.empty()) { data.memo = value; } break;
+        }
+    }
+
+    /// <summary>
+    /// UnicodeのコードポイントをUTF-8として追加する
+    /// </summary>
+    void appendUtf8(std::string& x, std::uint32_t cp) {
+        if (cp < 0x80) {
+            x += static_cast<char>(cp);
+        }
+        else if (cp < 0x800) {
+            x += static_cast<char>(0xC0 | (cp >> 6));
+            x += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+        else if (cp < 0x10000) {
+            x += static_cast<char>(0xE0 | (cp >> 12));
+            x += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            x += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+        else {
+            x += static_cast<char>(0xF0 | (cp >> 18));
+            x += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+            x += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            x += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+    }
+
+    /// <summary>
+    /// JSON Linesの1行に記述された階層を持たないオブジェクトを解析するクラス
+    /// </summary>
+    class JsonLineParser {
+        std::string_view _line;
+        std::size_t _pos = 0;
+
+        void skipSpace() {
+            while (this->_pos < this->_line.size() && (this->_line[this->_pos] == ' ' || this->_line[this->_pos] == '\t' || this->_line[this->_pos] == '\r')) {
+                ++this->_pos;
+            }
+        }
+
+        void expect(char c) {
+            this->skipSpace();
+            if (this->_pos >= this->_line.size() || this->_line[this->_pos] != c) {
+                throw std::runtime_error(std::format("JSONの{0}文字目に{1}が必要です", this->_pos + 1, c));
+            }
+            ++this->_pos;
+        }
+
+        std::uint32_t hex4() {
+            if (this->_pos + 4 > this->_line.size()) {
+                throw std::runtime_error("JSONの\\uエスケープが不正です");
+            }
+            std::uint32_t x = 0;
+            for (int i = 0; i < 4; ++i) {
+                char c = this->_line[this->_pos++];
+                x <<= 4;
+                if (c >= '0' && c <= '9') { x |= c - '0'; }
+                else if (c >= 'a' && c <= 'f') { x |= c - 'a' + 10; }
+                else if (c >= 'A' && c <= 'F') { x |= c - 'A' + 10; }
+                else { throw std::runtime_error("JSONの\\uエスケープが不正です"); }
+            }
+            return x;
+        }
+
+        std::string string() {
+            this->expect('"');
+            std::string x;
+            while (true) {
+                if (this->_pos >= this->_line.size()) {
+                    throw std::runtime_error("JSONの文字列が閉じられていません");
+                }
+                char c = this->_line[this->_pos++];
+                if (c == '"') {
+                    return x;
+                }
+                if (c != '\\') {
+                    x += c;
+                    continue;
+                }
+                if (this->_pos >= this->_line.size()) {
+                    throw std::runtime_error("JSONの文字列が閉じられていません");
+                }
+                switch (c = this->_line[this->_pos++]) {
+                case '"': x += '"'; break;
+                case '\\': x += '\\'; break;
+                case '/': x += '/'; break;
+                case 'b': x += '\b'; break;
+                case 'f': x += '\f'; break;
+                case 'n': x += '\n'; break;
+                case 'r': x += '\r'; break;
+                case 't': x += '\t'; break;
+                case 'u':
+                {
+                    std::uint32_t cp = this->hex4();
+                    if (cp >= 0xD800 && cp < 0xDC00) {
+                        // サロゲートペアを結合する
+                        if (this->_line.substr(this->_pos, 2) != "\\u") {
+                            throw std::runtime_error("JSONのサロゲートペアが不正です");
+                        }
+                        this->_pos += 2;
+                        std::uint32_t low = this->hex4();
+                        if (low < 0xDC00 || low >= 0xE000) {
+                            throw std::runtime_error("JSONのサロゲートペアが不正です");
+                        }
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    appendUtf8(x, cp);
+                    break;
+                }
+                default:
+                    throw std::runtime_error("JSONのエスケープが不正です");
+                }
+            }
+        }
+
+        std::optional<std::string> value() {
+            this->skipSpace();
+            if (this->_pos >= this->_line.size()) {
+                throw std::runtime_error("JSONの値が存在しません");
+            }
+            char c = this->_line[this->_pos];
+            if (c == '"') {
+                return this->string();
+            }
+            if (c == '{' || c == '[') {
+                throw std::runtime_error("JSONの値としてオブジェクトや配列は指定できません");
+            }
+            // 数値や真偽値はそのまま文字列とする
+            auto begin = this->_pos;
+            while (this->_pos < this->_line.size() && this->_line[this->_pos] != ',' && this->_line[this->_pos] != '}' && this->_line[this->_pos] != ' ' && this->_line[this->_pos] != '\t') {
+                ++this->_pos;
+            }
+            auto literal = this->_line.substr(begin, this->_pos - begin);
+            if (literal == "null") {
+                return std::nullopt;
+            }
+            return std::string(literal);
+        }
+
+    public:
+        JsonLineParser(std::string_view line) : _line(line) {}
+
+        /// <summary>
+        /// オブジェクトの各メンバを解析する
+        /// </summary>
+        /// <param name="f">メンバ名と値(nullであればnullopt)を受け取る関数</param>
+        template <class F>
+        void parse(F&& f) {
+            this->expect('{');
+            this->skipSpace();
+            if (this->_pos < this->_line.size() && this->_line[this->_pos] == '}') {
+                ++this->_pos;
+            }
+            else {
+                while (true) {
+                    auto key = this->string();
+                    this->expect(':');
+                    f(key, this->value());
+                    this->skipSpace();
+                    if (this->_pos < this->_line.size() && this->_line[this->_pos] == ',') {
+                        ++this->_pos;
+                        continue;
+                    }
+                    this->expect('}');
+                    break;
+                }
+            }
+            this->skipSpace();
+            if (this->_pos != this->_line.size()) {
+                throw std::runtime_error("JSONのオブジェクトの後に余分な文字があります");
+            }
+        }
+    };
+}
+
+void import_(int argc, const char* argv[], const std::filesystem::path& db, std::ostream& os) {
+    option::CommandLineOption clo;
+    clo.add_options()
+        .l(od_help.name, od_help.summary)
+        .l(od_help_with_target.name, option::Value<std::string>().name("option"), od_help_with_target.summary)
+        .l(od_format.name, option::Value<std::string>("")
+            .constraint([](const std::string& x) { return x.length() == 0 || x == format_list::csv || x == format_list::jsonl; }).name("format"), od_format.summary)
+        .l(od_on_conflict.name, option::Value<std::string>("fail")
+            .constraint([](const std::string& x) { return conflict_map.contains(x); }).name("policy"), od_on_conflict.summary)
+        .l(od_chunk.name, option::Value<long long>(static_cast<long long>(pwm::PasswordManagement::default_chunk_size))
+            .constraint([](long long x) { return x > 0; }).name("rows"), od_chunk.summary)
+        .l(od_scan.name, option::Value<std::string>("auto")
+            .constraint([](const std::string& x) { return scan_map.contains(x); }).name("isa"), od_scan.summary)
+        .l(od_dry_run.name, od_dry_run.summary)
+        .u(option::Value<std::string>("").name(od_file.name), od_file.summary);
+
+    const option::OptionMap& map = clo.map();
+    // コマンドライン引数の解析の実行
+    clo.parse(argc, argv, false);
+
+    if (auto temp = map.luse(od_help_with_target.name); temp) {
+        // コマンドライン引数に対する説明の表示
+        auto target = temp.as<std::string>();
+        std::string detail;
+        if (target == od_help.name) {
+            detail = od_help.detail;
+        }
+        else if (target == od_help_with_target.name) {
+            detail = od_help_with_target.detail;
+        }
+        else if (target == od_format.name) {
+            detail = od_format.detail;
+        }
+        else if (target == od_on_conflict.name) {
+            detail = od_on_conflict.detail;
+        }
+        else if (target == od_chunk.name) {
+            detail = od_chunk.detail;
+        }
+        else if (target == od_scan.name) {
+            detail = od_scan.detail;
+        }
+        else if (target == od_dry_run.name) {
+            detail = od_dry_run.detail;
+        }
+        else if (target == od_file.name) {
+            detail = od_file.detail;
+        }
+        else {
+            std::cerr << target << " に該当する説明は存在しません" << std::endl;
+            return;
+        }
+        std::cout << detail << std::endl;
+        return;
+    }
+    else if (auto temp = map.luse(od_help.name); temp) {
+        // コマンド一覧を表示
+        std::cout << "Options:" << std::endl;
+        std::cout << clo.description() << std::endl;
+        return;
+    }
+
+    // 入力値の評価
+    map.validate();
+
+    // 入力元の決定(チャンクに分割して書き出したものは展開しながら読み込む)
+    auto file = map.unnamed_options().as<std::string>();
+    std::ifstream ifs;
+    std::optional<pwm::ChunkArchiveReader> archive;
+    std::optional<pwm::ChunkStreamBuf> archive_buf;
+    std::istream archive_is(nullptr);
+    if (std::filesystem::path(file).extension() == ".pwmc") {
+        archive.emplace(std::filesystem::path(std::bit_cast<const char8_t*>(file.c_str())));
+        if (!archive->complete()) {
+            throw std::runtime_error(file + " への書き出しが完了していません");
+        }
+        if (archive->format() == pwm::RecordFormat::binary) {
+            throw std::runtime_error(file + " はバイナリ形式で書き出されているため読み込めません");
+        }
+        archive_buf.emplace(archive.value());
+        archive_is.rdbuf(&archive_buf.value());
+    }
+    else if (file.length() != 0 && file != "-") {
+        ifs.open(std::filesystem::path(std::bit_cast<const char8_t*>(file.c_str())), std::ios::binary);
+        if (!ifs) {
+            throw std::runtime_error(file + " を開けません");
+        }
+    }
+    std::istream& is = archive ? archive_is : ifs.is_open() ? static_cast<std::istream&>(ifs) : std::cin;
+
+    // 入力の形式の決定
+    auto format = map.use(od_format.name).as<std::string>();
+    if (archive) {
+        format = archive->format() == pwm::RecordFormat::jsonl ? format_list::jsonl : format_list::csv;
+    }
+    else if (format.length() == 0) {
+        auto ext = std::filesystem::path(file).extension();
+        format = ext == ".jsonl" || ext == ".ndjson" ? format_list::jsonl : format_list::csv;
+    }
+
+    // 入力を1レコードずつ挿入情報へ変換する関数の構築
+    std::uint64_t line = 0;
+    std::function<std::optional<pwm::InsertParam>()> next;
+    std::optional<pwm::CsvTokenizer> csv;
+    std::vector<int> header;
+    std::vector<std::u8string_view> fields;
+    std::string json_line;
+    std::uint64_t json_bytes = 0;
+    if (format == format_list::csv) {
+        csv.emplace(is, scan_map.at(map.use(od_scan.name).as<std::string>()));
+        // 1行目のヘッダから各列の項目を決定する(挿入できない項目は-1とする)
+        if (!csv->next(fields)) {
+            return;
+        }
+        for (const auto& x : fields) {
+            auto itr = col_map.find(x);
+            header.push_back(itr == col_map.end() ? -1 : itr->second);
+        }
+        next = [&]() -> std::optional<pwm::InsertParam> {
+            while (true) {
+                line = csv->line();
+                if (!csv->next(fields)) {
+                    return std::nullopt;
+                }
+                if (fields.size() == 1 && fields[0].empty()) {
+                    // 空行は読み飛ばす
+                    continue;
+                }
+                if (fields.size() != header.size()) {
+                    throw std::runtime_error("列数がヘッダと一致しません");
+                }
+                // フィールドはバッファを指すため挿入情報の構築まで複製しない
+                pwm::InsertParam data;
+                for (std::size_t i = 0; i < fields.size(); ++i) {
+                    setField(data, header[i], fields[i]);
+                }
+                return data;
+            }
+        };
+    }
+    else {
+        next = [&]() -> std::optional<pwm::InsertParam> {
+            while (std::getline(is, json_line)) {
+                ++line;
+                json_bytes += json_line.size() + 1;
+                if (line == 1 && json_line.starts_with("\xEF\xBB\xBF")) {
+                    // UTF-8のBOMは読み飛ばす
+                    json_line.erase(0, 3);
+                }
+                if (json_line.find_first_not_of(" \t\r") == std::string::npos) {
+                    // 空行は読み飛ばす
+                    continue;
+                }
+                pwm::InsertParam data;
+                JsonLineParser(json_line).parse([&](const std::string& key, const std::optional<std::string>& value) {
+                    if (auto itr = col_map.find(std::u8string_view(std::bit_cast<const char8_t*>(key.data()), key.size())); itr != col_map.end() && value) {
+                        setField(data, itr->second, std::u8string_view(std::bit_cast<const char8_t*>(value->data()), value->size()));
+                    }
+                });
+                return data;
+            }
+            return std::nullopt;
+        };
+    }
+
+    if (map.luse(od_dry_run.name)) {
+        // 解析のみを行いスループットを出力する
+        auto begin = std::chrono::steady_clock::now();
+        std::uint64_t rows = 0;
+        try {
+            while (auto data = next()) {
+                pwm::PasswordManagement::validate(data.value());
+                ++rows;
+            }
+        }
+        catch (const std::exception& e) {
+            throw std::runtime_error(std::format("{0}行目: {1}", line, e.what()));
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+        auto bytes = csv ? csv->bytes() : json_bytes;
+        os << "rows: " << rows << '\n';
+        os << "bytes: " << bytes << '\n';
+        os << "elapsed: " << std::format("{0:.3f}", elapsed.count()) << "s" << '\n';
+        os << "rows-per-sec: " << std::format("{0:.0f}", elapsed.count() > 0 ? rows / elapsed.count() : 0.0) << '\n';
+        os << "mib-per-sec: " << std::format("{0:.1f}", elapsed.count() > 0 ? bytes / elapsed.count() / (1 << 20) : 0.0) << std::endl;
+        return;
+    }
+
+    // DBとのコネクションを確立して一括で挿入する
+    auto conn = SQLite(db);
+    auto pm = pwm::PasswordManagement(db, conn);
+    unlockVault(pm);
+    auto begin = std::chrono::steady_clock::now();
+    pwm::InsertManyResult result;
+    try {
+        result = pm.insertMany(next, conflict_map.at(map.use(od_on_conflict.name).as<std::string>()), static_cast<std::size_t>(map.use(od_chunk.name).as<long long>()));
+    }
+    catch (const std::exception& e) {
+        // 失敗したレコードの位置を付加する
+        throw std::runtime_error(std::format("{0}行目: {1}", line, e.what()));
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+    // 処理件数とスループットの出力
+    auto rows = result.inserted + result.overwritten + result.skipped;
+    os << "rows: " << rows << '\n';
+    os << "inserted: " << result.inserted << '\n';
+    os << "overwritten: " << result.overwritten << '\n';
+    os << "skipped: " << result.skipped << '\n';
+    os << "elapsed: " << std::format("{0:.3f}", elapsed.count()) << "s" << '\n';
+    os << "rows-per-sec: " << std::format("{0:.0f}", elapsed.count() > 0 ? rows / elapsed.count() : 0.0) << std::endl;
+}
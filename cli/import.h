@@ -0,0 +1,15 @@
+﻿#pragma once
+
+#include <iostream>
+
+/// <summary>
+/// importコマンドの実行
+/// </summary>
+/// <remarks>
+/// importはモジュールの宣言に用いられる識別子であるため関数名の末尾に_を付す
+/// </remarks>
+/// <param name="argc">コマンドライン引数の個数</param>
+/// <param name="argv">コマンドライン引数の配列</param>
+/// <param name="db">DBデータへのパス</param>
+/// <param name="os">出力ストリーム</param>
+void import_(int argc, const char* argv[], const std::filesystem::path& db, std::ostream& os);
@@ -120,5 +120,6 @@ void ins(int argc, const char* argv[], const std::filesystem::path& db, std::ost
     // DBとのコネクションを確立してデータの更新を行う
     auto conn = SQLite(db);
     auto pm = pwm::PasswordManagement(db, conn);
+    unlockVault(pm);
     pm.insert(data);
 }
@@ -6,7 +6,17 @@
 #include "ins.h"
 #include "upd.h"
 #include "del.h"
+#include "complete.h"
+#include "import.h"
+#include "export.h"
+#include "backup.h"
+#include "sync.h"
+#include "verify.h"
+#include "diff.h"
+#include "agent.h"
+#include "rekey.h"
 #include "common.h"
+#include "PageCipherVfs.h"
 #if defined(_MSC_VER)
 #include <windows.h>
 #endif
@@ -31,6 +41,23 @@ namespace {
         "  file    ファイルへ出力"
     };
 
+    const OptionDetail od_stats = {
+        .name = "stats",
+        .summary = "コマンドの実行後に統計情報を表示",
+        .detail = "<command>で指定したコマンドの実行後に以下の統計情報を標準エラー出力へ表示する\n"
+        "  busy-retries    DBのロック待ちにより再試行した回数\n"
+        "  busy-wait       DBのロック待ちにより待機した時間の合計\n"
+        "  busy-give-ups   DBのロック待ちの再試行を諦めた回数"
+    };
+
+    const OptionDetail od_busy_timeout = {
+        .name = "busy-timeout ",
+        .summary = "DBのロック待ちの上限時間(ミリ秒)",
+        .detail = "DBが他のプロセスによりロックされているときに再試行を続ける時間の上限(ミリ秒)\n"
+        "再試行の間隔は指数的に増加し、ジッタが加えられる\n"
+        "0を指定したときは再試行せずに即座に失敗する"
+    };
+
     const OptionDetail od_command = {
         .name = "command",
         .summary = "実行するコマンド",
@@ -39,7 +66,16 @@ namespace {
         "  get     パスワード情報を取得する\n"
         "  ins     パスワード情報を挿入する\n"
         "  upd     パスワード情報を更新する\n"
-        "  del     パスワード情報を削除する"
+        "  del     パスワード情報を削除する\n"
+        "  complete サービス名あるいは名称を補完する\n"
+        "  import  CSVあるいはJSON Linesからパスワード情報を一括で挿入する\n"
+        "  export  パスワード情報をCSV、JSON Linesあるいはバイナリ形式で書き出す\n"
+        "  backup  書き込み中でも安全にDBを別のファイルへ複製する\n"
+        "  sync    他のDBと前回の同期以降の差分のみを双方向に同期する\n"
+        "  verify  すべての行をマークル木と照合して改ざんや破損を検出する\n"
+        "  diff    他のDBとマークル木を比較して異なる行を表示する\n"
+        "  agent   導出した鍵を保持して他のコマンドへ受け渡すエージェントを起動する\n"
+        "  rekey   新たな世代の鍵を作成してすべてのパスワードを並列に暗号化し直す"
     };
 
     /// <summary>
@@ -56,7 +92,16 @@ namespace {
         { "get", {.callback = get }},
         { "ins", {.callback = ins }},
         { "upd", {.callback = upd }},
-        { "del", {.callback = del }}
+        { "del", {.callback = del }},
+        { "complete", {.callback = complete }},
+        { "import", {.callback = import_ }},
+        { "export", {.callback = export_ }},
+        { "backup", {.callback = backup }},
+        { "sync", {.callback = sync_ }},
+        { "verify", {.callback = verify }},
+        { "diff", {.callback = diff }},
+        { "agent", {.callback = agent }},
+        { "rekey", {.callback = rekey }}
     };
 }
 
@@ -71,6 +116,8 @@ int main(int argc, const char* argv[]) {
         .l(od_help_with_target.name, option::Value<std::string>().name("option"), od_help_with_target.summary)
         .l(od_target.name, option::Value<std::string>("stdout").name("type"), od_target.summary)
         .o(od_output.name, option::Value<std::string>().name("out"), od_output.summary)
+        .l(od_stats.name, od_stats.summary)
+        .l(od_busy_timeout.name, option::Value<long long>(SQLiteConnection::default_busy_config.timeout.count()).name("ms"), od_busy_timeout.summary)
         // コマンドが入力されたらそそれ以降は別の解析器で解析する
         .u.pause()(option::Value<std::string>().name(od_command.name), od_command.summary);
 
@@ -109,6 +156,12 @@ int main(int argc, const char* argv[]) {
         else if (target == od_output.name) {
             detail = od_output.detail;
         }
+        else if (target == od_stats.name) {
+            detail = od_stats.detail;
+        }
+        else if (target == od_busy_timeout.name) {
+            detail = od_busy_timeout.detail;
+        }
         else if (target == od_command.name) {
             detail = od_command.detail;
         }
@@ -132,12 +185,37 @@ int main(int argc, const char* argv[]) {
         std::filesystem::path dbname = std::filesystem::path(argv[0]).remove_filename() / u8"pwm.db";
 
         if (cd_map.contains(command)) {
+            // 以降に確立するコネクションのロック待ちの設定
+            SQLiteConnection::default_busy_config.timeout = std::chrono::milliseconds(map.use(od_busy_timeout.name).as<long long>());
+            // コマンドライン引数や入力ファイルの不正なバイト列をDBへ格納しないようバインドする文字列を検証する
+            SQLiteConnection::default_validate_utf8 = true;
+            if (auto passphrase = readPassphrase(env_db_passphrase); passphrase) {
+                // 以降に開くDBをページ単位で暗号化する
+                SQLiteConnection::default_page_cipher_provider = makePageCipherProvider(std::move(passphrase.value()));
+            }
+            int ret = 0;
             try {
                 cd_map.at(command).callback(argc - 1 - suboffset, &argv[1 + suboffset], dbname, std::cout);
             }
             catch (std::exception& e) {
                 std::cerr << "error: " << e.what() << std::endl;
-                return 1;
+                ret = 1;
+            }
+            if (auto temp = map.luse(od_stats.name); temp) {
+                // 統計情報の表示
+                auto stats = SQLite::totalBusyStats();
+                std::cerr << "busy-retries: " << stats.retries << std::endl;
+                std::cerr << "busy-wait: " << std::format("{0:.3f}", stats.wait_time.count() / 1000.0) << "ms" << std::endl;
+                std::cerr << "busy-give-ups: " << stats.give_ups << std::endl;
+                if (SQLiteConnection::default_page_cipher_provider) {
+                    auto pages = SQLitePageCipher::totalStats();
+                    std::cerr << "page-encrypted: " << pages.encrypted << std::endl;
+                    std::cerr << "page-decrypted: " << pages.decrypted << std::endl;
+                    std::cerr << "page-cache-hits: " << pages.cache_hits << std::endl;
+                }
+            }
+            if (ret != 0) {
+                return ret;
             }
         }
         else {
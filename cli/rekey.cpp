@@ -0,0 +1,114 @@
+﻿#include "rekey.h"
+#include "CommandLineOption.hpp"
+#include "common.h"
+#include "PasswordManagement.h"
+#include "SQLitePool.h"
+#include <thread>
+
+namespace {
+
+    const OptionDetail od_threads = {
+        .name = "threads ",
+        .summary = "並列に復号と暗号化を行うスレッドの数",
+        .detail = "主キーの範囲で分割したチャンクごとにDBからの読み取り、復号および暗号化を行うワーカーのスレッドの数\n"
+        "省略時は論理コアの数とし、書き込みは呼び出し元のスレッドがチャンクの順に行う"
+    };
+
+    const OptionDetail od_chunk_ids = {
+        .name = "chunk-ids ",
+        .summary = "1つのチャンクが受け持つ主キーの幅",
+        .detail = "1つのチャンクが受け持つ主キーの幅であり、チャンクごとに1つのトランザクションで書き込んで進捗を記録する\n"
+        "小さくするほど他のコネクションの書き込みの待ち時間と中断時にやり直す行数は少なくなる"
+    };
+
+    const OptionDetail od_progress = {
+        .name = "progress",
+        .summary = "進捗を表示",
+        .detail = "再暗号化を終えた主キーと行数を1秒ごとに標準エラー出力へ表示する"
+    };
+}
+
+void rekey(int argc, const char* argv[], const std::filesystem::path& db, std::ostream& os) {
+    option::CommandLineOption clo;
+    clo.add_options()
+        .l(od_help.name, od_help.summary)
+        .l(od_help_with_target.name, option::Value<std::string>().name("option"), od_help_with_target.summary)
+        .l(od_threads.name, option::Value<long long>(static_cast<long long>(std::max(1u, std::thread::hardware_concurrency())))
+            .constraint([](long long x) { return x > 0; }).name("n"), od_threads.summary)
+        .l(od_chunk_ids.name, option::Value<long long>(pwm::PasswordManagement::default_rekey_chunk_ids)
+            .constraint([](long long x) { return x > 0; }).name("n"), od_chunk_ids.summary)
+        .l(od_progress.name, od_progress.summary);
+
+    const option::OptionMap& map = clo.map();
+    // 引数を伴わずに実行するため引数が存在するときのみ解析する
+    if (argc != 0) {
+        // コマンドライン引数の解析の実行
+        clo.parse(argc, argv, false);
+
+        if (auto temp = map.luse(od_help_with_target.name); temp) {
+            // コマンドライン引数に対する説明の表示
+            auto target = temp.as<std::string>();
+            std::string detail;
+            if (target == od_help.name) {
+                detail = od_help.detail;
+            }
+            else if (target == od_help_with_target.name) {
+                detail = od_help_with_target.detail;
+            }
+            else if (target == od_threads.name) {
+                detail = od_threads.detail;
+            }
+            else if (target == od_chunk_ids.name) {
+                detail = od_chunk_ids.detail;
+            }
+            else if (target == od_progress.name) {
+                detail = od_progress.detail;
+            }
+            else {
+                std::cerr << target << " に該当する説明は存在しません" << std::endl;
+                return;
+            }
+            std::cout << detail << std::endl;
+            return;
+        }
+        else if (auto temp = map.luse(od_help.name); temp) {
+            // コマンド一覧を表示
+            std::cout << "Options:" << std::endl;
+            std::cout << clo.description() << std::endl;
+            return;
+        }
+
+        // 入力値の評価
+        map.validate();
+    }
+
+    auto passphrase = readPassphrase();
+    if (!passphrase) {
+        throw std::invalid_argument(std::format("環境変数{0}にパスフレーズを設定してください", env_passphrase));
+    }
+    const auto threads = static_cast<std::size_t>(map.use(od_threads.name).as<long long>());
+    const bool show_progress = static_cast<bool>(map.luse(od_progress.name));
+
+    // ワーカーごとの読み取り用のコネクションと書き込み用のコネクションを確立する
+    auto begin = std::chrono::steady_clock::now();
+    auto last_report = begin;
+    SQLitePool pool(db, threads);
+    auto pm = pwm::PasswordManagement(db, pool);
+    auto result = pm.rekey(passphrase.value(), threads, map.use(od_chunk_ids.name).as<long long>(), [&](const pwm::RekeyProgress& progress) {
+        auto now = std::chrono::steady_clock::now();
+        if (show_progress && now - last_report >= std::chrono::seconds(1)) {
+            last_report = now;
+            std::cerr << std::format("progress: {0}/{1} ids, {2} rows", progress.next_id, progress.last_id, progress.rewritten) << std::endl;
+        }
+    });
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+    // 新たな鍵の世代と再暗号化した行数の出力
+    os << "generation: " << result.generation << '\n';
+    os << "resumed: " << (result.resumed ? "true" : "false") << '\n';
+    os << "chunks: " << result.chunks << '\n';
+    os << "rewritten: " << result.rewritten << '\n';
+    os << "conflicts: " << result.conflicts << '\n';
+    os << "elapsed: " << std::format("{0:.3f}", elapsed.count()) << "s" << '\n';
+    os << "rows-per-sec: " << std::format("{0:.0f}", elapsed.count() > 0 ? result.rewritten / elapsed.count() : 0.0) << std::endl;
+}
@@ -0,0 +1,86 @@
+﻿#include "sync.h"
+#include "CommandLineOption.hpp"
+#include "common.h"
+#include "PasswordManagement.h"
+
+namespace {
+
+    const OptionDetail od_peer = {
+        .name = "peer",
+        .summary = "同期先のDBのパス",
+        .detail = "同期先のDBのパス\n"
+        "前回の同期以降に双方で変更された行のみを1つのトランザクションで双方向に反映する\n"
+        "双方で変更された行は行のバージョン、更新日時、削除であるか、内容の順に比較して大きい方を採用する\n"
+        "鍵の情報が異なる暗号化されたDBどうしでは、エージェントあるいはPWM_PASSPHRASEから得た双方の鍵で暗号化し直す"
+    };
+}
+
+void sync_(int argc, const char* argv[], const std::filesystem::path& db, std::ostream& os) {
+    option::CommandLineOption clo;
+    clo.add_options()
+        .l(od_help.name, od_help.summary)
+        .l(od_help_with_target.name, option::Value<std::string>().name("option"), od_help_with_target.summary)
+        .u(option::Value<std::string>().name(od_peer.name), od_peer.summary);
+
+    if (argc == 0) {
+        // 引数が存在しないときは説明を表示
+        std::cout << "Options:" << std::endl;
+        std::cout << clo.description() << std::endl;
+        return;
+    }
+
+    const option::OptionMap& map = clo.map();
+    // コマンドライン引数の解析の実行
+    clo.parse(argc, argv, false);
+
+    if (auto temp = map.luse(od_help_with_target.name); temp) {
+        // コマンドライン引数に対する説明の表示
+        auto target = temp.as<std::string>();
+        std::string detail;
+        if (target == od_help.name) {
+            detail = od_help.detail;
+        }
+        else if (target == od_help_with_target.name) {
+            detail = od_help_with_target.detail;
+        }
+        else if (target == od_peer.name) {
+            detail = od_peer.detail;
+        }
+        else {
+            std::cerr << target << " に該当する説明は存在しません" << std::endl;
+            return;
+        }
+        std::cout << detail << std::endl;
+        return;
+    }
+    else if (auto temp = map.luse(od_help.name); temp) {
+        // コマンド一覧を表示
+        std::cout << "Options:" << std::endl;
+        std::cout << clo.description() << std::endl;
+        return;
+    }
+
+    // 入力値の評価
+    map.validate();
+
+    auto file = map.unnamed_options().as<std::string>();
+    auto peer = std::filesystem::path(std::bit_cast<const char8_t*>(file.c_str()));
+
+    // DBとのコネクションを確立して同期を行う
+    auto begin = std::chrono::steady_clock::now();
+    auto conn = SQLite(db);
+    auto pm = pwm::PasswordManagement(db, conn);
+    // 鍵の情報が異なるDBとの同期では一方の鍵で復号して他方の鍵で暗号化し直すため、双方の鍵を設定する
+    unlockVault(pm);
+    auto result = pm.sync(peer, unlockVault);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+    // 差分の件数と反映した件数の出力
+    os << "local-changes: " << result.local_changes << '\n';
+    os << "peer-changes: " << result.peer_changes << '\n';
+    os << "pulled: " << result.pulled << '\n';
+    os << "pushed: " << result.pushed << '\n';
+    os << "conflicts: " << result.conflicts << '\n';
+    os << "duplicates: " << result.duplicates << '\n';
+    os << "elapsed: " << std::format("{0:.3f}", elapsed.count()) << "s" << std::endl;
+}
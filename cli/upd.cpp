@@ -28,6 +28,13 @@ namespace {
         .detail = "パスワード情報における更新するパスワード"
     };
 
+    const OptionDetail od_version = {
+        .name = "ver ",
+        .summary = "更新対象に期待する行のバージョン",
+        .detail = "更新対象に期待する行のバージョンであり、getコマンドでverを取得対象とすることで得られる\n"
+        "指定されたときは更新対象のバージョンが一致しなければ何も更新せずに失敗する"
+    };
+
     const OptionDetail od_memo_to = {
         .name = "memo-to ",
         .summary = "パスワード情報に対して更新する補足する事項",
@@ -45,8 +52,10 @@ void upd(int argc, const char* argv[], const std::filesystem::path& db, std::ost
         .l(od_user_to.name, option::Value<std::string>().name("user"), od_user_to.summary)
         .l(od_name_to.name, option::Value<std::string>().name("name"), od_name_to.summary)
         .l(od_password_to.name, option::Value<std::string>().name("password"), od_password_to.summary)
-        .l(od_memo_to.name, option::Value<std::string>().name("memo"), od_memo_to.summary);
+        .l(od_memo_to.name, option::Value<std::string>().name("memo"), od_memo_to.summary)
+        .l(od_version.name, option::Value<long long>().name("version"), od_version.summary);
     cond::addCond(clo.add_options());
+    cond::addIdCond(clo.add_options());
 
     if (argc == 0) {
         // 引数が存在しないときは説明を表示
@@ -84,6 +93,9 @@ void upd(int argc, const char* argv[], const std::filesystem::path& db, std::ost
         else if (target == od_memo_to.name) {
             detail = od_memo_to.detail;
         }
+        else if (target == od_version.name) {
+            detail = od_version.detail;
+        }
         else if (cond::getDetail(target, detail));
         else {
             std::cerr << target << " に該当する説明は存在しません" << std::endl;
@@ -133,11 +145,32 @@ void upd(int argc, const char* argv[], const std::filesystem::path& db, std::ost
         }
     }
 
-    // 検索条件を示すデータの構築
-    pwm::GetParam getData = cond::getGetParam(map);
-
     // DBとのコネクションを確立してデータの更新を行う
     auto conn = SQLite(db);
     auto pm = pwm::PasswordManagement(db, conn);
-    pm.update(getData, updateData);
+    unlockVault(pm);
+    auto ids = cond::getIds(map);
+    if (auto temp = map.use(od_version.name); temp) {
+        // バージョンが指定されたときは一致する場合にのみ更新を行う
+        auto version = static_cast<std::int64_t>(temp.as<long long>());
+        if (ids) {
+            if (ids.value().size() != 1) {
+                throw std::invalid_argument("バージョンを指定するときは主キーを1つだけ指定してください");
+            }
+            pm.updateById(ids.value()[0], updateData, version);
+        }
+        else {
+            pwm::GetParam getData = cond::getGetParam(map);
+            pm.update(getData, updateData, version);
+        }
+    }
+    else if (ids) {
+        // 主キーが指定されたときは主キーによる更新を行う
+        pm.updateById(ids.value(), updateData);
+    }
+    else {
+        // 検索条件を示すデータの構築
+        pwm::GetParam getData = cond::getGetParam(map);
+        pm.update(getData, updateData);
+    }
 }
@@ -0,0 +1,68 @@
+﻿#include "verify.h"
+#include "CommandLineOption.hpp"
+#include "common.h"
+#include "PasswordManagement.h"
+
+void verify(int argc, const char* argv[], const std::filesystem::path& db, std::ostream& os) {
+    option::CommandLineOption clo;
+    clo.add_options()
+        .l(od_help.name, od_help.summary)
+        .l(od_help_with_target.name, option::Value<std::string>().name("option"), od_help_with_target.summary);
+
+    const option::OptionMap& map = clo.map();
+    // 引数を伴わずに実行するため引数が存在するときのみ解析する
+    if (argc != 0) {
+        // コマンドライン引数の解析の実行
+        clo.parse(argc, argv, false);
+
+        if (auto temp = map.luse(od_help_with_target.name); temp) {
+            // コマンドライン引数に対する説明の表示
+            auto target = temp.as<std::string>();
+            std::string detail;
+            if (target == od_help.name) {
+                detail = od_help.detail;
+            }
+            else if (target == od_help_with_target.name) {
+                detail = od_help_with_target.detail;
+            }
+            else {
+                std::cerr << target << " に該当する説明は存在しません" << std::endl;
+                return;
+            }
+            std::cout << detail << std::endl;
+            return;
+        }
+        else if (auto temp = map.luse(od_help.name); temp) {
+            // コマンド一覧を表示
+            std::cout << "Options:" << std::endl;
+            std::cout << clo.description() << std::endl;
+            return;
+        }
+
+        // 入力値の評価
+        map.validate();
+    }
+
+    // DBとのコネクションを確立してすべての行からマークル木と照合する
+    auto begin = std::chrono::steady_clock::now();
+    auto conn = SQLite(db);
+    auto pm = pwm::PasswordManagement(db, conn);
+    auto mismatches = pm.verifyDigest();
+    auto root = pm.digest();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+    // 根のハッシュ値と一致しなかった主キーの範囲の出力
+    os << "digest: ";
+    for (auto x : root) {
+        os << std::format("{0:02x}", static_cast<unsigned int>(x));
+    }
+    os << '\n';
+    for (const auto& x : mismatches) {
+        os << "mismatch: " << x.first_id << '-' << x.last_id << '\n';
+    }
+    os << "mismatches: " << mismatches.size() << '\n';
+    os << "elapsed: " << std::format("{0:.3f}", elapsed.count()) << "s" << std::endl;
+    if (!mismatches.empty()) {
+        throw std::runtime_error("マークル木と一致しない行が存在します");
+    }
+}
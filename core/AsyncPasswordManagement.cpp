@@ -0,0 +1,68 @@
+﻿#include "AsyncPasswordManagement.h"
+
+namespace pwm {
+    AsyncRowStream::~AsyncRowStream() {
+        if (this->_queue) {
+            // 読み取り中のワーカスレッドを中断させる
+            this->_queue->close();
+        }
+    }
+
+    AsyncRowStream& AsyncRowStream::operator=(AsyncRowStream&& x) noexcept {
+        if (this->_queue) {
+            this->_queue->close();
+        }
+        this->_queue = std::move(x._queue);
+        return *this;
+    }
+
+    AsyncResult<void> AsyncPasswordManagement::insert(InsertParam obj) {
+        return this->_pool.async([&pm = this->_pm, obj = std::move(obj)] { pm.insert(obj); });
+    }
+
+    AsyncResult<void> AsyncPasswordManagement::update(GetParam obj, UpdateParam content) {
+        return this->_pool.async([&pm = this->_pm, obj = std::move(obj), content = std::move(content)] { pm.update(obj, content); });
+    }
+
+    AsyncResult<void> AsyncPasswordManagement::update(GetParam obj, UpdateParam content, std::int64_t expected_version) {
+        return this->_pool.async([&pm = this->_pm, obj = std::move(obj), content = std::move(content), expected_version] { pm.update(obj, content, expected_version); });
+    }
+
+    AsyncResult<void> AsyncPasswordManagement::updateById(std::vector<std::int64_t> ids, UpdateParam content) {
+        return this->_pool.async([&pm = this->_pm, ids = std::move(ids), content = std::move(content)] { pm.updateById(ids, content); });
+    }
+
+    AsyncRowStream AsyncPasswordManagement::get(GetParam obj, std::vector<int> target_list, std::size_t capacity) {
+        auto queue = std::make_shared<BoundedQueue<SQLiteRow>>(capacity);
+        this->_pool.post([&pm = this->_pm, queue, obj = std::move(obj), target_list = std::move(target_list)] {
+            try {
+                for (auto e : pm.get(obj, target_list)) {
+                    if (!queue->push(SQLiteRow(e))) {
+                        // ストリームが破棄されたため読み取りを中断する
+                        return;
+                    }
+                }
+                queue->close();
+            }
+            catch (...) {
+                queue->close(std::current_exception());
+            }
+        });
+        return AsyncRowStream(std::move(queue));
+    }
+
+    AsyncResult<std::vector<std::optional<SQLiteRow>>> AsyncPasswordManagement::getByNames(std::vector<std::u8string> names, std::vector<int> target_list) {
+        return this->_pool.async([&pm = this->_pm, names = std::move(names), target_list = std::move(target_list)] {
+            std::vector<std::u8string_view> views(names.begin(), names.end());
+            return pm.getByNames(views, target_list);
+        });
+    }
+
+    AsyncResult<void> AsyncPasswordManagement::remove(GetParam obj) {
+        return this->_pool.async([&pm = this->_pm, obj = std::move(obj)] { pm.remove(obj); });
+    }
+
+    AsyncResult<void> AsyncPasswordManagement::removeById(std::vector<std::int64_t> ids) {
+        return this->_pool.async([&pm = this->_pm, ids = std::move(ids)] { pm.removeById(ids); });
+    }
+}
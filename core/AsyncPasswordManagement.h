@@ -0,0 +1,140 @@
+﻿#pragma once
+
+#include <memory>
+#include <optional>
+#include <vector>
+#include "AsyncResult.h"
+#include "BoundedQueue.h"
+#include "ThreadPool.h"
+#include "PasswordManagement.h"
+
+namespace pwm {
+
+	/// <summary>
+	/// 取得したパスワード情報を届いた順に1行ずつ受け取るためのストリーム
+	/// </summary>
+	/// <remarks>
+	/// 行はワーカスレッドで読み取られ、容量の上限までバッファされる。
+	/// ストリームを破棄すると読み取りは中断される。
+	/// </remarks>
+	class AsyncRowStream {
+		/// <summary>
+		/// 読み取った行を受け渡すキュー
+		/// </summary>
+		std::shared_ptr<BoundedQueue<SQLiteRow>> _queue;
+
+	public:
+		AsyncRowStream() = delete;
+		AsyncRowStream(std::shared_ptr<BoundedQueue<SQLiteRow>> queue) : _queue(std::move(queue)) {}
+		~AsyncRowStream();
+
+		/// <summary>
+		/// 次の行をco_awaitにより取得する
+		/// </summary>
+		/// <returns>co_awaitの結果は次の行(すべて読み取った場合はnullopt)</returns>
+		[[nodiscard]] auto next() { return this->_queue->popAsync(); }
+
+		/// <summary>
+		/// 次の行をスレッドをブロックして取得する
+		/// </summary>
+		/// <returns>次の行(すべて読み取った場合はnullopt)</returns>
+		[[nodiscard]] std::optional<SQLiteRow> nextSync() { return this->_queue->pop(); }
+
+		AsyncRowStream(AsyncRowStream&& x) noexcept = default;
+		AsyncRowStream& operator=(AsyncRowStream&& x) noexcept;
+
+		// コピーによる構築を禁止する
+		AsyncRowStream(const AsyncRowStream&) = delete;
+		AsyncRowStream& operator=(const AsyncRowStream&) = delete;
+	};
+
+	/// <summary>
+	/// パスワード管理の操作をワーカスレッドで非同期に実行するクラス
+	/// </summary>
+	/// <remarks>
+	/// 複数のワーカスレッドで並行に実行する場合はPasswordManagementをコネクションプールにより構築する。
+	/// co_awaitで待機したコルーチンは処理を完了させたワーカスレッドで再開される。
+	/// </remarks>
+	class AsyncPasswordManagement {
+		/// <summary>
+		/// パスワード管理を行うオブジェクト
+		/// </summary>
+		PasswordManagement& _pm;
+
+		/// <summary>
+		/// 処理を実行するスレッドプール
+		/// </summary>
+		ThreadPool& _pool;
+
+	public:
+		/// <summary>
+		/// ストリームがバッファする行数の既定の上限
+		/// </summary>
+		static constexpr std::size_t default_stream_capacity = 256;
+
+		AsyncPasswordManagement() = delete;
+		/// <summary>
+		/// 非同期に実行するためのオブジェクトを構築する
+		/// </summary>
+		/// <param name="pm">パスワード管理を行うオブジェクト(このオブジェクトより長く存在する必要がある)</param>
+		/// <param name="pool">処理を実行するスレッドプール(このオブジェクトより長く存在する必要がある)</param>
+		AsyncPasswordManagement(PasswordManagement& pm, ThreadPool& pool) : _pm(pm), _pool(pool) {}
+
+		/// <summary>
+		/// パスワード情報を挿入する
+		/// </summary>
+		/// <param name="obj">挿入情報</param>
+		[[nodiscard]] AsyncResult<void> insert(InsertParam obj);
+
+		/// <summary>
+		/// パスワード情報を更新する
+		/// </summary>
+		/// <param name="obj">更新条件</param>
+		/// <param name="content">更新内容</param>
+		[[nodiscard]] AsyncResult<void> update(GetParam obj, UpdateParam content);
+
+		/// <summary>
+		/// 行のバージョンが一致する場合にのみパスワード情報を更新する
+		/// </summary>
+		/// <param name="obj">更新条件</param>
+		/// <param name="content">更新内容</param>
+		/// <param name="expected_version">更新条件に該当する行に期待するバージョン</param>
+		[[nodiscard]] AsyncResult<void> update(GetParam obj, UpdateParam content, std::int64_t expected_version);
+
+		/// <summary>
+		/// 主キーを指定して複数のパスワード情報を1つのトランザクションで更新する
+		/// </summary>
+		/// <param name="ids">更新対象の主キーの一覧</param>
+		/// <param name="content">更新内容</param>
+		[[nodiscard]] AsyncResult<void> updateById(std::vector<std::int64_t> ids, UpdateParam content);
+
+		/// <summary>
+		/// パスワード情報を取得する
+		/// </summary>
+		/// <param name="obj">取得条件</param>
+		/// <param name="target_list">取得対象(passwordsのカラムに関連付けられたインデックス)</param>
+		/// <param name="capacity">バッファする行数の上限</param>
+		/// <returns>取得した行を届いた順に受け取るためのストリーム</returns>
+		[[nodiscard]] AsyncRowStream get(GetParam obj, std::vector<int> target_list, std::size_t capacity = default_stream_capacity);
+
+		/// <summary>
+		/// 名称を指定してパスワード情報をまとめて取得する
+		/// </summary>
+		/// <param name="names">名称の一覧</param>
+		/// <param name="target_list">取得対象(passwordsのカラムに関連付けられたインデックス)</param>
+		/// <returns>namesと同じ順序の取得結果(該当するパスワード情報が存在しなければnullopt)</returns>
+		[[nodiscard]] AsyncResult<std::vector<std::optional<SQLiteRow>>> getByNames(std::vector<std::u8string> names, std::vector<int> target_list);
+
+		/// <summary>
+		/// パスワード情報を削除する
+		/// </summary>
+		/// <param name="obj">削除条件</param>
+		[[nodiscard]] AsyncResult<void> remove(GetParam obj);
+
+		/// <summary>
+		/// 主キーを指定して複数のパスワード情報を1つのトランザクションで削除する
+		/// </summary>
+		/// <param name="ids">削除対象の主キーの一覧</param>
+		[[nodiscard]] AsyncResult<void> removeById(std::vector<std::int64_t> ids);
+	};
+}
@@ -0,0 +1,155 @@
+﻿#pragma once
+
+#include <coroutine>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+/// <summary>
+/// 非同期処理の結果を受け渡すための共有状態
+/// </summary>
+template <class T>
+struct AsyncState {
+	/// <summary>
+	/// 保持する値の型(voidはstd::monostateで代用する)
+	/// </summary>
+	using value_type = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+	std::mutex mutex;
+	std::condition_variable cv;
+	/// <summary>
+	/// 処理の結果
+	/// </summary>
+	std::optional<value_type> value;
+	/// <summary>
+	/// 処理中に送出された例外
+	/// </summary>
+	std::exception_ptr error;
+	/// <summary>
+	/// 処理が完了したか
+	/// </summary>
+	bool ready = false;
+	/// <summary>
+	/// 完了を待機しているコルーチン
+	/// </summary>
+	std::coroutine_handle<> waiter;
+
+	/// <summary>
+	/// 処理を完了させて待機しているスレッドおよびコルーチンを再開する
+	/// </summary>
+	template <class F>
+	void finish(F&& set) {
+		std::coroutine_handle<> h;
+		{
+			std::lock_guard lock(this->mutex);
+			set();
+			this->ready = true;
+			h = std::exchange(this->waiter, nullptr);
+		}
+		this->cv.notify_all();
+		// コルーチンは完了させたスレッドで再開する
+		if (h) {
+			h.resume();
+		}
+	}
+};
+
+/// <summary>
+/// 非同期処理の結果を表すクラス
+/// </summary>
+/// <remarks>
+/// co_awaitにより待機するかgetによりスレッドをブロックして待機する。
+/// 結果の取り出しは1度のみ可能である(std::futureと同様)。
+/// </remarks>
+template <class T>
+class AsyncResult {
+	/// <summary>
+	/// 非同期処理の結果を受け渡すための共有状態
+	/// </summary>
+	std::shared_ptr<AsyncState<T>> _state;
+
+	/// <summary>
+	/// 完了した処理の結果を取り出す
+	/// </summary>
+	T take() {
+		if (this->_state->error) {
+			std::rethrow_exception(this->_state->error);
+		}
+		if constexpr (!std::is_void_v<T>) {
+			return std::move(this->_state->value.value());
+		}
+	}
+
+public:
+	AsyncResult() = delete;
+	AsyncResult(std::shared_ptr<AsyncState<T>> state) : _state(std::move(state)) {}
+
+	/// <summary>
+	/// 処理が完了しているかを判定する
+	/// </summary>
+	[[nodiscard]] bool ready() const {
+		std::lock_guard lock(this->_state->mutex);
+		return this->_state->ready;
+	}
+
+	/// <summary>
+	/// 処理が完了するまでスレッドをブロックして結果を取得する
+	/// </summary>
+	/// <returns>処理の結果(処理中に例外が送出された場合は再送出する)</returns>
+	T get() {
+		{
+			std::unique_lock lock(this->_state->mutex);
+			this->_state->cv.wait(lock, [this] { return this->_state->ready; });
+		}
+		return this->take();
+	}
+
+	bool await_ready() const { return this->ready(); }
+	bool await_suspend(std::coroutine_handle<> h) {
+		std::lock_guard lock(this->_state->mutex);
+		if (this->_state->ready) {
+			// 待機を登録する前に完了した場合は中断せずに再開する
+			return false;
+		}
+		this->_state->waiter = h;
+		return true;
+	}
+	T await_resume() { return this->take(); }
+};
+
+/// <summary>
+/// 非同期処理の結果を設定するためのクラス
+/// </summary>
+template <class T>
+class AsyncPromise {
+	/// <summary>
+	/// 非同期処理の結果を受け渡すための共有状態
+	/// </summary>
+	std::shared_ptr<AsyncState<T>> _state = std::make_shared<AsyncState<T>>();
+
+public:
+	/// <summary>
+	/// 結果を受け取るためのオブジェクトを取得する
+	/// </summary>
+	[[nodiscard]] AsyncResult<T> result() const { return AsyncResult<T>(this->_state); }
+
+	/// <summary>
+	/// 結果を設定して処理を完了させる
+	/// </summary>
+	template <class... Args>
+	void setValue(Args&&... args) {
+		this->_state->finish([&] { this->_state->value.emplace(std::forward<Args>(args)...); });
+	}
+
+	/// <summary>
+	/// 例外を設定して処理を完了させる
+	/// </summary>
+	void setException(std::exception_ptr error) {
+		this->_state->finish([&] { this->_state->error = std::move(error); });
+	}
+};
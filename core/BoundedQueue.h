@@ -0,0 +1,227 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <coroutine>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+
+/// <summary>
+/// BoundedQueueの混み具合に関する統計
+/// </summary>
+struct BoundedQueueStats {
+	/// <summary>
+	/// 追加した要素数
+	/// </summary>
+	std::uint64_t pushes = 0;
+	/// <summary>
+	/// 取り出した要素数
+	/// </summary>
+	std::uint64_t pops = 0;
+	/// <summary>
+	/// 格納されていた要素数の最大値
+	/// </summary>
+	std::size_t max_depth = 0;
+	/// <summary>
+	/// 取り出す直前に格納されていた要素数の合計
+	/// </summary>
+	std::uint64_t depth_sum = 0;
+	/// <summary>
+	/// 満杯のためにpushが待機した回数
+	/// </summary>
+	std::uint64_t full_waits = 0;
+	/// <summary>
+	/// 空のためにpopが待機した回数
+	/// </summary>
+	std::uint64_t empty_waits = 0;
+
+	/// <summary>
+	/// 取り出す直前に格納されていた要素数の平均
+	/// </summary>
+	[[nodiscard]] double meanDepth() const noexcept { return this->pops == 0 ? 0.0 : static_cast<double>(this->depth_sum) / static_cast<double>(this->pops); }
+};
+
+/// <summary>
+/// 容量に上限のあるスレッド安全なキュー
+/// </summary>
+/// <remarks>
+/// 満杯の間はpushが、空の間はpopが待機する。
+/// popAsyncによりco_awaitで待機できるが、同時に待機できるコルーチンは1つのみである。
+/// </remarks>
+template <class T>
+class BoundedQueue {
+	std::mutex _mutex;
+	std::condition_variable _not_full;
+	std::condition_variable _not_empty;
+	/// <summary>
+	/// 格納されている要素
+	/// </summary>
+	std::deque<T> _queue;
+	/// <summary>
+	/// 格納できる要素数の上限
+	/// </summary>
+	std::size_t _capacity;
+	/// <summary>
+	/// 閉じられたか
+	/// </summary>
+	bool _closed = false;
+	/// <summary>
+	/// 供給側で発生した例外(要素をすべて取り出した後に送出する)
+	/// </summary>
+	std::exception_ptr _error;
+	/// <summary>
+	/// 要素を待機しているコルーチン
+	/// </summary>
+	std::coroutine_handle<> _waiter;
+	/// <summary>
+	/// 混み具合に関する統計
+	/// </summary>
+	BoundedQueueStats _stats;
+
+	/// <summary>
+	/// 要素が取り出せる状態であるか(ロックを取得した状態で呼び出す)
+	/// </summary>
+	bool readable() const noexcept { return !this->_queue.empty() || this->_closed; }
+
+	/// <summary>
+	/// 先頭の要素を取り出す(ロックを取得した状態で呼び出す)
+	/// </summary>
+	std::optional<T> take() {
+		if (this->_queue.empty()) {
+			if (this->_error) {
+				std::rethrow_exception(this->_error);
+			}
+			return std::nullopt;
+		}
+		++this->_stats.pops;
+		this->_stats.depth_sum += this->_queue.size();
+		std::optional<T> result(std::move(this->_queue.front()));
+		this->_queue.pop_front();
+		this->_not_full.notify_one();
+		return result;
+	}
+
+public:
+	BoundedQueue() = delete;
+	/// <summary>
+	/// キューを構築する
+	/// </summary>
+	/// <param name="capacity">格納できる要素数の上限</param>
+	BoundedQueue(std::size_t capacity) : _capacity(capacity) {
+		if (capacity == 0) {
+			throw std::invalid_argument("キューの容量は1以上である必要があります");
+		}
+	}
+
+	/// <summary>
+	/// 要素を追加する(満杯の間は待機する)
+	/// </summary>
+	/// <param name="value">追加する要素</param>
+	/// <returns>キューが閉じられていて追加できなければfalse</returns>
+	bool push(T value) {
+		std::coroutine_handle<> h;
+		{
+			std::unique_lock lock(this->_mutex);
+			if (this->_queue.size() >= this->_capacity && !this->_closed) {
+				++this->_stats.full_waits;
+			}
+			this->_not_full.wait(lock, [this] { return this->_queue.size() < this->_capacity || this->_closed; });
+			if (this->_closed) {
+				return false;
+			}
+			this->_queue.push_back(std::move(value));
+			++this->_stats.pushes;
+			this->_stats.max_depth = std::max(this->_stats.max_depth, this->_queue.size());
+			h = std::exchange(this->_waiter, nullptr);
+		}
+		this->_not_empty.notify_one();
+		if (h) {
+			h.resume();
+		}
+		return true;
+	}
+
+	/// <summary>
+	/// 先頭の要素を取り出す(空の間は待機する)
+	/// </summary>
+	/// <returns>取り出した要素(閉じられていて空であればnullopt)</returns>
+	std::optional<T> pop() {
+		std::unique_lock lock(this->_mutex);
+		if (!this->readable()) {
+			++this->_stats.empty_waits;
+		}
+		this->_not_empty.wait(lock, [this] { return this->readable(); });
+		return this->take();
+	}
+
+	/// <summary>
+	/// 先頭の要素をco_awaitにより取り出すためのAwaiter
+	/// </summary>
+	struct PopAwaiter {
+		BoundedQueue& queue;
+
+		bool await_ready() {
+			std::lock_guard lock(this->queue._mutex);
+			return this->queue.readable();
+		}
+		bool await_suspend(std::coroutine_handle<> h) {
+			std::lock_guard lock(this->queue._mutex);
+			if (this->queue.readable()) {
+				return false;
+			}
+			++this->queue._stats.empty_waits;
+			this->queue._waiter = h;
+			return true;
+		}
+		std::optional<T> await_resume() {
+			std::lock_guard lock(this->queue._mutex);
+			return this->queue.take();
+		}
+	};
+
+	/// <summary>
+	/// 先頭の要素をco_awaitにより取り出す
+	/// </summary>
+	/// <returns>co_awaitの結果は取り出した要素(閉じられていて空であればnullopt)</returns>
+	[[nodiscard]] PopAwaiter popAsync() { return PopAwaiter{ *this }; }
+
+	/// <summary>
+	/// キューを閉じる(格納済みの要素は引き続き取り出せる)
+	/// </summary>
+	/// <param name="error">供給側で発生した例外(要素をすべて取り出した後に送出する)</param>
+	void close(std::exception_ptr error = nullptr) {
+		std::coroutine_handle<> h;
+		{
+			std::lock_guard lock(this->_mutex);
+			if (this->_closed) {
+				return;
+			}
+			this->_closed = true;
+			this->_error = std::move(error);
+			h = std::exchange(this->_waiter, nullptr);
+		}
+		this->_not_full.notify_all();
+		this->_not_empty.notify_all();
+		if (h) {
+			h.resume();
+		}
+	}
+
+	/// <summary>
+	/// 混み具合に関する統計を取得する
+	/// </summary>
+	[[nodiscard]] BoundedQueueStats stats() {
+		std::lock_guard lock(this->_mutex);
+		return this->_stats;
+	}
+
+	// コピーによる構築を禁止する
+	BoundedQueue(const BoundedQueue&) = delete;
+	BoundedQueue& operator=(const BoundedQueue&) = delete;
+};
@@ -0,0 +1,468 @@
+﻿#include "ChaCha20Poly1305.h"
+#include "CpuFeatures.h"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#if defined(_MSC_VER)
+#include <windows.h>
+#endif
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#define PWM_CHACHA_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#define PWM_TARGET_SSE2
+#define PWM_TARGET_AVX2
+#else
+#define PWM_TARGET_SSE2 __attribute__((target("sse2")))
+#define PWM_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace {
+
+    /// <summary>
+    /// 1ブロックのバイト数
+    /// </summary>
+    constexpr std::size_t block_size = 64;
+
+    /// <summary>
+    /// 状態の先頭の定数("expand 32-byte k")
+    /// </summary>
+    constexpr std::uint32_t sigma[4] = { 0x61707865, 0x3320646e, 0x79622d32, 0x6b206574 };
+
+    /// <summary>
+    /// リトルエンディアンの32ビット整数を読み取る
+    /// </summary>
+    std::uint32_t loadLe32(const std::byte* p) noexcept {
+        return std::to_integer<std::uint32_t>(p[0]) | (std::to_integer<std::uint32_t>(p[1]) << 8)
+            | (std::to_integer<std::uint32_t>(p[2]) << 16) | (std::to_integer<std::uint32_t>(p[3]) << 24);
+    }
+
+    /// <summary>
+    /// リトルエンディアンの32ビット整数を書き込む
+    /// </summary>
+    void storeLe32(std::byte* p, std::uint32_t x) noexcept {
+        p[0] = static_cast<std::byte>(x);
+        p[1] = static_cast<std::byte>(x >> 8);
+        p[2] = static_cast<std::byte>(x >> 16);
+        p[3] = static_cast<std::byte>(x >> 24);
+    }
+
+    /// <summary>
+    /// 最適化により省かれないように領域を0で埋める
+    /// </summary>
+    void secureZero(void* p, std::size_t size) noexcept {
+#if defined(_MSC_VER)
+        SecureZeroMemory(p, size);
+#else
+        std::memset(p, 0, size);
+        // 書き込んだ領域が参照されるものとしてコンパイラに扱わせる
+        __asm__ __volatile__("" : : "r"(p) : "memory");
+#endif
+    }
+
+    /// <summary>
+    /// 鍵、カウンタ、nonceから初期状態を構築する
+    /// </summary>
+    void initState(std::uint32_t (&state)[16], const ChaCha20Poly1305::key_type& key, const ChaCha20Poly1305::nonce_type& nonce, std::uint32_t counter) noexcept {
+        std::copy(std::begin(sigma), std::end(sigma), state);
+        for (int i = 0; i < 8; ++i) {
+            state[4 + i] = loadLe32(key.data() + i * 4);
+        }
+        state[12] = counter;
+        for (int i = 0; i < 3; ++i) {
+            state[13 + i] = loadLe32(nonce.data() + i * 4);
+        }
+    }
+
+    // 4つの語に対するquarter round(加算、排他的論理和、回転の組み合わせを型ごとに与える)
+#define PWM_CHACHA_QR(a, b, c, d) \
+    a = add(a, b); d = rotl<16>(xor_(d, a)); \
+    c = add(c, d); b = rotl<12>(xor_(b, c)); \
+    a = add(a, b); d = rotl<8>(xor_(d, a)); \
+    c = add(c, d); b = rotl<7>(xor_(b, c));
+
+    // 列と対角線に対するquarter roundを交互に10回ずつ行う
+#define PWM_CHACHA_ROUNDS(x) \
+    for (int round = 0; round < 10; ++round) { \
+        PWM_CHACHA_QR(x[0], x[4], x[8], x[12]) \
+        PWM_CHACHA_QR(x[1], x[5], x[9], x[13]) \
+        PWM_CHACHA_QR(x[2], x[6], x[10], x[14]) \
+        PWM_CHACHA_QR(x[3], x[7], x[11], x[15]) \
+        PWM_CHACHA_QR(x[0], x[5], x[10], x[15]) \
+        PWM_CHACHA_QR(x[1], x[6], x[11], x[12]) \
+        PWM_CHACHA_QR(x[2], x[7], x[8], x[13]) \
+        PWM_CHACHA_QR(x[3], x[4], x[9], x[14]) \
+    }
+
+    namespace scalar {
+        inline std::uint32_t add(std::uint32_t a, std::uint32_t b) noexcept { return a + b; }
+        inline std::uint32_t xor_(std::uint32_t a, std::uint32_t b) noexcept { return a ^ b; }
+        template <int N>
+        inline std::uint32_t rotl(std::uint32_t x) noexcept { return std::rotl(x, N); }
+
+        /// <summary>
+        /// 1ブロック分の鍵ストリームを生成する
+        /// </summary>
+        void block(const std::uint32_t (&state)[16], std::byte* out) noexcept {
+            std::uint32_t x[16];
+            std::copy(std::begin(state), std::end(state), x);
+            PWM_CHACHA_ROUNDS(x)
+            for (int i = 0; i < 16; ++i) {
+                storeLe32(out + i * 4, x[i] + state[i]);
+            }
+        }
+    }
+
+#if defined(PWM_CHACHA_X86)
+    namespace sse2 {
+        PWM_TARGET_SSE2 inline __m128i add(__m128i a, __m128i b) noexcept { return _mm_add_epi32(a, b); }
+        PWM_TARGET_SSE2 inline __m128i xor_(__m128i a, __m128i b) noexcept { return _mm_xor_si128(a, b); }
+        template <int N>
+        PWM_TARGET_SSE2 inline __m128i rotl(__m128i x) noexcept { return _mm_or_si128(_mm_slli_epi32(x, N), _mm_srli_epi32(x, 32 - N)); }
+
+        /// <summary>
+        /// 4x4の語を転置し、ブロックごとに入力との排他的論理和を書き込む
+        /// </summary>
+        PWM_TARGET_SSE2 inline void xorTransposed(__m128i a, __m128i b, __m128i c, __m128i d, const std::byte* in, std::byte* out) noexcept {
+            auto t0 = _mm_unpacklo_epi32(a, b);
+            auto t1 = _mm_unpacklo_epi32(c, d);
+            auto t2 = _mm_unpackhi_epi32(a, b);
+            auto t3 = _mm_unpackhi_epi32(c, d);
+            const __m128i rows[4] = { _mm_unpacklo_epi64(t0, t1), _mm_unpackhi_epi64(t0, t1), _mm_unpacklo_epi64(t2, t3), _mm_unpackhi_epi64(t2, t3) };
+            for (std::size_t r = 0; r < 4; ++r) {
+                auto p = reinterpret_cast<const __m128i*>(in + r * block_size);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + r * block_size), _mm_xor_si128(_mm_loadu_si128(p), rows[r]));
+            }
+        }
+
+        /// <summary>
+        /// 連続する4ブロック分の鍵ストリームと入力との排他的論理和を書き込む(各レジスタは4ブロックの同じ語を保持する)
+        /// </summary>
+        PWM_TARGET_SSE2 void xorBlocks(const std::uint32_t (&state)[16], const std::byte* in, std::byte* out) noexcept {
+            __m128i x[16];
+            __m128i origin[16];
+            for (int i = 0; i < 16; ++i) {
+                origin[i] = _mm_set1_epi32(static_cast<int>(state[i]));
+            }
+            origin[12] = _mm_add_epi32(origin[12], _mm_setr_epi32(0, 1, 2, 3));
+            std::copy(std::begin(origin), std::end(origin), x);
+            PWM_CHACHA_ROUNDS(x)
+            for (int i = 0; i < 16; ++i) {
+                x[i] = _mm_add_epi32(x[i], origin[i]);
+            }
+            // 4語ずつ転置すると各ブロックの16バイトずつが得られる
+            for (std::size_t i = 0; i < 16; i += 4) {
+                xorTransposed(x[i], x[i + 1], x[i + 2], x[i + 3], in + i * 4, out + i * 4);
+            }
+        }
+    }
+
+    namespace avx2 {
+        PWM_TARGET_AVX2 inline __m256i add(__m256i a, __m256i b) noexcept { return _mm256_add_epi32(a, b); }
+        PWM_TARGET_AVX2 inline __m256i xor_(__m256i a, __m256i b) noexcept { return _mm256_xor_si256(a, b); }
+        template <int N>
+        PWM_TARGET_AVX2 inline __m256i rotl(__m256i x) noexcept { return _mm256_or_si256(_mm256_slli_epi32(x, N), _mm256_srli_epi32(x, 32 - N)); }
+
+        /// <summary>
+        /// 連続する8ブロック分の鍵ストリームと入力との排他的論理和を書き込む(各レジスタは8ブロックの同じ語を保持する)
+        /// </summary>
+        PWM_TARGET_AVX2 void xorBlocks(const std::uint32_t (&state)[16], const std::byte* in, std::byte* out) noexcept {
+            __m256i x[16];
+            __m256i origin[16];
+            for (int i = 0; i < 16; ++i) {
+                origin[i] = _mm256_set1_epi32(static_cast<int>(state[i]));
+            }
+            origin[12] = _mm256_add_epi32(origin[12], _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+            std::copy(std::begin(origin), std::end(origin), x);
+            PWM_CHACHA_ROUNDS(x)
+            for (int i = 0; i < 16; ++i) {
+                x[i] = _mm256_add_epi32(x[i], origin[i]);
+            }
+            // 128ビットの単位ごとに4語ずつ転置すると、下位は前半の4ブロック、上位は後半の4ブロックの16バイトずつが得られる
+            for (std::size_t i = 0; i < 16; i += 4) {
+                auto t0 = _mm256_unpacklo_epi32(x[i], x[i + 1]);
+                auto t1 = _mm256_unpacklo_epi32(x[i + 2], x[i + 3]);
+                auto t2 = _mm256_unpackhi_epi32(x[i], x[i + 1]);
+                auto t3 = _mm256_unpackhi_epi32(x[i + 2], x[i + 3]);
+                const __m256i rows[4] = { _mm256_unpacklo_epi64(t0, t1), _mm256_unpackhi_epi64(t0, t1), _mm256_unpacklo_epi64(t2, t3), _mm256_unpackhi_epi64(t2, t3) };
+                for (std::size_t r = 0; r < 4; ++r) {
+                    for (std::size_t half = 0; half < 2; ++half) {
+                        auto offset = (r + half * 4) * block_size + i * 4;
+                        auto lane = half == 0 ? _mm256_castsi256_si128(rows[r]) : _mm256_extracti128_si256(rows[r], 1);
+                        auto p = reinterpret_cast<const __m128i*>(in + offset);
+                        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + offset), _mm_xor_si128(_mm_loadu_si128(p), lane));
+                    }
+                }
+            }
+        }
+    }
+#endif
+
+#undef PWM_CHACHA_ROUNDS
+#undef PWM_CHACHA_QR
+
+    /// <summary>
+    /// Poly1305(RFC 8439)によるメッセージ認証符号を逐次的に計算するクラス
+    /// </summary>
+    /// <remarks>
+    /// 130ビットの値を26ビットずつ5つの語で保持し、64ビットの乗算のみで計算する
+    /// </remarks>
+    class Poly1305 {
+        std::uint32_t _r[5];
+        std::uint32_t _h[5] = {};
+        std::uint32_t _pad[4];
+        std::byte _buf[16];
+        std::size_t _size = 0;
+
+        /// <summary>
+        /// 16バイトのブロックを累積する
+        /// </summary>
+        /// <param name="hibit">ブロックの末尾に付す1のビット(端数のブロックであれば0)</param>
+        void blocks(const std::byte* m, std::size_t bytes, std::uint32_t hibit) noexcept {
+            constexpr std::uint32_t mask = 0x3ffffff;
+            const std::uint64_t r0 = this->_r[0], r1 = this->_r[1], r2 = this->_r[2], r3 = this->_r[3], r4 = this->_r[4];
+            const std::uint64_t s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+            std::uint64_t h0 = this->_h[0], h1 = this->_h[1], h2 = this->_h[2], h3 = this->_h[3], h4 = this->_h[4];
+            for (; bytes >= 16; m += 16, bytes -= 16) {
+                h0 += loadLe32(m) & mask;
+                h1 += (loadLe32(m + 3) >> 2) & mask;
+                h2 += (loadLe32(m + 6) >> 4) & mask;
+                h3 += (loadLe32(m + 9) >> 6) & mask;
+                h4 += (loadLe32(m + 12) >> 8) | hibit;
+
+                // h *= r (mod 2^130-5)
+                std::uint64_t d0 = h0 * r0 + h1 * s4 + h2 * s3 + h3 * s2 + h4 * s1;
+                std::uint64_t d1 = h0 * r1 + h1 * r0 + h2 * s4 + h3 * s3 + h4 * s2;
+                std::uint64_t d2 = h0 * r2 + h1 * r1 + h2 * r0 + h3 * s4 + h4 * s3;
+                std::uint64_t d3 = h0 * r3 + h1 * r2 + h2 * r1 + h3 * r0 + h4 * s4;
+                std::uint64_t d4 = h0 * r4 + h1 * r3 + h2 * r2 + h3 * r1 + h4 * r0;
+
+                // 桁上げ
+                std::uint64_t c = d0 >> 26; h0 = d0 & mask;
+                d1 += c; c = d1 >> 26; h1 = d1 & mask;
+                d2 += c; c = d2 >> 26; h2 = d2 & mask;
+                d3 += c; c = d3 >> 26; h3 = d3 & mask;
+                d4 += c; c = d4 >> 26; h4 = d4 & mask;
+                h0 += c * 5; c = h0 >> 26; h0 &= mask;
+                h1 += c;
+            }
+            this->_h[0] = static_cast<std::uint32_t>(h0);
+            this->_h[1] = static_cast<std::uint32_t>(h1);
+            this->_h[2] = static_cast<std::uint32_t>(h2);
+            this->_h[3] = static_cast<std::uint32_t>(h3);
+            this->_h[4] = static_cast<std::uint32_t>(h4);
+        }
+
+    public:
+        /// <summary>
+        /// 32バイトの使い捨ての鍵から構築する
+        /// </summary>
+        explicit Poly1305(const std::byte* key) noexcept {
+            // rの一部のビットを0とする(clamp)
+            this->_r[0] = loadLe32(key) & 0x3ffffff;
+            this->_r[1] = (loadLe32(key + 3) >> 2) & 0x3ffff03;
+            this->_r[2] = (loadLe32(key + 6) >> 4) & 0x3ffc0ff;
+            this->_r[3] = (loadLe32(key + 9) >> 6) & 0x3f03fff;
+            this->_r[4] = (loadLe32(key + 12) >> 8) & 0x00fffff;
+            for (int i = 0; i < 4; ++i) {
+                this->_pad[i] = loadLe32(key + 16 + i * 4);
+            }
+        }
+        ~Poly1305() {
+            secureZero(this, sizeof(*this));
+        }
+
+        /// <summary>
+        /// データを入力する
+        /// </summary>
+        void update(std::span<const std::byte> data) noexcept {
+            if (this->_size != 0) {
+                auto n = std::min(data.size(), sizeof(this->_buf) - this->_size);
+                std::memcpy(this->_buf + this->_size, data.data(), n);
+                this->_size += n;
+                data = data.subspan(n);
+                if (this->_size < sizeof(this->_buf)) {
+                    return;
+                }
+                this->blocks(this->_buf, sizeof(this->_buf), 1u << 24);
+                this->_size = 0;
+            }
+            auto whole = data.size() & ~std::size_t(15);
+            this->blocks(data.data(), whole, 1u << 24);
+            std::memcpy(this->_buf, data.data() + whole, data.size() - whole);
+            this->_size = data.size() - whole;
+        }
+
+        /// <summary>
+        /// 16バイトの境界まで0を入力する
+        /// </summary>
+        void pad() noexcept {
+            if (this->_size != 0) {
+                std::memset(this->_buf + this->_size, 0, sizeof(this->_buf) - this->_size);
+                this->blocks(this->_buf, sizeof(this->_buf), 1u << 24);
+                this->_size = 0;
+            }
+        }
+
+        /// <summary>
+        /// 入力を終えて認証タグを取得する
+        /// </summary>
+        ChaCha20Poly1305::tag_type finish() noexcept {
+            constexpr std::uint32_t mask = 0x3ffffff;
+            if (this->_size != 0) {
+                // 端数は1のバイトを付して0で埋める
+                this->_buf[this->_size] = std::byte{ 1 };
+                std::memset(this->_buf + this->_size + 1, 0, sizeof(this->_buf) - this->_size - 1);
+                this->blocks(this->_buf, sizeof(this->_buf), 0);
+            }
+
+            // 桁上げを完了する
+            std::uint32_t h0 = this->_h[0], h1 = this->_h[1], h2 = this->_h[2], h3 = this->_h[3], h4 = this->_h[4];
+            std::uint32_t c = h1 >> 26; h1 &= mask;
+            h2 += c; c = h2 >> 26; h2 &= mask;
+            h3 += c; c = h3 >> 26; h3 &= mask;
+            h4 += c; c = h4 >> 26; h4 &= mask;
+            h0 += c * 5; c = h0 >> 26; h0 &= mask;
+            h1 += c;
+
+            // h - p を計算し、負でなければそちらを採用する(分岐せずに選択する)
+            std::uint32_t g0 = h0 + 5; c = g0 >> 26; g0 &= mask;
+            std::uint32_t g1 = h1 + c; c = g1 >> 26; g1 &= mask;
+            std::uint32_t g2 = h2 + c; c = g2 >> 26; g2 &= mask;
+            std::uint32_t g3 = h3 + c; c = g3 >> 26; g3 &= mask;
+            std::uint32_t g4 = h4 + c - (1u << 26);
+            std::uint32_t select = (g4 >> 31) - 1;
+            h0 = (h0 & ~select) | (g0 & select);
+            h1 = (h1 & ~select) | (g1 & select);
+            h2 = (h2 & ~select) | (g2 & select);
+            h3 = (h3 & ~select) | (g3 & select);
+            h4 = (h4 & ~select) | (g4 & select);
+
+            // 128ビットへ詰め直してpadを加える
+            std::uint32_t w0 = h0 | (h1 << 26);
+            std::uint32_t w1 = (h1 >> 6) | (h2 << 20);
+            std::uint32_t w2 = (h2 >> 12) | (h3 << 14);
+            std::uint32_t w3 = (h3 >> 18) | (h4 << 8);
+            std::uint64_t f = std::uint64_t(w0) + this->_pad[0];
+            w0 = static_cast<std::uint32_t>(f);
+            f = std::uint64_t(w1) + this->_pad[1] + (f >> 32);
+            w1 = static_cast<std::uint32_t>(f);
+            f = std::uint64_t(w2) + this->_pad[2] + (f >> 32);
+            w2 = static_cast<std::uint32_t>(f);
+            f = std::uint64_t(w3) + this->_pad[3] + (f >> 32);
+            w3 = static_cast<std::uint32_t>(f);
+
+            ChaCha20Poly1305::tag_type tag;
+            storeLe32(tag.data(), w0);
+            storeLe32(tag.data() + 4, w1);
+            storeLe32(tag.data() + 8, w2);
+            storeLe32(tag.data() + 12, w3);
+            return tag;
+        }
+    };
+
+    /// <summary>
+    /// 追加データと暗号文の認証タグを計算する
+    /// </summary>
+    ChaCha20Poly1305::tag_type computeTag(const ChaCha20Poly1305::key_type& key, const ChaCha20Poly1305::nonce_type& nonce,
+        std::span<const std::byte> aad, std::span<const std::byte> ciphertext, ChaChaMode mode) noexcept {
+        // カウンタ0の鍵ストリームの先頭32バイトをPoly1305の鍵とする
+        std::byte poly_key[block_size] = {};
+        chacha20Xor(key, nonce, 0, std::span<const std::byte>(poly_key), std::span<std::byte>(poly_key), mode);
+        Poly1305 mac(poly_key);
+        secureZero(poly_key, sizeof(poly_key));
+
+        mac.update(aad);
+        mac.pad();
+        mac.update(ciphertext);
+        mac.pad();
+        std::byte lengths[16];
+        for (int i = 0; i < 8; ++i) {
+            lengths[i] = static_cast<std::byte>(static_cast<std::uint64_t>(aad.size()) >> (i * 8));
+            lengths[8 + i] = static_cast<std::byte>(static_cast<std::uint64_t>(ciphertext.size()) >> (i * 8));
+        }
+        mac.update(lengths);
+        return mac.finish();
+    }
+}
+
+ChaChaMode bestChaChaMode() noexcept {
+#if defined(PWM_CHACHA_X86)
+    const auto& cpu = CpuFeatures::current();
+    return cpu.avx2 ? ChaChaMode::avx2 : cpu.sse2 ? ChaChaMode::sse2 : ChaChaMode::scalar;
+#else
+    return ChaChaMode::scalar;
+#endif
+}
+
+void chacha20Xor(const ChaCha20Poly1305::key_type& key, const ChaCha20Poly1305::nonce_type& nonce, std::uint32_t counter,
+    std::span<const std::byte> in, std::span<std::byte> out, ChaChaMode mode) noexcept {
+    static const ChaChaMode best = bestChaChaMode();
+    if (mode == ChaChaMode::automatic || mode > best) {
+        mode = best;
+    }
+    std::uint32_t state[16];
+    initState(state, key, nonce, counter);
+    std::size_t offset = 0;
+#if defined(PWM_CHACHA_X86)
+    // 複数のブロックを同時に生成できる長さはベクトル化した実装で処理する
+    if (mode == ChaChaMode::avx2) {
+        for (; in.size() - offset >= block_size * 8; offset += block_size * 8, state[12] += 8) {
+            avx2::xorBlocks(state, in.data() + offset, out.data() + offset);
+        }
+    }
+    if (mode >= ChaChaMode::sse2) {
+        for (; in.size() - offset >= block_size * 4; offset += block_size * 4, state[12] += 4) {
+            sse2::xorBlocks(state, in.data() + offset, out.data() + offset);
+        }
+    }
+#endif
+    if (offset < in.size()) {
+        std::byte stream[block_size];
+        for (; offset < in.size(); ++state[12]) {
+            scalar::block(state, stream);
+            auto n = std::min(block_size, in.size() - offset);
+            std::size_t i = 0;
+            for (; i + 8 <= n; i += 8) {
+                std::uint64_t x, k;
+                std::memcpy(&x, in.data() + offset + i, 8);
+                std::memcpy(&k, stream + i, 8);
+                x ^= k;
+                std::memcpy(out.data() + offset + i, &x, 8);
+            }
+            for (; i < n; ++i) {
+                out[offset + i] = in[offset + i] ^ stream[i];
+            }
+            offset += n;
+        }
+        secureZero(stream, sizeof(stream));
+    }
+    secureZero(state, sizeof(state));
+}
+
+ChaCha20Poly1305::ChaCha20Poly1305(const key_type& key, ChaChaMode mode) noexcept : _key(key), _mode(mode) {}
+
+ChaCha20Poly1305::~ChaCha20Poly1305() {
+    secureZero(this->_key.data(), this->_key.size());
+}
+
+void ChaCha20Poly1305::seal(const nonce_type& nonce, std::span<const std::byte> aad, std::span<const std::byte> plaintext, std::span<std::byte> ciphertext, tag_type& tag) const noexcept {
+    // 暗号化にはカウンタ1以降の鍵ストリームを用いる
+    chacha20Xor(this->_key, nonce, 1, plaintext, ciphertext, this->_mode);
+    tag = computeTag(this->_key, nonce, aad, ciphertext.first(plaintext.size()), this->_mode);
+}
+
+bool ChaCha20Poly1305::open(const nonce_type& nonce, std::span<const std::byte> aad, std::span<const std::byte> ciphertext, const tag_type& tag, std::span<std::byte> plaintext) const noexcept {
+    auto expected = computeTag(this->_key, nonce, aad, ciphertext, this->_mode);
+    // 一致するバイト数から時間差が生じないようにすべてのバイトを比較する
+    std::byte diff{ 0 };
+    for (std::size_t i = 0; i < tag.size(); ++i) {
+        diff |= expected[i] ^ tag[i];
+    }
+    if (diff != std::byte{ 0 }) {
+        return false;
+    }
+    chacha20Xor(this->_key, nonce, 1, ciphertext, plaintext, this->_mode);
+    return true;
+}
@@ -0,0 +1,109 @@
+﻿#pragma once
+
+#include <array>
+#include <span>
+#include <cstddef>
+#include <cstdint>
+
+/// <summary>
+/// ChaCha20の鍵ストリームの生成に用いる命令セットの列挙
+/// </summary>
+enum class ChaChaMode {
+	/// <summary>
+	/// 実行環境で利用可能な最速の命令セット
+	/// </summary>
+	automatic,
+	/// <summary>
+	/// 1ブロック(64バイト)ずつ生成する(比較の基準)
+	/// </summary>
+	scalar,
+	/// <summary>
+	/// SSE2により4ブロックずつ生成する
+	/// </summary>
+	sse2,
+	/// <summary>
+	/// AVX2により8ブロックずつ生成する
+	/// </summary>
+	avx2
+};
+
+/// <summary>
+/// ChaCha20-Poly1305(RFC 8439)による認証付き暗号
+/// </summary>
+/// <remarks>
+/// 同じ鍵に対して同じnonceを2度用いてはならない
+/// </remarks>
+class ChaCha20Poly1305 {
+public:
+	/// <summary>
+	/// 鍵の型
+	/// </summary>
+	using key_type = std::array<std::byte, 32>;
+	/// <summary>
+	/// nonceの型
+	/// </summary>
+	using nonce_type = std::array<std::byte, 12>;
+	/// <summary>
+	/// 認証タグの型
+	/// </summary>
+	using tag_type = std::array<std::byte, 16>;
+
+private:
+	key_type _key;
+	ChaChaMode _mode;
+
+public:
+	ChaCha20Poly1305() = delete;
+	/// <summary>
+	/// 鍵を指定して構築する
+	/// </summary>
+	/// <param name="key">鍵</param>
+	/// <param name="mode">鍵ストリームの生成に用いる命令セット</param>
+	explicit ChaCha20Poly1305(const key_type& key, ChaChaMode mode = ChaChaMode::automatic) noexcept;
+	/// <summary>
+	/// 保持する鍵を消去して破棄する
+	/// </summary>
+	~ChaCha20Poly1305();
+
+	/// <summary>
+	/// 暗号化して認証タグを計算する
+	/// </summary>
+	/// <param name="nonce">nonce</param>
+	/// <param name="aad">暗号化せずに認証する追加データ</param>
+	/// <param name="plaintext">平文</param>
+	/// <param name="ciphertext">暗号文の書き込み先(平文と同じ長さで、平文と同じ領域でもよい)</param>
+	/// <param name="tag">認証タグの書き込み先</param>
+	void seal(const nonce_type& nonce, std::span<const std::byte> aad, std::span<const std::byte> plaintext, std::span<std::byte> ciphertext, tag_type& tag) const noexcept;
+
+	/// <summary>
+	/// 認証タグを検証して復号する
+	/// </summary>
+	/// <param name="nonce">nonce</param>
+	/// <param name="aad">暗号化せずに認証する追加データ</param>
+	/// <param name="ciphertext">暗号文</param>
+	/// <param name="tag">認証タグ</param>
+	/// <param name="plaintext">平文の書き込み先(暗号文と同じ長さで、暗号文と同じ領域でもよい)</param>
+	/// <returns>認証に成功したならtrue(失敗したときは何も書き込まない)</returns>
+	[[nodiscard]] bool open(const nonce_type& nonce, std::span<const std::byte> aad, std::span<const std::byte> ciphertext, const tag_type& tag, std::span<std::byte> plaintext) const noexcept;
+
+	// コピーによる構築を禁止する
+	ChaCha20Poly1305(const ChaCha20Poly1305&) = delete;
+	ChaCha20Poly1305& operator=(const ChaCha20Poly1305&) = delete;
+};
+
+/// <summary>
+/// ChaCha20の鍵ストリームとの排他的論理和を計算する
+/// </summary>
+/// <param name="key">鍵</param>
+/// <param name="nonce">nonce</param>
+/// <param name="counter">最初のブロックのカウンタ</param>
+/// <param name="in">入力</param>
+/// <param name="out">出力の書き込み先(入力と同じ長さで、入力と同じ領域でもよい)</param>
+/// <param name="mode">鍵ストリームの生成に用いる命令セット</param>
+void chacha20Xor(const ChaCha20Poly1305::key_type& key, const ChaCha20Poly1305::nonce_type& nonce, std::uint32_t counter,
+	std::span<const std::byte> in, std::span<std::byte> out, ChaChaMode mode = ChaChaMode::automatic) noexcept;
+
+/// <summary>
+/// 実行環境で利用可能な最速の命令セットを取得する
+/// </summary>
+[[nodiscard]] ChaChaMode bestChaChaMode() noexcept;
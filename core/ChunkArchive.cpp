@@ -0,0 +1,412 @@
+﻿#include "ChunkArchive.h"
+#include "Lz.h"
+#include <array>
+#include <algorithm>
+#include <cstring>
+#include <format>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+    /// <summary>
+    /// スライスごとのCRC-32(多項式0xEDB88320)の表を構築する
+    /// </summary>
+    constexpr std::array<std::array<std::uint32_t, 256>, 8> makeCrcTable() {
+        std::array<std::array<std::uint32_t, 256>, 8> table{};
+        for (std::uint32_t i = 0; i < 256; ++i) {
+            std::uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) != 0 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[0][i] = c;
+        }
+        for (std::size_t s = 1; s < 8; ++s) {
+            for (std::size_t i = 0; i < 256; ++i) {
+                table[s][i] = (table[s - 1][i] >> 8) ^ table[0][table[s - 1][i] & 0xFF];
+            }
+        }
+        return table;
+    }
+
+    constexpr auto crc_table = makeCrcTable();
+
+    void put8(std::vector<std::byte>& dst, std::uint8_t x) {
+        dst.push_back(static_cast<std::byte>(x));
+    }
+
+    void put32(std::vector<std::byte>& dst, std::uint32_t x) {
+        for (int i = 0; i < 4; ++i) {
+            dst.push_back(static_cast<std::byte>(x >> (i * 8)));
+        }
+    }
+
+    void put64(std::vector<std::byte>& dst, std::uint64_t x) {
+        for (int i = 0; i < 8; ++i) {
+            dst.push_back(static_cast<std::byte>(x >> (i * 8)));
+        }
+    }
+
+    void putMagic(std::vector<std::byte>& dst, std::string_view magic) {
+        for (char c : magic) {
+            dst.push_back(static_cast<std::byte>(c));
+        }
+    }
+
+    std::uint32_t get32(const std::byte* p) noexcept {
+        std::uint32_t x = 0;
+        for (int i = 0; i < 4; ++i) {
+            x |= static_cast<std::uint32_t>(p[i]) << (i * 8);
+        }
+        return x;
+    }
+
+    std::uint64_t get64(const std::byte* p) noexcept {
+        std::uint64_t x = 0;
+        for (int i = 0; i < 8; ++i) {
+            x |= static_cast<std::uint64_t>(p[i]) << (i * 8);
+        }
+        return x;
+    }
+
+    bool hasMagic(const std::byte* p, std::string_view magic) noexcept {
+        return std::memcmp(p, magic.data(), magic.size()) == 0;
+    }
+
+    /// <summary>
+    /// フレームのヘッダとインデックスの要素で共通するチャンクの情報を追加する
+    /// </summary>
+    void putInfo(std::vector<std::byte>& dst, const pwm::ChunkInfo& info) {
+        put8(dst, static_cast<std::uint8_t>(info.compression));
+        put8(dst, 0);
+        put8(dst, 0);
+        put8(dst, 0);
+        put32(dst, info.raw_size);
+        put32(dst, info.stored_size);
+        put32(dst, info.rows);
+        put32(dst, info.checksum);
+        put64(dst, static_cast<std::uint64_t>(info.first_id));
+        put64(dst, static_cast<std::uint64_t>(info.last_id));
+    }
+
+    /// <summary>
+    /// putInfoで追加したチャンクの情報を読み取る
+    /// </summary>
+    /// <returns>圧縮方式が不正であればnullopt</returns>
+    std::optional<pwm::ChunkInfo> getInfo(const std::byte* p) {
+        pwm::ChunkInfo info;
+        auto compression = static_cast<std::uint8_t>(p[0]);
+        if (compression > static_cast<std::uint8_t>(pwm::ChunkCompression::lz)) {
+            return std::nullopt;
+        }
+        info.compression = static_cast<pwm::ChunkCompression>(compression);
+        info.raw_size = get32(p + 4);
+        info.stored_size = get32(p + 8);
+        info.rows = get32(p + 12);
+        info.checksum = get32(p + 16);
+        info.first_id = static_cast<std::int64_t>(get64(p + 20));
+        info.last_id = static_cast<std::int64_t>(get64(p + 28));
+        return info;
+    }
+
+    /// <summary>
+    /// チャンクの情報のバイト数
+    /// </summary>
+    constexpr std::size_t info_size = 36;
+    /// <summary>
+    /// インデックスの要素のバイト数
+    /// </summary>
+    constexpr std::size_t index_entry_size = 8 + info_size;
+
+    /// <summary>
+    /// ファイルを開いて出力先を構築する
+    /// </summary>
+    std::unique_ptr<OutputSink> openSink(const std::filesystem::path& path, bool append, const FileSinkFactory& open) {
+        if (open) {
+            return open(path, append);
+        }
+        return std::make_unique<FileSink>(path, append);
+    }
+
+    /// <summary>
+    /// ファイルの指定位置から読み込む
+    /// </summary>
+    /// <returns>すべて読み込めたか</returns>
+    bool readAt(std::ifstream& is, std::uint64_t offset, std::byte* dst, std::size_t size) {
+        is.clear();
+        is.seekg(static_cast<std::streamoff>(offset));
+        is.read(reinterpret_cast<char*>(dst), static_cast<std::streamsize>(size));
+        return static_cast<std::size_t>(is.gcount()) == size;
+    }
+}
+
+namespace pwm {
+
+    std::uint32_t ChunkArchive::crc32(std::span<const std::byte> data, std::uint32_t crc) noexcept {
+        crc = ~crc;
+        const std::byte* p = data.data();
+        std::size_t n = data.size();
+        // 8バイトずつ表を引く(slicing-by-8)
+        while (n >= 8) {
+            std::uint32_t lo = get32(p) ^ crc;
+            std::uint32_t hi = get32(p + 4);
+            crc = crc_table[7][lo & 0xFF] ^ crc_table[6][(lo >> 8) & 0xFF] ^ crc_table[5][(lo >> 16) & 0xFF] ^ crc_table[4][lo >> 24]
+                ^ crc_table[3][hi & 0xFF] ^ crc_table[2][(hi >> 8) & 0xFF] ^ crc_table[1][(hi >> 16) & 0xFF] ^ crc_table[0][hi >> 24];
+            p += 8;
+            n -= 8;
+        }
+        while (n-- > 0) {
+            crc = crc_table[0][(crc ^ static_cast<std::uint32_t>(*p++)) & 0xFF] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+
+    ChunkFrame ChunkArchive::encode(std::span<const std::byte> raw, ChunkCompression compression, std::uint32_t rows, std::int64_t first_id, std::int64_t last_id) {
+        if (raw.size() > std::numeric_limits<std::uint32_t>::max()) {
+            throw std::invalid_argument("1つのチャンクは4GiB未満である必要があります");
+        }
+        ChunkFrame frame;
+        frame.bytes.resize(frame_header_size);
+        if (compression == ChunkCompression::lz) {
+            lzCompress(raw, frame.bytes);
+        }
+        // 圧縮により小さくならなければ圧縮せずに格納する
+        if (compression == ChunkCompression::none || frame.bytes.size() - frame_header_size >= raw.size()) {
+            compression = ChunkCompression::none;
+            frame.bytes.resize(frame_header_size);
+            frame.bytes.insert(frame.bytes.end(), raw.begin(), raw.end());
+        }
+        auto stored = std::span(frame.bytes).subspan(frame_header_size);
+
+        ChunkInfo& info = frame.info;
+        info.raw_size = static_cast<std::uint32_t>(raw.size());
+        info.stored_size = static_cast<std::uint32_t>(stored.size());
+        info.rows = rows;
+        info.checksum = crc32(stored);
+        info.first_id = first_id;
+        info.last_id = last_id;
+        info.compression = compression;
+
+        std::vector<std::byte> header;
+        header.reserve(frame_header_size);
+        putMagic(header, frame_magic);
+        putInfo(header, info);
+        put32(header, crc32(header));
+        std::memcpy(frame.bytes.data(), header.data(), frame_header_size);
+        return frame;
+    }
+
+    ChunkArchiveReader::ChunkArchiveReader(const std::filesystem::path& path) : _is(path, std::ios::binary) {
+        if (!this->_is) {
+            throw std::runtime_error("ファイルのオープンに失敗");
+        }
+        std::uint64_t file_size = std::filesystem::file_size(path);
+        std::array<std::byte, ChunkArchive::header_size> header;
+        if (!readAt(this->_is, 0, header.data(), header.size()) || !hasMagic(header.data(), ChunkArchive::magic)) {
+            throw std::runtime_error("チャンクに分割した書き出しの形式ではありません");
+        }
+        if (static_cast<std::uint8_t>(header[4]) != ChunkArchive::version) {
+            throw std::runtime_error("対応していないバージョンです");
+        }
+        auto format = static_cast<std::uint8_t>(header[5]);
+        auto compression = static_cast<std::uint8_t>(header[6]);
+        if (format > static_cast<std::uint8_t>(RecordFormat::binary) || compression > static_cast<std::uint8_t>(ChunkCompression::lz)) {
+            throw std::runtime_error("ファイルのヘッダが壊れています");
+        }
+        this->_format = static_cast<RecordFormat>(format);
+        this->_compression = static_cast<ChunkCompression>(compression);
+
+        if (!this->readIndex(file_size)) {
+            this->scanFrames(file_size);
+        }
+    }
+
+    bool ChunkArchiveReader::readIndex(std::uint64_t file_size) {
+        if (file_size < ChunkArchive::header_size + ChunkArchive::trailer_size) {
+            return false;
+        }
+        const std::uint64_t trailer_offset = file_size - ChunkArchive::trailer_size;
+        std::array<std::byte, ChunkArchive::trailer_size> trailer;
+        if (!readAt(this->_is, trailer_offset, trailer.data(), trailer.size()) || !hasMagic(trailer.data() + 8, ChunkArchive::trailer_magic)) {
+            return false;
+        }
+        const std::uint64_t index_offset = get64(trailer.data());
+        if (index_offset < ChunkArchive::header_size || index_offset > trailer_offset || trailer_offset - index_offset < 16) {
+            return false;
+        }
+        std::vector<std::byte> index(static_cast<std::size_t>(trailer_offset - index_offset));
+        if (!readAt(this->_is, index_offset, index.data(), index.size()) || !hasMagic(index.data(), ChunkArchive::index_magic)) {
+            return false;
+        }
+        const std::uint64_t count = get64(index.data() + 4);
+        if (count > (index.size() - 16) / index_entry_size || 12 + count * index_entry_size + 4 != index.size()) {
+            return false;
+        }
+        const std::size_t body = index.size() - 4;
+        if (ChunkArchive::crc32(std::span(index.data(), body)) != get32(index.data() + body)) {
+            return false;
+        }
+        std::vector<ChunkInfo> chunks;
+        std::uint64_t expected = ChunkArchive::header_size;
+        for (std::uint64_t i = 0; i < count; ++i) {
+            const std::byte* p = index.data() + 12 + i * index_entry_size;
+            auto info = getInfo(p + 8);
+            if (!info) {
+                return false;
+            }
+            info->offset = get64(p);
+            // フレームは隙間なく並ぶ
+            if (info->offset != expected) {
+                return false;
+            }
+            expected += ChunkArchive::frame_header_size + info->stored_size;
+            chunks.push_back(info.value());
+        }
+        if (expected != index_offset) {
+            return false;
+        }
+        this->_chunks = std::move(chunks);
+        this->_valid_size = index_offset;
+        this->_complete = true;
+        return true;
+    }
+
+    void ChunkArchiveReader::scanFrames(std::uint64_t file_size) {
+        std::uint64_t offset = ChunkArchive::header_size;
+        std::array<std::byte, ChunkArchive::frame_header_size> header;
+        std::vector<std::byte> stored;
+        while (file_size - offset >= ChunkArchive::frame_header_size) {
+            if (!readAt(this->_is, offset, header.data(), header.size()) || !hasMagic(header.data(), ChunkArchive::frame_magic)) {
+                break;
+            }
+            const std::size_t body = ChunkArchive::frame_header_size - 4;
+            if (ChunkArchive::crc32(std::span(header.data(), body)) != get32(header.data() + body)) {
+                break;
+            }
+            auto info = getInfo(header.data() + 4);
+            if (!info || file_size - offset - ChunkArchive::frame_header_size < info->stored_size) {
+                break;
+            }
+            // 書き込みが途中で中断されたフレームを除外するため格納されたバイト列も検証する
+            stored.resize(info->stored_size);
+            if (!readAt(this->_is, offset + ChunkArchive::frame_header_size, stored.data(), stored.size())
+                || ChunkArchive::crc32(stored) != info->checksum) {
+                break;
+            }
+            info->offset = offset;
+            this->_chunks.push_back(info.value());
+            offset += ChunkArchive::frame_header_size + info->stored_size;
+        }
+        this->_valid_size = offset;
+    }
+
+    void ChunkArchiveReader::read(std::size_t index, std::vector<std::byte>& dst) {
+        const ChunkInfo& info = this->_chunks.at(index);
+        std::vector<std::byte> stored(info.stored_size);
+        if (!readAt(this->_is, info.offset + ChunkArchive::frame_header_size, stored.data(), stored.size())) {
+            throw std::runtime_error("チャンクの読み込みに失敗");
+        }
+        if (ChunkArchive::crc32(stored) != info.checksum) {
+            throw std::runtime_error(std::format("チャンクが壊れています({0}番目)", index));
+        }
+        if (info.compression == ChunkCompression::none) {
+            if (info.stored_size != info.raw_size) {
+                throw std::runtime_error(std::format("チャンクが壊れています({0}番目)", index));
+            }
+            dst = std::move(stored);
+            return;
+        }
+        dst.resize(info.raw_size);
+        lzDecompress(stored, dst);
+    }
+
+    ChunkArchiveWriter::ChunkArchiveWriter(const std::filesystem::path& path, RecordFormat format, ChunkCompression compression, const FileSinkFactory& open) {
+        this->_sink = openSink(path, false, open);
+        std::vector<std::byte> header;
+        putMagic(header, ChunkArchive::magic);
+        put8(header, ChunkArchive::version);
+        put8(header, static_cast<std::uint8_t>(format));
+        put8(header, static_cast<std::uint8_t>(compression));
+        header.resize(ChunkArchive::header_size);
+        this->_sink->write(header);
+        this->_offset = header.size();
+    }
+
+    ChunkArchiveWriter::ChunkArchiveWriter(const std::filesystem::path& path, RecordFormat format, std::span<const std::byte> header, const FileSinkFactory& open) {
+        ChunkCompression compression;
+        {
+            // 既存のファイルを走査して再開できるかを検証する(切り詰める前に閉じる)
+            ChunkArchiveReader reader(path);
+            if (reader.complete()) {
+                throw std::runtime_error("書き出しは既に完了しています");
+            }
+            if (reader.format() != format) {
+                throw std::runtime_error("既存のファイルと出力の形式が一致しません");
+            }
+            compression = reader.compression();
+            if (!reader.chunks().empty()) {
+                std::vector<std::byte> first;
+                reader.read(0, first);
+                if (!std::ranges::equal(first, header)) {
+                    throw std::runtime_error("既存のファイルと対象項目が一致しません");
+                }
+            }
+            this->_chunks = reader.chunks();
+        }
+        if (this->_chunks.empty()) {
+            // ヘッダのフレームも書き込まれていなければ作り直す
+            std::filesystem::resize_file(path, ChunkArchive::header_size);
+            this->_offset = ChunkArchive::header_size;
+            this->_sink = openSink(path, true, open);
+            this->write(ChunkArchive::encode(header, compression, 0, 0, 0));
+            return;
+        }
+        // 先頭以外のレコードを含まないフレーム(フッタ)を破棄する
+        while (this->_chunks.size() > 1 && this->_chunks.back().rows == 0) {
+            this->_chunks.pop_back();
+        }
+        const ChunkInfo& last = this->_chunks.back();
+        this->_offset = last.offset + ChunkArchive::frame_header_size + last.stored_size;
+        std::filesystem::resize_file(path, this->_offset);
+        this->_sink = openSink(path, true, open);
+    }
+
+    void ChunkArchiveWriter::write(const ChunkFrame& frame) {
+        this->_sink->write(frame.bytes);
+        ChunkInfo info = frame.info;
+        info.offset = this->_offset;
+        this->_chunks.push_back(info);
+        this->_offset += frame.bytes.size();
+    }
+
+    void ChunkArchiveWriter::finish() {
+        std::vector<std::byte> index;
+        index.reserve(16 + this->_chunks.size() * index_entry_size + ChunkArchive::trailer_size);
+        putMagic(index, ChunkArchive::index_magic);
+        put64(index, this->_chunks.size());
+        for (const auto& info : this->_chunks) {
+            put64(index, info.offset);
+            putInfo(index, info);
+        }
+        put32(index, ChunkArchive::crc32(index));
+        // トレーラ
+        put64(index, this->_offset);
+        putMagic(index, ChunkArchive::trailer_magic);
+        this->_sink->write(index);
+        this->_offset += index.size();
+        this->_sink->flush();
+    }
+
+    ChunkStreamBuf::int_type ChunkStreamBuf::underflow() {
+        // 空のチャンクを読み飛ばして次のチャンクを展開する
+        while (this->gptr() == this->egptr()) {
+            if (this->_next == this->_reader.chunks().size()) {
+                return traits_type::eof();
+            }
+            this->_reader.read(this->_next++, this->_buf);
+            char* begin = reinterpret_cast<char*>(this->_buf.data());
+            this->setg(begin, begin, begin + this->_buf.size());
+        }
+        return traits_type::to_int_type(*this->gptr());
+    }
+}
@@ -0,0 +1,303 @@
+﻿#pragma once
+
+#include "OutputSink.h"
+#include "RecordWriter.h"
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <span>
+#include <streambuf>
+#include <string_view>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace pwm {
+
+	/// <summary>
+	/// チャンクの圧縮方式の列挙
+	/// </summary>
+	enum class ChunkCompression : std::uint8_t {
+		/// <summary>
+		/// 圧縮しない
+		/// </summary>
+		none = 0,
+		/// <summary>
+		/// lzCompressによるLZ77系の圧縮
+		/// </summary>
+		lz = 1
+	};
+
+	/// <summary>
+	/// チャンクの情報
+	/// </summary>
+	struct ChunkInfo {
+		/// <summary>
+		/// ファイル内のフレームの先頭の位置
+		/// </summary>
+		std::uint64_t offset = 0;
+		/// <summary>
+		/// 展開後のバイト数
+		/// </summary>
+		std::uint32_t raw_size = 0;
+		/// <summary>
+		/// ファイル内に格納されたバイト数
+		/// </summary>
+		std::uint32_t stored_size = 0;
+		/// <summary>
+		/// 含まれるレコードの数(ヘッダやフッタのみのチャンクは0)
+		/// </summary>
+		std::uint32_t rows = 0;
+		/// <summary>
+		/// 格納されたバイト列のCRC-32
+		/// </summary>
+		std::uint32_t checksum = 0;
+		/// <summary>
+		/// 含まれるレコードの主キーの範囲の先頭
+		/// </summary>
+		std::int64_t first_id = 0;
+		/// <summary>
+		/// 含まれるレコードの主キーの範囲の末尾
+		/// </summary>
+		std::int64_t last_id = 0;
+		/// <summary>
+		/// 実際に適用した圧縮方式(圧縮により小さくならなければnone)
+		/// </summary>
+		ChunkCompression compression = ChunkCompression::none;
+	};
+
+	/// <summary>
+	/// ファイルへ書き込む前のフレーム
+	/// </summary>
+	struct ChunkFrame {
+		/// <summary>
+		/// チャンクの情報(offsetは書き込み時に決定する)
+		/// </summary>
+		ChunkInfo info;
+		/// <summary>
+		/// フレームのヘッダと格納するバイト列
+		/// </summary>
+		std::vector<std::byte> bytes;
+	};
+
+	/// <summary>
+	/// 書き出したレコードをチャンクに分割して1つのファイルへ格納する形式の定数と関数
+	/// </summary>
+	/// <remarks>
+	/// 形式は以下のとおりであり、整数はリトルエンディアンとする。
+	///   ファイル   : ヘッダ フレーム* [インデックス トレーラ]
+	///   ヘッダ     : "PWMC" バージョン(1) 形式(1) 圧縮方式(1) 予約(9)
+	///   フレーム   : "CHNK" 圧縮方式(1) 予約(3) 展開後のバイト数(4) 格納したバイト数(4) レコード数(4)
+	///                格納したバイト列のCRC-32(4) 主キーの先頭(8) 主キーの末尾(8) ここまでのCRC-32(4) 格納したバイト列
+	///   インデックス: "INDX" チャンク数(8) {位置(8) フレームのヘッダと同じ情報}* ここまでのCRC-32(4)
+	///   トレーラ   : インデックスの位置(8) "PWMCEND" 0
+	/// 先頭のフレームはヘッダ、末尾のフレームはフッタを格納し、すべてのフレームを展開して連結すると
+	/// 通常の書き出しと同じバイト列となる。フレームは単独で検証できるため、インデックスが無い
+	/// 中断されたファイルも先頭から走査して正常なフレームまでを読み出し、続きから再開できる。
+	/// </remarks>
+	class ChunkArchive {
+	public:
+		/// <summary>
+		/// ファイルの先頭のマジックナンバー
+		/// </summary>
+		static constexpr std::string_view magic = "PWMC";
+		/// <summary>
+		/// フレームの先頭のマジックナンバー
+		/// </summary>
+		static constexpr std::string_view frame_magic = "CHNK";
+		/// <summary>
+		/// インデックスの先頭のマジックナンバー
+		/// </summary>
+		static constexpr std::string_view index_magic = "INDX";
+		/// <summary>
+		/// トレーラの末尾のマジックナンバー
+		/// </summary>
+		static constexpr std::string_view trailer_magic = std::string_view("PWMCEND\0", 8);
+		/// <summary>
+		/// 形式のバージョン
+		/// </summary>
+		static constexpr std::uint8_t version = 1;
+		/// <summary>
+		/// ファイルのヘッダのバイト数
+		/// </summary>
+		static constexpr std::size_t header_size = 16;
+		/// <summary>
+		/// フレームのヘッダのバイト数
+		/// </summary>
+		static constexpr std::size_t frame_header_size = 44;
+		/// <summary>
+		/// トレーラのバイト数
+		/// </summary>
+		static constexpr std::size_t trailer_size = 16;
+
+		/// <summary>
+		/// チャンクを圧縮してフレームを構築する(ワーカーのスレッドから並行に呼び出せる)
+		/// </summary>
+		/// <param name="raw">展開後のバイト列</param>
+		/// <param name="compression">圧縮方式</param>
+		/// <param name="rows">含まれるレコードの数</param>
+		/// <param name="first_id">主キーの範囲の先頭</param>
+		/// <param name="last_id">主キーの範囲の末尾</param>
+		[[nodiscard]] static ChunkFrame encode(std::span<const std::byte> raw, ChunkCompression compression, std::uint32_t rows, std::int64_t first_id, std::int64_t last_id);
+
+		/// <summary>
+		/// CRC-32を計算する
+		/// </summary>
+		/// <param name="data">対象のバイト列</param>
+		/// <param name="crc">前の部分のCRC-32(続きを計算する場合)</param>
+		[[nodiscard]] static std::uint32_t crc32(std::span<const std::byte> data, std::uint32_t crc = 0) noexcept;
+	};
+
+	/// <summary>
+	/// チャンクに分割したファイルを読み出すクラス
+	/// </summary>
+	class ChunkArchiveReader {
+		std::ifstream _is;
+		RecordFormat _format;
+		ChunkCompression _compression;
+		std::vector<ChunkInfo> _chunks;
+		/// <summary>
+		/// インデックスとトレーラまで書き込まれているか
+		/// </summary>
+		bool _complete = false;
+		/// <summary>
+		/// 最後の正常なフレームの末尾
+		/// </summary>
+		std::uint64_t _valid_size = ChunkArchive::header_size;
+
+		/// <summary>
+		/// トレーラが正常であればインデックスを読み込む
+		/// </summary>
+		/// <returns>インデックスを読み込めたか</returns>
+		bool readIndex(std::uint64_t file_size);
+
+		/// <summary>
+		/// 先頭からフレームを走査して正常なものを列挙する
+		/// </summary>
+		void scanFrames(std::uint64_t file_size);
+
+	public:
+		ChunkArchiveReader() = delete;
+		/// <summary>
+		/// ファイルを開いてチャンクの一覧を読み込む
+		/// </summary>
+		/// <remarks>
+		/// インデックスが無いあるいは壊れている場合は先頭から正常なフレームまでを列挙する
+		/// </remarks>
+		/// <param name="path">ファイルのパス</param>
+		/// <exception cref="std::runtime_error">ファイルを開けないか形式が異なる</exception>
+		ChunkArchiveReader(const std::filesystem::path& path);
+
+		/// <summary>
+		/// 格納したレコードの形式
+		/// </summary>
+		RecordFormat format() const noexcept { return this->_format; }
+
+		/// <summary>
+		/// 書き出し時に指定した圧縮方式
+		/// </summary>
+		ChunkCompression compression() const noexcept { return this->_compression; }
+
+		/// <summary>
+		/// チャンクの一覧
+		/// </summary>
+		const std::vector<ChunkInfo>& chunks() const noexcept { return this->_chunks; }
+
+		/// <summary>
+		/// 書き出しが完了しているか(インデックスとトレーラが正常であるか)
+		/// </summary>
+		bool complete() const noexcept { return this->_complete; }
+
+		/// <summary>
+		/// 正常なフレームが続くファイルの先頭からのバイト数
+		/// </summary>
+		std::uint64_t validSize() const noexcept { return this->_valid_size; }
+
+		/// <summary>
+		/// チャンクを展開して読み出す
+		/// </summary>
+		/// <param name="index">チャンクの番号</param>
+		/// <param name="dst">展開したバイト列を格納する変数</param>
+		/// <exception cref="std::runtime_error">チャンクが壊れている</exception>
+		void read(std::size_t index, std::vector<std::byte>& dst);
+	};
+
+	/// <summary>
+	/// チャンクに分割したファイルへフレームを順に書き込むクラス
+	/// </summary>
+	class ChunkArchiveWriter {
+		std::unique_ptr<OutputSink> _sink;
+		std::vector<ChunkInfo> _chunks;
+		/// <summary>
+		/// 次に書き込むフレームの位置
+		/// </summary>
+		std::uint64_t _offset = 0;
+
+	public:
+		ChunkArchiveWriter() = delete;
+		/// <summary>
+		/// ファイルを作成してヘッダを書き込む(既に存在すれば切り詰める)
+		/// </summary>
+		/// <param name="path">ファイルのパス</param>
+		/// <param name="format">格納するレコードの形式</param>
+		/// <param name="compression">圧縮方式</param>
+		/// <param name="open">ファイルを開く関数(省略時はFileSink)</param>
+		ChunkArchiveWriter(const std::filesystem::path& path, RecordFormat format, ChunkCompression compression, const FileSinkFactory& open = {});
+		/// <summary>
+		/// 中断されたファイルを最後の正常なフレームの直後から再開する
+		/// </summary>
+		/// <remarks>
+		/// 末尾のレコードを含まないフレーム(フッタ)と壊れたフレーム以降は破棄し、ヘッダのフレームも無ければ作り直す
+		/// </remarks>
+		/// <param name="path">ファイルのパス</param>
+		/// <param name="format">格納するレコードの形式</param>
+		/// <param name="header">先頭のフレームに期待する展開後のバイト列(列名のヘッダ等)</param>
+		/// <param name="open">ファイルを開く関数(省略時はFileSink)</param>
+		/// <exception cref="std::runtime_error">書き出しが完了しているか形式あるいはヘッダが一致しない</exception>
+		ChunkArchiveWriter(const std::filesystem::path& path, RecordFormat format, std::span<const std::byte> header, const FileSinkFactory& open = {});
+
+		/// <summary>
+		/// フレームを書き込む
+		/// </summary>
+		/// <param name="frame">書き込むフレーム</param>
+		void write(const ChunkFrame& frame);
+
+		/// <summary>
+		/// インデックスとトレーラを書き込んでストレージへ永続化する
+		/// </summary>
+		void finish();
+
+		/// <summary>
+		/// 書き込んだチャンクの一覧
+		/// </summary>
+		const std::vector<ChunkInfo>& chunks() const noexcept { return this->_chunks; }
+
+		/// <summary>
+		/// ファイルの先頭からのバイト数
+		/// </summary>
+		std::uint64_t bytes() const noexcept { return this->_offset; }
+	};
+
+	/// <summary>
+	/// チャンクに分割したファイルを展開しながら連続したバイト列として読み出すストリームバッファ
+	/// </summary>
+	class ChunkStreamBuf : public std::streambuf {
+		ChunkArchiveReader& _reader;
+		std::vector<std::byte> _buf;
+		/// <summary>
+		/// 次に展開するチャンクの番号
+		/// </summary>
+		std::size_t _next = 0;
+
+	protected:
+		int_type underflow() override;
+
+	public:
+		ChunkStreamBuf() = delete;
+		/// <summary>
+		/// 読み出すファイルを指定して構築する
+		/// </summary>
+		/// <param name="reader">読み出すファイル(このオブジェクトより長く存在する必要がある)</param>
+		ChunkStreamBuf(ChunkArchiveReader& reader) : _reader(reader) {}
+	};
+}
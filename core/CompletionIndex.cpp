@@ -0,0 +1,456 @@
+﻿#include "CompletionIndex.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+
+namespace pwm {
+    namespace {
+        /// <summary>
+        /// 索引ファイルのマジックナンバー
+        /// </summary>
+        constexpr std::array<char, 8> magic = { 'P', 'W', 'M', 'C', 'M', 'P', '0', '2' };
+
+        /// <summary>
+        /// 索引ファイルのヘッダ
+        /// </summary>
+        struct FileHeader {
+            std::array<char, 8> magic;
+            CompletionIndex::Stamp stamp;
+            /// <summary>
+            /// 索引に含めた行の範囲を示す目印
+            /// </summary>
+            InsertionMark mark;
+            std::uint64_t trie_count;
+        };
+
+        /// <summary>
+        /// 1つのtrieに関するヘッダ(同じ対象のtrieは前回に構築したものと差分の順に並ぶ)
+        /// </summary>
+        struct TrieHeader {
+            std::uint64_t target;
+            std::uint64_t node_offset;
+            std::uint64_t node_count;
+            std::uint64_t label_offset;
+            std::uint64_t label_size;
+            /// <summary>
+            /// trieに含まれる値の数
+            /// </summary>
+            std::uint64_t value_count;
+        };
+
+        /// <summary>
+        /// trieのノード(子ノードは連続して配置され、ラベルの先頭の文字で昇順に並ぶ)
+        /// </summary>
+        struct Node {
+            /// <summary>
+            /// 親からこのノードへの辺のラベルの位置
+            /// </summary>
+            std::uint32_t label_offset;
+            /// <summary>
+            /// 親からこのノードへの辺のラベルの長さ
+            /// </summary>
+            std::uint32_t label_size;
+            /// <summary>
+            /// 最初の子ノードのインデックス
+            /// </summary>
+            std::uint32_t first_child;
+            /// <summary>
+            /// 子ノードの数(最上位ビットは値の終端であるかを示す)
+            /// </summary>
+            std::uint32_t child_info;
+
+            static constexpr std::uint32_t TERMINAL = 0x80000000u;
+
+            std::uint32_t child_count() const noexcept { return this->child_info & ~TERMINAL; }
+            bool terminal() const noexcept { return (this->child_info & TERMINAL) != 0; }
+        };
+
+        /// <summary>
+        /// ソート済みの重複のない文字列の一覧からtrieを構築するクラス
+        /// </summary>
+        class TrieBuilder {
+            const std::vector<std::u8string>& _values;
+        public:
+            std::vector<Node> nodes;
+            std::u8string labels;
+
+            TrieBuilder(const std::vector<std::u8string>& values) : _values(values) {
+                // 根ノードの追加
+                this->nodes.push_back(Node{});
+                this->build(0, 0, values.size(), 0);
+            }
+
+        private:
+            /// <summary>
+            /// [lo, hi)の範囲の値について先頭からdepth文字が一致するノードを構築する
+            /// </summary>
+            void build(std::size_t node, std::size_t lo, std::size_t hi, std::size_t depth) {
+                if (lo < hi && this->_values[lo].size() == depth) {
+                    // ソート済みであるため終端となる値は範囲の先頭にのみ存在する
+                    this->nodes[node].child_info |= Node::TERMINAL;
+                    ++lo;
+                }
+
+                // depth文字目で値をグループ化して子ノードを生成
+                struct Group { std::size_t lo; std::size_t hi; std::size_t depth; };
+                std::vector<Group> groups;
+                for (std::size_t a = lo; a < hi;) {
+                    char8_t c = this->_values[a][depth];
+                    std::size_t b = a + 1;
+                    while (b < hi && this->_values[b][depth] == c) {
+                        ++b;
+                    }
+                    // ソート済みであるためグループの共通接頭辞は先頭と末尾の共通接頭辞に等しい
+                    const auto& first = this->_values[a];
+                    const auto& last = this->_values[b - 1];
+                    std::size_t lcp = depth + 1;
+                    while (lcp < first.size() && lcp < last.size() && first[lcp] == last[lcp]) {
+                        ++lcp;
+                    }
+                    groups.push_back({ a, b, lcp });
+                    a = b;
+                }
+                if (this->nodes.size() + groups.size() > Node::TERMINAL) {
+                    throw std::length_error("補完候補の索引のノード数が上限を超えました");
+                }
+
+                std::size_t first_child = this->nodes.size();
+                this->nodes[node].first_child = static_cast<std::uint32_t>(first_child);
+                this->nodes[node].child_info |= static_cast<std::uint32_t>(groups.size());
+                for (const auto& group : groups) {
+                    Node child{};
+                    child.label_offset = static_cast<std::uint32_t>(this->labels.size());
+                    child.label_size = static_cast<std::uint32_t>(group.depth - depth);
+                    this->labels.append(this->_values[group.lo], depth, group.depth - depth);
+                    this->nodes.push_back(child);
+                }
+                for (std::size_t i = 0; i < groups.size(); ++i) {
+                    this->build(first_child + i, groups[i].lo, groups[i].hi, groups[i].depth);
+                }
+            }
+        };
+
+        /// <summary>
+        /// マップされた領域からtrivially copyableな値を読み出す
+        /// </summary>
+        template <class T>
+        T read(std::span<const std::byte> data, std::size_t offset) {
+            if (offset > data.size() || data.size() - offset < sizeof(T)) {
+                throw std::runtime_error("補完候補の索引が破損しています");
+            }
+            T x;
+            std::memcpy(&x, data.data() + offset, sizeof(T));
+            return x;
+        }
+
+        /// <summary>
+        /// trieを走査するクラス
+        /// </summary>
+        class TrieReader {
+            std::span<const std::byte> _data;
+            TrieHeader _header;
+        public:
+            TrieReader(std::span<const std::byte> data, const TrieHeader& header) : _data(data), _header(header) {
+                if (header.node_count == 0 ||
+                    header.node_offset + header.node_count * sizeof(Node) > data.size() ||
+                    header.label_offset + header.label_size > data.size()) {
+                    throw std::runtime_error("補完候補の索引が破損しています");
+                }
+            }
+
+            Node node(std::size_t i) const {
+                return read<Node>(this->_data, this->_header.node_offset + i * sizeof(Node));
+            }
+            std::u8string_view label(const Node& n) const {
+                if (static_cast<std::uint64_t>(n.label_offset) + n.label_size > this->_header.label_size) {
+                    throw std::runtime_error("補完候補の索引が破損しています");
+                }
+                return { reinterpret_cast<const char8_t*>(this->_data.data() + this->_header.label_offset + n.label_offset), n.label_size };
+            }
+
+            const TrieHeader& header() const noexcept { return this->_header; }
+
+            /// <summary>
+            /// 根から接頭辞を消費し切るまで辺を辿る
+            /// </summary>
+            /// <param name="prefix">接頭辞</param>
+            /// <param name="path">辿った辺のラベルを連結した文字列の格納先</param>
+            /// <returns>接頭辞を消費し切ったノード(前方一致する値が存在しなければnullopt)</returns>
+            std::optional<Node> descend(std::u8string_view prefix, std::u8string& path) const {
+                Node n = this->node(0);
+                std::size_t pos = 0;
+                while (pos < prefix.size()) {
+                    // 子ノードはラベルの先頭の文字で昇順に並ぶため二分探索する
+                    std::uint32_t lo = 0, hi = n.child_count();
+                    std::optional<Node> next;
+                    while (lo < hi) {
+                        std::uint32_t mid = lo + (hi - lo) / 2;
+                        Node child = this->node(static_cast<std::size_t>(n.first_child) + mid);
+                        char8_t c = this->label(child)[0];
+                        if (c == prefix[pos]) {
+                            next = child;
+                            break;
+                        }
+                        else if (c < prefix[pos]) {
+                            lo = mid + 1;
+                        }
+                        else {
+                            hi = mid;
+                        }
+                    }
+                    if (!next) {
+                        return std::nullopt;
+                    }
+                    auto label = this->label(next.value());
+                    std::size_t len = std::min(label.size(), prefix.size() - pos);
+                    if (label.substr(0, len) != prefix.substr(pos, len)) {
+                        return std::nullopt;
+                    }
+                    path += label;
+                    pos += len;
+                    n = next.value();
+                }
+                return n;
+            }
+
+            /// <summary>
+            /// 値が含まれるかを判定する
+            /// </summary>
+            bool contains(std::u8string_view value) const {
+                std::u8string path;
+                auto n = this->descend(value, path);
+                return n && n->terminal() && path.size() == value.size();
+            }
+
+            /// <summary>
+            /// nodeを根とする部分木に含まれる値を昇順で列挙する
+            /// </summary>
+            void collect(const Node& n, std::u8string& path, std::vector<std::u8string>& result, std::size_t limit) const {
+                if (result.size() >= limit) {
+                    return;
+                }
+                if (n.terminal()) {
+                    result.push_back(path);
+                }
+                for (std::uint32_t i = 0; i < n.child_count() && result.size() < limit; ++i) {
+                    Node child = this->node(static_cast<std::size_t>(n.first_child) + i);
+                    std::size_t len = path.size();
+                    path += this->label(child);
+                    this->collect(child, path, result, limit);
+                    path.resize(len);
+                }
+            }
+        };
+    }
+
+    CompletionIndex::CompletionIndex(const std::filesystem::path& dbpath) : _file(CompletionIndex::path(dbpath)) {
+        auto header = read<FileHeader>(this->_file.data(), 0);
+        if (header.magic != magic) {
+            throw std::runtime_error("補完候補の索引の形式が不正です");
+        }
+    }
+
+    std::vector<std::u8string> CompletionIndex::complete(int target, std::u8string_view prefix, std::size_t limit) const {
+        std::vector<std::u8string> result;
+        bool found = false;
+        auto data = this->_file.data();
+        auto header = read<FileHeader>(data, 0);
+        for (std::uint64_t t = 0; t < header.trie_count; ++t) {
+            auto trie_header = read<TrieHeader>(data, sizeof(FileHeader) + t * sizeof(TrieHeader));
+            if (trie_header.target != static_cast<std::uint64_t>(target)) {
+                continue;
+            }
+            found = true;
+            TrieReader trie(data, trie_header);
+            std::u8string path;
+            if (auto n = trie.descend(prefix, path); n) {
+                // trieごとにlimit件まで取得してから併合する
+                std::vector<std::u8string> values;
+                trie.collect(n.value(), path, values, limit);
+                result.insert(result.end(), std::make_move_iterator(values.begin()), std::make_move_iterator(values.end()));
+            }
+        }
+        if (!found) {
+            throw std::invalid_argument("補完対象として指定された列の索引は存在しません");
+        }
+        std::ranges::sort(result);
+        result.erase(std::ranges::unique(result).begin(), result.end());
+        if (result.size() > limit) {
+            result.resize(limit);
+        }
+        return result;
+    }
+
+    std::filesystem::path CompletionIndex::path(const std::filesystem::path& dbpath) {
+        auto p = dbpath;
+        p += u8"-complete";
+        return p;
+    }
+
+    CompletionIndex::Stamp CompletionIndex::stamp(const std::filesystem::path& dbpath) {
+        Stamp s;
+        std::error_code ec;
+        // file change counterはDBヘッダの24バイト目からのビッグエンディアンの4バイト
+        if (std::ifstream ifs(dbpath, std::ios::binary); ifs) {
+            std::array<unsigned char, 28> header{};
+            if (ifs.read(reinterpret_cast<char*>(header.data()), header.size())) {
+                s.change_counter = (std::uint64_t(header[24]) << 24) | (std::uint64_t(header[25]) << 16) | (std::uint64_t(header[26]) << 8) | std::uint64_t(header[27]);
+            }
+        }
+        if (auto size = std::filesystem::file_size(dbpath, ec); !ec) {
+            s.db_size = size;
+        }
+        // WALモードではコミットによってDBファイルが更新されないためWALファイルの状態も含める
+        auto walpath = dbpath;
+        walpath += u8"-wal";
+        if (auto size = std::filesystem::file_size(walpath, ec); !ec) {
+            s.wal_size = size;
+        }
+        if (auto time = std::filesystem::last_write_time(walpath, ec); !ec) {
+            s.wal_mtime = static_cast<std::uint64_t>(time.time_since_epoch().count());
+        }
+        return s;
+    }
+
+    bool CompletionIndex::fresh(const std::filesystem::path& dbpath) {
+        std::ifstream ifs(CompletionIndex::path(dbpath), std::ios::binary);
+        FileHeader header;
+        if (!ifs || !ifs.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+            return false;
+        }
+        return header.magic == magic && header.stamp == CompletionIndex::stamp(dbpath);
+    }
+
+    bool CompletionIndex::build(const std::filesystem::path& dbpath, PasswordManagement& pm) {
+        // 読み取り中に更新された場合は次回に再構築されるよう読み取りより前のスタンプと目印を記録する
+        FileHeader header = { .magic = magic, .stamp = CompletionIndex::stamp(dbpath), .mark = pm.insertionMark(), .trie_count = 0 };
+
+        struct Trie {
+            std::uint64_t target;
+            std::vector<Node> nodes;
+            std::u8string labels;
+            std::uint64_t value_count;
+        };
+        std::vector<Trie> tries;
+        auto add = [&tries](int target, const std::vector<std::u8string>& values) {
+            TrieBuilder builder(values);
+            tries.push_back({ static_cast<std::uint64_t>(target), std::move(builder.nodes), std::move(builder.labels), values.size() });
+        };
+
+        bool incremental = false;
+        if (std::ifstream ifs(CompletionIndex::path(dbpath), std::ios::binary); ifs) {
+            FileHeader old;
+            if (ifs.read(reinterpret_cast<char*>(&old), sizeof(old)) && old.magic == magic
+                && old.mark.last_id <= header.mark.last_id && old.mark.seq <= header.mark.seq) {
+                incremental = pm.insertedOnly(old.mark);
+            }
+        }
+        if (incremental) {
+            // 前回のtrieを複製し、挿入された行の値のうち含まれないものを以前の差分と合わせて差分のtrieとする
+            // (置き換えの前にマップを解除するためスコープを限る)
+            MappedFile file(CompletionIndex::path(dbpath));
+            auto data = file.data();
+            auto old = read<FileHeader>(data, 0);
+            for (int target : targets) {
+                std::optional<TrieReader> base;
+                std::vector<std::u8string> delta;
+                for (std::uint64_t t = 0; t < old.trie_count; ++t) {
+                    auto trie_header = read<TrieHeader>(data, sizeof(FileHeader) + t * sizeof(TrieHeader));
+                    if (trie_header.target != static_cast<std::uint64_t>(target)) {
+                        continue;
+                    }
+                    TrieReader trie(data, trie_header);
+                    if (!base) {
+                        base = trie;
+                    }
+                    else {
+                        std::u8string path;
+                        trie.collect(trie.node(0), path, delta, std::numeric_limits<std::size_t>::max());
+                    }
+                }
+                if (!base) {
+                    incremental = false;
+                    break;
+                }
+                for (auto e : pm.distinctInserted(target, old.mark.last_id)) {
+                    auto value = e.get<SQLiteData::string_type>(0).value();
+                    if (!base->contains(value)) {
+                        delta.emplace_back(value);
+                    }
+                }
+                std::ranges::sort(delta);
+                delta.erase(std::ranges::unique(delta).begin(), delta.end());
+                if (delta.size() > std::max(min_delta_limit, base->header().value_count / 8)) {
+                    incremental = false;
+                    break;
+                }
+
+                const auto& h = base->header();
+                auto nodes = data.subspan(h.node_offset, h.node_count * sizeof(Node));
+                std::vector<Node> copied(h.node_count);
+                std::memcpy(copied.data(), nodes.data(), nodes.size());
+                tries.push_back({ h.target, std::move(copied),
+                    std::u8string(reinterpret_cast<const char8_t*>(data.data() + h.label_offset), h.label_size), h.value_count });
+                if (!delta.empty()) {
+                    add(target, delta);
+                }
+            }
+            if (!incremental) {
+                tries.clear();
+            }
+        }
+        if (!incremental) {
+            for (int target : targets) {
+                std::vector<std::u8string> values;
+                for (auto e : pm.distinct(target)) {
+                    values.emplace_back(e.get<SQLiteData::string_type>(0).value());
+                }
+                add(target, values);
+            }
+        }
+
+        header.trie_count = tries.size();
+        std::vector<TrieHeader> trie_headers;
+        std::uint64_t offset = sizeof(FileHeader) + sizeof(TrieHeader) * tries.size();
+        for (const auto& trie : tries) {
+            TrieHeader trie_header = {
+                .target = trie.target,
+                .node_offset = offset,
+                .node_count = trie.nodes.size(),
+                .label_offset = offset + trie.nodes.size() * sizeof(Node),
+                .label_size = trie.labels.size(),
+                .value_count = trie.value_count
+            };
+            // 次のノードの配列が境界に揃うように調整する
+            offset = (trie_header.label_offset + trie_header.label_size + 7) & ~std::uint64_t(7);
+            trie_headers.push_back(trie_header);
+        }
+
+        // 一時ファイルへ書き出してから置き換えることで読み取り側が書き込み途中の索引を参照しないようにする
+        auto tmppath = CompletionIndex::path(dbpath);
+        tmppath += u8".tmp";
+        {
+            std::ofstream ofs(tmppath, std::ios::binary | std::ios::trunc);
+            if (!ofs) {
+                throw std::runtime_error("補完候補の索引の書き出しに失敗");
+            }
+            ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            ofs.write(reinterpret_cast<const char*>(trie_headers.data()), trie_headers.size() * sizeof(TrieHeader));
+            for (std::size_t i = 0; i < tries.size(); ++i) {
+                const auto& trie = tries[i];
+                ofs.seekp(static_cast<std::streamoff>(trie_headers[i].node_offset));
+                ofs.write(reinterpret_cast<const char*>(trie.nodes.data()), trie.nodes.size() * sizeof(Node));
+                ofs.write(reinterpret_cast<const char*>(trie.labels.data()), trie.labels.size());
+            }
+            if (!ofs) {
+                throw std::runtime_error("補完候補の索引の書き出しに失敗");
+            }
+        }
+        std::filesystem::rename(tmppath, CompletionIndex::path(dbpath));
+        return incremental;
+    }
+}
@@ -0,0 +1,106 @@
+﻿#pragma once
+
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "MappedFile.h"
+#include "PasswordManagement.h"
+
+namespace pwm {
+
+	/// <summary>
+	/// 補完候補の検索のためのradix trieをファイルとして保持するクラス
+	/// </summary>
+	/// <remarks>
+	/// ファイルは不変でありメモリマップしてそのまま探索する。
+	/// DBファイルの変更を検知するとbuildにより再構築する。前回の構築以降の変更が行の挿入のみであれば
+	/// 前回のtrieをそのまま複製し、挿入された行の値のうち含まれないものだけを差分のtrieとして追加する。
+	/// 既存の行の更新や削除があるか、差分が大きくなったときはすべての行から構築し直す。
+	/// </remarks>
+	class CompletionIndex {
+	public:
+		/// <summary>
+		/// DBファイルの状態を示すスタンプ(一致すれば索引は最新である)
+		/// </summary>
+		struct Stamp {
+			/// <summary>
+			/// DBヘッダのfile change counter
+			/// </summary>
+			std::uint64_t change_counter = 0;
+			/// <summary>
+			/// DBファイルのサイズ
+			/// </summary>
+			std::uint64_t db_size = 0;
+			/// <summary>
+			/// WALファイルのサイズ
+			/// </summary>
+			std::uint64_t wal_size = 0;
+			/// <summary>
+			/// WALファイルの更新日時
+			/// </summary>
+			std::uint64_t wal_mtime = 0;
+
+			friend bool operator==(const Stamp&, const Stamp&) = default;
+		};
+
+		/// <summary>
+		/// 補完対象のカラム(passwordsのカラムに関連付けられたインデックス)の一覧
+		/// </summary>
+		static constexpr int targets[] = { table::passwords::c_service::index, table::passwords::c_name::index };
+
+		/// <summary>
+		/// 差分のtrieの値の数がこれと前回に構築したtrieの値の数の1/8のいずれも超えるとすべての行から構築し直す
+		/// </summary>
+		static constexpr std::uint64_t min_delta_limit = 4096;
+
+	private:
+		/// <summary>
+		/// メモリマップした索引ファイル
+		/// </summary>
+		MappedFile _file;
+
+	public:
+		CompletionIndex() = delete;
+		/// <summary>
+		/// 構築済みの索引を開く
+		/// </summary>
+		/// <param name="dbpath">データベースへのパス</param>
+		CompletionIndex(const std::filesystem::path& dbpath);
+
+		/// <summary>
+		/// 前方一致する値を昇順で取得する
+		/// </summary>
+		/// <param name="target">補完対象(passwordsのカラムに関連付けられたインデックス)</param>
+		/// <param name="prefix">接頭辞</param>
+		/// <param name="limit">取得する最大件数</param>
+		/// <returns>前方一致する値の一覧</returns>
+		[[nodiscard]] std::vector<std::u8string> complete(int target, std::u8string_view prefix, std::size_t limit) const;
+
+		/// <summary>
+		/// 索引の格納されたファイルのパスを取得する
+		/// </summary>
+		/// <param name="dbpath">データベースへのパス</param>
+		static std::filesystem::path path(const std::filesystem::path& dbpath);
+
+		/// <summary>
+		/// SQLiteを開かずにDBファイルの現在のスタンプを取得する
+		/// </summary>
+		/// <param name="dbpath">データベースへのパス</param>
+		static Stamp stamp(const std::filesystem::path& dbpath);
+
+		/// <summary>
+		/// 索引がDBファイルの現在の状態に対して最新であるかを判定する
+		/// </summary>
+		/// <param name="dbpath">データベースへのパス</param>
+		static bool fresh(const std::filesystem::path& dbpath);
+
+		/// <summary>
+		/// 索引を構築してファイルへ書き出す
+		/// </summary>
+		/// <param name="dbpath">データベースへのパス</param>
+		/// <param name="pm">パスワード管理を行うオブジェクト</param>
+		/// <returns>前回の索引に差分を追加したならtrue、すべての行から構築したならfalse</returns>
+		static bool build(const std::filesystem::path& dbpath, PasswordManagement& pm);
+	};
+}
@@ -0,0 +1,31 @@
+﻿#include "CpuFeatures.h"
+#if defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#endif
+
+const CpuFeatures& CpuFeatures::current() noexcept {
+    static const CpuFeatures features = []() {
+        CpuFeatures x;
+#if defined(_M_X64) || defined(_M_IX86)
+        int info[4];
+        __cpuid(info, 0);
+        auto max_leaf = info[0];
+        __cpuid(info, 1);
+        x.sse2 = (info[3] & (1 << 26)) != 0;
+        x.ssse3 = (info[2] & (1 << 9)) != 0;
+        // AVX2はOSがYMMレジスタを保存する場合のみ利用できる
+        bool ymm = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+        if (ymm && max_leaf >= 7) {
+            __cpuidex(info, 7, 0);
+            x.avx2 = (info[1] & (1 << 5)) != 0;
+        }
+#elif defined(__x86_64__) || defined(__i386__)
+        __builtin_cpu_init();
+        x.sse2 = __builtin_cpu_supports("sse2");
+        x.ssse3 = __builtin_cpu_supports("ssse3");
+        x.avx2 = __builtin_cpu_supports("avx2");
+#endif
+        return x;
+    }();
+    return features;
+}
@@ -0,0 +1,24 @@
+﻿#pragma once
+
+/// <summary>
+/// 実行環境のCPUで利用可能な拡張命令セット
+/// </summary>
+struct CpuFeatures {
+	/// <summary>
+	/// SSE2を利用可能か
+	/// </summary>
+	bool sse2 = false;
+	/// <summary>
+	/// SSSE3を利用可能か
+	/// </summary>
+	bool ssse3 = false;
+	/// <summary>
+	/// AVX2を利用可能か(OSがYMMレジスタを保存する場合に限る)
+	/// </summary>
+	bool avx2 = false;
+
+	/// <summary>
+	/// 実行環境のCPUで利用可能な拡張命令セットを取得する(初回のみ判定する)
+	/// </summary>
+	static const CpuFeatures& current() noexcept;
+};
@@ -0,0 +1,280 @@
+﻿#include "CsvTokenizer.h"
+#include "CpuFeatures.h"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#define PWM_CSV_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#define PWM_TARGET_SSE2
+#define PWM_TARGET_AVX2
+#else
+#define PWM_TARGET_SSE2 __attribute__((target("sse2")))
+#define PWM_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace {
+
+    constexpr std::size_t block_size = pwm::CsvTokenizer::block_size;
+
+    /// <summary>
+    /// 各ビットについて最下位ビットからそのビットまでの累積XORを求める
+    /// </summary>
+    inline std::uint64_t prefixXor(std::uint64_t x) noexcept {
+        x ^= x << 1;
+        x ^= x << 2;
+        x ^= x << 4;
+        x ^= x << 8;
+        x ^= x << 16;
+        x ^= x << 32;
+        return x;
+    }
+
+    /// <summary>
+    /// 1ブロックのビットマスクから引用符の外側にある区切り文字と改行の位置を追加する
+    /// </summary>
+    /// <param name="quote">引用符の位置</param>
+    /// <param name="sep">区切り文字と改行の位置</param>
+    /// <param name="in_quote">ブロックの直前が引用符の内側であるか(ブロックの末尾の状態で更新する)</param>
+    /// <param name="base">ブロックの先頭のバッファ内の位置</param>
+    /// <param name="seps">位置を追加する変数</param>
+    inline void emit(std::uint64_t quote, std::uint64_t sep, std::uint64_t& in_quote, std::uint32_t base, std::vector<std::uint32_t>& seps) {
+        // 引用符の内側(開き引用符から閉じ引用符の直前まで)のビットを1とする
+        auto inside = prefixXor(quote) ^ in_quote;
+        in_quote = static_cast<std::uint64_t>(static_cast<std::int64_t>(inside) >> 63);
+        auto mask = sep & ~inside;
+        if (mask == 0) {
+            return;
+        }
+        auto n = seps.size();
+        seps.resize(n + static_cast<std::size_t>(std::popcount(mask)));
+        auto* out = seps.data() + n;
+        do {
+            *out++ = base + static_cast<std::uint32_t>(std::countr_zero(mask));
+            mask &= mask - 1;
+        } while (mask != 0);
+    }
+
+    /// <summary>
+    /// 1バイトずつ引用符の状態を追跡して探索する
+    /// </summary>
+    void scanScalar(const char8_t* p, std::size_t blocks, std::uint64_t& in_quote, std::uint32_t base, std::vector<std::uint32_t>& seps) {
+        auto n = blocks * block_size;
+        for (std::size_t i = 0; i < n; ++i) {
+            auto c = p[i];
+            if (c == u8'"') {
+                in_quote = ~in_quote;
+            }
+            else if (in_quote == 0 && (c == u8',' || c == u8'\n')) {
+                seps.push_back(base + static_cast<std::uint32_t>(i));
+            }
+        }
+    }
+
+#if defined(PWM_CSV_X86)
+    /// <summary>
+    /// SSE2により16バイトずつ比較して探索する
+    /// </summary>
+    PWM_TARGET_SSE2 void scanSse2(const char8_t* p, std::size_t blocks, std::uint64_t& in_quote, std::uint32_t base, std::vector<std::uint32_t>& seps) {
+        const auto quote_v = _mm_set1_epi8('"');
+        const auto comma_v = _mm_set1_epi8(',');
+        const auto newline_v = _mm_set1_epi8('\n');
+        for (std::size_t b = 0; b < blocks; ++b, p += block_size, base += block_size) {
+            std::uint64_t quote = 0;
+            std::uint64_t sep = 0;
+            for (int i = 0; i < 4; ++i) {
+                auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i * 16));
+                quote |= static_cast<std::uint64_t>(static_cast<std::uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, quote_v)))) << (i * 16);
+                sep |= static_cast<std::uint64_t>(static_cast<std::uint16_t>(_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, comma_v), _mm_cmpeq_epi8(v, newline_v))))) << (i * 16);
+            }
+            emit(quote, sep, in_quote, base, seps);
+        }
+    }
+
+    /// <summary>
+    /// AVX2により32バイトずつ比較して探索する
+    /// </summary>
+    PWM_TARGET_AVX2 void scanAvx2(const char8_t* p, std::size_t blocks, std::uint64_t& in_quote, std::uint32_t base, std::vector<std::uint32_t>& seps) {
+        const auto quote_v = _mm256_set1_epi8('"');
+        const auto comma_v = _mm256_set1_epi8(',');
+        const auto newline_v = _mm256_set1_epi8('\n');
+        for (std::size_t b = 0; b < blocks; ++b, p += block_size, base += block_size) {
+            auto lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            auto hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32));
+            auto quote = static_cast<std::uint64_t>(static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, quote_v))))
+                | static_cast<std::uint64_t>(static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, quote_v)))) << 32;
+            auto sep = static_cast<std::uint64_t>(static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(lo, comma_v), _mm256_cmpeq_epi8(lo, newline_v)))))
+                | static_cast<std::uint64_t>(static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(hi, comma_v), _mm256_cmpeq_epi8(hi, newline_v))))) << 32;
+            emit(quote, sep, in_quote, base, seps);
+        }
+    }
+#endif
+
+    /// <summary>
+    /// 指定された命令セットによりブロック単位で探索する
+    /// </summary>
+    void scanBlocks(pwm::CsvScanMode mode, const char8_t* p, std::size_t blocks, std::uint64_t& in_quote, std::uint32_t base, std::vector<std::uint32_t>& seps) {
+        switch (mode) {
+#if defined(PWM_CSV_X86)
+        case pwm::CsvScanMode::avx2: scanAvx2(p, blocks, in_quote, base, seps); break;
+        case pwm::CsvScanMode::sse2: scanSse2(p, blocks, in_quote, base, seps); break;
+#endif
+        default: scanScalar(p, blocks, in_quote, base, seps); break;
+        }
+    }
+}
+
+pwm::CsvScanMode pwm::CsvTokenizer::bestMode() noexcept {
+#if defined(PWM_CSV_X86)
+    const auto& cpu = CpuFeatures::current();
+    return cpu.avx2 ? CsvScanMode::avx2 : cpu.sse2 ? CsvScanMode::sse2 : CsvScanMode::scalar;
+#else
+    return CsvScanMode::scalar;
+#endif
+}
+
+pwm::CsvTokenizer::CsvTokenizer(std::istream& is, CsvScanMode mode) : _is(is), _mode(mode), _buf(default_buffer_size) {
+    auto best = bestMode();
+    if (this->_mode == CsvScanMode::automatic) {
+        this->_mode = best;
+    }
+    else if (this->_mode > best) {
+        throw std::invalid_argument("実行環境では指定された命令セットを利用できません");
+    }
+    this->fill();
+    // UTF-8のBOMは読み飛ばす
+    if (this->_end >= 3 && std::u8string_view(this->_buf.data(), 3) == u8"\uFEFF") {
+        this->_pos = 3;
+    }
+}
+
+void pwm::CsvTokenizer::fill() {
+    // 未処理のレコードを先頭へ移動する(探索はレコードの先頭からやり直す)
+    auto keep = this->_end - this->_pos;
+    if (this->_pos != 0) {
+        std::memmove(this->_buf.data(), this->_buf.data() + this->_pos, keep);
+    }
+    else if (keep == this->_buf.size()) {
+        // 1レコードがバッファに収まらなければ拡張する
+        if (this->_buf.size() > std::numeric_limits<std::uint32_t>::max() / 2) {
+            throw std::runtime_error("レコードが長すぎます");
+        }
+        this->_buf.resize(this->_buf.size() * 2);
+    }
+    this->_pos = 0;
+    this->_end = keep;
+
+    auto request = this->_buf.size() - this->_end;
+    this->_is.read(std::bit_cast<char*>(this->_buf.data() + this->_end), static_cast<std::streamsize>(request));
+    auto n = static_cast<std::size_t>(this->_is.gcount());
+    this->_end += n;
+    this->_bytes += n;
+    this->_eof = n < request;
+
+    this->_scanned = 0;
+    this->_in_quote = 0;
+    this->_seps.clear();
+    this->_sep_index = 0;
+    this->scan();
+}
+
+void pwm::CsvTokenizer::scan() {
+    auto blocks = (this->_end - this->_scanned) / block_size;
+    scanBlocks(this->_mode, this->_buf.data() + this->_scanned, blocks, this->_in_quote, static_cast<std::uint32_t>(this->_scanned), this->_seps);
+    this->_scanned += blocks * block_size;
+    if (this->_eof && this->_scanned < this->_end) {
+        // 末尾の端数は0で埋めたブロックとして探索する
+        char8_t tail[block_size] = {};
+        std::copy(this->_buf.data() + this->_scanned, this->_buf.data() + this->_end, tail);
+        scanBlocks(this->_mode, tail, 1, this->_in_quote, static_cast<std::uint32_t>(this->_scanned), this->_seps);
+        this->_scanned = this->_end;
+    }
+}
+
+std::u8string_view pwm::CsvTokenizer::field(std::size_t begin, std::size_t end) {
+    auto* data = this->_buf.data();
+    if (begin == end || data[begin] != u8'"') {
+        std::u8string_view x(data + begin, end - begin);
+        if (x.find(u8'"') != std::u8string_view::npos) {
+            throw std::runtime_error("引用符で囲まれていないフィールドに引用符が含まれています");
+        }
+        return x;
+    }
+    if (end - begin < 2 || data[end - 1] != u8'"') {
+        throw std::runtime_error("引用符で囲まれたフィールドの後に区切り文字がありません");
+    }
+    auto* first = data + begin + 1;
+    auto* last = data + end - 1;
+    // 引用符の内側の改行も行数に含める
+    this->_line += static_cast<std::uint64_t>(std::count(first, last, u8'\n'));
+    auto* q = std::find(first, last, u8'"');
+    if (q == last) {
+        return { first, static_cast<std::size_t>(last - first) };
+    }
+    // ""を"へ置換して前方へ詰める
+    auto* out = q;
+    for (auto* p = q; p != last; ++p) {
+        if (*p == u8'"') {
+            if (p + 1 == last || p[1] != u8'"') {
+                throw std::runtime_error("引用符で囲まれたフィールドの後に区切り文字がありません");
+            }
+            ++p;
+        }
+        *out++ = *p;
+    }
+    return { first, static_cast<std::size_t>(out - first) };
+}
+
+bool pwm::CsvTokenizer::next(std::vector<std::u8string_view>& fields) {
+    fields.clear();
+    this->_spans.clear();
+    auto begin = this->_pos;
+    bool newline = false;
+    while (true) {
+        if (this->_sep_index < this->_seps.size()) {
+            std::size_t p = this->_seps[this->_sep_index++];
+            this->_spans.emplace_back(begin, p);
+            begin = p + 1;
+            if (this->_buf[p] == u8'\n') {
+                newline = true;
+                break;
+            }
+            continue;
+        }
+        if (!this->_eof) {
+            // バッファを詰め直すためレコードの先頭からやり直す
+            this->fill();
+            this->_spans.clear();
+            begin = this->_pos;
+            continue;
+        }
+        if (this->_spans.empty() && begin == this->_end) {
+            return false;
+        }
+        if (this->_in_quote != 0) {
+            throw std::runtime_error("引用符が閉じられていません");
+        }
+        this->_spans.emplace_back(begin, this->_end);
+        begin = this->_end;
+        break;
+    }
+    this->_pos = begin;
+
+    // 改行の直前の\rは除く
+    auto& back = this->_spans.back();
+    if (back.second != back.first && this->_buf[back.second - 1] == u8'\r') {
+        --back.second;
+    }
+    // レコードが揃ってからバッファ内で""の置換を行う
+    for (const auto& [first, last] : this->_spans) {
+        fields.push_back(this->field(first, last));
+    }
+    if (newline) {
+        ++this->_line;
+    }
+    return true;
+}
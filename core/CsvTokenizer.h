@@ -0,0 +1,155 @@
+﻿#pragma once
+
+#include <istream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+namespace pwm {
+
+	/// <summary>
+	/// 区切り文字等の探索に用いる命令セットの列挙
+	/// </summary>
+	enum class CsvScanMode {
+		/// <summary>
+		/// 実行環境で利用可能な最速の命令セット
+		/// </summary>
+		automatic,
+		/// <summary>
+		/// 1バイトずつ判定する(比較の基準)
+		/// </summary>
+		scalar,
+		/// <summary>
+		/// SSE2により16バイトずつ判定する
+		/// </summary>
+		sse2,
+		/// <summary>
+		/// AVX2により32バイトずつ判定する
+		/// </summary>
+		avx2
+	};
+
+	/// <summary>
+	/// RFC 4180形式のCSVを1レコードずつ分割するクラス
+	/// </summary>
+	/// <remarks>
+	/// 64バイトのブロックごとに引用符、区切り文字、改行の位置をビットマスクとして求め、
+	/// 引用符のマスクの累積XORにより引用符の内側にある区切り文字と改行を除外する。
+	/// フィールドは内部のバッファを指すため次のレコードを読み取るまでのみ有効である。
+	/// 引用符はフィールドの先頭と末尾にのみ記述できる。
+	/// </remarks>
+	class CsvTokenizer {
+	public:
+		/// <summary>
+		/// 1度に判定するブロックのバイト数
+		/// </summary>
+		static constexpr std::size_t block_size = 64;
+		/// <summary>
+		/// バッファの初期サイズ
+		/// </summary>
+		static constexpr std::size_t default_buffer_size = 1 << 20;
+
+	private:
+		std::istream& _is;
+		CsvScanMode _mode;
+		/// <summary>
+		/// 入力を読み込むバッファ
+		/// </summary>
+		std::vector<char8_t> _buf;
+		/// <summary>
+		/// 未処理のレコードの先頭
+		/// </summary>
+		std::size_t _pos = 0;
+		/// <summary>
+		/// バッファ内の有効なデータの末尾
+		/// </summary>
+		std::size_t _end = 0;
+		/// <summary>
+		/// 区切り文字等の探索を終えた位置
+		/// </summary>
+		std::size_t _scanned = 0;
+		/// <summary>
+		/// 探索を終えた位置が引用符の内側であるか(全ビットが1であれば内側)
+		/// </summary>
+		std::uint64_t _in_quote = 0;
+		/// <summary>
+		/// 引用符の外側にある区切り文字と改行の位置
+		/// </summary>
+		std::vector<std::uint32_t> _seps;
+		/// <summary>
+		/// 次に処理する_sepsの要素
+		/// </summary>
+		std::size_t _sep_index = 0;
+		/// <summary>
+		/// 読み取り中のレコードのフィールドの範囲
+		/// </summary>
+		std::vector<std::pair<std::size_t, std::size_t>> _spans;
+		/// <summary>
+		/// 入力の終端に達したか
+		/// </summary>
+		bool _eof = false;
+		/// <summary>
+		/// 次に読み取る行の行番号
+		/// </summary>
+		std::uint64_t _line = 1;
+		/// <summary>
+		/// 読み込んだバイト数
+		/// </summary>
+		std::uint64_t _bytes = 0;
+
+		/// <summary>
+		/// 未処理のレコードをバッファの先頭へ移動して入力を追加で読み込む
+		/// </summary>
+		void fill();
+
+		/// <summary>
+		/// 未探索の領域から区切り文字と改行の位置を求める
+		/// </summary>
+		void scan();
+
+		/// <summary>
+		/// フィールドの範囲から引用符を除いた値を得る
+		/// </summary>
+		/// <param name="begin">フィールドの先頭</param>
+		/// <param name="end">フィールドの末尾</param>
+		/// <returns>値(バッファ内で""を"へ置換する)</returns>
+		std::u8string_view field(std::size_t begin, std::size_t end);
+
+	public:
+		CsvTokenizer() = delete;
+		/// <summary>
+		/// 入力ストリームを分割するオブジェクトを構築する
+		/// </summary>
+		/// <param name="is">入力ストリーム(バイナリモードで開くこと)</param>
+		/// <param name="mode">探索に用いる命令セット</param>
+		CsvTokenizer(std::istream& is, CsvScanMode mode = CsvScanMode::automatic);
+
+		/// <summary>
+		/// 1レコードを読み取る
+		/// </summary>
+		/// <param name="fields">読み取ったフィールドを格納する変数(次の呼び出しまで有効)</param>
+		/// <returns>終端に達していればfalse</returns>
+		bool next(std::vector<std::u8string_view>& fields);
+
+		/// <summary>
+		/// 次に読み取る行の行番号
+		/// </summary>
+		std::uint64_t line() const noexcept { return this->_line; }
+
+		/// <summary>
+		/// 入力から読み込んだバイト数
+		/// </summary>
+		std::uint64_t bytes() const noexcept { return this->_bytes; }
+
+		/// <summary>
+		/// 実際に探索に用いる命令セット
+		/// </summary>
+		CsvScanMode mode() const noexcept { return this->_mode; }
+
+		/// <summary>
+		/// 実行環境で利用可能な最速の命令セットを取得する
+		/// </summary>
+		static CsvScanMode bestMode() noexcept;
+	};
+}
@@ -0,0 +1,447 @@
+﻿#include "KeyAgent.h"
+#include <algorithm>
+#include <cstring>
+#include <format>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#if !defined(_MSC_VER)
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/prctl.h>
+#endif
+#endif
+
+namespace pwm {
+    namespace {
+        /// <summary>
+        /// 応答の先頭を示す値
+        /// </summary>
+        constexpr std::string_view agent_magic = "PWMA";
+        /// <summary>
+        /// 応答の形式のバージョン
+        /// </summary>
+        constexpr std::uint32_t agent_version = 1;
+        /// <summary>
+        /// 鍵を要求するコマンド
+        /// </summary>
+        constexpr char agent_request_keys = 'K';
+        /// <summary>
+        /// 停止を要求するコマンド
+        /// </summary>
+        constexpr char agent_request_stop = 'Q';
+        /// <summary>
+        /// 受け取る応答のサイズの上限
+        /// </summary>
+        constexpr std::size_t agent_max_response = 64 * 1024;
+
+        /// <summary>
+        /// 最適化により省略されないよう領域を0で埋める
+        /// </summary>
+        void wipe(std::span<std::byte> data) noexcept {
+            volatile std::byte* p = data.data();
+            for (std::size_t i = 0; i < data.size(); ++i) {
+                p[i] = std::byte{ 0 };
+            }
+        }
+
+        /// <summary>
+        /// 鍵を応答の形式で表現したときのバイト数
+        /// </summary>
+        std::size_t serializedSize(std::span<const VaultKeyMaterial> keys) {
+            std::size_t size = agent_magic.size() + 8;
+            for (const auto& x : keys) {
+                size += 8 + x.method.size() + x.key.size() + x.verifier.size();
+            }
+            return size;
+        }
+
+        /// <summary>
+        /// 鍵を応答の形式で書き込む
+        /// </summary>
+        /// <remarks>
+        /// 形式は[PWMA][バージョン][鍵の数]に続けて鍵ごとに[世代][方式の名称の長さ][方式の名称][鍵][照合値]とする(整数は4バイトのリトルエンディアン)
+        /// </remarks>
+        void serialize(std::span<const VaultKeyMaterial> keys, std::byte* out) {
+            auto put = [&out](const void* p, std::size_t n) {
+                std::memcpy(out, p, n);
+                out += n;
+            };
+            auto put32 = [&put](std::uint32_t x) {
+                unsigned char b[4] = { static_cast<unsigned char>(x), static_cast<unsigned char>(x >> 8), static_cast<unsigned char>(x >> 16), static_cast<unsigned char>(x >> 24) };
+                put(b, 4);
+            };
+            put(agent_magic.data(), agent_magic.size());
+            put32(agent_version);
+            put32(static_cast<std::uint32_t>(keys.size()));
+            for (const auto& x : keys) {
+                put32(x.generation);
+                put32(static_cast<std::uint32_t>(x.method.size()));
+                put(x.method.data(), x.method.size());
+                put(x.key.data(), x.key.size());
+                put(x.verifier.data(), x.verifier.size());
+            }
+        }
+
+        /// <summary>
+        /// 応答の形式から鍵を読み取る
+        /// </summary>
+        /// <returns>鍵(形式が不正であればnullopt)</returns>
+        std::optional<std::vector<VaultKeyMaterial>> deserialize(std::span<const std::byte> in) {
+            auto take = [&in](void* p, std::size_t n) {
+                if (in.size() < n) {
+                    return false;
+                }
+                std::memcpy(p, in.data(), n);
+                in = in.subspan(n);
+                return true;
+            };
+            auto take32 = [&take](std::uint32_t& x) {
+                unsigned char b[4];
+                if (!take(b, 4)) {
+                    return false;
+                }
+                x = std::uint32_t(b[0]) | (std::uint32_t(b[1]) << 8) | (std::uint32_t(b[2]) << 16) | (std::uint32_t(b[3]) << 24);
+                return true;
+            };
+            char magic[4];
+            std::uint32_t version = 0, count = 0;
+            if (!take(magic, 4) || std::string_view(magic, 4) != agent_magic || !take32(version) || version != agent_version || !take32(count)) {
+                return std::nullopt;
+            }
+            std::vector<VaultKeyMaterial> result;
+            for (std::uint32_t i = 0; i < count; ++i) {
+                VaultKeyMaterial x;
+                std::uint32_t length = 0;
+                if (!take32(x.generation) || !take32(length) || length > in.size()) {
+                    return std::nullopt;
+                }
+                x.method.resize(length);
+                if (!take(x.method.data(), length) || !take(x.key.data(), x.key.size()) || !take(x.verifier.data(), x.verifier.size())) {
+                    return std::nullopt;
+                }
+                result.push_back(std::move(x));
+            }
+            if (!in.empty()) {
+                return std::nullopt;
+            }
+            return result;
+        }
+
+#if !defined(_MSC_VER)
+        /// <summary>
+        /// 接続先のプロセスのユーザIDが自身と一致するかを判定する
+        /// </summary>
+        bool samePeer(int fd) noexcept {
+#if defined(__linux__)
+            ucred cred{};
+            socklen_t length = sizeof(cred);
+            if (::getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &length) != 0) {
+                return false;
+            }
+            return cred.uid == ::geteuid();
+#else
+            uid_t uid = 0;
+            gid_t gid = 0;
+            if (::getpeereid(fd, &uid, &gid) != 0) {
+                return false;
+            }
+            return uid == ::geteuid();
+#endif
+        }
+
+        /// <summary>
+        /// ソケットのアドレスを構築する
+        /// </summary>
+        sockaddr_un socketAddress(const std::filesystem::path& path) {
+            sockaddr_un addr{};
+            addr.sun_family = AF_UNIX;
+            const auto& str = path.native();
+            if (str.empty() || str.size() >= sizeof(addr.sun_path)) {
+                throw std::invalid_argument("ソケットのパスが長すぎます: " + str);
+            }
+            std::memcpy(addr.sun_path, str.c_str(), str.size() + 1);
+            return addr;
+        }
+
+        /// <summary>
+        /// 送受信が相手の応答を待ち続けないよう時間の上限を設定する
+        /// </summary>
+        void setTimeout(int fd, std::chrono::milliseconds timeout) noexcept {
+            timeval tv{ .tv_sec = static_cast<time_t>(timeout.count() / 1000), .tv_usec = static_cast<suseconds_t>(timeout.count() % 1000 * 1000) };
+            ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+            ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        }
+
+        /// <summary>
+        /// すべてのバイト列を送信する(接続が切断されてもSIGPIPEを発生させない)
+        /// </summary>
+        bool sendAll(int fd, std::span<const std::byte> data) noexcept {
+#if defined(MSG_NOSIGNAL)
+            constexpr int flags = MSG_NOSIGNAL;
+#else
+            constexpr int flags = 0;
+#endif
+            while (!data.empty()) {
+                auto n = ::send(fd, data.data(), data.size(), flags);
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n <= 0) {
+                    return false;
+                }
+                data = data.subspan(static_cast<std::size_t>(n));
+            }
+            return true;
+        }
+
+        /// <summary>
+        /// エージェントへ接続してコマンドを送信する
+        /// </summary>
+        /// <returns>接続したソケット(エージェントが存在しなければ-1)</returns>
+        int request(const std::filesystem::path& path, char command) {
+            if (path.empty()) {
+                return -1;
+            }
+            auto addr = socketAddress(path);
+            int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd < 0) {
+                return -1;
+            }
+            ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+            // エージェントを装った他のユーザのプロセスへは要求を送らない
+            if (::connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0 || !samePeer(fd)) {
+                ::close(fd);
+                return -1;
+            }
+            setTimeout(fd, std::chrono::milliseconds(2000));
+            if (!sendAll(fd, std::as_bytes(std::span(&command, 1)))) {
+                ::close(fd);
+                return -1;
+            }
+            return fd;
+        }
+
+        /// <summary>
+        /// 切断されるまで受信する
+        /// </summary>
+        /// <returns>受信したバイト列(上限を超えたか受信に失敗すればnullopt)</returns>
+        std::optional<std::vector<std::byte>> receiveAll(int fd) {
+            std::vector<std::byte> buffer(agent_max_response);
+            std::size_t size = 0;
+            while (true) {
+                if (size == buffer.size()) {
+                    wipe(buffer);
+                    return std::nullopt;
+                }
+                auto n = ::recv(fd, buffer.data() + size, buffer.size() - size, 0);
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n < 0) {
+                    wipe(buffer);
+                    return std::nullopt;
+                }
+                if (n == 0) {
+                    break;
+                }
+                size += static_cast<std::size_t>(n);
+            }
+            buffer.resize(size);
+            return buffer;
+        }
+#endif
+    }
+
+#if defined(_MSC_VER)
+    KeyAgent::KeyAgent(const std::filesystem::path& path, std::span<const VaultKeyMaterial> keys) : _path(path) {
+        throw std::runtime_error("Windowsではエージェントは利用できません");
+    }
+
+    KeyAgent::~KeyAgent() {}
+
+    std::uint64_t KeyAgent::serve(std::chrono::seconds ttl, const std::atomic<bool>& stop) {
+        return 0;
+    }
+
+    std::filesystem::path keyAgentPath(std::u8string_view vault) {
+        return {};
+    }
+
+    std::optional<std::vector<VaultKeyMaterial>> fetchAgentKeys(const std::filesystem::path& path) {
+        return std::nullopt;
+    }
+
+    bool stopKeyAgent(const std::filesystem::path& path) {
+        return false;
+    }
+#else
+    KeyAgent::KeyAgent(const std::filesystem::path& path, std::span<const VaultKeyMaterial> keys) : _path(path) {
+        auto addr = socketAddress(path);
+
+        // 鍵はスワップされないようロックし、コアダンプにも含めない領域に保持する
+        const auto page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+        this->_size = serializedSize(keys);
+        this->_capacity = (this->_size + page - 1) / page * page;
+        void* p = ::mmap(nullptr, this->_capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) {
+            throw std::runtime_error("鍵を保持する領域の確保に失敗");
+        }
+        this->_data = static_cast<std::byte*>(p);
+        if (::mlock(this->_data, this->_capacity) != 0) {
+            ::munmap(this->_data, this->_capacity);
+            throw std::runtime_error("鍵を保持する領域のロックに失敗(RLIMIT_MEMLOCKを確認してください)");
+        }
+#if defined(__linux__)
+        ::madvise(this->_data, this->_capacity, MADV_DONTDUMP);
+        // 同一ユーザの他のプロセスからもメモリを読み取られないようにする(ptraceの禁止)
+        ::prctl(PR_SET_DUMPABLE, 0, 0, 0, 0);
+#endif
+        serialize(keys, this->_data);
+
+        try {
+            // ソケットを置くディレクトリは所有者のみがアクセスできなければならない
+            auto dir = path.parent_path();
+            if (::mkdir(dir.c_str(), 0700) != 0 && errno != EEXIST) {
+                throw std::runtime_error("ソケットのディレクトリの作成に失敗: " + dir.string());
+            }
+            struct stat st{};
+            if (::lstat(dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode) || st.st_uid != ::geteuid() || (st.st_mode & 077) != 0) {
+                throw std::runtime_error("ソケットのディレクトリが他のユーザからアクセス可能です: " + dir.string());
+            }
+
+            this->_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            if (this->_fd < 0) {
+                throw std::runtime_error("ソケットの作成に失敗");
+            }
+            ::fcntl(this->_fd, F_SETFD, FD_CLOEXEC);
+            if (::bind(this->_fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+                if (errno != EADDRINUSE) {
+                    throw std::runtime_error("ソケットのバインドに失敗: " + path.string());
+                }
+                // 応答するエージェントが存在しなければ異常終了したエージェントのソケットとして置き換える
+                if (int fd = request(path, '\0'); fd >= 0) {
+                    ::close(fd);
+                    throw std::runtime_error("他のエージェントが既に起動しています: " + path.string());
+                }
+                ::unlink(path.c_str());
+                if (::bind(this->_fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+                    throw std::runtime_error("ソケットのバインドに失敗: " + path.string());
+                }
+            }
+            ::chmod(path.c_str(), 0600);
+            if (::listen(this->_fd, 16) != 0) {
+                ::unlink(path.c_str());
+                throw std::runtime_error("ソケットの待ち受けに失敗");
+            }
+        }
+        catch (...) {
+            if (this->_fd >= 0) {
+                ::close(this->_fd);
+            }
+            wipe({ this->_data, this->_capacity });
+            ::munlock(this->_data, this->_capacity);
+            ::munmap(this->_data, this->_capacity);
+            throw;
+        }
+    }
+
+    KeyAgent::~KeyAgent() {
+        ::close(this->_fd);
+        ::unlink(this->_path.c_str());
+        wipe({ this->_data, this->_capacity });
+        ::munlock(this->_data, this->_capacity);
+        ::munmap(this->_data, this->_capacity);
+    }
+
+    std::uint64_t KeyAgent::serve(std::chrono::seconds ttl, const std::atomic<bool>& stop) {
+        // 停止の要求を確認する間隔
+        constexpr auto interval = std::chrono::milliseconds(500);
+        const auto deadline = std::chrono::steady_clock::now() + ttl;
+        std::uint64_t served = 0;
+        while (!stop.load(std::memory_order_relaxed)) {
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+            if (remaining.count() <= 0) {
+                break;
+            }
+            pollfd pfd{ .fd = this->_fd, .events = POLLIN, .revents = 0 };
+            int ready = ::poll(&pfd, 1, static_cast<int>(std::min(remaining, std::chrono::milliseconds(interval)).count()));
+            if (ready <= 0) {
+                continue;
+            }
+            int fd = ::accept(this->_fd, nullptr, nullptr);
+            if (fd < 0) {
+                continue;
+            }
+            // 他のユーザのプロセスには応答しない
+            bool quit = false;
+            if (samePeer(fd)) {
+                setTimeout(fd, std::chrono::milliseconds(1000));
+                char command = 0;
+                if (::recv(fd, &command, 1, 0) == 1) {
+                    if (command == agent_request_keys) {
+                        if (sendAll(fd, { this->_data, this->_size })) {
+                            ++served;
+                        }
+                    }
+                    else if (command == agent_request_stop) {
+                        sendAll(fd, std::as_bytes(std::span(&command, 1)));
+                        quit = true;
+                    }
+                }
+            }
+            ::close(fd);
+            if (quit) {
+                break;
+            }
+        }
+        return served;
+    }
+
+    std::filesystem::path keyAgentPath(std::u8string_view vault) {
+        // 所有者のみがアクセスできる実行時のディレクトリがあればそれを利用する
+        std::filesystem::path dir;
+        if (const char* runtime = std::getenv("XDG_RUNTIME_DIR"); runtime != nullptr && *runtime != '\0') {
+            dir = std::filesystem::path(runtime) / "pwm";
+        }
+        else {
+            dir = std::filesystem::temp_directory_path() / std::format("pwm-{0}", static_cast<unsigned long>(::geteuid()));
+        }
+        return dir / (u8"agent-" + std::u8string(vault) + u8".sock");
+    }
+
+    std::optional<std::vector<VaultKeyMaterial>> fetchAgentKeys(const std::filesystem::path& path) {
+        int fd = request(path, agent_request_keys);
+        if (fd < 0) {
+            return std::nullopt;
+        }
+        auto data = receiveAll(fd);
+        ::close(fd);
+        if (!data) {
+            return std::nullopt;
+        }
+        auto result = deserialize(data.value());
+        wipe(data.value());
+        return result;
+    }
+
+    bool stopKeyAgent(const std::filesystem::path& path) {
+        int fd = request(path, agent_request_stop);
+        if (fd < 0) {
+            return false;
+        }
+        char reply = 0;
+        bool stopped = ::recv(fd, &reply, 1, 0) == 1 && reply == agent_request_stop;
+        ::close(fd);
+        return stopped;
+    }
+#endif
+}
@@ -0,0 +1,92 @@
+﻿#pragma once
+
+#include "PasswordManagement.h"
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace pwm {
+
+	/// <summary>
+	/// 導出済みの鍵を保持して同一ユーザのプロセスへ受け渡すエージェント
+	/// </summary>
+	/// <remarks>
+	/// 鍵はスワップされずコアダンプにも含まれないようロックしたメモリに保持し、
+	/// 接続はUnixドメインソケットで受け付けて接続元のユーザIDが自身と一致する場合にのみ応答する。
+	/// ソケットは所有者のみがアクセスできるディレクトリ($XDG_RUNTIME_DIRあるいは一時ディレクトリ下)に作成する。
+	/// Windowsでは利用できない(構築すると例外を送出する)。
+	/// </remarks>
+	class KeyAgent {
+		/// <summary>
+		/// ソケットのパス
+		/// </summary>
+		std::filesystem::path _path;
+		/// <summary>
+		/// 接続を待ち受けるソケット
+		/// </summary>
+		int _fd = -1;
+		/// <summary>
+		/// 応答する鍵を格納したロックされた領域
+		/// </summary>
+		std::byte* _data = nullptr;
+		/// <summary>
+		/// ロックされた領域のサイズ
+		/// </summary>
+		std::size_t _capacity = 0;
+		/// <summary>
+		/// 応答する鍵のバイト数
+		/// </summary>
+		std::size_t _size = 0;
+
+	public:
+		KeyAgent() = delete;
+		/// <summary>
+		/// 鍵を保持してソケットで接続の待ち受けを開始する
+		/// </summary>
+		/// <param name="path">ソケットのパス(他のエージェントが待ち受けていれば例外を送出する)</param>
+		/// <param name="keys">保持する鍵(複製した後は呼び出し元で破棄してよい)</param>
+		KeyAgent(const std::filesystem::path& path, std::span<const VaultKeyMaterial> keys);
+		/// <summary>
+		/// 鍵を消去してソケットを削除する
+		/// </summary>
+		~KeyAgent();
+
+		/// <summary>
+		/// 有効期限に達するか停止を要求されるまで接続に応答する
+		/// </summary>
+		/// <param name="ttl">鍵の有効期限(開始からの時間)</param>
+		/// <param name="stop">trueになると停止する(シグナルハンドラから設定してよい)</param>
+		/// <returns>応答した接続の数</returns>
+		std::uint64_t serve(std::chrono::seconds ttl, const std::atomic<bool>& stop);
+
+		// コピーによる構築を禁止する
+		KeyAgent(const KeyAgent&) = delete;
+		KeyAgent& operator=(const KeyAgent&) = delete;
+	};
+
+	/// <summary>
+	/// DBに対応するエージェントのソケットのパスを取得する
+	/// </summary>
+	/// <param name="vault">DBを識別する値</param>
+	[[nodiscard]] std::filesystem::path keyAgentPath(std::u8string_view vault);
+
+	/// <summary>
+	/// エージェントから導出済みの鍵を受け取る
+	/// </summary>
+	/// <param name="path">ソケットのパス</param>
+	/// <returns>受け取った鍵(エージェントが存在しないか応答が不正であればnullopt)</returns>
+	[[nodiscard]] std::optional<std::vector<VaultKeyMaterial>> fetchAgentKeys(const std::filesystem::path& path);
+
+	/// <summary>
+	/// エージェントに停止を要求する
+	/// </summary>
+	/// <param name="path">ソケットのパス</param>
+	/// <returns>エージェントが停止を受け付けたならtrue</returns>
+	bool stopKeyAgent(const std::filesystem::path& path);
+}
@@ -0,0 +1,172 @@
+﻿#include "Lz.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+    /// <summary>
+    /// ハッシュ表のビット数
+    /// </summary>
+    constexpr int hash_bits = 14;
+    /// <summary>
+    /// 一致とみなす最小のバイト数
+    /// </summary>
+    constexpr std::size_t min_match = 4;
+    /// <summary>
+    /// 一致を探索しない末尾のバイト数(末尾はリテラルとして出力する)
+    /// </summary>
+    constexpr std::size_t last_literals = 8;
+    /// <summary>
+    /// 参照可能な最大のオフセット
+    /// </summary>
+    constexpr std::size_t max_offset = 0xFFFF;
+
+    std::uint32_t load32(const std::byte* p) noexcept {
+        std::uint32_t x;
+        std::memcpy(&x, p, 4);
+        return x;
+    }
+
+    std::uint32_t hash(std::uint32_t x) noexcept {
+        return (x * 2654435761u) >> (32 - hash_bits);
+    }
+
+    /// <summary>
+    /// 15以上の長さの延長を255単位で追加する
+    /// </summary>
+    void putLength(std::vector<std::byte>& dst, std::size_t len) {
+        while (len >= 255) {
+            dst.push_back(std::byte{ 255 });
+            len -= 255;
+        }
+        dst.push_back(static_cast<std::byte>(len));
+    }
+
+    /// <summary>
+    /// 1つのシーケンスを追加する
+    /// </summary>
+    /// <param name="literal">リテラル</param>
+    /// <param name="offset">一致の位置までのオフセット(リテラルのみであれば0)</param>
+    /// <param name="match">一致したバイト数</param>
+    void putSequence(std::vector<std::byte>& dst, std::span<const std::byte> literal, std::size_t offset, std::size_t match) {
+        std::size_t lit_len = literal.size();
+        std::size_t match_code = offset != 0 ? match - min_match : 0;
+        dst.push_back(static_cast<std::byte>((std::min<std::size_t>(lit_len, 15) << 4) | std::min<std::size_t>(match_code, 15)));
+        if (lit_len >= 15) {
+            putLength(dst, lit_len - 15);
+        }
+        dst.insert(dst.end(), literal.begin(), literal.end());
+        if (offset != 0) {
+            dst.push_back(static_cast<std::byte>(offset & 0xFF));
+            dst.push_back(static_cast<std::byte>(offset >> 8));
+            if (match_code >= 15) {
+                putLength(dst, match_code - 15);
+            }
+        }
+    }
+
+    /// <summary>
+    /// 延長された長さを読み取る
+    /// </summary>
+    std::size_t getLength(const std::byte*& p, const std::byte* end, std::size_t len) {
+        if (len != 15) {
+            return len;
+        }
+        while (true) {
+            if (p == end) {
+                throw std::runtime_error("圧縮されたデータが壊れています");
+            }
+            auto x = static_cast<std::size_t>(*p++);
+            len += x;
+            if (x != 255) {
+                return len;
+            }
+        }
+    }
+}
+
+void lzCompress(std::span<const std::byte> src, std::vector<std::byte>& dst) {
+    dst.reserve(dst.size() + lzBound(src.size()));
+    const std::byte* base = src.data();
+    const std::size_t n = src.size();
+    std::size_t anchor = 0;
+    if (n > last_literals + min_match) {
+        // 各ハッシュ値に対して直近の出現位置を保持する(0は未出現と区別しない)
+        std::vector<std::uint32_t> table(std::size_t(1) << hash_bits, 0);
+        const std::size_t limit = n - last_literals;
+        std::size_t i = 1;
+        table[hash(load32(base))] = 0;
+        while (i < limit) {
+            auto v = load32(base + i);
+            auto& slot = table[hash(v)];
+            std::size_t candidate = slot;
+            slot = static_cast<std::uint32_t>(i);
+            if (i - candidate > max_offset || load32(base + candidate) != v) {
+                ++i;
+                continue;
+            }
+            // 一致を前方へ伸ばす
+            std::size_t len = min_match;
+            while (i + len < limit && base[candidate + len] == base[i + len]) {
+                ++len;
+            }
+            putSequence(dst, src.subspan(anchor, i - anchor), i - candidate, len);
+            i += len;
+            anchor = i;
+            if (i < limit) {
+                table[hash(load32(base + i - 2))] = static_cast<std::uint32_t>(i - 2);
+            }
+        }
+    }
+    // 残りはリテラルのみのシーケンスとする
+    putSequence(dst, src.subspan(anchor), 0, 0);
+}
+
+void lzDecompress(std::span<const std::byte> src, std::span<std::byte> dst) {
+    const std::byte* p = src.data();
+    const std::byte* end = p + src.size();
+    std::size_t out = 0;
+    while (p != end) {
+        auto token = static_cast<std::size_t>(*p++);
+        std::size_t lit_len = getLength(p, end, token >> 4);
+        if (static_cast<std::size_t>(end - p) < lit_len || dst.size() - out < lit_len) {
+            throw std::runtime_error("圧縮されたデータが壊れています");
+        }
+        if (lit_len != 0) {
+            // 出力が空のとき dst.data() は null になりうる
+            std::memcpy(dst.data() + out, p, lit_len);
+        }
+        p += lit_len;
+        out += lit_len;
+        if (p == end) {
+            // 最後のシーケンスはリテラルのみである
+            break;
+        }
+        if (end - p < 2) {
+            throw std::runtime_error("圧縮されたデータが壊れています");
+        }
+        std::size_t offset = static_cast<std::size_t>(p[0]) | (static_cast<std::size_t>(p[1]) << 8);
+        p += 2;
+        std::size_t match = getLength(p, end, token & 0x0F) + min_match;
+        if (offset == 0 || offset > out || dst.size() - out < match) {
+            throw std::runtime_error("圧縮されたデータが壊れています");
+        }
+        // 重なりうるため1バイトずつ複製する
+        std::byte* d = dst.data() + out;
+        const std::byte* s = d - offset;
+        if (match != 0 && offset >= match) {
+            std::memcpy(d, s, match);
+        }
+        else {
+            for (std::size_t k = 0; k < match; ++k) {
+                d[k] = s[k];
+            }
+        }
+        out += match;
+    }
+    if (out != dst.size()) {
+        throw std::runtime_error("圧縮されたデータが壊れています");
+    }
+}
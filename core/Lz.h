@@ -0,0 +1,33 @@
+﻿#pragma once
+
+#include <span>
+#include <vector>
+#include <cstddef>
+
+/// <summary>
+/// LZ77系の圧縮後の最大のバイト数を取得する
+/// </summary>
+/// <param name="size">圧縮前のバイト数</param>
+[[nodiscard]] constexpr std::size_t lzBound(std::size_t size) noexcept {
+	return size + size / 255 + 16;
+}
+
+/// <summary>
+/// データをLZ77系の形式で圧縮する
+/// </summary>
+/// <remarks>
+/// 64KiBの窓と4バイトのハッシュ表による貪欲な一致探索を行う。符号化はLZ4のブロック形式と同様に
+/// トークン(上位4ビットがリテラル長、下位4ビットが一致長-4、15は後続の255単位の延長を示す)、リテラル、
+/// 2バイトのリトルエンディアンのオフセット、一致長の延長を繰り返し、最後のシーケンスはリテラルのみとする。
+/// </remarks>
+/// <param name="src">圧縮するデータ</param>
+/// <param name="dst">圧縮したデータを追加する変数</param>
+void lzCompress(std::span<const std::byte> src, std::vector<std::byte>& dst);
+
+/// <summary>
+/// lzCompressで圧縮されたデータを展開する
+/// </summary>
+/// <param name="src">圧縮されたデータ</param>
+/// <param name="dst">展開したデータを格納する領域(展開後のバイト数と一致すること)</param>
+/// <exception cref="std::runtime_error">データが壊れている</exception>
+void lzDecompress(std::span<const std::byte> src, std::span<std::byte> dst);
@@ -0,0 +1,96 @@
+﻿#include "MappedFile.h"
+#include <stdexcept>
+#include <utility>
+#if defined(_MSC_VER)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::filesystem::path& path) {
+#if defined(_MSC_VER)
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error("ファイルのオープンに失敗");
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        throw std::runtime_error("ファイルサイズの取得に失敗");
+    }
+    this->_size = static_cast<std::size_t>(size.QuadPart);
+    if (this->_size != 0) {
+        // マッピングオブジェクトはファイルハンドルを閉じても有効である
+        this->_mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file);
+        if (this->_mapping == nullptr) {
+            throw std::runtime_error("ファイルのマップに失敗");
+        }
+        this->_data = static_cast<const std::byte*>(MapViewOfFile(this->_mapping, FILE_MAP_READ, 0, 0, 0));
+        if (this->_data == nullptr) {
+            CloseHandle(this->_mapping);
+            throw std::runtime_error("ファイルのマップに失敗");
+        }
+    }
+    else {
+        CloseHandle(file);
+    }
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("ファイルのオープンに失敗");
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw std::runtime_error("ファイルサイズの取得に失敗");
+    }
+    this->_size = static_cast<std::size_t>(st.st_size);
+    if (this->_size != 0) {
+        void* p = ::mmap(nullptr, this->_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) {
+            throw std::runtime_error("ファイルのマップに失敗");
+        }
+        this->_data = static_cast<const std::byte*>(p);
+    }
+    else {
+        ::close(fd);
+    }
+#endif
+}
+
+MappedFile::~MappedFile() {
+    this->unmap();
+}
+
+void MappedFile::unmap() noexcept {
+    if (this->_data != nullptr) {
+#if defined(_MSC_VER)
+        UnmapViewOfFile(this->_data);
+        CloseHandle(this->_mapping);
+        this->_mapping = nullptr;
+#else
+        ::munmap(const_cast<std::byte*>(this->_data), this->_size);
+#endif
+    }
+    this->_data = nullptr;
+    this->_size = 0;
+}
+
+MappedFile::MappedFile(MappedFile&& x) noexcept {
+    *this = std::move(x);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& x) noexcept {
+    this->unmap();
+    this->_data = std::exchange(x._data, nullptr);
+    this->_size = std::exchange(x._size, 0);
+#if defined(_MSC_VER)
+    this->_mapping = std::exchange(x._mapping, nullptr);
+#endif
+    return *this;
+}
@@ -0,0 +1,47 @@
+﻿#pragma once
+
+#include <filesystem>
+#include <span>
+#include <cstddef>
+
+/// <summary>
+/// 読み取り専用でメモリマップしたファイルを管理するクラス
+/// </summary>
+class MappedFile {
+	/// <summary>
+	/// マップされた領域の先頭
+	/// </summary>
+	const std::byte* _data = nullptr;
+	/// <summary>
+	/// マップされた領域のサイズ
+	/// </summary>
+	std::size_t _size = 0;
+#if defined(_MSC_VER)
+	/// <summary>
+	/// ファイルマッピングオブジェクトのハンドル
+	/// </summary>
+	void* _mapping = nullptr;
+#endif
+
+	/// <summary>
+	/// マップを解除する
+	/// </summary>
+	void unmap() noexcept;
+
+public:
+	MappedFile() = delete;
+	MappedFile(const std::filesystem::path& path);
+	~MappedFile();
+
+	/// <summary>
+	/// マップされた領域の取得
+	/// </summary>
+	[[nodiscard]] std::span<const std::byte> data() const noexcept { return { this->_data, this->_size }; }
+
+	MappedFile(MappedFile&& x) noexcept;
+	MappedFile& operator=(MappedFile&& x) noexcept;
+
+	// コピーによる構築を禁止する
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+};
@@ -0,0 +1,108 @@
+﻿#include "OutputSink.h"
+#include <algorithm>
+#include <stdexcept>
+#if defined(_MSC_VER)
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+void StreamSink::write(std::span<const std::byte> data) {
+    this->_os.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+    if (!this->_os) {
+        throw std::runtime_error("出力ストリームへの書き込みに失敗");
+    }
+}
+
+void StreamSink::flush() {
+    this->_os.flush();
+}
+
+FileSink::FileSink(const std::filesystem::path& path, bool append) {
+#if defined(_MSC_VER)
+    this->_handle = CreateFileW(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, append ? OPEN_ALWAYS : CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (this->_handle == INVALID_HANDLE_VALUE) {
+        this->_handle = nullptr;
+        throw std::runtime_error("ファイルのオープンに失敗");
+    }
+    // FlushFileBuffersにはGENERIC_WRITEが必要なため追記は末尾へ移動して行う
+    if (append && !SetFilePointerEx(this->_handle, LARGE_INTEGER{}, nullptr, FILE_END)) {
+        CloseHandle(this->_handle);
+        this->_handle = nullptr;
+        throw std::runtime_error("ファイルのオープンに失敗");
+    }
+#else
+    this->_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC) | O_CLOEXEC, 0600);
+    if (this->_fd < 0) {
+        throw std::runtime_error("ファイルのオープンに失敗");
+    }
+#endif
+}
+
+FileSink::~FileSink() {
+#if defined(_MSC_VER)
+    if (this->_handle != nullptr) {
+        CloseHandle(this->_handle);
+    }
+#else
+    if (this->_fd >= 0) {
+        ::close(this->_fd);
+    }
+#endif
+}
+
+void FileSink::write(std::span<const std::byte> data) {
+    while (!data.empty()) {
+#if defined(_MSC_VER)
+        // WriteFileは1度に4GB未満しか書き込めない
+        DWORD request = static_cast<DWORD>(std::min<std::size_t>(data.size(), 1u << 30));
+        DWORD n = 0;
+        if (!WriteFile(this->_handle, data.data(), request, &n, nullptr)) {
+            throw std::runtime_error("ファイルへの書き込みに失敗");
+        }
+#else
+        auto n = ::write(this->_fd, data.data(), data.size());
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("ファイルへの書き込みに失敗");
+        }
+#endif
+        data = data.subspan(static_cast<std::size_t>(n));
+    }
+}
+
+void FileSink::flush() {
+#if defined(_MSC_VER)
+    if (!FlushFileBuffers(this->_handle)) {
+        throw std::runtime_error("ファイルの永続化に失敗");
+    }
+#else
+    // パイプやデバイスなど永続化に対応しない出力先は無視する
+    if (::fsync(this->_fd) != 0 && errno != EINVAL && errno != EROFS) {
+        throw std::runtime_error("ファイルの永続化に失敗");
+    }
+#endif
+}
+
+BufferedWriter::BufferedWriter(OutputSink& sink, std::size_t capacity) : _sink(sink), _buf(capacity) {
+    if (capacity == 0) {
+        throw std::invalid_argument("バッファのサイズは1以上である必要があります");
+    }
+}
+
+void BufferedWriter::drain() {
+    if (this->_size != 0) {
+        this->_sink.write(std::span(this->_buf.data(), this->_size));
+        this->_written += this->_size;
+        this->_size = 0;
+    }
+}
+
+void BufferedWriter::flush() {
+    this->drain();
+    this->_sink.flush();
+}
@@ -0,0 +1,191 @@
+﻿#pragma once
+
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <span>
+#include <string_view>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/// <summary>
+/// 出力先への書き込みを抽象化するクラス
+/// </summary>
+class OutputSink {
+public:
+	virtual ~OutputSink() = default;
+
+	/// <summary>
+	/// データをすべて書き込む
+	/// </summary>
+	/// <param name="data">書き込むデータ</param>
+	virtual void write(std::span<const std::byte> data) = 0;
+
+	/// <summary>
+	/// 書き込んだデータを出力先へ確定させる
+	/// </summary>
+	virtual void flush() = 0;
+};
+
+/// <summary>
+/// 出力ストリームへ書き込むクラス
+/// </summary>
+class StreamSink : public OutputSink {
+	std::ostream& _os;
+
+public:
+	StreamSink(std::ostream& os) : _os(os) {}
+
+	void write(std::span<const std::byte> data) override;
+	void flush() override;
+};
+
+/// <summary>
+/// ファイルへOSのシステムコールにより直接書き込むクラス
+/// </summary>
+class FileSink : public OutputSink {
+#if defined(_MSC_VER)
+	/// <summary>
+	/// ファイルのハンドル
+	/// </summary>
+	void* _handle = nullptr;
+#else
+	/// <summary>
+	/// ファイルディスクリプタ
+	/// </summary>
+	int _fd = -1;
+#endif
+
+public:
+	FileSink() = delete;
+	/// <summary>
+	/// ファイルを作成して開く
+	/// </summary>
+	/// <param name="path">ファイルのパス</param>
+	/// <param name="append">trueなら既存の内容の末尾へ追記し、falseなら切り詰める</param>
+	FileSink(const std::filesystem::path& path, bool append = false);
+	~FileSink();
+
+	void write(std::span<const std::byte> data) override;
+	/// <summary>
+	/// 書き込んだデータをストレージへ永続化する
+	/// </summary>
+	void flush() override;
+
+	// コピーによる構築を禁止する
+	FileSink(const FileSink&) = delete;
+	FileSink& operator=(const FileSink&) = delete;
+};
+
+/// <summary>
+/// ファイルを開いて出力先を構築する関数(引数はファイルのパスと既存の内容の末尾へ追記するか)
+/// </summary>
+using FileSinkFactory = std::function<std::unique_ptr<OutputSink>(const std::filesystem::path&, bool)>;
+
+/// <summary>
+/// メモリ上へ書き込むクラス
+/// </summary>
+class MemorySink : public OutputSink {
+	std::vector<std::byte> _data;
+
+public:
+	void write(std::span<const std::byte> data) override {
+		this->_data.insert(this->_data.end(), data.begin(), data.end());
+	}
+	void flush() override {}
+
+	/// <summary>
+	/// 書き込まれたデータ
+	/// </summary>
+	const std::vector<std::byte>& data() const noexcept { return this->_data; }
+
+	/// <summary>
+	/// 書き込まれたデータを破棄する(確保した領域は再利用する)
+	/// </summary>
+	void clear() noexcept { this->_data.clear(); }
+};
+
+/// <summary>
+/// 書き込むデータを大きなバッファにまとめてから出力先へ書き込むクラス
+/// </summary>
+/// <remarks>
+/// 破棄する前にflushを呼び出さなければバッファに残ったデータは失われる
+/// </remarks>
+class BufferedWriter {
+	OutputSink& _sink;
+	std::vector<std::byte> _buf;
+	/// <summary>
+	/// バッファに蓄えたバイト数
+	/// </summary>
+	std::size_t _size = 0;
+	/// <summary>
+	/// 出力先へ書き込んだバイト数
+	/// </summary>
+	std::uint64_t _written = 0;
+
+	/// <summary>
+	/// バッファの内容を出力先へ書き込む
+	/// </summary>
+	void drain();
+
+public:
+	/// <summary>
+	/// 既定のバッファのサイズ
+	/// </summary>
+	static constexpr std::size_t default_capacity = 1 << 20;
+
+	BufferedWriter() = delete;
+	/// <summary>
+	/// 出力先とバッファのサイズを指定して構築する
+	/// </summary>
+	/// <param name="sink">出力先(このオブジェクトより長く存在する必要がある)</param>
+	/// <param name="capacity">バッファのサイズ</param>
+	BufferedWriter(OutputSink& sink, std::size_t capacity = default_capacity);
+
+	/// <summary>
+	/// バイト列を書き込む
+	/// </summary>
+	void write(std::span<const std::byte> data) {
+		if (data.size() > this->_buf.size() - this->_size) {
+			this->drain();
+			if (data.size() >= this->_buf.size()) {
+				// バッファより大きなデータは複製せずに書き込む
+				this->_sink.write(data);
+				this->_written += data.size();
+				return;
+			}
+		}
+		std::memcpy(this->_buf.data() + this->_size, data.data(), data.size());
+		this->_size += data.size();
+	}
+
+	/// <summary>
+	/// 文字列を書き込む
+	/// </summary>
+	void write(std::u8string_view x) {
+		this->write(std::as_bytes(std::span(x)));
+	}
+
+	/// <summary>
+	/// 1バイトを書き込む
+	/// </summary>
+	void put(char8_t c) {
+		if (this->_size == this->_buf.size()) {
+			this->drain();
+		}
+		this->_buf[this->_size++] = static_cast<std::byte>(c);
+	}
+
+	/// <summary>
+	/// バッファの内容を書き込んで出力先へ確定させる
+	/// </summary>
+	void flush();
+
+	/// <summary>
+	/// これまでに書き込んだバイト数(バッファに蓄えたものを含む)
+	/// </summary>
+	std::uint64_t bytes() const noexcept { return this->_written + this->_size; }
+};
@@ -0,0 +1,699 @@
+﻿#include "PageCipherVfs.h"
+#include "RecordCipher.h"
+#include "Sha256.h"
+#include "sqlite3.h"
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <new>
+#include <stdexcept>
+#include <cstring>
+
+namespace {
+    /// <summary>
+    /// 暗号化しないSQLiteのDBファイルの先頭
+    /// </summary>
+    constexpr char sqlite_magic[] = "SQLite format 3";
+    /// <summary>
+    /// DBファイルの先頭に格納する塩のバイト数
+    /// </summary>
+    constexpr std::size_t salt_size = std::tuple_size_v<SQLitePageCipher::salt_type>;
+    /// <summary>
+    /// ページのうち暗号化する領域のバイト数
+    /// </summary>
+    constexpr std::size_t sealed_size = SQLitePageCipher::page_size - SQLitePageCipher::reserve_size;
+    /// <summary>
+    /// WALファイルのヘッダのバイト数
+    /// </summary>
+    constexpr std::int64_t wal_header_size = 32;
+    /// <summary>
+    /// WALファイルのフレームのヘッダのバイト数
+    /// </summary>
+    constexpr std::int64_t wal_frame_header_size = 24;
+    /// <summary>
+    /// URIで鍵の識別子を指定するパラメータ
+    /// </summary>
+    constexpr const char* uri_parameter = "pwm_cipher";
+    /// <summary>
+    /// VFSの名称
+    /// </summary>
+    constexpr const char* vfs_name = "pwm-page-cipher";
+
+    void storeLe32(std::byte* p, std::uint32_t x) noexcept {
+        for (int i = 0; i < 4; ++i) {
+            p[i] = static_cast<std::byte>(x >> (i * 8));
+        }
+    }
+
+    /// <summary>
+    /// 最適化により省略されないよう領域を0で埋める
+    /// </summary>
+    void wipe(std::span<std::byte> data) noexcept {
+        volatile std::byte* p = data.data();
+        for (std::size_t i = 0; i < data.size(); ++i) {
+            p[i] = std::byte{ 0 };
+        }
+    }
+
+    /// <summary>
+    /// DBファイルの先頭ページであればtrue(先頭に塩を平文で格納する)
+    /// </summary>
+    bool isHeaderPage(SQLitePageCipher::FileKind kind, std::int64_t offset) noexcept {
+        return kind == SQLitePageCipher::FileKind::database && offset == 0;
+    }
+
+    /// <summary>
+    /// ファイルの種類とページのオフセットを追加データとして構築する
+    /// </summary>
+    std::array<std::byte, 9> makeAad(SQLitePageCipher::FileKind kind, std::int64_t offset) noexcept {
+        std::array<std::byte, 9> aad;
+        aad[0] = static_cast<std::byte>(kind);
+        storeLe32(aad.data() + 1, static_cast<std::uint32_t>(offset));
+        storeLe32(aad.data() + 5, static_cast<std::uint32_t>(static_cast<std::uint64_t>(offset) >> 32));
+        return aad;
+    }
+
+    /// <summary>
+    /// キャッシュの索引のキー
+    /// </summary>
+    std::uint64_t cacheKey(SQLitePageCipher::FileKind kind, std::int64_t offset) noexcept {
+        return (static_cast<std::uint64_t>(kind) << 56) | static_cast<std::uint64_t>(offset);
+    }
+
+    /// <summary>
+    /// 識別子ごとの鍵の登録先
+    /// </summary>
+    struct CipherRegistry {
+        std::mutex mutex;
+        std::map<std::uint64_t, std::weak_ptr<SQLitePageCipher>> ciphers;
+        std::atomic<std::uint64_t> next_id = 1;
+    };
+
+    CipherRegistry& cipherRegistry() {
+        // 静的な変数に保持された鍵が終了時に破棄されるより先に破棄されないよう解放しない
+        static auto& x = *new CipherRegistry;
+        return x;
+    }
+}
+
+SQLitePageCipher::SQLitePageCipher(const ChaCha20Poly1305::key_type& key, const salt_type& salt, std::size_t cache_pages)
+    : _aead(key), _salt(salt), _id(cipherRegistry().next_id.fetch_add(1, std::memory_order_relaxed)), _cache_capacity(cache_pages) {
+    std::array<std::byte, 12> seed;
+    secureRandom(seed);
+    std::uint64_t counter = 0;
+    std::memcpy(&this->_nonce_prefix, seed.data(), 4);
+    std::memcpy(&counter, seed.data() + 4, 8);
+    this->_nonce_counter = counter;
+}
+
+SQLitePageCipher::~SQLitePageCipher() {
+    auto& x = cipherRegistry();
+    std::lock_guard lock(x.mutex);
+    x.ciphers.erase(this->_id);
+}
+
+std::shared_ptr<SQLitePageCipher> SQLitePageCipher::derive(std::u8string_view passphrase, const salt_type& salt, std::size_t cache_pages) {
+    ChaCha20Poly1305::key_type key;
+    pbkdf2HmacSha256(std::as_bytes(std::span(passphrase)), salt, kdf_iterations, key);
+    auto result = std::make_shared<SQLitePageCipher>(key, salt, cache_pages);
+    wipe(key);
+    return result;
+}
+
+void SQLitePageCipher::store(FileKind kind, std::int64_t offset, std::span<const std::byte> reserve, std::span<const std::byte> plaintext) {
+    if (this->_cache_capacity == 0) {
+        return;
+    }
+    std::lock_guard lock(this->_mutex);
+    auto key = cacheKey(kind, offset);
+    auto it = this->_index.find(key);
+    if (it != this->_index.end()) {
+        // 既存の項目を更新して先頭へ移す
+        this->_lru.splice(this->_lru.begin(), this->_lru, it->second);
+    }
+    else if (this->_lru.size() >= this->_cache_capacity) {
+        // 最も古い項目を再利用する
+        this->_lru.splice(this->_lru.begin(), this->_lru, std::prev(this->_lru.end()));
+        this->_index.erase(cacheKey(this->_lru.front().kind, this->_lru.front().offset));
+        this->_index.emplace(key, this->_lru.begin());
+    }
+    else {
+        this->_lru.emplace_front();
+        this->_lru.front().plaintext.resize(page_size);
+        this->_index.emplace(key, this->_lru.begin());
+    }
+    auto& page = this->_lru.front();
+    page.kind = kind;
+    page.offset = offset;
+    std::ranges::copy(reserve, page.reserve.begin());
+    // 読み取り時に復号した場合と同じ内容(予約領域はnonceと認証タグ)とする
+    std::copy_n(plaintext.begin(), sealed_size, page.plaintext.begin());
+    std::ranges::copy(reserve, page.plaintext.begin() + sealed_size);
+}
+
+void SQLitePageCipher::seal(FileKind kind, std::int64_t offset, std::span<const std::byte> plaintext, std::span<std::byte> out) {
+    constexpr auto nonce_size = std::tuple_size_v<ChaCha20Poly1305::nonce_type>;
+    // DBファイルの先頭ページは"SQLite format 3\0"に代えて塩を格納する
+    std::size_t begin = isHeaderPage(kind, offset) ? salt_size : 0;
+    if (begin != 0) {
+        std::ranges::copy(this->_salt, out.begin());
+    }
+
+    ChaCha20Poly1305::nonce_type nonce;
+    auto counter = this->_nonce_counter.fetch_add(1, std::memory_order_relaxed);
+    storeLe32(nonce.data(), this->_nonce_prefix);
+    storeLe32(nonce.data() + 4, static_cast<std::uint32_t>(counter));
+    storeLe32(nonce.data() + 8, static_cast<std::uint32_t>(counter >> 32));
+    ChaCha20Poly1305::tag_type tag;
+    auto aad = makeAad(kind, offset);
+    this->_aead.seal(nonce, aad, plaintext.subspan(begin, sealed_size - begin), out.subspan(begin, sealed_size - begin), tag);
+    std::ranges::copy(nonce, out.begin() + sealed_size);
+    std::ranges::copy(tag, out.begin() + sealed_size + nonce_size);
+    this->_encrypted.fetch_add(1, std::memory_order_relaxed);
+
+    this->store(kind, offset, out.subspan(sealed_size), plaintext);
+}
+
+bool SQLitePageCipher::open(FileKind kind, std::int64_t offset, std::span<const std::byte> ciphertext, std::span<std::byte> out) {
+    constexpr auto nonce_size = std::tuple_size_v<ChaCha20Poly1305::nonce_type>;
+    constexpr auto tag_size = std::tuple_size_v<ChaCha20Poly1305::tag_type>;
+    // 復号先が暗号文と同じ領域でもよいよう予約領域を退避する
+    std::array<std::byte, reserve_size> reserve;
+    std::copy_n(ciphertext.begin() + sealed_size, reserve_size, reserve.begin());
+
+    if (this->_cache_capacity != 0) {
+        // nonceと認証タグが一致すれば同じ暗号文であるため復号を省略する
+        std::lock_guard lock(this->_mutex);
+        auto it = this->_index.find(cacheKey(kind, offset));
+        if (it != this->_index.end() && it->second->reserve == reserve) {
+            this->_lru.splice(this->_lru.begin(), this->_lru, it->second);
+            std::ranges::copy(it->second->plaintext, out.begin());
+            this->_cache_hits.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    std::size_t begin = isHeaderPage(kind, offset) ? salt_size : 0;
+    ChaCha20Poly1305::nonce_type nonce;
+    ChaCha20Poly1305::tag_type tag;
+    std::copy_n(reserve.begin(), nonce_size, nonce.begin());
+    std::copy_n(reserve.begin() + nonce_size, tag_size, tag.begin());
+    auto aad = makeAad(kind, offset);
+    if (!this->_aead.open(nonce, aad, ciphertext.subspan(begin, sealed_size - begin), tag, out.subspan(begin, sealed_size - begin))) {
+        return false;
+    }
+    if (begin != 0) {
+        // 塩に代えてSQLiteのDBファイルの先頭を復元する
+        std::memcpy(out.data(), sqlite_magic, salt_size);
+    }
+    std::ranges::copy(reserve, out.begin() + sealed_size);
+    this->_decrypted.fetch_add(1, std::memory_order_relaxed);
+    this->store(kind, offset, reserve, out.first(page_size));
+    return true;
+}
+
+SQLitePageCipherStats SQLitePageCipher::stats() const noexcept {
+    return {
+        .encrypted = this->_encrypted.load(std::memory_order_relaxed),
+        .decrypted = this->_decrypted.load(std::memory_order_relaxed),
+        .cache_hits = this->_cache_hits.load(std::memory_order_relaxed)
+    };
+}
+
+SQLitePageCipherStats SQLitePageCipher::totalStats() {
+    // 最後の参照を手放した鍵の破棄が登録先の排他制御と重ならないよう、集計は排他制御の外で行う
+    std::vector<std::shared_ptr<SQLitePageCipher>> ciphers;
+    {
+        auto& x = cipherRegistry();
+        std::lock_guard lock(x.mutex);
+        for (const auto& [id, weak] : x.ciphers) {
+            if (auto cipher = weak.lock(); cipher) {
+                ciphers.push_back(std::move(cipher));
+            }
+        }
+    }
+    SQLitePageCipherStats total;
+    for (const auto& cipher : ciphers) {
+        auto stats = cipher->stats();
+        total.encrypted += stats.encrypted;
+        total.decrypted += stats.decrypted;
+        total.cache_hits += stats.cache_hits;
+    }
+    return total;
+}
+
+void registerPageCipher(const std::shared_ptr<SQLitePageCipher>& cipher) {
+    auto& x = cipherRegistry();
+    std::lock_guard lock(x.mutex);
+    x.ciphers.insert_or_assign(cipher->id(), cipher);
+}
+
+namespace {
+    /// <summary>
+    /// VFSが開いたファイル
+    /// </summary>
+    /// <remarks>
+    /// 直後に包んでいるVFSのファイル(szOsFileバイト)が続く
+    /// </remarks>
+    struct CipherFile {
+        sqlite3_file base;
+        /// <summary>
+        /// ページの暗号化に用いる鍵(暗号化しないファイルであればnullptr)
+        /// </summary>
+        std::shared_ptr<SQLitePageCipher> cipher;
+        SQLitePageCipher::FileKind kind;
+
+        /// <summary>
+        /// 包んでいるVFSのファイル
+        /// </summary>
+        sqlite3_file* real() noexcept {
+            return reinterpret_cast<sqlite3_file*>(reinterpret_cast<char*>(this) + sizeof(CipherFile));
+        }
+    };
+
+    /// <summary>
+    /// ファイル上の領域(ページであれば暗号化する)
+    /// </summary>
+    struct Segment {
+        std::int64_t begin;
+        std::int64_t end;
+        bool page;
+    };
+
+    /// <summary>
+    /// 指定した位置を含むファイル上の領域を取得する
+    /// </summary>
+    Segment segmentAt(SQLitePageCipher::FileKind kind, std::int64_t pos) noexcept {
+        constexpr auto page_size = static_cast<std::int64_t>(SQLitePageCipher::page_size);
+        if (kind == SQLitePageCipher::FileKind::database) {
+            auto begin = pos / page_size * page_size;
+            return { begin, begin + page_size, true };
+        }
+        // WALファイルは[ヘッダ][フレームのヘッダ][ページ][フレームのヘッダ][ページ]...とし、ヘッダは暗号化しない
+        if (pos < wal_header_size) {
+            return { 0, wal_header_size, false };
+        }
+        constexpr auto frame_size = wal_frame_header_size + page_size;
+        auto frame = wal_header_size + (pos - wal_header_size) / frame_size * frame_size;
+        if (pos < frame + wal_frame_header_size) {
+            return { frame, frame + wal_frame_header_size, false };
+        }
+        return { frame + wal_frame_header_size, frame + frame_size, true };
+    }
+
+    /// <summary>
+    /// 暗号化したページを読み取って復号する
+    /// </summary>
+    /// <param name="out">平文のページの書き込み先(page_sizeバイト)</param>
+    /// <returns>SQLiteの結果コード(ファイルの末尾を超えて読み取ったページは0で埋めてSQLITE_IOERR_SHORT_READを返す)</returns>
+    int readPage(CipherFile& f, std::int64_t offset, std::span<std::byte> out) {
+        auto real = f.real();
+        int rc = real->pMethods->xRead(real, out.data(), static_cast<int>(out.size()), offset);
+        if (rc == SQLITE_IOERR_SHORT_READ && std::ranges::all_of(out, [](std::byte x) { return x == std::byte{ 0 }; })) {
+            return rc;
+        }
+        if (rc != SQLITE_OK && rc != SQLITE_IOERR_SHORT_READ) {
+            return rc;
+        }
+        if (!f.cipher->open(f.kind, offset, out, out)) {
+            return SQLITE_IOERR_DATA;
+        }
+        return rc;
+    }
+
+    int cipherClose(sqlite3_file* file) {
+        auto& f = *reinterpret_cast<CipherFile*>(file);
+        auto real = f.real();
+        int rc = real->pMethods != nullptr ? real->pMethods->xClose(real) : SQLITE_OK;
+        f.~CipherFile();
+        return rc;
+    }
+
+    int cipherRead(sqlite3_file* file, void* buf, int amt, sqlite3_int64 offset) {
+        auto& f = *reinterpret_cast<CipherFile*>(file);
+        auto real = f.real();
+        if (!f.cipher) {
+            return real->pMethods->xRead(real, buf, amt, offset);
+        }
+        auto out = static_cast<std::byte*>(buf);
+        std::int64_t end = offset + amt;
+        bool short_read = false;
+        for (std::int64_t pos = offset; pos < end;) {
+            auto segment = segmentAt(f.kind, pos);
+            auto n = std::min(segment.end, end) - pos;
+            int rc;
+            if (!segment.page) {
+                rc = real->pMethods->xRead(real, out + (pos - offset), static_cast<int>(n), pos);
+            }
+            else if (pos == segment.begin && n == segment.end - segment.begin) {
+                // ページ全体を読み取るときは読み取り先で復号する
+                rc = readPage(f, pos, { out + (pos - offset), SQLitePageCipher::page_size });
+            }
+            else {
+                // ページの一部(DBファイルのヘッダなど)はページ全体を復号して切り出す
+                std::array<std::byte, SQLitePageCipher::page_size> page;
+                rc = readPage(f, segment.begin, page);
+                std::memcpy(out + (pos - offset), page.data() + (pos - segment.begin), static_cast<std::size_t>(n));
+            }
+            if (rc == SQLITE_IOERR_SHORT_READ) {
+                short_read = true;
+            }
+            else if (rc != SQLITE_OK) {
+                return rc;
+            }
+            pos += n;
+        }
+        return short_read ? SQLITE_IOERR_SHORT_READ : SQLITE_OK;
+    }
+
+    int cipherWrite(sqlite3_file* file, const void* buf, int amt, sqlite3_int64 offset) {
+        auto& f = *reinterpret_cast<CipherFile*>(file);
+        auto real = f.real();
+        if (!f.cipher) {
+            return real->pMethods->xWrite(real, buf, amt, offset);
+        }
+        auto in = static_cast<const std::byte*>(buf);
+        std::int64_t end = offset + amt;
+        std::array<std::byte, SQLitePageCipher::page_size> plaintext;
+        std::array<std::byte, SQLitePageCipher::page_size> ciphertext;
+        for (std::int64_t pos = offset; pos < end;) {
+            auto segment = segmentAt(f.kind, pos);
+            auto n = std::min(segment.end, end) - pos;
+            if (!segment.page) {
+                if (int rc = real->pMethods->xWrite(real, in + (pos - offset), static_cast<int>(n), pos); rc != SQLITE_OK) {
+                    return rc;
+                }
+                pos += n;
+                continue;
+            }
+            std::span<const std::byte> page;
+            if (pos == segment.begin && n == segment.end - segment.begin) {
+                page = { in + (pos - offset), SQLitePageCipher::page_size };
+            }
+            else {
+                // ページの一部の書き込みは既存のページを復号して重ねる
+                int rc = readPage(f, segment.begin, plaintext);
+                if (rc != SQLITE_OK && rc != SQLITE_IOERR_SHORT_READ) {
+                    return rc == SQLITE_IOERR_DATA ? SQLITE_IOERR_WRITE : rc;
+                }
+                std::memcpy(plaintext.data() + (pos - segment.begin), in + (pos - offset), static_cast<std::size_t>(n));
+                page = plaintext;
+            }
+            if (isHeaderPage(f.kind, segment.begin)
+                && (page[16] != std::byte{ SQLitePageCipher::page_size >> 8 } || page[17] != std::byte{ 0 } || page[20] != std::byte{ SQLitePageCipher::reserve_size })) {
+                // ページのサイズか予約領域が異なると予約領域(nonceと認証タグ)にデータが書き込まれる
+                return SQLITE_IOERR_WRITE;
+            }
+            f.cipher->seal(f.kind, segment.begin, page, ciphertext);
+            if (int rc = real->pMethods->xWrite(real, ciphertext.data(), static_cast<int>(ciphertext.size()), segment.begin); rc != SQLITE_OK) {
+                return rc;
+            }
+            pos += n;
+        }
+        return SQLITE_OK;
+    }
+
+    int cipherTruncate(sqlite3_file* file, sqlite3_int64 size) {
+        auto real = reinterpret_cast<CipherFile*>(file)->real();
+        return real->pMethods->xTruncate(real, size);
+    }
+
+    int cipherSync(sqlite3_file* file, int flags) {
+        auto real = reinterpret_cast<CipherFile*>(file)->real();
+        return real->pMethods->xSync(real, flags);
+    }
+
+    int cipherFileSize(sqlite3_file* file, sqlite3_int64* size) {
+        auto real = reinterpret_cast<CipherFile*>(file)->real();
+        return real->pMethods->xFileSize(real, size);
+    }
+
+    int cipherLock(sqlite3_file* file, int lock) {
+        auto real = reinterpret_cast<CipherFile*>(file)->real();
+        return real->pMethods->xLock(real, lock);
+    }
+
+    int cipherUnlock(sqlite3_file* file, int lock) {
+        auto real = reinterpret_cast<CipherFile*>(file)->real();
+        return real->pMethods->xUnlock(real, lock);
+    }
+
+    int cipherCheckReservedLock(sqlite3_file* file, int* out) {
+        auto real = reinterpret_cast<CipherFile*>(file)->real();
+        return real->pMethods->xCheckReservedLock(real, out);
+    }
+
+    int cipherFileControl(sqlite3_file* file, int op, void* arg) {
+        auto real = reinterpret_cast<CipherFile*>(file)->real();
+        return real->pMethods->xFileControl(real, op, arg);
+    }
+
+    int cipherSectorSize(sqlite3_file* file) {
+        auto real = reinterpret_cast<CipherFile*>(file)->real();
+        return real->pMethods->xSectorSize(real);
+    }
+
+    int cipherDeviceCharacteristics(sqlite3_file* file) {
+        auto& f = *reinterpret_cast<CipherFile*>(file);
+        auto real = f.real();
+        int flags = real->pMethods->xDeviceCharacteristics(real);
+        if (f.cipher) {
+            // WALへの書き込みがページの途中で分割されないよう、セクタ単位の書き込みが他の領域を壊さないものとして扱う
+            flags |= SQLITE_IOCAP_POWERSAFE_OVERWRITE;
+        }
+        return flags;
+    }
+
+    int cipherShmMap(sqlite3_file* file, int page, int size, int extend, void volatile** out) {
+        auto real = reinterpret_cast<CipherFile*>(file)->real();
+        return real->pMethods->xShmMap(real, page, size, extend, out);
+    }
+
+    int cipherShmLock(sqlite3_file* file, int offset, int n, int flags) {
+        auto real = reinterpret_cast<CipherFile*>(file)->real();
+        return real->pMethods->xShmLock(real, offset, n, flags);
+    }
+
+    void cipherShmBarrier(sqlite3_file* file) {
+        auto real = reinterpret_cast<CipherFile*>(file)->real();
+        real->pMethods->xShmBarrier(real);
+    }
+
+    int cipherShmUnmap(sqlite3_file* file, int remove) {
+        auto real = reinterpret_cast<CipherFile*>(file)->real();
+        return real->pMethods->xShmUnmap(real, remove);
+    }
+
+    /// <summary>
+    /// ファイルの操作
+    /// </summary>
+    /// <remarks>
+    /// メモリマップによる読み取りは復号を経ないため、xFetchを持たないバージョン2とする
+    /// </remarks>
+    const sqlite3_io_methods cipher_io_methods = {
+        2,
+        cipherClose,
+        cipherRead,
+        cipherWrite,
+        cipherTruncate,
+        cipherSync,
+        cipherFileSize,
+        cipherLock,
+        cipherUnlock,
+        cipherCheckReservedLock,
+        cipherFileControl,
+        cipherSectorSize,
+        cipherDeviceCharacteristics,
+        cipherShmMap,
+        cipherShmLock,
+        cipherShmBarrier,
+        cipherShmUnmap,
+        nullptr,
+        nullptr
+    };
+
+    /// <summary>
+    /// 包んでいるVFS
+    /// </summary>
+    sqlite3_vfs* baseVfs(sqlite3_vfs* vfs) noexcept {
+        return static_cast<sqlite3_vfs*>(vfs->pAppData);
+    }
+
+    int vfsOpen(sqlite3_vfs* vfs, sqlite3_filename name, sqlite3_file* file, int flags, int* out_flags) {
+        auto& f = *new (file) CipherFile{};
+        f.base.pMethods = nullptr;
+        auto real = f.real();
+        auto base = baseVfs(vfs);
+        if (name != nullptr && (flags & (SQLITE_OPEN_MAIN_DB | SQLITE_OPEN_WAL)) != 0) {
+            // URIで指定された識別子から鍵を取得する
+            auto id = static_cast<std::uint64_t>(sqlite3_uri_int64(name, uri_parameter, 0));
+            if (id != 0) {
+                auto& x = cipherRegistry();
+                std::lock_guard lock(x.mutex);
+                if (auto it = x.ciphers.find(id); it != x.ciphers.end()) {
+                    f.cipher = it->second.lock();
+                }
+                if (!f.cipher) {
+                    f.~CipherFile();
+                    return SQLITE_CANTOPEN;
+                }
+            }
+            f.kind = (flags & SQLITE_OPEN_WAL) != 0 ? SQLitePageCipher::FileKind::wal : SQLitePageCipher::FileKind::database;
+        }
+        int rc = base->xOpen(base, name, real, flags, out_flags);
+        if (rc != SQLITE_OK) {
+            if (real->pMethods != nullptr) {
+                real->pMethods->xClose(real);
+            }
+            f.~CipherFile();
+            return rc;
+        }
+        f.base.pMethods = &cipher_io_methods;
+        return SQLITE_OK;
+    }
+
+    int vfsDelete(sqlite3_vfs* vfs, const char* name, int sync_dir) {
+        auto base = baseVfs(vfs);
+        return base->xDelete(base, name, sync_dir);
+    }
+
+    int vfsAccess(sqlite3_vfs* vfs, const char* name, int flags, int* out) {
+        auto base = baseVfs(vfs);
+        return base->xAccess(base, name, flags, out);
+    }
+
+    int vfsFullPathname(sqlite3_vfs* vfs, const char* name, int size, char* out) {
+        auto base = baseVfs(vfs);
+        return base->xFullPathname(base, name, size, out);
+    }
+
+    void* vfsDlOpen(sqlite3_vfs* vfs, const char* name) {
+        auto base = baseVfs(vfs);
+        return base->xDlOpen(base, name);
+    }
+
+    void vfsDlError(sqlite3_vfs* vfs, int size, char* out) {
+        auto base = baseVfs(vfs);
+        base->xDlError(base, size, out);
+    }
+
+    void (*vfsDlSym(sqlite3_vfs* vfs, void* handle, const char* symbol))(void) {
+        auto base = baseVfs(vfs);
+        return base->xDlSym(base, handle, symbol);
+    }
+
+    void vfsDlClose(sqlite3_vfs* vfs, void* handle) {
+        auto base = baseVfs(vfs);
+        base->xDlClose(base, handle);
+    }
+
+    int vfsRandomness(sqlite3_vfs* vfs, int size, char* out) {
+        auto base = baseVfs(vfs);
+        return base->xRandomness(base, size, out);
+    }
+
+    int vfsSleep(sqlite3_vfs* vfs, int us) {
+        auto base = baseVfs(vfs);
+        return base->xSleep(base, us);
+    }
+
+    int vfsCurrentTime(sqlite3_vfs* vfs, double* out) {
+        auto base = baseVfs(vfs);
+        return base->xCurrentTime(base, out);
+    }
+
+    int vfsGetLastError(sqlite3_vfs* vfs, int size, char* out) {
+        auto base = baseVfs(vfs);
+        return base->xGetLastError != nullptr ? base->xGetLastError(base, size, out) : 0;
+    }
+
+    int vfsCurrentTimeInt64(sqlite3_vfs* vfs, sqlite3_int64* out) {
+        auto base = baseVfs(vfs);
+        return base->xCurrentTimeInt64(base, out);
+    }
+}
+
+const char* registerPageCipherVfs() {
+    static std::once_flag once;
+    static sqlite3_vfs vfs{};
+    std::call_once(once, [] {
+        auto base = sqlite3_vfs_find(nullptr);
+        if (base == nullptr) {
+            throw std::runtime_error("既定のVFSが見つかりません");
+        }
+        vfs.iVersion = 2;
+        // 包んでいるVFSのファイルを直後に配置する
+        vfs.szOsFile = static_cast<int>(sizeof(CipherFile)) + base->szOsFile;
+        vfs.mxPathname = base->mxPathname;
+        vfs.zName = vfs_name;
+        vfs.pAppData = base;
+        vfs.xOpen = vfsOpen;
+        vfs.xDelete = vfsDelete;
+        vfs.xAccess = vfsAccess;
+        vfs.xFullPathname = vfsFullPathname;
+        vfs.xDlOpen = vfsDlOpen;
+        vfs.xDlError = vfsDlError;
+        vfs.xDlSym = vfsDlSym;
+        vfs.xDlClose = vfsDlClose;
+        vfs.xRandomness = vfsRandomness;
+        vfs.xSleep = vfsSleep;
+        vfs.xCurrentTime = vfsCurrentTime;
+        vfs.xGetLastError = vfsGetLastError;
+        vfs.xCurrentTimeInt64 = vfsCurrentTimeInt64;
+        if (sqlite3_vfs_register(&vfs, 0) != SQLITE_OK) {
+            throw std::runtime_error("VFSの登録に失敗");
+        }
+    });
+    return vfs_name;
+}
+
+std::optional<SQLitePageCipher::salt_type> readPageCipherSalt(const std::filesystem::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    SQLitePageCipher::salt_type salt;
+    if (!file || !file.read(reinterpret_cast<char*>(salt.data()), salt.size())) {
+        // 存在しないか空のDBは塩を持たない
+        return std::nullopt;
+    }
+    if (std::memcmp(salt.data(), sqlite_magic, salt.size()) == 0) {
+        throw std::invalid_argument("暗号化されていないDBです");
+    }
+    return salt;
+}
+
+bool isPlainDatabase(const std::filesystem::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    std::array<char, salt_size> head;
+    return file && file.read(head.data(), head.size()) && std::memcmp(head.data(), sqlite_magic, head.size()) == 0;
+}
+
+SQLitePageCipherProvider makePageCipherProvider(std::u8string passphrase) {
+    struct State {
+        std::u8string passphrase;
+        std::mutex mutex;
+        /// <summary>
+        /// DBへのパスごとの鍵
+        /// </summary>
+        std::map<std::filesystem::path, std::shared_ptr<SQLitePageCipher>> ciphers;
+    };
+    auto state = std::make_shared<State>();
+    state->passphrase = std::move(passphrase);
+    return [state](const std::filesystem::path& path) -> std::shared_ptr<SQLitePageCipher> {
+        if (path.empty() || path == ":memory:" || isPlainDatabase(path)) {
+            return nullptr;
+        }
+        auto key = std::filesystem::weakly_canonical(path);
+        // 同じDBを同時に開くコネクションが鍵を重複して導出しないよう導出を終えるまで保持する
+        std::lock_guard lock(state->mutex);
+        auto salt = readPageCipherSalt(path);
+        if (auto it = state->ciphers.find(key); it != state->ciphers.end() && (!salt || it->second->salt() == *salt)) {
+            return it->second;
+        }
+        SQLitePageCipher::salt_type fresh;
+        if (!salt) {
+            secureRandom(fresh);
+        }
+        auto cipher = SQLitePageCipher::derive(state->passphrase, salt.value_or(fresh));
+        state->ciphers.insert_or_assign(key, cipher);
+        return cipher;
+    };
+}
@@ -0,0 +1,234 @@
+﻿#pragma once
+
+#include "ChaCha20Poly1305.h"
+#include "SQLiteConnection.h"
+#include <array>
+#include <atomic>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+/// <summary>
+/// ページ単位の暗号化の統計
+/// </summary>
+struct SQLitePageCipherStats {
+	/// <summary>
+	/// 暗号化したページ数
+	/// </summary>
+	std::uint64_t encrypted = 0;
+	/// <summary>
+	/// 復号したページ数
+	/// </summary>
+	std::uint64_t decrypted = 0;
+	/// <summary>
+	/// 復号せずにキャッシュから読み取ったページ数
+	/// </summary>
+	std::uint64_t cache_hits = 0;
+};
+
+/// <summary>
+/// DBのページを認証付きで暗号化する鍵と、復号したページのキャッシュ
+/// </summary>
+/// <remarks>
+/// ページは[暗号文][nonce 12バイト][認証タグ 16バイト]とし、末尾のreserve_sizeバイトをSQLiteの予約領域として確保する。
+/// ファイルの種類とページのオフセットを追加データとして認証するため、ページの入れ替えも検出する。
+/// DBファイルの先頭16バイト(平文では"SQLite format 3\0")には鍵の導出に用いた塩を平文で格納する。
+/// 同じDBを開くコネクションで共有すると、復号したページのキャッシュも共有する
+/// </remarks>
+class SQLitePageCipher {
+public:
+	/// <summary>
+	/// 塩の型
+	/// </summary>
+	using salt_type = std::array<std::byte, 16>;
+
+	/// <summary>
+	/// ページのサイズ(これ以外のページのサイズのDBは扱えない)
+	/// </summary>
+	static constexpr std::size_t page_size = 4096;
+	/// <summary>
+	/// ページの末尾に確保するnonceと認証タグのバイト数
+	/// </summary>
+	static constexpr std::size_t reserve_size = std::tuple_size_v<ChaCha20Poly1305::nonce_type> + std::tuple_size_v<ChaCha20Poly1305::tag_type>;
+	/// <summary>
+	/// パスフレーズから鍵を導出するPBKDF2-HMAC-SHA256の反復回数
+	/// </summary>
+	static constexpr std::uint32_t kdf_iterations = 600000;
+	/// <summary>
+	/// キャッシュに保持する既定のページ数(64MiB)
+	/// </summary>
+	static constexpr std::size_t default_cache_pages = 16384;
+
+	/// <summary>
+	/// ページを暗号化するファイルの種類
+	/// </summary>
+	enum class FileKind : std::uint8_t {
+		/// <summary>
+		/// DBファイル
+		/// </summary>
+		database = 'D',
+		/// <summary>
+		/// WALファイル
+		/// </summary>
+		wal = 'W'
+	};
+
+private:
+	ChaCha20Poly1305 _aead;
+	salt_type _salt;
+	/// <summary>
+	/// VFSが開くファイルから参照するための識別子
+	/// </summary>
+	std::uint64_t _id;
+	/// <summary>
+	/// nonceの上位32ビット(インスタンスごとの乱数)
+	/// </summary>
+	std::uint32_t _nonce_prefix = 0;
+	/// <summary>
+	/// nonceの下位64ビット(乱数で初期化して暗号化のたびに進める)
+	/// </summary>
+	std::atomic<std::uint64_t> _nonce_counter = 0;
+
+	/// <summary>
+	/// 復号したページ
+	/// </summary>
+	struct CachedPage {
+		FileKind kind;
+		std::int64_t offset;
+		/// <summary>
+		/// 暗号化したページの末尾(nonceと認証タグ)
+		/// </summary>
+		std::array<std::byte, reserve_size> reserve;
+		std::vector<std::byte> plaintext;
+	};
+	/// <summary>
+	/// キャッシュに保持するページ数の上限
+	/// </summary>
+	std::size_t _cache_capacity;
+	/// <summary>
+	/// 最近に利用した順のページ
+	/// </summary>
+	std::list<CachedPage> _lru;
+	/// <summary>
+	/// ファイルの種類とオフセットからページを検索するための索引
+	/// </summary>
+	std::unordered_map<std::uint64_t, std::list<CachedPage>::iterator> _index;
+	std::mutex _mutex;
+
+	std::atomic<std::uint64_t> _encrypted = 0;
+	std::atomic<std::uint64_t> _decrypted = 0;
+	std::atomic<std::uint64_t> _cache_hits = 0;
+
+	/// <summary>
+	/// 復号したページをキャッシュへ格納する
+	/// </summary>
+	void store(FileKind kind, std::int64_t offset, std::span<const std::byte> reserve, std::span<const std::byte> plaintext);
+
+public:
+	SQLitePageCipher() = delete;
+	/// <summary>
+	/// 鍵と塩を指定して構築する
+	/// </summary>
+	/// <param name="key">鍵</param>
+	/// <param name="salt">鍵の導出に用いた塩(DBファイルの先頭に格納する)</param>
+	/// <param name="cache_pages">キャッシュに保持するページ数(0ならキャッシュしない)</param>
+	SQLitePageCipher(const ChaCha20Poly1305::key_type& key, const salt_type& salt, std::size_t cache_pages = default_cache_pages);
+	~SQLitePageCipher();
+
+	/// <summary>
+	/// パスフレーズと塩から鍵を導出して構築する
+	/// </summary>
+	/// <param name="passphrase">パスフレーズ</param>
+	/// <param name="salt">塩</param>
+	/// <param name="cache_pages">キャッシュに保持するページ数(0ならキャッシュしない)</param>
+	[[nodiscard]] static std::shared_ptr<SQLitePageCipher> derive(std::u8string_view passphrase, const salt_type& salt, std::size_t cache_pages = default_cache_pages);
+
+	/// <summary>
+	/// VFSが開くファイルから参照するための識別子
+	/// </summary>
+	[[nodiscard]] std::uint64_t id() const noexcept { return this->_id; }
+	/// <summary>
+	/// 鍵の導出に用いた塩
+	/// </summary>
+	[[nodiscard]] const salt_type& salt() const noexcept { return this->_salt; }
+
+	/// <summary>
+	/// ページを暗号化する
+	/// </summary>
+	/// <param name="kind">ファイルの種類</param>
+	/// <param name="offset">ページのファイル上のオフセット</param>
+	/// <param name="plaintext">平文のページ(page_sizeバイト)</param>
+	/// <param name="out">暗号化したページの書き込み先(page_sizeバイト)</param>
+	void seal(FileKind kind, std::int64_t offset, std::span<const std::byte> plaintext, std::span<std::byte> out);
+
+	/// <summary>
+	/// ページを認証して復号する(キャッシュに同じnonceと認証タグのページがあれば復号しない)
+	/// </summary>
+	/// <param name="kind">ファイルの種類</param>
+	/// <param name="offset">ページのファイル上のオフセット</param>
+	/// <param name="ciphertext">暗号化したページ(page_sizeバイト)</param>
+	/// <param name="out">平文のページの書き込み先(page_sizeバイト)</param>
+	/// <returns>認証に成功したならtrue</returns>
+	[[nodiscard]] bool open(FileKind kind, std::int64_t offset, std::span<const std::byte> ciphertext, std::span<std::byte> out);
+
+	/// <summary>
+	/// 暗号化と復号の統計を取得する
+	/// </summary>
+	[[nodiscard]] SQLitePageCipherStats stats() const noexcept;
+
+	/// <summary>
+	/// プロセス内で登録済みのすべての鍵における統計の合計を取得する
+	/// </summary>
+	[[nodiscard]] static SQLitePageCipherStats totalStats();
+
+	// コピーによる構築を禁止する
+	SQLitePageCipher(const SQLitePageCipher&) = delete;
+	SQLitePageCipher& operator=(const SQLitePageCipher&) = delete;
+};
+
+/// <summary>
+/// ページ単位で暗号化するVFSを登録する(2度目以降は登録済みのVFSの名称を返す)
+/// </summary>
+/// <remarks>
+/// 既定のVFSを包み、DBファイルとWALファイルのページを暗号化する。ロールバックジャーナルと一時ファイルは
+/// 暗号化しないため、暗号化したDBはWALモードかつtemp_store=MEMORYとして開く必要がある(SQLiteConnection::connectが設定する)
+/// </remarks>
+/// <returns>VFSの名称</returns>
+const char* registerPageCipherVfs();
+
+/// <summary>
+/// VFSが開くファイルから参照できるよう鍵を登録する(鍵が破棄されると登録も解除される)
+/// </summary>
+/// <param name="cipher">ページの暗号化に用いる鍵</param>
+void registerPageCipher(const std::shared_ptr<SQLitePageCipher>& cipher);
+
+/// <summary>
+/// DBファイルの先頭から塩を読み取る
+/// </summary>
+/// <param name="path">データベースへのパス</param>
+/// <returns>塩(ファイルが存在しないか空であればnullopt、暗号化されていないDBであれば例外を送出する)</returns>
+[[nodiscard]] std::optional<SQLitePageCipher::salt_type> readPageCipherSalt(const std::filesystem::path& path);
+
+/// <summary>
+/// DBファイルが暗号化されていないSQLiteのDBであるかを判定する
+/// </summary>
+/// <param name="path">データベースへのパス</param>
+[[nodiscard]] bool isPlainDatabase(const std::filesystem::path& path);
+
+/// <summary>
+/// パスフレーズからDBごとの鍵を導出する関数を構築する
+/// </summary>
+/// <remarks>
+/// 存在しないか空のDBは新たな塩で暗号化し、暗号化されていない既存のDBは暗号化せずに開く。
+/// 導出した鍵はDBへのパスごとに保持し、同じDBを開くコネクションで共有する
+/// </remarks>
+/// <param name="passphrase">パスフレーズ</param>
+[[nodiscard]] SQLitePageCipherProvider makePageCipherProvider(std::u8string passphrase);
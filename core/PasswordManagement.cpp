@@ -1,8 +1,20 @@
 ﻿#include "PasswordManagement.h"
+#include "BoundedQueue.h"
+#include "Sha256.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <bit>
+#include <compare>
+#include <condition_variable>
+#include <format>
+#include <mutex>
+#include <thread>
 #include <iostream>
+#include <map>
 #include <sstream>
 #include <ranges>
+#include <tuple>
 
 namespace pwm {
     namespace {
@@ -52,11 +64,242 @@ namespace pwm {
             std::bit_cast<const char*>(pws::c_update_at::value.data())
         ).data());
 
+        /// <summary>
+        /// 同期に関するテーブル名とカラム名を埋め込んでSQLを構築
+        /// </summary>
+        /// <remarks>
+        /// {0}はスキーマ名とピリオド(省略時は空)、以降は{1}passwords {2}uid {3}seq {4}service {5}user {6}name {7}password {8}encryption
+        /// {9}memo {10}registered_at {11}update_at {12}version {13}tombstones {14}deleted_at {15}sync_state {16}vault
+        /// {17}sync_peers {18}local_seq {19}peer_seq {20}synced_at {21}id {22}merkle_seq {23}merkle {24}level {25}idx {26}hash
+        /// {27}merkle_dirty {28}bucket を埋め込む
+        /// </remarks>
+        /// <param name="fmt">SQLの書式</param>
+        /// <param name="schema">スキーマ名(空であれば修飾しない)</param>
+        /// <returns></returns>
+        std::u8string formatSyncSql(std::string_view fmt, std::u8string_view schema = u8"") {
+            auto str = [](std::u8string_view x) { return std::string_view(std::bit_cast<const char*>(x.data()), x.size()); };
+            const auto prefix = schema.empty() ? std::string() : std::string(str(schema)) + ".";
+            const std::array<std::string_view, 29> names = {
+                prefix, str(pws::value), str(pws::c_uid::value), str(pws::c_seq::value),
+                str(pws::c_service::value), str(pws::c_user::value), str(pws::c_name::value), str(pws::c_password::value),
+                str(pws::c_encryption::value), str(pws::c_memo::value), str(pws::c_registered_at::value), str(pws::c_update_at::value),
+                str(pws::c_version::value), str(table::tombstones::value), str(table::tombstones::c_deleted_at::value),
+                str(table::sync_state::value), str(table::sync_state::c_vault::value), str(table::sync_peers::value),
+                str(table::sync_peers::c_local_seq::value), str(table::sync_peers::c_peer_seq::value), str(table::sync_peers::c_synced_at::value),
+                str(pws::c_id::value), str(table::sync_state::c_merkle_seq::value), str(table::merkle::value),
+                str(table::merkle::c_level::value), str(table::merkle::c_idx::value), str(table::merkle::c_hash::value),
+                str(table::merkle_dirty::value), str(table::merkle_dirty::c_bucket::value)
+            };
+            return std::bit_cast<const char8_t*>(std::vformat(fmt, std::make_format_args(
+                names[0], names[1], names[2], names[3], names[4], names[5], names[6], names[7], names[8], names[9], names[10],
+                names[11], names[12], names[13], names[14], names[15], names[16], names[17], names[18], names[19], names[20], names[21],
+                names[22], names[23], names[24], names[25], names[26], names[27], names[28]
+            )).data());
+        }
+
+        /// <summary>
+        /// 次に付与する変更の連番を求めるSQLの断片
+        /// </summary>
+        /// <remarks>
+        /// 行と墓標の連番の最大値の次とする(いずれもインデックスの末尾を参照するのみ)。
+        /// 挿入時にトリガーで付与すると文ごとにステートメントジャーナルが作られ一括挿入が大きく遅くなるため、
+        /// 書き込むSQLの中で直接付与する
+        /// </remarks>
+        /// <param name="schema">スキーマ名(空であれば修飾しない)</param>
+        /// <returns></returns>
+        std::u8string nextSeqSql(std::u8string_view schema = u8"") {
+            return formatSyncSql("(SELECT max(coalesce((SELECT max({3}) FROM {0}{1}),0),coalesce((SELECT max({3}) FROM {0}{13}),0))+1)", schema);
+        }
+
+        /// <summary>
+        /// 新たな行を識別する値を求めるSQLの断片
+        /// </summary>
+        /// <remarks>
+        /// DBを識別する値と挿入時の連番を連結するため、DBをまたいで一意かつDB内では昇順となりインデックスの末尾へ追加される
+        /// </remarks>
+        /// <param name="schema">スキーマ名(空であれば修飾しない)</param>
+        /// <returns></returns>
+        std::u8string newUidSql(std::u8string_view schema = u8"") {
+            return formatSyncSql("((SELECT {16} FROM {0}{15})||printf('%016x',", schema) + nextSeqSql(schema) + u8"))";
+        }
+
+        /// <summary>
+        /// スキーマの移行のためのSQLの宣言(i番目の要素はuser_versionがiのDBをi+1へ移行する)
+        /// </summary>
+        static const std::vector<std::u8string> sql_migrations = {
+            // 楽観的排他制御のための行のバージョンの追加
+            std::bit_cast<const char8_t*>(std::format(R"(
+                ALTER TABLE {0} ADD COLUMN {1} INTEGER NOT NULL DEFAULT 1;
+            )",
+                // テーブル名の埋め込み
+                std::bit_cast<const char*>(pws::value.data()),
+                // 行のバージョン名の埋め込み
+                std::bit_cast<const char*>(pws::c_version::value.data())
+            ).data()),
+            // 差分同期のための行の識別子、変更の連番、墓標および同期の位置の追加
+            // (既存の行は主キーを連番として初回の同期で全件を送る)
+            formatSyncSql(R"(
+                ALTER TABLE {1} ADD COLUMN {2} TEXT;
+                ALTER TABLE {1} ADD COLUMN {3} INTEGER NOT NULL DEFAULT 0;
+                CREATE TABLE {15} (
+                    {21} INTEGER PRIMARY KEY CHECK ({21}=0),
+                    {16} TEXT NOT NULL
+                );
+                INSERT INTO {15} ({21}, {16}) VALUES (0, lower(hex(randomblob(8))));
+                UPDATE {1} SET {2}=(SELECT {16} FROM {15})||printf('%016x', {21}), {3}={21};
+                CREATE UNIQUE INDEX idx_{1}_05 ON {1}({2});
+                CREATE INDEX idx_{1}_06 ON {1}({3});
+                CREATE TABLE {13} (
+                    {2} TEXT PRIMARY KEY,
+                    {12} INTEGER NOT NULL,
+                    {14} TEXT NOT NULL,
+                    {3} INTEGER NOT NULL
+                );
+                CREATE INDEX idx_{13}_00 ON {13}({3});
+                CREATE TABLE {17} (
+                    {16} TEXT PRIMARY KEY,
+                    {18} INTEGER NOT NULL,
+                    {19} INTEGER NOT NULL,
+                    {20} TEXT NOT NULL DEFAULT CURRENT_TIMESTAMP
+                );
+                CREATE TRIGGER trg_{1}_delete AFTER DELETE ON {1} WHEN old.{2} IS NOT NULL BEGIN
+                    INSERT INTO {13} ({2}, {12}, {14}, {3}) VALUES (old.{2}, old.{12}, CURRENT_TIMESTAMP,
+                        (SELECT max(coalesce((SELECT max({3}) FROM {1}),0),coalesce((SELECT max({3}) FROM {13}),0))+1))
+                    ON CONFLICT({2}) DO UPDATE SET {12}=excluded.{12}, {14}=excluded.{14}, {3}=excluded.{3};
+                END;
+            )"),
+            // 内容の比較と改ざんの検出のためのマークル木の追加
+            // (削除された行のバケットはトリガーで記録し、それ以外の変更は変更の連番から求める。
+            // バケットは主キーをmerkle_bucket_bitsビット右シフトした値)
+            formatSyncSql(R"(
+                ALTER TABLE {15} ADD COLUMN {22} INTEGER NOT NULL DEFAULT 0;
+                CREATE TABLE {23} (
+                    {24} INTEGER NOT NULL,
+                    {25} INTEGER NOT NULL,
+                    {26} BLOB NOT NULL,
+                    PRIMARY KEY ({24}, {25})
+                ) WITHOUT ROWID;
+                CREATE TABLE {27} (
+                    {28} INTEGER PRIMARY KEY
+                );
+                CREATE TRIGGER trg_{1}_delete_{23} AFTER DELETE ON {1} BEGIN
+                    INSERT OR IGNORE INTO {27} ({28}) VALUES (old.{21} >> 10);
+                END;
+            )"),
+            // パスワードの暗号化のための鍵の世代ごとの情報の追加
+            // (鍵そのものは保持せず、パスフレーズの照合のための値のみを保持する)
+            std::bit_cast<const char8_t*>(std::format(R"(
+                CREATE TABLE {0} (
+                    {1} INTEGER PRIMARY KEY,
+                    {2} TEXT NOT NULL,
+                    {3} BLOB NOT NULL,
+                    {4} INTEGER NOT NULL,
+                    {5} BLOB NOT NULL,
+                    {6} TEXT NOT NULL DEFAULT CURRENT_TIMESTAMP
+                );
+            )",
+                // テーブル名の埋め込み
+                std::bit_cast<const char*>(table::vault_keys::value.data()),
+                // 鍵の世代名の埋め込み
+                std::bit_cast<const char*>(table::vault_keys::c_generation::value.data()),
+                // 暗号化方式名の埋め込み
+                std::bit_cast<const char*>(table::vault_keys::c_method::value.data()),
+                // 塩名の埋め込み
+                std::bit_cast<const char*>(table::vault_keys::c_salt::value.data()),
+                // 反復回数名の埋め込み
+                std::bit_cast<const char*>(table::vault_keys::c_iterations::value.data()),
+                // 照合値名の埋め込み
+                std::bit_cast<const char*>(table::vault_keys::c_verifier::value.data()),
+                // 作成日時名の埋め込み
+                std::bit_cast<const char*>(table::vault_keys::c_created_at::value.data())
+            ).data()),
+            // 中断した鍵の更新を再開するための進捗の追加
+            // (次に再暗号化する主キーを保持し、NULLであれば再暗号化を終えている)
+            std::bit_cast<const char8_t*>(std::format(R"(
+                ALTER TABLE {0} ADD COLUMN {1} INTEGER;
+            )",
+                // テーブル名の埋め込み
+                std::bit_cast<const char*>(table::vault_keys::value.data()),
+                // 鍵の更新の進捗名の埋め込み
+                std::bit_cast<const char*>(table::vault_keys::c_rekey_id::value.data())
+            ).data())
+        };
+
         /// <summary>
         /// パスワードを登録するSQLの宣言
         /// </summary>
         std::u8string sql_insert = std::bit_cast<const char8_t*>(std::format(R"(
-            INSERT INTO {0} ({1}, {2}, {3}, {4}, {5}, {6}) VALUES (?, ?, ?, ?, ?, ?);
+            INSERT INTO {0} ({1}, {2}, {3}, {4}, {5}, {6}, {7}, {8}) VALUES (?, ?, ?, ?, ?, ?, {9}, {10});
+        )",
+            // テーブル名の埋め込み
+            std::bit_cast<const char*>(pws::value.data()),
+            // サービス名の埋め込み
+            std::bit_cast<const char*>(pws::c_service::value.data()),
+            // ユーザ名の埋め込み
+            std::bit_cast<const char*>(pws::c_user::value.data()),
+            // 名称の埋め込み
+            std::bit_cast<const char*>(pws::c_name::value.data()),
+            // パスワード名の埋め込み
+            std::bit_cast<const char*>(pws::c_password::value.data()),
+            // 暗号化の名称の埋め込み
+            std::bit_cast<const char*>(pws::c_encryption::value.data()),
+            // メモ名の埋め込み
+            std::bit_cast<const char*>(pws::c_memo::value.data()),
+            // 行の識別子名の埋め込み
+            std::bit_cast<const char*>(pws::c_uid::value.data()),
+            // 変更の連番名の埋め込み
+            std::bit_cast<const char*>(pws::c_seq::value.data()),
+            // 行の識別子を求める式の埋め込み
+            std::bit_cast<const char*>(newUidSql().data()),
+            // 変更の連番を求める式の埋め込み
+            std::bit_cast<const char*>(nextSeqSql().data())
+        ).data());
+
+        /// <summary>
+        /// 既存のパスワード情報と重複した場合に上書きしつつ登録するSQLの宣言
+        /// </summary>
+        /// <remarks>
+        /// サービス名とユーザ名の組あるいは名称が重複した行を更新し、行のバージョンを返す(1であれば新たに挿入された)
+        /// </remarks>
+        std::u8string sql_upsert = std::bit_cast<const char8_t*>(std::format(R"(
+            INSERT INTO {0} ({1}, {2}, {3}, {4}, {5}, {6}, {9}, {10}) VALUES (?, ?, ?, ?, ?, ?, {11}, {12})
+            ON CONFLICT({1}, {2}) DO UPDATE SET {3}=excluded.{3},{4}=excluded.{4},{5}=excluded.{5},{6}=excluded.{6},{7}=CURRENT_TIMESTAMP,{8}={8}+1,{10}=excluded.{10}
+            ON CONFLICT({3}) DO UPDATE SET {1}=excluded.{1},{2}=excluded.{2},{4}=excluded.{4},{5}=excluded.{5},{6}=excluded.{6},{7}=CURRENT_TIMESTAMP,{8}={8}+1,{10}=excluded.{10}
+            RETURNING {8};
+        )",
+            // テーブル名の埋め込み
+            std::bit_cast<const char*>(pws::value.data()),
+            // サービス名の埋め込み
+            std::bit_cast<const char*>(pws::c_service::value.data()),
+            // ユーザ名の埋め込み
+            std::bit_cast<const char*>(pws::c_user::value.data()),
+            // 名称の埋め込み
+            std::bit_cast<const char*>(pws::c_name::value.data()),
+            // パスワード名の埋め込み
+            std::bit_cast<const char*>(pws::c_password::value.data()),
+            // 暗号化の名称の埋め込み
+            std::bit_cast<const char*>(pws::c_encryption::value.data()),
+            // メモ名の埋め込み
+            std::bit_cast<const char*>(pws::c_memo::value.data()),
+            // パスワードの更新日時名の埋め込み
+            std::bit_cast<const char*>(pws::c_update_at::value.data()),
+            // 行のバージョン名の埋め込み
+            std::bit_cast<const char*>(pws::c_version::value.data()),
+            // 行の識別子名の埋め込み
+            std::bit_cast<const char*>(pws::c_uid::value.data()),
+            // 変更の連番名の埋め込み
+            std::bit_cast<const char*>(pws::c_seq::value.data()),
+            // 行の識別子を求める式の埋め込み
+            std::bit_cast<const char*>(newUidSql().data()),
+            // 変更の連番を求める式の埋め込み
+            std::bit_cast<const char*>(nextSeqSql().data())
+        ).data());
+
+        /// <summary>
+        /// 既存のパスワード情報と重複した場合に読み飛ばしつつ登録するSQLの宣言
+        /// </summary>
+        std::u8string sql_insert_or_skip = std::bit_cast<const char8_t*>(std::format(R"(
+            INSERT INTO {0} ({1}, {2}, {3}, {4}, {5}, {6}, {7}, {8}) VALUES (?, ?, ?, ?, ?, ?, {9}, {10}) ON CONFLICT DO NOTHING;
         )",
             // テーブル名の埋め込み
             std::bit_cast<const char*>(pws::value.data()),
@@ -71,9 +314,140 @@ namespace pwm {
             // 暗号化の名称の埋め込み
             std::bit_cast<const char*>(pws::c_encryption::value.data()),
             // メモ名の埋め込み
-            std::bit_cast<const char*>(pws::c_memo::value.data())
+            std::bit_cast<const char*>(pws::c_memo::value.data()),
+            // 行の識別子名の埋め込み
+            std::bit_cast<const char*>(pws::c_uid::value.data()),
+            // 変更の連番名の埋め込み
+            std::bit_cast<const char*>(pws::c_seq::value.data()),
+            // 行の識別子を求める式の埋め込み
+            std::bit_cast<const char*>(newUidSql().data()),
+            // 変更の連番を求める式の埋め込み
+            std::bit_cast<const char*>(nextSeqSql().data())
+        ).data());
+
+        /// <summary>
+        /// 格納するパスワードとその暗号化方式
+        /// </summary>
+        /// <remarks>
+        /// バインド変数は実行を終えるまで値を参照するため、実行を終えるまで破棄してはならない
+        /// </remarks>
+        class SealedPassword {
+            std::u8string_view _method = table::encryption_method::none;
+            std::vector<unsigned char> _ciphertext;
+            const std::vector<unsigned char>* _value = nullptr;
+        public:
+            /// <summary>
+            /// 鍵が存在すれば暗号化し、存在しなければ平文のまま格納する
+            /// </summary>
+            /// <param name="keyring">鍵</param>
+            /// <param name="password">パスワード</param>
+            SealedPassword(RecordKeyring& keyring, const std::vector<unsigned char>& password) : _value(&password) {
+                if (auto cipher = keyring.current(); cipher != nullptr) {
+                    this->_method = cipher->method();
+                    this->_ciphertext = cipher->encrypt(password);
+                    this->_value = &this->_ciphertext;
+                }
+            }
+            SealedPassword(const SealedPassword&) = delete;
+            SealedPassword& operator=(const SealedPassword&) = delete;
+
+            /// <summary>
+            /// 暗号化方式の名称
+            /// </summary>
+            [[nodiscard]] std::u8string_view method() const noexcept { return this->_method; }
+            /// <summary>
+            /// 格納する値
+            /// </summary>
+            [[nodiscard]] const std::vector<unsigned char>& value() const noexcept { return *this->_value; }
+        };
+
+        /// <summary>
+        /// 更新内容にパスワードが含まれていれば格納するパスワードを構築する
+        /// </summary>
+        /// <param name="keyring">鍵</param>
+        /// <param name="content">更新内容</param>
+        /// <returns>格納するパスワード(更新内容にパスワードが含まれなければnullopt)</returns>
+        std::optional<SealedPassword> sealPassword(RecordKeyring& keyring, const UpdateParam& content) {
+            if (!content.password) {
+                return std::nullopt;
+            }
+            return std::optional<SealedPassword>(std::in_place, keyring, content.password.value());
+        }
+
+        /// <summary>
+        /// 挿入情報をバインド変数へ設定(sql_insertと同じ順序)
+        /// </summary>
+        /// <param name="stmt"></param>
+        /// <param name="obj"></param>
+        /// <param name="password">格納するパスワード</param>
+        void bindInsert(SQLiteStmt& stmt, const InsertParam& obj, const SealedPassword& password) {
+            stmt.bind(1, obj.service);
+            stmt.bind(2, obj.user);
+            stmt.bind(3, obj.name);
+            stmt.bind(4, password.value());
+            stmt.bind(5, password.method());
+            stmt.bind(6, obj.memo);
+        }
+
+        /// <summary>
+        /// 暗号化されたパスワードを復号して取得する式
+        /// </summary>
+        /// <remarks>
+        /// 暗号化されていなければ値をそのまま返す
+        /// </remarks>
+        static const std::u8string sql_decrypt_password = std::bit_cast<const char8_t*>(std::format("pwm_decrypt({0},{1})",
+            // 暗号化の名称の埋め込み
+            std::bit_cast<const char*>(pws::c_encryption::value.data()),
+            // パスワード名の埋め込み
+            std::bit_cast<const char*>(pws::c_password::value.data())
         ).data());
 
+        /// <summary>
+        /// カラムに関連付けられたインデックスからカラム名を取得する
+        /// </summary>
+        /// <param name="index">passwordsのカラムに関連付けられたインデックス</param>
+        /// <returns>カラム名(該当するカラムが存在しなければnullopt)</returns>
+        std::optional<std::u8string_view> getColName(int index) {
+            switch (index) {
+            case pws::c_service::index: return pws::c_service::value;
+            case pws::c_name::index: return pws::c_name::value;
+            case pws::c_user::index: return pws::c_user::value;
+            case pws::c_password::index: return pws::c_password::value;
+            case pws::c_encryption::index: return pws::c_encryption::value;
+            case pws::c_memo::index: return pws::c_memo::value;
+            case pws::c_registered_at::index: return pws::c_registered_at::value;
+            case pws::c_update_at::index: return pws::c_update_at::value;
+            case pws::c_id::index: return pws::c_id::value;
+            case pws::c_version::index: return pws::c_version::value;
+            case pws::c_uid::index: return pws::c_uid::value;
+            case pws::c_seq::index: return pws::c_seq::value;
+            }
+            return std::nullopt;
+        }
+
+        /// <summary>
+        /// 取得対象のカラムを列挙するSQLの断片を構築
+        /// </summary>
+        /// <param name="target_list">取得対象(passwordsのカラムに関連付けられたインデックス)</param>
+        /// <returns>カンマ区切りのカラム名</returns>
+        std::u8string getColListStr(const std::vector<int>& target_list) {
+            using namespace std::ranges;
+            std::vector<std::u8string_view> col_list;
+            for (const auto& i : target_list) {
+                if (i == pws::c_password::index) {
+                    // パスワードは復号して取得する
+                    col_list.emplace_back(sql_decrypt_password);
+                }
+                else if (auto col = getColName(i); col) {
+                    col_list.emplace_back(col.value());
+                }
+            }
+            if (col_list.size() == 0) {
+                throw std::invalid_argument("取得対象として指定された列が空です");
+            }
+            return col_list | views::join_with(u8',') | to<std::u8string>();
+        }
+
         /// <summary>
         /// 検索条件におけるWhere句を示す文字列を構築
         /// </summary>
@@ -181,37 +555,22 @@ namespace pwm {
             }
             return offset;
         }
-    }
 
-    PasswordManagement::PasswordManagement(const std::filesystem::path& dbpath, SQLite& conn): _dbpath(dbpath), _conn(conn) {
-        if (this->_conn) {
-            // テーブルを構築
-            this->_conn.exec(sql_cretate_table);
-        }
-        else {
-            throw std::runtime_error("DBとのコネクションが確立されていません");
+        /// <summary>
+        /// 主キーにより1件を特定するWhere句を示す文字列を構築
+        /// </summary>
+        /// <returns></returns>
+        std::u8string getWhereIdStr() {
+            return u8"WHERE " + std::u8string(pws::c_id::value) + u8"=?";
         }
-    }
 
-    void PasswordManagement::insert(const InsertParam& obj) {
-        if (this->_conn) {
-            auto stmt = this->_conn.prepare(sql_insert);
-            // バインド変数へ設定
-            stmt.bind(1, obj.service);
-            stmt.bind(2, obj.user);
-            stmt.bind(3, obj.name);
-            stmt.bind(4, obj.password);
-            stmt.bind(5, pwm::table::encryption_method::none);
-            stmt.bind(6, obj.memo);
-            // パスワード情報を挿入
-            for (const auto& x : stmt.exec()) {}
-        }
-        else {
-            throw std::runtime_error("DBとのコネクションが確立されていません");
-        }
-    }
-    void PasswordManagement::update(const GetParam& obj, const UpdateParam& content) {
-        if (this->_conn) {
+        /// <summary>
+        /// 更新内容と抽出条件から更新のためのSQLを構築
+        /// </summary>
+        /// <param name="content">更新内容</param>
+        /// <param name="where_str">Where句を示す文字列</param>
+        /// <returns></returns>
+        std::u8string getUpdateSql(const UpdateParam& content, const std::u8string& where_str) {
             std::vector<std::u8string_view> update_list = {};
             if (content.service) {
                 update_list.push_back(pws::c_service::value);
@@ -224,6 +583,7 @@ namespace pwm {
             }
             if (content.password) {
                 update_list.push_back(pws::c_password::value);
+                update_list.push_back(pws::c_encryption::value);
             }
             if (content.memo) {
                 update_list.push_back(pws::c_memo::value);
@@ -235,11 +595,8 @@ namespace pwm {
                     return u8"," + std::u8string(x.begin(), x.end()) + u8"=?";
                 }) | views::join | to<std::u8string>();
 
-            // 抽出条件のSQLの構築
-            std::u8string where_str = getWhereStr(obj);
-
-            std::u8string sql_update = std::bit_cast<const char8_t*>(std::format(R"(
-                UPDATE {0} SET {1}=CURRENT_TIMESTAMP{2} {3};
+            return std::bit_cast<const char8_t*>(std::format(R"(
+                UPDATE {0} SET {1}=CURRENT_TIMESTAMP,{4}={4}+1,{5}={6}{2} {3};
             )",
                 // テーブル名の埋め込み
                 std::bit_cast<const char*>(pws::value.data()),
@@ -248,117 +605,1773 @@ namespace pwm {
                 // 更新に関するクエリ部分の埋め込み
                 std::bit_cast<const char*>(cols.data()),
                 // WHERE句の埋め込み
-                std::bit_cast<const char*>(where_str.data())
+                std::bit_cast<const char*>(where_str.data()),
+                // 行のバージョン名の埋め込み
+                std::bit_cast<const char*>(pws::c_version::value.data()),
+                // 変更の連番名の埋め込み
+                std::bit_cast<const char*>(pws::c_seq::value.data()),
+                // 変更の連番を求める式の埋め込み
+                std::bit_cast<const char*>(nextSeqSql().data())
             ).data());
+        }
 
-            // バインド変数の設定
-            auto stmt = this->_conn.prepare(sql_update);
-            int offset = 1;
-            if (content.service) {
-                stmt.bind(offset++, content.service.value());
+        /// <summary>
+        /// Where句に行のバージョンの条件を追加する
+        /// </summary>
+        /// <param name="where_str">Where句を示す文字列</param>
+        /// <returns></returns>
+        std::u8string addWhereVersionStr(const std::u8string& where_str) {
+            return (where_str.length() == 0 ? u8"WHERE " : where_str + u8" AND ") + std::u8string(pws::c_version::value) + u8"=?";
+        }
+
+        /// <summary>
+        /// Where句に主キーの範囲の条件を追加する
+        /// </summary>
+        /// <param name="where_str">Where句を示す文字列</param>
+        /// <returns></returns>
+        std::u8string addWhereIdRangeStr(const std::u8string& where_str) {
+            return (where_str.length() == 0 ? u8"WHERE " : where_str + u8" AND ") + std::u8string(pws::c_id::value) + u8" BETWEEN ? AND ?";
+        }
+
+        /// <summary>
+        /// 並列の走査において1度に受け渡す行数
+        /// </summary>
+        constexpr std::size_t scan_batch_size = 256;
+
+        /// <summary>
+        /// 並列の走査において範囲ごとに滞留可能な行のまとまりの数
+        /// </summary>
+        constexpr std::size_t scan_queue_depth = 4;
+
+        /// <summary>
+        /// スキーマのバージョンを取得する
+        /// </summary>
+        /// <param name="conn">SQLiteに関する操作の起点となるオブジェクト</param>
+        /// <returns></returns>
+        std::int64_t getUserVersion(SQLite& conn) {
+            for (auto e : conn.prepare(u8"PRAGMA user_version;").exec()) {
+                return e.get<SQLiteData::integer_type>(0).value_or(0);
             }
-            if (content.user) {
-                stmt.bind(offset++, content.user.value());
+            return 0;
+        }
+
+        /// <summary>
+        /// スキーマを最新のバージョンへ移行する
+        /// </summary>
+        /// <param name="conn">SQLiteに関する操作の起点となるオブジェクト</param>
+        void migrate(SQLite& conn) {
+            const auto latest = static_cast<std::int64_t>(sql_migrations.size());
+            if (getUserVersion(conn) >= latest) {
+                return;
             }
-            if (content.name) {
-                stmt.bind(offset++, content.name.value());
+            // 他のプロセスと同時に移行しないよう書き込みのロックを取得してから再度確認する
+            SQLiteTransaction transaction(conn, true);
+            for (auto version = getUserVersion(conn); version < latest; ++version) {
+                conn.exec(sql_migrations[version]);
             }
-            if (content.password) {
-                stmt.bind(offset++, content.password.value());
+            conn.exec(std::bit_cast<const char8_t*>(std::format("PRAGMA user_version={0};", latest).c_str()));
+            transaction.commit();
+        }
+
+        /// <summary>
+        /// 更新内容に関するバインド変数を設定
+        /// </summary>
+        /// <param name="stmt"></param>
+        /// <param name="content"></param>
+        /// <param name="password">格納するパスワード(content.passwordが存在する場合のみ参照する)</param>
+        /// <param name="offset"></param>
+        /// <returns></returns>
+        int bindSet(SQLiteStmt& stmt, const UpdateParam& content, const std::optional<SealedPassword>& password, int offset) {
+            // コードの構造は更新内容のgetUpdateSqlと同じ
+
+            if (content.service) { stmt.bind(offset++, content.service.value()); }
+            if (content.user) { stmt.bind(offset++, content.user.value()); }
+            if (content.name) { stmt.bind(offset++, content.name.value()); }
+            if (content.password) { stmt.bind(offset++, password->value()); stmt.bind(offset++, password->method()); }
+            if (content.memo) { stmt.bind(offset++, content.memo.value()); }
+            return offset;
+        }
+
+        /// <summary>
+        /// 同期において受け渡す1行分の変更(削除を含む)
+        /// </summary>
+        struct SyncEntry {
+            /// <summary>
+            /// DBをまたいで行を識別する値
+            /// </summary>
+            std::u8string uid;
+            /// <summary>
+            /// trueなら削除(墓標)
+            /// </summary>
+            bool deleted = false;
+            /// <summary>
+            /// 行のバージョン(削除であれば削除時点のバージョン)
+            /// </summary>
+            std::int64_t version = 0;
+            /// <summary>
+            /// 更新日時(削除であれば削除日時)
+            /// </summary>
+            std::u8string stamp;
+            std::u8string service;
+            std::u8string user;
+            std::optional<std::u8string> name;
+            std::vector<unsigned char> password;
+            std::u8string encryption;
+            std::optional<std::u8string> memo;
+            std::u8string registered_at;
+
+            /// <summary>
+            /// この行を削除したことを示す墓標を生成する
+            /// </summary>
+            SyncEntry tombstone() const {
+                return { .uid = this->uid, .deleted = true, .version = this->version, .stamp = this->stamp };
             }
-            if (content.memo) {
-                stmt.bind(offset++, content.memo.value());
+        };
+
+        /// <summary>
+        /// 競合した変更のうちいずれを採用するかを比較する(大きい方を採用する)
+        /// </summary>
+        /// <remarks>
+        /// 行のバージョン、日時、削除であるか(削除を優先)、内容、識別子の順に比較するため、
+        /// どちらのDBを起点としても同じ結果となる
+        /// </remarks>
+        std::strong_ordering compareSyncEntry(const SyncEntry& a, const SyncEntry& b) {
+            if (auto c = a.version <=> b.version; c != 0) { return c; }
+            if (auto c = a.stamp <=> b.stamp; c != 0) { return c; }
+            if (auto c = a.deleted <=> b.deleted; c != 0) { return c; }
+            return std::tie(a.service, a.user, a.name, a.password, a.encryption, a.memo, a.registered_at, a.uid)
+                <=> std::tie(b.service, b.user, b.name, b.password, b.encryption, b.memo, b.registered_at, b.uid);
+        }
+
+        /// <summary>
+        /// 他のDBをATTACHし、破棄時にDETACHするクラス
+        /// </summary>
+        class AttachedDatabase {
+            SQLite& _conn;
+            std::u8string _schema;
+        public:
+            AttachedDatabase(SQLite& conn, const std::filesystem::path& path, std::u8string_view schema) : _conn(conn), _schema(schema) {
+                conn.attach(path, this->_schema);
             }
-            if (where_str.length() != 0) {
-                bindWhere(stmt, obj, offset);
+            ~AttachedDatabase() {
+                try {
+                    this->_conn.detach(this->_schema);
+                }
+                catch (...) {}
             }
 
-            // パスワード情報を更新
-            for (const auto& x : stmt.exec()) {}
-        }
-        else {
-            throw std::runtime_error("DBとのコネクションが確立されていません");
-        }
-    }
-    SQLiteView PasswordManagement::get(const GetParam& obj, const std::vector<int>& target_list) {
-        using namespace std::ranges;
-        if (this->_conn) {
-            // 取得対象のカラムに関するSQLの構築
-            std::vector<std::u8string_view> col_list;
-            for (const auto& i : target_list) {
-                switch (i) {
-                case pws::c_service::index:
-                    col_list.emplace_back(pws::c_service::value);
-                    break;
-                case pws::c_name::index:
-                    col_list.emplace_back(pws::c_name::value);
-                    break;
-                case pws::c_user::index:
-                    col_list.emplace_back(pws::c_user::value);
-                    break;
-                case pws::c_password::index:
-                    col_list.emplace_back(pws::c_password::value);
-                    break;
-                case pws::c_encryption::index:
-                    col_list.emplace_back(pws::c_encryption::value);
-                    break;
-                case pws::c_memo::index:
-                    col_list.emplace_back(pws::c_memo::value);
-                    break;
-                case pws::c_registered_at::index:
-                    col_list.emplace_back(pws::c_registered_at::value);
-                    break;
-                case pws::c_update_at::index:
-                    col_list.emplace_back(pws::c_update_at::value);
-                    break;
+            // コピーによる構築を禁止する
+            AttachedDatabase(const AttachedDatabase&) = delete;
+            AttachedDatabase& operator=(const AttachedDatabase&) = delete;
+        };
+
+        /// <summary>
+        /// 同期の一方のDB(スキーマ)に対する読み書きを行うクラス
+        /// </summary>
+        class SyncSide {
+            /// <summary>
+            /// 行の取得対象のカラム(SyncEntryの読み取りと同じ順序)
+            /// </summary>
+            static constexpr std::string_view row_cols = "{2},{12},{11},{4},{5},{6},{7},{8},{9},{10}";
+
+            SQLite& _conn;
+            std::u8string _schema;
+            /// <summary>
+            /// パスワードを平文で受け渡すときのこのDBの鍵(暗号文のまま受け渡すときはnullptr)
+            /// </summary>
+            RecordKeyring* _keyring;
+            SQLiteStmt _select_changes;
+            SQLiteStmt _select_tombstones;
+            SQLiteStmt _select_row;
+            SQLiteStmt _select_tombstone;
+            SQLiteStmt _select_duplicates;
+            SQLiteStmt _upsert_row;
+            SQLiteStmt _delete_row;
+            SQLiteStmt _delete_tombstone;
+            SQLiteStmt _next_seq;
+            SQLiteStmt _upsert_tombstone;
+
+            /// <summary>
+            /// row_colsの順に取得した行を読み取る
+            /// </summary>
+            /// <remarks>
+            /// 鍵が設定されていれば暗号化されたパスワードを復号する(暗号化方式は元のまま残し、反映先で暗号化し直す)
+            /// </remarks>
+            SyncEntry readRow(SQLiteData& e) {
+                auto blob = e.get<SQLiteData::blob_type>(6).value_or(SQLiteData::blob_type{});
+                SyncEntry entry = {
+                    .uid = std::u8string(e.get<SQLiteData::string_type>(0).value_or(u8"")),
+                    .version = e.get<SQLiteData::integer_type>(1).value_or(0),
+                    .stamp = std::u8string(e.get<SQLiteData::string_type>(2).value_or(u8"")),
+                    .service = std::u8string(e.get<SQLiteData::string_type>(3).value_or(u8"")),
+                    .user = std::u8string(e.get<SQLiteData::string_type>(4).value_or(u8"")),
+                    .name = e.get<SQLiteData::string_type>(5).transform([](auto x) { return std::u8string(x); }),
+                    .password = std::vector<unsigned char>(blob.begin(), blob.end()),
+                    .encryption = std::u8string(e.get<SQLiteData::string_type>(7).value_or(u8"")),
+                    .memo = e.get<SQLiteData::string_type>(8).transform([](auto x) { return std::u8string(x); }),
+                    .registered_at = std::u8string(e.get<SQLiteData::string_type>(9).value_or(u8""))
+                };
+                if (this->_keyring != nullptr && entry.encryption != table::encryption_method::none) {
+                    entry.password = this->_keyring->decrypt(entry.encryption, entry.password);
                 }
+                return entry;
             }
-            if (col_list.size() == 0) {
-                throw std::invalid_argument("取得対象として指定された列が空です");
+
+            /// <summary>
+            /// 単一の整数を返すステートメントを実行する
+            /// </summary>
+            static std::int64_t scalar(SQLiteStmt& stmt) {
+                std::int64_t value = 0;
+                for (auto e : stmt.exec()) {
+                    value = e.get<SQLiteData::integer_type>(0).value_or(0);
+                }
+                return value;
             }
-            std::u8string col_list_str = col_list | views::join_with(u8',') | to<std::u8string>();
 
-            // 抽出条件のSQLの構築
-            std::u8string where_str = getWhereStr(obj);
+        public:
+            /// <param name="conn">同期元と同期先をATTACHしたコネクション</param>
+            /// <param name="schema">このDBのスキーマ名</param>
+            /// <param name="keyring">パスワードを平文で受け渡すときのこのDBの鍵(暗号文のまま受け渡すときはnullptr)</param>
+            SyncSide(SQLite& conn, std::u8string_view schema, RecordKeyring* keyring = nullptr) : _conn(conn), _schema(schema), _keyring(keyring),
+                _select_changes(conn.prepare(formatSyncSql(std::format("SELECT {} FROM {{0}}{{1}} WHERE {{3}}>?;", row_cols), schema))),
+                _select_tombstones(conn.prepare(formatSyncSql("SELECT {2},{12},{14} FROM {0}{13} WHERE {3}>?;", schema))),
+                _select_row(conn.prepare(formatSyncSql(std::format("SELECT {} FROM {{0}}{{1}} WHERE {{2}}=?;", row_cols), schema))),
+                _select_tombstone(conn.prepare(formatSyncSql("SELECT {12},{14} FROM {0}{13} WHERE {2}=?;", schema))),
+                _select_duplicates(conn.prepare(formatSyncSql(std::format("SELECT {} FROM {{0}}{{1}} WHERE (({{4}}=? AND {{5}}=?) OR {{6}}=?) AND {{2}}<>?;", row_cols), schema))),
+                _upsert_row(conn.prepare(formatSyncSql(R"(
+                    INSERT INTO {0}{1} ({2},{12},{11},{4},{5},{6},{7},{8},{9},{10},{3}) VALUES (?,?,?,?,?,?,?,?,?,?,?)
+                    ON CONFLICT({2}) DO UPDATE SET {12}=excluded.{12},{11}=excluded.{11},{4}=excluded.{4},{5}=excluded.{5},
+                    {6}=excluded.{6},{7}=excluded.{7},{8}=excluded.{8},{9}=excluded.{9},{10}=excluded.{10},{3}=excluded.{3};
+                )", schema))),
+                _delete_row(conn.prepare(formatSyncSql("DELETE FROM {0}{1} WHERE {2}=?;", schema))),
+                _delete_tombstone(conn.prepare(formatSyncSql("DELETE FROM {0}{13} WHERE {2}=?;", schema))),
+                _next_seq(conn.prepare(u8"SELECT " + nextSeqSql(schema) + u8";")),
+                _upsert_tombstone(conn.prepare(formatSyncSql(R"(
+                    INSERT INTO {0}{13} ({2},{12},{14},{3}) VALUES (?,?,?,?)
+                    ON CONFLICT({2}) DO UPDATE SET {12}=excluded.{12},{14}=excluded.{14},{3}=excluded.{3};
+                )", schema))) {}
 
-            std::u8string sql_select = std::bit_cast<const char8_t*>(std::format(R"(
-                SELECT {0} FROM {1} {2} ORDER BY id;
-            )",
-                // カラム名の埋め込み
-                std::bit_cast<const char*>(col_list_str.data()),
-                // テーブル名の埋め込み
-                std::bit_cast<const char*>(pws::value.data()),
-                // WHERE句の埋め込み
-                std::bit_cast<const char*>(where_str.data())
-            ).data());
+            /// <summary>
+            /// DBを識別する値
+            /// </summary>
+            std::u8string vault() {
+                for (auto e : this->_conn.prepare(formatSyncSql("SELECT {16} FROM {0}{15};", this->_schema)).exec()) {
+                    return std::u8string(e.get<SQLiteData::string_type>(0).value_or(u8""));
+                }
+                throw std::runtime_error("同期のための状態が存在しません");
+            }
 
-            // バインド変数の設定
-            auto stmt = this->_conn.prepare(sql_select);
-            if (where_str.length() != 0) {
-                bindWhere(stmt, obj, 1);
+            /// <summary>
+            /// 最後に付与した変更の連番
+            /// </summary>
+            std::int64_t seq() {
+                return scalar(this->_next_seq) - 1;
             }
 
-            return stmt.exec();
-        }
-        else {
-            throw std::runtime_error("DBとのコネクションが確立されていません");
-        }
-    }
-    void PasswordManagement::remove(const GetParam& obj) {
-        // 抽出条件のSQLの構築
-        std::u8string where_str = getWhereStr(obj);
+            /// <summary>
+            /// 識別子を持たない行(このクラスを介さずに挿入された行)へ識別子と連番を付与する
+            /// </summary>
+            void adopt() {
+                this->_conn.exec(formatSyncSql("UPDATE {0}{1} SET {2}=lower(hex(randomblob(16))),{3}=", this->_schema)
+                    + nextSeqSql(this->_schema) + formatSyncSql(" WHERE {2} IS NULL;", this->_schema));
+            }
 
-        std::u8string sql_select = std::bit_cast<const char8_t*>(std::format(R"(
-                DELETE  FROM {0} {1};
-            )",
-            // テーブル名の埋め込み
-            std::bit_cast<const char*>(pws::value.data()),
-            // WHERE句の埋め込み
-            std::bit_cast<const char*>(where_str.data())
+            /// <summary>
+            /// 同期先との前回の同期の位置(自身の連番と同期先の連番)を取得する(未同期であれば0)
+            /// </summary>
+            std::pair<std::int64_t, std::int64_t> watermark(const std::u8string& peer) {
+                auto stmt = this->_conn.prepare(formatSyncSql("SELECT {18},{19} FROM {0}{17} WHERE {16}=?;", this->_schema));
+                stmt.bind(1, peer);
+                for (auto e : stmt.exec()) {
+                    return { e.get<SQLiteData::integer_type>(0).value_or(0), e.get<SQLiteData::integer_type>(1).value_or(0) };
+                }
+                return { 0, 0 };
+            }
+
+            /// <summary>
+            /// 同期先との同期の位置を記録する
+            /// </summary>
+            void mark(const std::u8string& peer, std::int64_t local_seq, std::int64_t peer_seq) {
+                auto stmt = this->_conn.prepare(formatSyncSql(R"(
+                    INSERT INTO {0}{17} ({16},{18},{19}) VALUES (?,?,?)
+                    ON CONFLICT({16}) DO UPDATE SET {18}=excluded.{18},{19}=excluded.{19},{20}=CURRENT_TIMESTAMP;
+                )", this->_schema));
+                stmt.bind(1, peer);
+                stmt.bind(2, local_seq);
+                stmt.bind(3, peer_seq);
+                for (const auto& x : stmt.exec()) {}
+            }
+
+            /// <summary>
+            /// 指定した連番より後の変更(行と墓標)を取得する
+            /// </summary>
+            std::vector<SyncEntry> changes(std::int64_t since) {
+                std::vector<SyncEntry> result;
+                this->_select_changes.bind(1, since);
+                for (auto e : this->_select_changes.exec()) {
+                    result.push_back(readRow(e));
+                }
+                this->_select_tombstones.bind(1, since);
+                for (auto e : this->_select_tombstones.exec()) {
+                    result.push_back({
+                        .uid = std::u8string(e.get<SQLiteData::string_type>(0).value_or(u8"")),
+                        .deleted = true,
+                        .version = e.get<SQLiteData::integer_type>(1).value_or(0),
+                        .stamp = std::u8string(e.get<SQLiteData::string_type>(2).value_or(u8""))
+                    });
+                }
+                return result;
+            }
+
+            /// <summary>
+            /// 識別子の異なる行のうちサービス名とユーザ名の組あるいは名称が重複するものを取得する
+            /// </summary>
+            std::vector<SyncEntry> duplicates(const SyncEntry& entry) {
+                std::vector<SyncEntry> result;
+                this->_select_duplicates.bind(1, entry.service);
+                this->_select_duplicates.bind(2, entry.user);
+                this->_select_duplicates.bind(3, entry.name);
+                this->_select_duplicates.bind(4, entry.uid);
+                for (auto e : this->_select_duplicates.exec()) {
+                    result.push_back(readRow(e));
+                }
+                return result;
+            }
+
+            /// <summary>
+            /// 変更を反映する(行であれば挿入あるいは上書きし、墓標であれば行を削除して墓標を記録する)
+            /// </summary>
+            /// <returns>内容が変化したならtrue</returns>
+            bool put(const SyncEntry& entry) {
+                if (entry.deleted) {
+                    this->_select_row.bind(1, entry.uid);
+                    bool exists = false;
+                    for (const auto& x : this->_select_row.exec()) {
+                        exists = true;
+                    }
+                    this->_select_tombstone.bind(1, entry.uid);
+                    for (auto e : this->_select_tombstone.exec()) {
+                        if (!exists && e.get<SQLiteData::integer_type>(0) == entry.version && e.get<SQLiteData::string_type>(1) == entry.stamp) {
+                            // 既に同じ墓標が記録されていれば連番を進めない
+                            return false;
+                        }
+                    }
+                    // 行を削除すると墓標はトリガーにより記録されるため、削除元のバージョンと日時で上書きする
+                    this->_delete_row.bind(1, entry.uid);
+                    for (const auto& x : this->_delete_row.exec()) {}
+                    this->_upsert_tombstone.bind(1, entry.uid);
+                    this->_upsert_tombstone.bind(2, entry.version);
+                    this->_upsert_tombstone.bind(3, entry.stamp);
+                    this->_upsert_tombstone.bind(4, scalar(this->_next_seq));
+                    for (const auto& x : this->_upsert_tombstone.exec()) {}
+                    return true;
+                }
+                this->_select_row.bind(1, entry.uid);
+                for (auto e : this->_select_row.exec()) {
+                    if (compareSyncEntry(readRow(e), entry) == 0) {
+                        // 既に同じ内容であれば連番を進めない
+                        return false;
+                    }
+                }
+                // 平文で受け渡すときはこのDBの鍵で暗号化し直す(バインド変数は実行を終えるまで参照する)
+                std::u8string_view method = entry.encryption;
+                const std::vector<unsigned char>* password = &entry.password;
+                std::vector<unsigned char> ciphertext;
+                if (this->_keyring != nullptr && method != table::encryption_method::none) {
+                    auto cipher = this->_keyring->current();
+                    if (cipher == nullptr) {
+                        throw std::runtime_error("暗号化されたパスワードを鍵の存在しないDBへ同期できません");
+                    }
+                    ciphertext = cipher->encrypt(entry.password);
+                    method = cipher->method();
+                    password = &ciphertext;
+                }
+                this->_upsert_row.bind(1, entry.uid);
+                this->_upsert_row.bind(2, entry.version);
+                this->_upsert_row.bind(3, entry.stamp);
+                this->_upsert_row.bind(4, entry.service);
+                this->_upsert_row.bind(5, entry.user);
+                this->_upsert_row.bind(6, entry.name);
+                this->_upsert_row.bind(7, *password);
+                this->_upsert_row.bind(8, method);
+                this->_upsert_row.bind(9, entry.memo);
+                this->_upsert_row.bind(10, entry.registered_at);
+                this->_upsert_row.bind(11, scalar(this->_next_seq));
+                for (const auto& x : this->_upsert_row.exec()) {}
+                // 連番の最大値が戻らないよう墓標は行を反映した後に削除する
+                this->_delete_tombstone.bind(1, entry.uid);
+                for (const auto& x : this->_delete_tombstone.exec()) {}
+                return true;
+            }
+        };
+
+        /// <summary>
+        /// 同期元の変更を同期先へ反映する
+        /// </summary>
+        /// <remarks>
+        /// 同期先に識別子の異なる重複した行があれば、採用されなかった方を双方のDBから削除する
+        /// </remarks>
+        /// <param name="dest">反映先</param>
+        /// <param name="src">同期元</param>
+        /// <param name="entry">反映する変更</param>
+        /// <param name="result">同期の結果</param>
+        /// <returns>反映先の内容が変化したならtrue</returns>
+        bool applySyncEntry(SyncSide& dest, SyncSide& src, const SyncEntry& entry, SyncResult& result) {
+            if (!entry.deleted) {
+                auto duplicates = dest.duplicates(entry);
+                result.duplicates += duplicates.size();
+                if (std::ranges::any_of(duplicates, [&](const SyncEntry& x) { return compareSyncEntry(x, entry) > 0; })) {
+                    // 既存の行を採用して反映しようとした行を削除する
+                    auto tombstone = entry.tombstone();
+                    dest.put(tombstone);
+                    src.put(tombstone);
+                    return false;
+                }
+                for (const auto& x : duplicates) {
+                    auto tombstone = x.tombstone();
+                    dest.put(tombstone);
+                    src.put(tombstone);
+                }
+            }
+            return dest.put(entry);
+        }
+
+        /// <summary>
+        /// マークル木の葉(バケット)が受け持つ主キーの範囲のビット数
+        /// </summary>
+        constexpr int merkle_bucket_bits = 10;
+        static_assert(PasswordManagement::digest_bucket_rows == std::int64_t(1) << merkle_bucket_bits);
+
+        /// <summary>
+        /// マークル木の1つのノードが束ねる子の範囲のビット数(16分木)
+        /// </summary>
+        constexpr int merkle_fanout_bits = 4;
+
+        /// <summary>
+        /// マークル木の根の段(AUTOINCREMENTの主キーの上限である2^63未満のすべてのバケットを覆う)
+        /// </summary>
+        constexpr std::int64_t merkle_root_level = (63 - merkle_bucket_bits + merkle_fanout_bits - 1) / merkle_fanout_bits;
+
+        /// <summary>
+        /// 一方のDB(スキーマ)のマークル木を更新し参照するクラス
+        /// </summary>
+        /// <remarks>
+        /// 葉はバケットに属する行のハッシュ値を主キーの昇順に連結したもののSHA-256、
+        /// 葉以外は子の番号とハッシュ値を番号の昇順に連結したもののSHA-256とし、行の存在しないノードは保持しない
+        /// </remarks>
+        class MerkleTree {
+            /// <summary>
+            /// 行のハッシュ値の計算の対象のカラム(型を固定するため変換して取得する)
+            /// </summary>
+            static constexpr std::string_view row_cols = "{21},CAST({2} AS TEXT),CAST({4} AS TEXT),CAST({5} AS TEXT),CAST({6} AS TEXT),"
+                "CAST({7} AS BLOB),CAST({8} AS TEXT),CAST({9} AS TEXT),CAST({10} AS TEXT),CAST({11} AS TEXT),CAST({12} AS INTEGER)";
+
+            SQLite& _conn;
+            std::u8string _schema;
+            SQLiteStmt _select_rows;
+            SQLiteStmt _select_children;
+            SQLiteStmt _select_node;
+            SQLiteStmt _upsert_node;
+            SQLiteStmt _delete_node;
+
+            /// <summary>
+            /// 型を示すタグと64bitの整数をリトルエンディアンで入力する
+            /// </summary>
+            static void putInteger(Sha256& sha, std::byte tag, std::uint64_t x) {
+                std::array<std::byte, 9> buf{ tag };
+                for (std::size_t i = 0; i < 8; ++i) {
+                    buf[i + 1] = static_cast<std::byte>(x >> (i * 8));
+                }
+                sha.update(buf);
+            }
+
+            /// <summary>
+            /// 長さを前置してバイト列を入力する(NULLであればタグのみ)
+            /// </summary>
+            template <class T>
+            static void putBytes(Sha256& sha, const std::optional<T>& x) {
+                if (!x) {
+                    sha.update(std::array{ std::byte{ 0 } });
+                    return;
+                }
+                putInteger(sha, std::byte{ 2 }, x->size());
+                sha.update(std::as_bytes(std::span(x->data(), x->size())));
+            }
+
+            /// <summary>
+            /// row_colsの順に取得した行のハッシュ値を計算する
+            /// </summary>
+            static Sha256::digest_type hashRow(SQLiteData& e) {
+                Sha256 sha;
+                auto integer = [&](int col) {
+                    if (auto x = e.get<SQLiteData::integer_type>(col)) {
+                        putInteger(sha, std::byte{ 1 }, static_cast<std::uint64_t>(*x));
+                    }
+                    else {
+                        sha.update(std::array{ std::byte{ 0 } });
+                    }
+                };
+                integer(0);
+                for (int col = 1; col <= 9; ++col) {
+                    if (col == 5) {
+                        putBytes(sha, e.get<SQLiteData::blob_type>(col));
+                    }
+                    else {
+                        putBytes(sha, e.get<SQLiteData::string_type>(col));
+                    }
+                }
+                integer(10);
+                return sha.finish();
+            }
+
+            /// <summary>
+            /// 単一の整数を返すステートメントを実行する
+            /// </summary>
+            static std::int64_t scalar(SQLiteStmt&& stmt) {
+                std::int64_t value = 0;
+                for (auto e : stmt.exec()) {
+                    value = e.get<SQLiteData::integer_type>(0).value_or(0);
+                }
+                return value;
+            }
+
+            /// <summary>
+            /// 取得したハッシュ値を読み取る
+            /// </summary>
+            static Sha256::digest_type readHash(SQLiteData& e, int col) {
+                Sha256::digest_type hash{};
+                auto blob = e.get<SQLiteData::blob_type>(col).value_or(SQLiteData::blob_type{});
+                if (blob.size() != hash.size()) {
+                    throw std::runtime_error("マークル木のハッシュ値が破損しています");
+                }
+                std::ranges::copy(std::as_bytes(blob), hash.begin());
+                return hash;
+            }
+
+            /// <summary>
+            /// ノードのハッシュ値を保存する(nulloptであれば削除する)
+            /// </summary>
+            void store(std::int64_t level, std::int64_t idx, const std::optional<Sha256::digest_type>& hash) {
+                if (!hash) {
+                    this->_delete_node.bind(1, level);
+                    this->_delete_node.bind(2, idx);
+                    for (const auto& x : this->_delete_node.exec()) {}
+                    return;
+                }
+                // バインドしたデータは実行を終えるまで保持する必要がある
+                std::vector<unsigned char> blob(hash->size());
+                std::ranges::copy(std::as_bytes(std::span(*hash)), std::as_writable_bytes(std::span(blob)).begin());
+                this->_upsert_node.bind(1, level);
+                this->_upsert_node.bind(2, idx);
+                this->_upsert_node.bind(3, blob);
+                for (const auto& x : this->_upsert_node.exec()) {}
+            }
+
+            /// <summary>
+            /// バケットに属する行からバケットのハッシュ値を計算する(行が存在しなければnullopt)
+            /// </summary>
+            std::optional<Sha256::digest_type> hashBucket(std::int64_t bucket) {
+                Sha256 sha;
+                bool empty = true;
+                for (const auto& [id, hash] : this->rowHashes(bucket)) {
+                    sha.update(hash);
+                    empty = false;
+                }
+                return empty ? std::nullopt : std::optional(sha.finish());
+            }
+
+            /// <summary>
+            /// 子のハッシュ値から葉以外のノードのハッシュ値を計算する(子が存在しなければnullopt)
+            /// </summary>
+            std::optional<Sha256::digest_type> hashNode(std::int64_t level, std::int64_t idx) {
+                Sha256 sha;
+                bool empty = true;
+                for (const auto& [child, hash] : this->children(level, idx)) {
+                    putInteger(sha, std::byte{ 1 }, static_cast<std::uint64_t>(child));
+                    sha.update(hash);
+                    empty = false;
+                }
+                return empty ? std::nullopt : std::optional(sha.finish());
+            }
+
+        public:
+            MerkleTree(SQLite& conn, std::u8string_view schema) : _conn(conn), _schema(schema),
+                _select_rows(conn.prepare(formatSyncSql(std::format("SELECT {} FROM {{0}}{{1}} WHERE {{21}} BETWEEN ? AND ? ORDER BY {{21}};", row_cols), schema))),
+                _select_children(conn.prepare(formatSyncSql("SELECT {25},{26} FROM {0}{23} WHERE {24}=? AND {25} BETWEEN ? AND ? ORDER BY {25};", schema))),
+                _select_node(conn.prepare(formatSyncSql("SELECT {26} FROM {0}{23} WHERE {24}=? AND {25}=?;", schema))),
+                _upsert_node(conn.prepare(formatSyncSql(R"(
+                    INSERT INTO {0}{23} ({24},{25},{26}) VALUES (?,?,?)
+                    ON CONFLICT({24},{25}) DO UPDATE SET {26}=excluded.{26};
+                )", schema))),
+                _delete_node(conn.prepare(formatSyncSql("DELETE FROM {0}{23} WHERE {24}=? AND {25}=?;", schema))) {}
+
+            /// <summary>
+            /// 前回の更新以降に変更されたバケットとその祖先のハッシュ値を計算し直す
+            /// </summary>
+            /// <returns>計算し直したバケットの数</returns>
+            std::size_t refresh() {
+                auto merkle_seq = scalar(this->_conn.prepare(formatSyncSql("SELECT {22} FROM {0}{15};", this->_schema)));
+                auto seq = scalar(this->_conn.prepare(u8"SELECT " + nextSeqSql(this->_schema) + u8";")) - 1;
+
+                // 連番が進んだ行のバケットと、行が削除されたバケット
+                std::vector<std::int64_t> dirty;
+                auto stmt = this->_conn.prepare(formatSyncSql(
+                    std::format("SELECT {{21}}>>{} FROM {{0}}{{1}} WHERE {{3}}>? UNION SELECT {{28}} FROM {{0}}{{27}};", merkle_bucket_bits), this->_schema));
+                stmt.bind(1, merkle_seq);
+                for (auto e : stmt.exec()) {
+                    dirty.push_back(e.get<SQLiteData::integer_type>(0).value_or(0));
+                }
+                std::ranges::sort(dirty);
+                const auto buckets = dirty.size();
+                if (buckets == 0 && seq == merkle_seq) {
+                    return 0;
+                }
+
+                for (auto bucket : dirty) {
+                    this->store(0, bucket, this->hashBucket(bucket));
+                }
+                // 子の属するノードを1段ずつ計算し直す(昇順のため重複は隣接する)
+                for (std::int64_t level = 1; level <= merkle_root_level; ++level) {
+                    for (auto& x : dirty) {
+                        x >>= merkle_fanout_bits;
+                    }
+                    dirty.erase(std::ranges::unique(dirty).begin(), dirty.end());
+                    for (auto idx : dirty) {
+                        this->store(level, idx, this->hashNode(level, idx));
+                    }
+                }
+
+                this->_conn.exec(formatSyncSql("DELETE FROM {0}{27};", this->_schema));
+                auto update = this->_conn.prepare(formatSyncSql("UPDATE {0}{15} SET {22}=?;", this->_schema));
+                update.bind(1, seq);
+                for (const auto& x : update.exec()) {}
+                return buckets;
+            }
+
+            /// <summary>
+            /// 根のハッシュ値を取得する(行が存在しなければ空のデータのハッシュ値)
+            /// </summary>
+            Sha256::digest_type root() {
+                return this->node(merkle_root_level, 0).value_or(Sha256::digest({}));
+            }
+
+            /// <summary>
+            /// 保持しているノードのハッシュ値を取得する
+            /// </summary>
+            std::optional<Sha256::digest_type> node(std::int64_t level, std::int64_t idx) {
+                this->_select_node.bind(1, level);
+                this->_select_node.bind(2, idx);
+                for (auto e : this->_select_node.exec()) {
+                    return readHash(e, 0);
+                }
+                return std::nullopt;
+            }
+
+            /// <summary>
+            /// 保持している子の番号とハッシュ値を番号の昇順に取得する
+            /// </summary>
+            std::vector<std::pair<std::int64_t, Sha256::digest_type>> children(std::int64_t level, std::int64_t idx) {
+                std::vector<std::pair<std::int64_t, Sha256::digest_type>> result;
+                this->_select_children.bind(1, level - 1);
+                this->_select_children.bind(2, idx << merkle_fanout_bits);
+                this->_select_children.bind(3, ((idx + 1) << merkle_fanout_bits) - 1);
+                for (auto e : this->_select_children.exec()) {
+                    result.emplace_back(e.get<SQLiteData::integer_type>(0).value_or(0), readHash(e, 1));
+                }
+                return result;
+            }
+
+            /// <summary>
+            /// バケットに属する行の主キーとハッシュ値を主キーの昇順に取得する
+            /// </summary>
+            std::vector<std::pair<std::int64_t, Sha256::digest_type>> rowHashes(std::int64_t bucket) {
+                std::vector<std::pair<std::int64_t, Sha256::digest_type>> result;
+                this->_select_rows.bind(1, bucket << merkle_bucket_bits);
+                this->_select_rows.bind(2, ((bucket + 1) << merkle_bucket_bits) - 1);
+                for (auto e : this->_select_rows.exec()) {
+                    result.emplace_back(e.get<SQLiteData::integer_type>(0).value_or(0), hashRow(e));
+                }
+                return result;
+            }
+
+            /// <summary>
+            /// すべての行からバケットのハッシュ値を計算し、保持している葉と一致しないバケットを取得する
+            /// </summary>
+            std::vector<std::int64_t> mismatches() {
+                // 保持している葉(行の件数に対して1/digest_bucket_rowsのため全件を読み込む)
+                std::map<std::int64_t, Sha256::digest_type> leaves;
+                auto select_leaves = this->_conn.prepare(formatSyncSql("SELECT {25},{26} FROM {0}{23} WHERE {24}=0;", this->_schema));
+                for (auto e : select_leaves.exec()) {
+                    leaves.emplace(e.get<SQLiteData::integer_type>(0).value_or(0), readHash(e, 1));
+                }
+
+                std::vector<std::int64_t> result;
+                auto check = [&](std::int64_t bucket, const std::optional<Sha256::digest_type>& hash) {
+                    auto it = leaves.find(bucket);
+                    if (it == leaves.end() ? hash.has_value() : hash != it->second) {
+                        result.push_back(bucket);
+                    }
+                    if (it != leaves.end()) {
+                        leaves.erase(it);
+                    }
+                };
+                // 主キーの昇順に1度だけ走査してバケットごとにまとめる
+                Sha256 sha;
+                std::optional<std::int64_t> current;
+                auto select_all = this->_conn.prepare(formatSyncSql(std::format("SELECT {} FROM {{0}}{{1}} ORDER BY {{21}};", row_cols), this->_schema));
+                for (auto e : select_all.exec()) {
+                    auto bucket = e.get<SQLiteData::integer_type>(0).value_or(0) >> merkle_bucket_bits;
+                    if (current && *current != bucket) {
+                        check(*current, sha.finish());
+                    }
+                    current = bucket;
+                    sha.update(hashRow(e));
+                }
+                if (current) {
+                    check(*current, sha.finish());
+                }
+                // 行が存在しないにもかかわらず保持している葉
+                for (const auto& [bucket, hash] : leaves) {
+                    result.push_back(bucket);
+                }
+                std::ranges::sort(result);
+                return result;
+            }
+        };
+
+        /// <summary>
+        /// 鍵の世代ごとの情報(vault_keysの1行)
+        /// </summary>
+        struct VaultKey {
+            std::uint32_t generation = 0;
+            std::u8string method;
+            std::vector<unsigned char> salt;
+            std::uint32_t iterations = 0;
+            std::vector<unsigned char> verifier;
+            std::optional<std::int64_t> rekey_id = std::nullopt;
+        };
+
+        /// <summary>
+        /// 鍵の情報を世代の昇順で取得する
+        /// </summary>
+        /// <param name="conn">SQLiteに関する操作の起点となるオブジェクト</param>
+        /// <param name="schema">スキーマ名</param>
+        std::vector<VaultKey> loadVaultKeys(SQLite& conn, std::u8string_view schema = u8"main") {
+            using vk = table::vault_keys;
+            std::vector<VaultKey> result;
+            for (auto e : conn.prepare(std::bit_cast<const char8_t*>(std::format("SELECT {1},{2},{3},{4},{5},{6} FROM {7}.{0} ORDER BY {1};",
+                // テーブル名の埋め込み
+                std::bit_cast<const char*>(vk::value.data()),
+                // 鍵の世代名の埋め込み
+                std::bit_cast<const char*>(vk::c_generation::value.data()),
+                // 暗号化方式名の埋め込み
+                std::bit_cast<const char*>(vk::c_method::value.data()),
+                // 塩名の埋め込み
+                std::bit_cast<const char*>(vk::c_salt::value.data()),
+                // 反復回数名の埋め込み
+                std::bit_cast<const char*>(vk::c_iterations::value.data()),
+                // 照合値名の埋め込み
+                std::bit_cast<const char*>(vk::c_verifier::value.data()),
+                // 鍵の更新の進捗名の埋め込み
+                std::bit_cast<const char*>(vk::c_rekey_id::value.data()),
+                // スキーマ名の埋め込み
+                std::string_view(std::bit_cast<const char*>(schema.data()), schema.size())
+            ).data())).exec()) {
+                auto salt = e.get<SQLiteData::blob_type>(2).value_or(SQLiteData::blob_type{});
+                auto verifier = e.get<SQLiteData::blob_type>(4).value_or(SQLiteData::blob_type{});
+                result.push_back({
+                    .generation = static_cast<std::uint32_t>(e.get<SQLiteData::integer_type>(0).value_or(0)),
+                    .method = std::u8string(e.get<SQLiteData::string_type>(1).value_or(u8"")),
+                    .salt = std::vector<unsigned char>(salt.begin(), salt.end()),
+                    .iterations = static_cast<std::uint32_t>(e.get<SQLiteData::integer_type>(3).value_or(0)),
+                    .verifier = std::vector<unsigned char>(verifier.begin(), verifier.end()),
+                    .rekey_id = e.get<SQLiteData::integer_type>(5)
+                });
+            }
+            return result;
+        }
+
+        /// <summary>
+        /// 2つのDBの鍵の情報が同じ鍵を導出するもの(暗号化されたパスワードをそのまま受け渡せるもの)であるかを判定する
+        /// </summary>
+        bool sameVaultKeys(const std::vector<VaultKey>& a, const std::vector<VaultKey>& b) {
+            return std::ranges::equal(a, b, [](const VaultKey& x, const VaultKey& y) {
+                return std::tie(x.generation, x.method, x.salt, x.iterations, x.verifier)
+                    == std::tie(y.generation, y.method, y.salt, y.iterations, y.verifier);
+            });
+        }
+
+        /// <summary>
+        /// パスフレーズから導出した暗号化の鍵と照合値
+        /// </summary>
+        struct DerivedKey {
+            RecordCipher::key_type key;
+            Sha256::digest_type verifier;
+        };
+
+        /// <summary>
+        /// パスフレーズから暗号化の鍵と照合値を導出する
+        /// </summary>
+        /// <remarks>
+        /// PBKDF2で導出した値を直接は用いず、用途ごとにHMACで分けることで照合値から鍵を推測できないようにする
+        /// </remarks>
+        /// <param name="passphrase">パスフレーズ</param>
+        /// <param name="salt">塩</param>
+        /// <param name="iterations">反復回数</param>
+        DerivedKey deriveVaultKey(std::u8string_view passphrase, std::span<const unsigned char> salt, std::uint32_t iterations) {
+            if (iterations == 0) {
+                throw std::runtime_error("鍵の導出の反復回数が不正です");
+            }
+            std::array<std::byte, 32> master;
+            pbkdf2HmacSha256(std::as_bytes(std::span(passphrase)), std::as_bytes(salt), iterations, master);
+            constexpr std::string_view record_label = "pwm record key";
+            constexpr std::string_view verifier_label = "pwm verifier";
+            DerivedKey result{
+                .key = HmacSha256::digest(master, std::as_bytes(std::span(record_label))),
+                .verifier = HmacSha256::digest(master, std::as_bytes(std::span(verifier_label)))
+            };
+            std::ranges::fill(master, std::byte{ 0 });
+            return result;
+        }
+
+        /// <summary>
+        /// 新たな塩で鍵の世代を作成する(書き込みのトランザクションの中で呼び出す)
+        /// </summary>
+        /// <param name="conn">SQLiteに関する操作の起点となるオブジェクト</param>
+        /// <param name="passphrase">パスフレーズ</param>
+        /// <param name="generation">作成する鍵の世代</param>
+        /// <param name="rekey_id">鍵の更新の進捗(鍵の更新でなければnullopt)</param>
+        /// <param name="keys">作成した鍵の情報の追加先</param>
+        /// <returns>作成した世代について導出した鍵</returns>
+        DerivedKey createVaultKey(SQLite& conn, std::u8string_view passphrase, std::uint32_t generation, std::optional<std::int64_t> rekey_id, std::vector<VaultKey>& keys) {
+            using vk = table::vault_keys;
+            VaultKey key{ .generation = generation, .method = std::u8string(table::encryption_method::chacha20_poly1305), .salt = std::vector<unsigned char>(16),
+                .iterations = PasswordManagement::default_kdf_iterations, .rekey_id = rekey_id };
+            secureRandom(std::as_writable_bytes(std::span(key.salt)));
+            auto created = deriveVaultKey(passphrase, key.salt, key.iterations);
+            key.verifier.assign(std::bit_cast<const unsigned char*>(created.verifier.data()), std::bit_cast<const unsigned char*>(created.verifier.data()) + created.verifier.size());
+            auto stmt = conn.prepare(std::bit_cast<const char8_t*>(std::format("INSERT INTO {0} ({1},{2},{3},{4},{5},{6}) VALUES (?,?,?,?,?,?);",
+                // テーブル名の埋め込み
+                std::bit_cast<const char*>(vk::value.data()),
+                // 鍵の世代名の埋め込み
+                std::bit_cast<const char*>(vk::c_generation::value.data()),
+                // 暗号化方式名の埋め込み
+                std::bit_cast<const char*>(vk::c_method::value.data()),
+                // 塩名の埋め込み
+                std::bit_cast<const char*>(vk::c_salt::value.data()),
+                // 反復回数名の埋め込み
+                std::bit_cast<const char*>(vk::c_iterations::value.data()),
+                // 照合値名の埋め込み
+                std::bit_cast<const char*>(vk::c_verifier::value.data()),
+                // 鍵の更新の進捗名の埋め込み
+                std::bit_cast<const char*>(vk::c_rekey_id::value.data())
+            ).data()));
+            stmt.bind(1, static_cast<std::int64_t>(key.generation));
+            stmt.bind(2, key.method);
+            stmt.bind(3, key.salt);
+            stmt.bind(4, static_cast<std::int64_t>(key.iterations));
+            stmt.bind(5, key.verifier);
+            stmt.bind(6, key.rekey_id);
+            for (const auto& x : stmt.exec()) {}
+            keys.push_back(std::move(key));
+            return created;
+        }
+
+        /// <summary>
+        /// 鍵の情報を取得し、存在しなければ最初の世代を作成する(読み取り専用であれば作成しない)
+        /// </summary>
+        /// <param name="conn">SQLiteに関する操作の起点となるオブジェクト</param>
+        /// <param name="passphrase">パスフレーズ</param>
+        /// <param name="keys">鍵の情報の格納先(世代の昇順)</param>
+        /// <returns>作成した世代について導出した鍵(作成しなければnullopt)</returns>
+        std::optional<DerivedKey> ensureVaultKeys(SQLite& conn, std::u8string_view passphrase, std::vector<VaultKey>& keys) {
+            keys = loadVaultKeys(conn);
+            if (!keys.empty() || conn.readOnly()) {
+                return std::nullopt;
+            }
+            // 他のプロセスと同時に最初の世代を作成しないよう書き込みのロックを取得してから再度確認する
+            SQLiteTransaction transaction(conn, true);
+            keys = loadVaultKeys(conn);
+            if (!keys.empty()) {
+                return std::nullopt;
+            }
+            auto created = createVaultKey(conn, passphrase, 1, std::nullopt, keys);
+            transaction.commit();
+            return created;
+        }
+
+        /// <summary>
+        /// すべての世代の鍵をパスフレーズから導出する
+        /// </summary>
+        /// <remarks>
+        /// 最新の世代と一致しないパスフレーズは誤りとし、古い世代で一致しないものは復号できないため除外する
+        /// </remarks>
+        /// <param name="keys">鍵の情報(世代の昇順)</param>
+        /// <param name="passphrase">パスフレーズ</param>
+        /// <param name="created">最新の世代について導出済みの鍵</param>
+        std::vector<VaultKeyMaterial> deriveVaultKeys(const std::vector<VaultKey>& keys, std::u8string_view passphrase, const std::optional<DerivedKey>& created) {
+            std::vector<VaultKeyMaterial> result;
+            for (std::size_t i = 0; i < keys.size(); ++i) {
+                const auto& key = keys[i];
+                bool latest = i + 1 == keys.size();
+                auto derived = created && latest ? created.value() : deriveVaultKey(passphrase, key.salt, key.iterations);
+                if (!std::ranges::equal(std::as_bytes(std::span(key.verifier)), derived.verifier)) {
+                    if (latest) {
+                        throw std::runtime_error("パスフレーズが一致しません");
+                    }
+                    continue;
+                }
+                result.push_back({ .generation = key.generation, .method = key.method, .key = derived.key, .verifier = derived.verifier });
+            }
+            return result;
+        }
+
+        /// <summary>
+        /// 導出済みの鍵を鍵の情報と照合して追加し、最新の世代を以降の暗号化に用いる
+        /// </summary>
+        /// <param name="keyring">鍵の追加先</param>
+        /// <param name="keys">鍵の情報(世代の昇順)</param>
+        /// <param name="material">導出済みの鍵</param>
+        /// <exception cref="std::runtime_error">最新の世代の鍵が存在しないか一致しない</exception>
+        void addVaultKeys(RecordKeyring& keyring, const std::vector<VaultKey>& keys, std::span<const VaultKeyMaterial> material) {
+            std::vector<std::pair<const VaultKey*, const VaultKeyMaterial*>> matched;
+            for (const auto& key : keys) {
+                auto itr = std::ranges::find_if(material, [&key](const VaultKeyMaterial& x) {
+                    return x.generation == key.generation && x.method == key.method && std::ranges::equal(std::as_bytes(std::span(key.verifier)), x.verifier);
+                });
+                if (itr != material.end()) {
+                    matched.emplace_back(&key, std::to_address(itr));
+                }
+            }
+            if (keys.empty() || matched.empty() || matched.back().first != &keys.back()) {
+                throw std::runtime_error("最新の世代の鍵が鍵の情報と一致しません");
+            }
+            keyring.clear();
+            for (const auto& [key, x] : matched) {
+                keyring.add(key->generation, makeRecordCipher(key->method, x->key, key->generation), key == &keys.back());
+            }
+        }
+
+        /// <summary>
+        /// 暗号化されたパスワードを復号するSQLの関数を構築する
+        /// </summary>
+        /// <remarks>
+        /// pwm_decrypt(encryption, password)として呼び出し、暗号化されていなければ値をそのまま返す
+        /// </remarks>
+        /// <param name="keyring">復号に用いる鍵</param>
+        std::shared_ptr<const SQLiteFunction> makeDecryptFunction(std::shared_ptr<RecordKeyring> keyring) {
+            return std::make_shared<const SQLiteFunction>([keyring = std::move(keyring)](sqlite3_context* ctx, std::span<sqlite3_value*> args) {
+                auto method = args[0];
+                auto value = args[1];
+                if (sqlite3_value_type(value) == SQLITE_NULL) {
+                    sqlite3_result_null(ctx);
+                    return;
+                }
+                auto method_str = std::u8string_view(
+                    std::bit_cast<const char8_t*>(sqlite3_value_text(method)),
+                    static_cast<std::size_t>(sqlite3_value_bytes(method)));
+                if (sqlite3_value_type(method) == SQLITE_NULL || method_str == table::encryption_method::none) {
+                    sqlite3_result_value(ctx, value);
+                    return;
+                }
+                auto data = static_cast<const unsigned char*>(sqlite3_value_blob(value));
+                auto plaintext = keyring->decrypt(method_str, std::span(data, static_cast<std::size_t>(sqlite3_value_bytes(value))));
+                sqlite3_result_blob64(ctx, plaintext.data(), plaintext.size(), SQLITE_TRANSIENT);
+            });
+        }
+    }
+
+    PasswordManagement::PasswordManagement(const std::filesystem::path& dbpath, SQLite& conn)
+        : _dbpath(dbpath), _conn(conn), _keyring(std::make_shared<RecordKeyring>()), _decrypt(makeDecryptFunction(_keyring)) {
+        this->initialize();
+    }
+    PasswordManagement::PasswordManagement(const std::filesystem::path& dbpath, SQLitePool& pool)
+        : _dbpath(dbpath), _pool(&pool), _keyring(std::make_shared<RecordKeyring>()), _decrypt(makeDecryptFunction(_keyring)) {
+        this->initialize();
+    }
+
+    SQLite& PasswordManagement::prepareConnection(SQLite& conn) {
+        if (conn) {
+            conn.function(u8"pwm_decrypt", 2, this->_decrypt);
+        }
+        return conn;
+    }
+    SQLite PasswordManagement::reader() {
+        auto conn = this->_pool != nullptr ? this->_pool->reader() : this->_conn.value();
+        this->prepareConnection(conn);
+        return conn;
+    }
+    SQLite PasswordManagement::writer() {
+        auto conn = this->_pool != nullptr ? this->_pool->writer() : this->_conn.value();
+        this->prepareConnection(conn);
+        return conn;
+    }
+
+    bool PasswordManagement::ready(SQLite& conn) {
+        return getUserVersion(conn) >= static_cast<std::int64_t>(sql_migrations.size());
+    }
+
+    void PasswordManagement::initialize() {
+        if (auto conn = this->writer(); conn) {
+            if (conn.readOnly()) {
+                // 読み取り専用であれば構築や移行は行わない
+                if (!ready(conn)) {
+                    throw std::runtime_error("スキーマが最新ではないため読み取り専用では利用できません");
+                }
+                return;
+            }
+            // テーブルを構築
+            conn.exec(sql_cretate_table);
+            migrate(conn);
+        }
+        else {
+            throw std::runtime_error("DBとのコネクションが確立されていません");
+        }
+    }
+
+    void PasswordManagement::insert(const InsertParam& obj) {
+        if (auto conn = this->writer(); conn) {
+            auto stmt = conn.prepare(sql_insert);
+            // バインド変数へ設定
+            SealedPassword password(*this->_keyring, obj.password);
+            bindInsert(stmt, obj, password);
+            // パスワード情報を挿入
+            for (const auto& x : stmt.exec()) {}
+        }
+        else {
+            throw std::runtime_error("DBとのコネクションが確立されていません");
+        }
+    }
+    void PasswordManagement::validate(const InsertParam& obj) {
+        if (obj.service.empty()) {
+            throw std::invalid_argument("サービス名が空です");
+        }
+        if (obj.user.empty()) {
+            throw std::invalid_argument("ユーザ名が空です");
+        }
+        if (obj.name && obj.name.value().empty()) {
+            throw std::invalid_argument("名称が空です");
+        }
+    }
+    InsertManyResult PasswordManagement::insertMany(const std::function<std::optional<InsertParam>()>& next, ConflictPolicy policy, std::size_t chunk_size) {
+        if (auto conn = this->writer(); conn) {
+            if (chunk_size == 0) {
+                throw std::invalid_argument("1つのトランザクションで挿入する件数は1以上である必要があります");
+            }
+            InsertManyResult result;
+            // 同一のステートメントを再利用してchunk_size件ごとにコミットする
+            std::optional<SQLiteTransaction> transaction;
+            auto stmt = conn.prepare(policy == ConflictPolicy::overwrite ? sql_upsert : policy == ConflictPolicy::skip ? sql_insert_or_skip : sql_insert);
+            std::size_t count = 0;
+            while (auto obj = next()) {
+                validate(obj.value());
+                if (!transaction) {
+                    transaction.emplace(conn, true);
+                }
+                SealedPassword password(*this->_keyring, obj->password);
+                bindInsert(stmt, obj.value(), password);
+                switch (policy) {
+                case ConflictPolicy::overwrite:
+                    // 行のバージョンが1であれば新たに挿入された
+                    for (auto e : stmt.exec()) {
+                        if (e.get<SQLiteData::integer_type>(0).value_or(1) == 1) {
+                            ++result.inserted;
+                        }
+                        else {
+                            ++result.overwritten;
+                        }
+                    }
+                    break;
+                case ConflictPolicy::skip:
+                    for (const auto& x : stmt.exec()) {}
+                    if (conn.changes() == 0) {
+                        ++result.skipped;
+                    }
+                    else {
+                        ++result.inserted;
+                    }
+                    break;
+                case ConflictPolicy::fail:
+                    for (const auto& x : stmt.exec()) {}
+                    ++result.inserted;
+                    break;
+                }
+                if (++count == chunk_size) {
+                    transaction->commit();
+                    transaction.reset();
+                    count = 0;
+                }
+            }
+            if (transaction) {
+                transaction->commit();
+            }
+            return result;
+        }
+        else {
+            throw std::runtime_error("DBとのコネクションが確立されていません");
+        }
+    }
+    void PasswordManagement::update(const GetParam& obj, const UpdateParam& content) {
+        if (auto conn = this->writer(); conn) {
+            // 抽出条件のSQLの構築
+            std::u8string where_str = getWhereStr(obj);
+
+            // バインド変数の設定
+            auto stmt = conn.prepare(getUpdateSql(content, where_str));
+            auto password = sealPassword(*this->_keyring, content);
+            int offset = bindSet(stmt, content, password, 1);
+            if (where_str.length() != 0) {
+                bindWhere(stmt, obj, offset);
+            }
+
+            // パスワード情報を更新
+            for (const auto& x : stmt.exec()) {}
+        }
+        else {
+            throw std::runtime_error("DBとのコネクションが確立されていません");
+        }
+    }
+    void PasswordManagement::update(const GetParam& obj, const UpdateParam& content, std::int64_t expected_version) {
+        if (auto conn = this->writer(); conn) {
+            // 抽出条件のSQLの構築
+            std::u8string where_str = getWhereStr(obj);
+
+            // 件数の確認と更新の間に他の書き込みが入らないよう書き込みのロックを取得する
+            SQLiteTransaction transaction(conn, true);
+
+            // 抽出条件に該当する件数を取得
+            std::u8string sql_count = std::bit_cast<const char8_t*>(std::format(R"(
+                SELECT count(*) FROM {0} {1};
+            )",
+                // テーブル名の埋め込み
+                std::bit_cast<const char*>(pws::value.data()),
+                // WHERE句の埋め込み
+                std::bit_cast<const char*>(where_str.data())
+            ).data());
+            auto count_stmt = conn.prepare(sql_count);
+            if (where_str.length() != 0) {
+                bindWhere(count_stmt, obj, 1);
+            }
+            std::int64_t count = 0;
+            for (auto e : count_stmt.exec()) {
+                count = e.get<SQLiteData::integer_type>(0).value();
+            }
+
+            // 行のバージョンが一致するもののみを更新
+            auto stmt = conn.prepare(getUpdateSql(content, addWhereVersionStr(where_str)));
+            auto password = sealPassword(*this->_keyring, content);
+            int offset = bindSet(stmt, content, password, 1);
+            if (where_str.length() != 0) {
+                offset = bindWhere(stmt, obj, offset);
+            }
+            stmt.bind(offset, expected_version);
+            for (const auto& x : stmt.exec()) {}
+
+            // 該当するすべての行が期待したバージョンでなければ何も書き込まずに失敗する
+            std::int64_t changes = conn.changes();
+            if (changes == 0 || changes != count) {
+                throw version_conflict_error("パスワード情報が他で更新されたため更新できません");
+            }
+            transaction.commit();
+        }
+        else {
+            throw std::runtime_error("DBとのコネクションが確立されていません");
+        }
+    }
+    void PasswordManagement::updateById(std::int64_t id, const UpdateParam& content, std::int64_t expected_version) {
+        if (auto conn = this->writer(); conn) {
+            auto stmt = conn.prepare(getUpdateSql(content, addWhereVersionStr(getWhereIdStr())));
+            auto password = sealPassword(*this->_keyring, content);
+            int offset = bindSet(stmt, content, password, 1);
+            stmt.bind(offset++, id);
+            stmt.bind(offset++, expected_version);
+            for (const auto& x : stmt.exec()) {}
+
+            if (conn.changes() == 0) {
+                throw version_conflict_error("パスワード情報が他で更新されたか存在しないため更新できません");
+            }
+        }
+        else {
+            throw std::runtime_error("DBとのコネクションが確立されていません");
+        }
+    }
+    void PasswordManagement::updateById(std::int64_t id, const UpdateParam& content) {
+        this->updateById(std::span<const std::int64_t>(&id, 1), content);
+    }
+    void PasswordManagement::updateById(std::span<const std::int64_t> ids, const UpdateParam& content) {
+        if (auto conn = this->writer(); conn) {
+            // 主キーによる検索のためのSQLの構築
+            std::u8string where_str = getWhereIdStr();
+
+            // 同一のステートメントをidごとに再利用して1つのトランザクションで更新する
+            SQLiteTransaction transaction(conn, true);
+            auto stmt = conn.prepare(getUpdateSql(content, where_str));
+            auto password = sealPassword(*this->_keyring, content);
+            int offset = bindSet(stmt, content, password, 1);
+            for (auto id : ids) {
+                stmt.bind(offset, id);
+                for (const auto& x : stmt.exec()) {}
+            }
+            transaction.commit();
+        }
+        else {
+            throw std::runtime_error("DBとのコネクションが確立されていません");
+        }
+    }
+    SQLiteView PasswordManagement::get(const GetParam& obj, const std::vector<int>& target_list) {
+        if (auto conn = this->reader(); conn) {
+            // 取得対象のカラムに関するSQLの構築
+            std::u8string col_list_str = getColListStr(target_list);
+
+            // 抽出条件のSQLの構築
+            std::u8string where_str = getWhereStr(obj);
+
+            // パスワードを取得する場合は、抽出した主キーから行を引き直すことで並べ替えの一時的なB木を用いないようにする
+            // (並べ替えると最初の行を返す前に該当するすべての行を復号するため、行を読み進めたときにのみ復号する)
+            bool decrypt = std::ranges::find(target_list, pws::c_password::index) != target_list.end();
+            std::u8string sql_select = std::bit_cast<const char8_t*>(std::format(decrypt && where_str.length() != 0 ? R"(
+                SELECT {0} FROM {1} WHERE {3} IN (SELECT {3} FROM {1} {2}) ORDER BY {3};
+            )" : R"(
+                SELECT {0} FROM {1} {2} ORDER BY {3};
+            )",
+                // カラム名の埋め込み
+                std::bit_cast<const char*>(col_list_str.data()),
+                // テーブル名の埋め込み
+                std::bit_cast<const char*>(pws::value.data()),
+                // WHERE句の埋め込み
+                std::bit_cast<const char*>(where_str.data()),
+                // 主キー名の埋め込み
+                std::bit_cast<const char*>(pws::c_id::value.data())
+            ).data());
+
+            // バインド変数の設定
+            auto stmt = conn.prepare(sql_select);
+            if (where_str.length() != 0) {
+                bindWhere(stmt, obj, 1);
+            }
+
+            return stmt.exec();
+        }
+        else {
+            throw std::runtime_error("DBとのコネクションが確立されていません");
+        }
+    }
+    void PasswordManagement::scan(const GetParam& obj, const std::vector<int>& target_list, const std::function<void(SQLiteRow&)>& callback, std::size_t partitions, bool ordered) {
+        // 取得対象のカラムに関するSQLの構築
+        std::u8string col_list_str = getColListStr(target_list);
+
+        // 抽出条件に主キーの範囲を加えたSQLの構築
+        std::u8string sql_select = std::bit_cast<const char8_t*>(std::format(R"(
+            SELECT {0} FROM {1} {2} ORDER BY id;
+        )",
+            // カラム名の埋め込み
+            std::bit_cast<const char*>(col_list_str.data()),
+            // テーブル名の埋め込み
+            std::bit_cast<const char*>(pws::value.data()),
+            // WHERE句の埋め込み
+            std::bit_cast<const char*>(addWhereIdRangeStr(getWhereStr(obj)).data())
+        ).data());
+        std::u8string sql_range = std::bit_cast<const char8_t*>(std::format(R"(
+            SELECT min({1}), max({1}) FROM {0};
+        )",
+            // テーブル名の埋め込み
+            std::bit_cast<const char*>(pws::value.data()),
+            // 主キー名の埋め込み
+            std::bit_cast<const char*>(pws::c_id::value.data())
+        ).data());
+
+        partitions = this->_pool != nullptr ? std::clamp<std::size_t>(partitions, 1, this->_pool->readerCount()) : 1;
+
+        // 範囲ごとのコネクションとトランザクション(SQLiteTransactionが参照するため再配置させない)
+        std::vector<SQLite> conns;
+        conns.reserve(partitions);
+        std::vector<std::unique_ptr<SQLiteTransaction>> transactions;
+        for (std::size_t i = 0; i < partitions; ++i) {
+            conns.emplace_back(this->reader());
+            if (!conns.back()) {
+                throw std::runtime_error("DBとのコネクションが確立されていません");
+            }
+        }
+
+        // 主キーの範囲の取得により最初のコネクションの読み取りトランザクションを開始する
+        transactions.emplace_back(std::make_unique<SQLiteTransaction>(conns[0]));
+        std::optional<std::int64_t> min_id, max_id;
+        for (auto e : conns[0].prepare(sql_range).exec()) {
+            min_id = e.get<SQLiteData::integer_type>(0);
+            max_id = e.get<SQLiteData::integer_type>(1);
+        }
+        if (!min_id || !max_id) {
+            // 1件も存在しない
+            transactions[0]->commit();
+            return;
+        }
+
+        // 主キーの範囲を均等に分割する
+        const std::int64_t step = (max_id.value() - min_id.value()) / static_cast<std::int64_t>(partitions) + 1;
+        std::vector<std::pair<std::int64_t, std::int64_t>> ranges;
+        for (std::int64_t begin = min_id.value(); begin <= max_id.value() && ranges.size() < partitions; begin += step) {
+            ranges.emplace_back(begin, std::min(begin + step - 1, max_id.value()));
+        }
+        ranges.back().second = max_id.value();
+
+        // 残りのコネクションは最初のコネクションと同一のスナップショットから読み取る
+        std::shared_ptr<sqlite3_snapshot> snapshot = SQLite::snapshot_supported && ranges.size() > 1 ? conns[0].snapshot() : nullptr;
+        for (std::size_t i = 1; i < ranges.size(); ++i) {
+            transactions.emplace_back(std::make_unique<SQLiteTransaction>(conns[i]));
+            if (snapshot) {
+                conns[i].openSnapshot(*snapshot);
+            }
+        }
+
+        // 順序を保つ場合は範囲ごとに、保たない場合はすべての範囲で1つのキューを利用する
+        std::vector<std::unique_ptr<BoundedQueue<std::vector<SQLiteRow>>>> queues;
+        for (std::size_t i = 0; i < (ordered ? ranges.size() : 1); ++i) {
+            queues.emplace_back(std::make_unique<BoundedQueue<std::vector<SQLiteRow>>>(scan_queue_depth * (ordered ? 1 : ranges.size())));
+        }
+        std::atomic<std::size_t> remaining = ranges.size();
+        std::vector<std::thread> producers;
+        auto stop = [&] {
+            for (auto& queue : queues) {
+                queue->close();
+            }
+            for (auto& producer : producers) {
+                producer.join();
+            }
+        };
+
+        try {
+            for (std::size_t i = 0; i < ranges.size(); ++i) {
+                producers.emplace_back([&, i] {
+                    auto& queue = *queues[ordered ? i : 0];
+                    try {
+                        auto stmt = conns[i].prepare(sql_select);
+                        int offset = bindWhere(stmt, obj, 1);
+                        stmt.bind(offset++, ranges[i].first);
+                        stmt.bind(offset++, ranges[i].second);
+
+                        std::vector<SQLiteRow> batch;
+                        batch.reserve(scan_batch_size);
+                        for (auto e : stmt.exec()) {
+                            batch.emplace_back(e);
+                            if (batch.size() == scan_batch_size) {
+                                if (!queue.push(std::move(batch))) {
+                                    return;
+                                }
+                                batch = {};
+                                batch.reserve(scan_batch_size);
+                            }
+                        }
+                        if (!batch.empty()) {
+                            queue.push(std::move(batch));
+                        }
+                    }
+                    catch (...) {
+                        queue.close(std::current_exception());
+                        return;
+                    }
+                    // 順序を保たない場合は最後に完了した範囲がキューを閉じる
+                    if (ordered || --remaining == 0) {
+                        queue.close();
+                    }
+                });
+            }
+
+            // 順序を保つ場合は主キーの小さい範囲から順に受け取る
+            for (auto& queue : queues) {
+                while (auto batch = queue->pop()) {
+                    for (auto& row : batch.value()) {
+                        callback(row);
+                    }
+                }
+            }
+        }
+        catch (...) {
+            // 読み取り中のスレッドを中断させてから例外を伝播する
+            stop();
+            throw;
+        }
+        stop();
+        for (auto& transaction : transactions) {
+            transaction->commit();
+        }
+    }
+    void PasswordManagement::scanChunks(const GetParam& obj, const std::vector<int>& target_list, std::int64_t begin_id, std::int64_t chunk_width, std::size_t workers, std::size_t window,
+        const std::function<void(const ScanChunk&, SQLiteView&)>& process, const std::function<void(const ScanChunk&)>& complete) {
+        if (chunk_width <= 0) {
+            throw std::invalid_argument("チャンクの幅は1以上である必要があります");
+        }
+        if (window == 0) {
+            throw std::invalid_argument("処理中のチャンクの上限は1以上である必要があります");
+        }
+
+        // 取得対象のカラムに関するSQLの構築
+        std::u8string col_list_str = getColListStr(target_list);
+
+        // 抽出条件に主キーの範囲を加えたSQLの構築
+        std::u8string sql_select = std::bit_cast<const char8_t*>(std::format(R"(
+            SELECT {0} FROM {1} {2} ORDER BY id;
+        )",
+            // カラム名の埋め込み
+            std::bit_cast<const char*>(col_list_str.data()),
+            // テーブル名の埋め込み
+            std::bit_cast<const char*>(pws::value.data()),
+            // WHERE句の埋め込み
+            std::bit_cast<const char*>(addWhereIdRangeStr(getWhereStr(obj)).data())
+        ).data());
+        std::u8string sql_range = std::bit_cast<const char8_t*>(std::format(R"(
+            SELECT min({1}), max({1}) FROM {0} WHERE {1}>=?;
+        )",
+            // テーブル名の埋め込み
+            std::bit_cast<const char*>(pws::value.data()),
+            // 主キー名の埋め込み
+            std::bit_cast<const char*>(pws::c_id::value.data())
+        ).data());
+
+        workers = this->_pool != nullptr ? std::clamp<std::size_t>(workers, 1, this->_pool->readerCount()) : 1;
+
+        // ワーカーごとのコネクションとトランザクション(SQLiteTransactionが参照するため再配置させない)
+        std::vector<SQLite> conns;
+        conns.reserve(workers);
+        std::vector<std::unique_ptr<SQLiteTransaction>> transactions;
+        for (std::size_t i = 0; i < workers; ++i) {
+            conns.emplace_back(this->reader());
+            if (!conns.back()) {
+                throw std::runtime_error("DBとのコネクションが確立されていません");
+            }
+        }
+
+        // 主キーの範囲の取得により最初のコネクションの読み取りトランザクションを開始する
+        transactions.emplace_back(std::make_unique<SQLiteTransaction>(conns[0]));
+        std::optional<std::int64_t> min_id, max_id;
+        {
+            auto stmt = conns[0].prepare(sql_range);
+            stmt.bind(1, begin_id);
+            for (auto e : stmt.exec()) {
+                min_id = e.get<SQLiteData::integer_type>(0);
+                max_id = e.get<SQLiteData::integer_type>(1);
+            }
+        }
+        if (!min_id || !max_id) {
+            // 対象が1件も存在しない
+            transactions[0]->commit();
+            return;
+        }
+
+        // 最小の主キーを起点として一定の幅で分割する(オーバーフローを避けるため符号なしで計算する)
+        const auto span = static_cast<std::uint64_t>(max_id.value()) - static_cast<std::uint64_t>(min_id.value());
+        const std::size_t count = static_cast<std::size_t>(span / static_cast<std::uint64_t>(chunk_width) + 1);
+        auto chunkAt = [&](std::size_t i) {
+            ScanChunk chunk;
+            chunk.index = i;
+            chunk.first_id = static_cast<std::int64_t>(static_cast<std::uint64_t>(min_id.value()) + i * static_cast<std::uint64_t>(chunk_width));
+            chunk.last_id = static_cast<std::uint64_t>(max_id.value() - chunk.first_id) < static_cast<std::uint64_t>(chunk_width)
+                ? max_id.value() : chunk.first_id + (chunk_width - 1);
+            return chunk;
+        };
+        auto run = [&](SQLite& conn, const ScanChunk& chunk) {
+            auto stmt = conn.prepare(sql_select);
+            int offset = bindWhere(stmt, obj, 1);
+            stmt.bind(offset++, chunk.first_id);
+            stmt.bind(offset++, chunk.last_id);
+            auto view = stmt.exec();
+            process(chunk, view);
+        };
+
+        if (this->_pool == nullptr) {
+            // コネクションプールを利用しない場合は呼び出し元のスレッドで順に処理する
+            for (std::size_t i = 0; i < count; ++i) {
+                auto chunk = chunkAt(i);
+                run(conns[0], chunk);
+                complete(chunk);
+            }
+            transactions[0]->commit();
+            return;
+        }
+
+        // 残りのコネクションは最初のコネクションと同一のスナップショットから読み取る
+        std::shared_ptr<sqlite3_snapshot> snapshot = SQLite::snapshot_supported && workers > 1 ? conns[0].snapshot() : nullptr;
+        for (std::size_t i = 1; i < workers; ++i) {
+            transactions.emplace_back(std::make_unique<SQLiteTransaction>(conns[i]));
+            if (snapshot) {
+                conns[i].openSnapshot(*snapshot);
+            }
+        }
+
+        // 処理を終えたチャンクをwindowの範囲で記録し、completeを終えた数により取り出しを制限する
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::vector<char> done(window, 0);
+        std::size_t next = 0;
+        std::size_t completed = 0;
+        bool stopped = false;
+        std::exception_ptr error;
+        std::vector<std::thread> threads;
+        auto stop = [&] {
+            {
+                std::lock_guard lock(mutex);
+                stopped = true;
+            }
+            cv.notify_all();
+            for (auto& thread : threads) {
+                thread.join();
+            }
+        };
+
+        try {
+            for (std::size_t w = 0; w < workers; ++w) {
+                threads.emplace_back([&, w] {
+                    while (true) {
+                        std::size_t i;
+                        {
+                            std::unique_lock lock(mutex);
+                            cv.wait(lock, [&] { return stopped || next == count || next < completed + window; });
+                            if (stopped || next == count) {
+                                return;
+                            }
+                            i = next++;
+                        }
+                        try {
+                            run(conns[w], chunkAt(i));
+                        }
+                        catch (...) {
+                            std::lock_guard lock(mutex);
+                            if (!error) {
+                                error = std::current_exception();
+                            }
+                            stopped = true;
+                            cv.notify_all();
+                            return;
+                        }
+                        {
+                            std::lock_guard lock(mutex);
+                            done[i % window] = 1;
+                        }
+                        cv.notify_all();
+                    }
+                });
+            }
+
+            // チャンクの番号の順に完了を待ってcompleteを呼び出す
+            for (std::size_t i = 0; i < count; ++i) {
+                {
+                    std::unique_lock lock(mutex);
+                    cv.wait(lock, [&] { return error || done[i % window] != 0; });
+                    if (error) {
+                        std::rethrow_exception(error);
+                    }
+                    done[i % window] = 0;
+                }
+                complete(chunkAt(i));
+                {
+                    std::lock_guard lock(mutex);
+                    ++completed;
+                }
+                cv.notify_all();
+            }
+        }
+        catch (...) {
+            // 処理中のワーカーを中断させてから例外を伝播する
+            stop();
+            throw;
+        }
+        stop();
+        for (auto& transaction : transactions) {
+            transaction->commit();
+        }
+    }
+    std::vector<std::optional<SQLiteRow>> PasswordManagement::getByNames(std::span<const std::u8string_view> names, const std::vector<int>& target_list) {
+        if (auto conn = this->reader(); conn) {
+            std::u8string col_list_str = getColListStr(target_list);
+
+            // nameのUNIQUEインデックスによる1件の検索を名称ごとに繰り返す
+            std::u8string sql_select = std::bit_cast<const char8_t*>(std::format(R"(
+                SELECT {0} FROM {1} WHERE {2}=?;
+            )",
+                // カラム名の埋め込み
+                std::bit_cast<const char*>(col_list_str.data()),
+                // テーブル名の埋め込み
+                std::bit_cast<const char*>(pws::value.data()),
+                // 名称の埋め込み
+                std::bit_cast<const char*>(pws::c_name::value.data())
+            ).data());
+
+            std::vector<std::optional<SQLiteRow>> result;
+            result.reserve(names.size());
+            // 全件を同一のスナップショットから読み取り、検索ごとのロックの取得を省く
+            SQLiteTransaction transaction(conn);
+            auto stmt = conn.prepare(sql_select);
+            for (const auto& name : names) {
+                stmt.bind(1, name);
+                auto& row = result.emplace_back(std::nullopt);
+                for (auto e : stmt.exec()) {
+                    row.emplace(e);
+                    break;
+                }
+            }
+            transaction.commit();
+            return result;
+        }
+        else {
+            throw std::runtime_error("DBとのコネクションが確立されていません");
+        }
+    }
+    SQLiteView PasswordManagement::distinct(int target) {
+        if (auto conn = this->reader(); conn) {
+            auto col = getColName(target);
+            if (!col) {
+                throw std::invalid_argument("取得対象として指定された列が存在しません");
+            }
+
+            // インデックスの張られたカラムであればインデックスの走査のみでソート済みの結果が得られる
+            std::u8string sql_distinct = std::bit_cast<const char8_t*>(std::format(R"(
+                SELECT DISTINCT {0} FROM {1} WHERE {0} IS NOT NULL ORDER BY {0};
+            )",
+                // カラム名の埋め込み
+                std::bit_cast<const char*>(col.value().data()),
+                // テーブル名の埋め込み
+                std::bit_cast<const char*>(pws::value.data())
+            ).data());
+
+            return conn.prepare(sql_distinct).exec();
+        }
+        else {
+            throw std::runtime_error("DBとのコネクションが確立されていません");
+        }
+    }
+    SQLiteView PasswordManagement::distinct(int target, std::u8string_view lower) {
+        if (auto conn = this->reader(); conn) {
+            auto col = getColName(target);
+            if (!col) {
+                throw std::invalid_argument("取得対象として指定された列が存在しません");
+            }
+
+            // 下限からインデックスを走査するため必要な件数だけ読み出せば打ち切れる
+            std::u8string sql_distinct = std::bit_cast<const char8_t*>(std::format(R"(
+                SELECT DISTINCT {0} FROM {1} WHERE {0} >= ? ORDER BY {0};
+            )",
+                // カラム名の埋め込み
+                std::bit_cast<const char*>(col.value().data()),
+                // テーブル名の埋め込み
+                std::bit_cast<const char*>(pws::value.data())
+            ).data());
+
+            auto stmt = conn.prepare(sql_distinct);
+            stmt.bind(1, lower);
+            return stmt.exec();
+        }
+        else {
+            throw std::runtime_error("DBとのコネクションが確立されていません");
+        }
+    }
+    SQLiteView PasswordManagement::distinctInserted(int target, std::int64_t last_id) {
+        if (auto conn = this->reader(); conn) {
+            auto col = getColName(target);
+            if (!col) {
+                throw std::invalid_argument("取得対象として指定された列が存在しません");
+            }
+
+            std::u8string sql_distinct = std::bit_cast<const char8_t*>(std::format(R"(
+                SELECT DISTINCT {0} FROM {1} WHERE {2} > ? AND {0} IS NOT NULL ORDER BY {0};
+            )",
+                // カラム名の埋め込み
+                std::bit_cast<const char*>(col.value().data()),
+                // テーブル名の埋め込み
+                std::bit_cast<const char*>(pws::value.data()),
+                // 主キー名の埋め込み
+                std::bit_cast<const char*>(pws::c_id::value.data())
+            ).data());
+
+            auto stmt = conn.prepare(sql_distinct);
+            stmt.bind(1, last_id);
+            return stmt.exec();
+        }
+        else {
+            throw std::runtime_error("DBとのコネクションが確立されていません");
+        }
+    }
+    InsertionMark PasswordManagement::insertionMark() {
+        if (auto conn = this->reader(); conn) {
+            // 1つの文で取得することで同じ時点の値とし、各副問い合わせはインデックスのみを走査させる
+            auto stmt = conn.prepare(formatSyncSql(R"(
+                SELECT (SELECT max({21}) FROM {1}), (SELECT count(*) FROM {1}), (SELECT max({3}) FROM {1});
+            )"));
+            InsertionMark mark;
+            for (auto e : stmt.exec()) {
+                mark.last_id = e.get<SQLiteData::integer_type>(0).value_or(0);
+                mark.rows = e.get<SQLiteData::integer_type>(1).value_or(0);
+                mark.seq = e.get<SQLiteData::integer_type>(2).value_or(0);
+            }
+            return mark;
+        }
+        else {
+            throw std::runtime_error("DBとのコネクションが確立されていません");
+        }
+    }
+    bool PasswordManagement::insertedOnly(const InsertionMark& mark) {
+        if (auto conn = this->reader(); conn) {
+            // 主キーがlast_id以下の行の数は全体の行数から挿入された行数を引いて求める
+            auto stmt = conn.prepare(formatSyncSql(R"(
+                SELECT (SELECT count(*) FROM {1}) - (SELECT count(*) FROM {1} WHERE {21} > ?1) = ?2
+                    AND NOT EXISTS (SELECT 1 FROM {1} WHERE {3} > ?3 AND {21} <= ?1);
+            )"));
+            stmt.bind(1, mark.last_id);
+            stmt.bind(2, mark.rows);
+            stmt.bind(3, mark.seq);
+            for (auto e : stmt.exec()) {
+                return e.get<SQLiteData::integer_type>(0).value_or(0) != 0;
+            }
+            return false;
+        }
+        else {
+            throw std::runtime_error("DBとのコネクションが確立されていません");
+        }
+    }
+    void PasswordManagement::removeById(std::int64_t id) {
+        this->removeById(std::span<const std::int64_t>(&id, 1));
+    }
+    void PasswordManagement::removeById(std::span<const std::int64_t> ids) {
+        if (auto conn = this->writer(); conn) {
+            std::u8string where_str = getWhereIdStr();
+
+            std::u8string sql_delete = std::bit_cast<const char8_t*>(std::format(R"(
+                DELETE FROM {0} {1};
+            )",
+                // テーブル名の埋め込み
+                std::bit_cast<const char*>(pws::value.data()),
+                // WHERE句の埋め込み
+                std::bit_cast<const char*>(where_str.data())
+            ).data());
+
+            // 同一のステートメントをidごとに再利用して1つのトランザクションで削除する
+            SQLiteTransaction transaction(conn, true);
+            auto stmt = conn.prepare(sql_delete);
+            for (auto id : ids) {
+                stmt.bind(1, id);
+                for (const auto& x : stmt.exec()) {}
+            }
+            transaction.commit();
+        }
+        else {
+            throw std::runtime_error("DBとのコネクションが確立されていません");
+        }
+    }
+    void PasswordManagement::remove(const GetParam& obj) {
+        auto conn = this->writer();
+
+        // 抽出条件のSQLの構築
+        std::u8string where_str = getWhereStr(obj);
+
+        std::u8string sql_select = std::bit_cast<const char8_t*>(std::format(R"(
+                DELETE  FROM {0} {1};
+            )",
+            // テーブル名の埋め込み
+            std::bit_cast<const char*>(pws::value.data()),
+            // WHERE句の埋め込み
+            std::bit_cast<const char*>(where_str.data())
         ).data());
 
         // バインド変数の設定
-        auto stmt = this->_conn.prepare(sql_select);
+        auto stmt = conn.prepare(sql_select);
         if (where_str.length() != 0) {
             bindWhere(stmt, obj, 1);
         }
@@ -366,4 +2379,437 @@ namespace pwm {
         // パスワード情報を削除
         for (const auto& x : stmt.exec()) {}
     }
+    SyncResult PasswordManagement::sync(const std::filesystem::path& peer_path, const std::function<void(PasswordManagement&)>& unlock_peer) {
+        if (!std::filesystem::exists(peer_path)) {
+            throw std::runtime_error("同期先のDBが存在しません");
+        }
+        if (std::filesystem::exists(this->_dbpath) && std::filesystem::equivalent(this->_dbpath, peer_path)) {
+            throw std::invalid_argument("同じDBどうしは同期できません");
+        }
+        // 同期先のスキーマを最新のバージョンへ移行し、同期先の鍵を設定する
+        SQLite peer_conn(peer_path);
+        PasswordManagement peer_pm(peer_path, peer_conn);
+        if (unlock_peer) {
+            unlock_peer(peer_pm);
+        }
+        if (auto conn = this->writer(); conn) {
+            // ATTACHはトランザクションの外で行う必要がある
+            AttachedDatabase attached(conn, peer_path, u8"peer");
+            SQLiteTransaction transaction(conn, true);
+
+            // 鍵の情報が異なれば暗号化されたパスワードをそのまま受け渡せないため、同期元の鍵で復号して反映先の鍵で暗号化し直す
+            auto local_keys = loadVaultKeys(conn, u8"main");
+            auto peer_keys = loadVaultKeys(conn, u8"peer");
+            bool reseal = !sameVaultKeys(local_keys, peer_keys);
+            if (reseal && !local_keys.empty() && this->_keyring->empty()) {
+                throw std::runtime_error("鍵の情報が異なるDBと同期するには自身の鍵が必要です");
+            }
+            if (reseal && !peer_keys.empty() && peer_pm._keyring->empty()) {
+                throw std::runtime_error("鍵の情報が異なるDBと同期するには同期先の鍵が必要です");
+            }
+            SyncSide local(conn, u8"main", reseal ? this->_keyring.get() : nullptr);
+            SyncSide peer(conn, u8"peer", reseal ? peer_pm._keyring.get() : nullptr);
+
+            local.adopt();
+            peer.adopt();
+            auto local_vault = local.vault();
+            auto peer_vault = peer.vault();
+            if (local_vault == peer_vault) {
+                throw std::runtime_error("同期先は同一のDBを複製したものであるため同期できません");
+            }
+
+            // 双方が記録した同期の位置のうち古い方から差分を求める
+            auto [local_mark, peer_mark] = local.watermark(peer_vault);
+            auto [peer_mark2, local_mark2] = peer.watermark(local_vault);
+            auto local_since = std::min(local_mark, local_mark2);
+            auto peer_since = std::min(peer_mark, peer_mark2);
+            // 同期の位置より連番が小さければバックアップから戻されたものとみなして全件を対象とする
+            if (local.seq() < local_since) {
+                local_since = 0;
+            }
+            if (peer.seq() < peer_since) {
+                peer_since = 0;
+            }
+
+            auto local_changes = local.changes(local_since);
+            auto peer_changes = peer.changes(peer_since);
+            SyncResult result{ .local_changes = local_changes.size(), .peer_changes = peer_changes.size() };
+
+            // 識別子の昇順に双方の変更を突き合わせる(同じ識別子の行と墓標があれば後者を優先する)
+            std::map<std::u8string_view, std::pair<const SyncEntry*, const SyncEntry*>> merged;
+            for (const auto& x : local_changes) {
+                if (auto& slot = merged[x.uid].first; slot == nullptr || x.deleted) {
+                    slot = &x;
+                }
+            }
+            for (const auto& x : peer_changes) {
+                if (auto& slot = merged[x.uid].second; slot == nullptr || x.deleted) {
+                    slot = &x;
+                }
+            }
+            for (const auto& [uid, pair] : merged) {
+                auto [l, p] = pair;
+                if (l != nullptr && p != nullptr) {
+                    auto order = compareSyncEntry(*l, *p);
+                    if (order == 0) {
+                        continue;
+                    }
+                    ++result.conflicts;
+                    if (order > 0) {
+                        p = nullptr;
+                    }
+                    else {
+                        l = nullptr;
+                    }
+                }
+                if (l != nullptr) {
+                    result.pushed += applySyncEntry(peer, local, *l, result) ? 1 : 0;
+                }
+                else {
+                    result.pulled += applySyncEntry(local, peer, *p, result) ? 1 : 0;
+                }
+            }
+
+            // 反映により進んだ連番までを同期済みとして双方に記録する
+            auto local_seq = local.seq();
+            auto peer_seq = peer.seq();
+            local.mark(peer_vault, local_seq, peer_seq);
+            peer.mark(local_vault, peer_seq, local_seq);
+            transaction.commit();
+            return result;
+        }
+        else {
+            throw std::runtime_error("DBとのコネクションが確立されていません");
+        }
+    }
+    Sha256::digest_type PasswordManagement::digest() {
+        if (auto conn = this->writer(); conn) {
+            SQLiteTransaction transaction(conn, true);
+            SyncSide(conn, u8"main").adopt();
+            MerkleTree tree(conn, u8"main");
+            tree.refresh();
+            auto root = tree.root();
+            transaction.commit();
+            return root;
+        }
+        else {
+            throw std::runtime_error("DBとのコネクションが確立されていません");
+        }
+    }
+    std::vector<DigestBucket> PasswordManagement::verifyDigest() {
+        if (auto conn = this->writer(); conn) {
+            SQLiteTransaction transaction(conn, true);
+            SyncSide(conn, u8"main").adopt();
+            MerkleTree tree(conn, u8"main");
+            tree.refresh();
+            // 計算し直した結果は保存しない(不一致を修復すると改ざんを見逃すため)
+            std::vector<DigestBucket> result;
+            for (auto bucket : tree.mismatches()) {
+                result.push_back({
+                    .index = bucket,
+                    .first_id = bucket << merkle_bucket_bits,
+                    .last_id = ((bucket + 1) << merkle_bucket_bits) - 1
+                });
+            }
+            transaction.commit();
+            return result;
+        }
+        else {
+            throw std::runtime_error("DBとのコネクションが確立されていません");
+        }
+    }
+    DiffResult PasswordManagement::diff(const std::filesystem::path& peer_path) {
+        if (!std::filesystem::exists(peer_path)) {
+            throw std::runtime_error("比較先のDBが存在しません");
+        }
+        if (std::filesystem::exists(this->_dbpath) && std::filesystem::equivalent(this->_dbpath, peer_path)) {
+            throw std::invalid_argument("同じDBどうしは比較できません");
+        }
+        {
+            // 比較先のスキーマを最新のバージョンへ移行する
+            SQLite peer_conn(peer_path);
+            PasswordManagement peer_pm(peer_path, peer_conn);
+        }
+        if (auto conn = this->writer(); conn) {
+            // ATTACHはトランザクションの外で行う必要がある
+            AttachedDatabase attached(conn, peer_path, u8"peer");
+            SQLiteTransaction transaction(conn, true);
+            SyncSide(conn, u8"main").adopt();
+            SyncSide(conn, u8"peer").adopt();
+            MerkleTree local(conn, u8"main");
+            MerkleTree peer(conn, u8"peer");
+            local.refresh();
+            peer.refresh();
+
+            DiffResult result{ .nodes = 1 };
+            if (local.root() == peer.root()) {
+                transaction.commit();
+                return result;
+            }
+            // ハッシュ値の異なるノードの子のみを根から1段ずつたどる
+            std::vector<std::int64_t> nodes = { 0 };
+            for (auto level = merkle_root_level; level > 0; --level) {
+                std::vector<std::int64_t> next;
+                for (auto idx : nodes) {
+                    auto l = local.children(level, idx);
+                    auto p = peer.children(level, idx);
+                    auto li = l.begin();
+                    auto pi = p.begin();
+                    while (li != l.end() || pi != p.end()) {
+                        ++result.nodes;
+                        if (pi == p.end() || (li != l.end() && li->first < pi->first)) {
+                            next.push_back((li++)->first);
+                        }
+                        else if (li == l.end() || pi->first < li->first) {
+                            next.push_back((pi++)->first);
+                        }
+                        else {
+                            if (li->second != pi->second) {
+                                next.push_back(li->first);
+                            }
+                            ++li;
+                            ++pi;
+                        }
+                    }
+                }
+                nodes = std::move(next);
+            }
+
+            // ハッシュ値の異なるバケットの行を主キーの昇順に突き合わせる
+            result.buckets = nodes.size();
+            for (auto bucket : nodes) {
+                auto l = local.rowHashes(bucket);
+                auto p = peer.rowHashes(bucket);
+                auto li = l.begin();
+                auto pi = p.begin();
+                while (li != l.end() || pi != p.end()) {
+                    if (pi == p.end() || (li != l.end() && li->first < pi->first)) {
+                        result.local_only.push_back((li++)->first);
+                    }
+                    else if (li == l.end() || pi->first < li->first) {
+                        result.peer_only.push_back((pi++)->first);
+                    }
+                    else {
+                        if (li->second != pi->second) {
+                            result.changed.push_back(li->first);
+                        }
+                        ++li;
+                        ++pi;
+                    }
+                }
+            }
+            transaction.commit();
+            return result;
+        }
+        else {
+            throw std::runtime_error("DBとのコネクションが確立されていません");
+        }
+    }
+
+    void PasswordManagement::unlock(std::u8string_view passphrase) {
+        if (auto conn = this->writer(); conn) {
+            std::vector<VaultKey> keys;
+            auto created = ensureVaultKeys(conn, passphrase, keys);
+            if (keys.empty()) {
+                // 鍵を作成できないため暗号化しない
+                return;
+            }
+            if (created) {
+                // 作成した世代の鍵は導出済み
+                addVaultKeys(*this->_keyring, keys, deriveVaultKeys(keys, passphrase, created));
+            }
+            else {
+                // 鍵の導出は最初に暗号化あるいは復号するときまで遅延する(パスワードを取得しなければ導出しない)
+                this->_keyring->defer([keys = std::move(keys), passphrase = std::u8string(passphrase)](RecordKeyring& keyring) {
+                    addVaultKeys(keyring, keys, deriveVaultKeys(keys, passphrase, std::nullopt));
+                });
+            }
+        }
+        else {
+            throw std::runtime_error("DBとのコネクションが確立されていません");
+        }
+    }
+
+    void PasswordManagement::unlock(std::span<const VaultKeyMaterial> material) {
+        if (auto conn = this->reader(); conn) {
+            addVaultKeys(*this->_keyring, loadVaultKeys(conn), material);
+        }
+        else {
+            throw std::runtime_error("DBとのコネクションが確立されていません");
+        }
+    }
+
+    std::vector<VaultKeyMaterial> PasswordManagement::deriveKeys(std::u8string_view passphrase) {
+        if (auto conn = this->writer(); conn) {
+            std::vector<VaultKey> keys;
+            auto created = ensureVaultKeys(conn, passphrase, keys);
+            if (keys.empty()) {
+                throw std::runtime_error("鍵の情報が存在せず、読み取り専用のため作成できません");
+            }
+            return deriveVaultKeys(keys, passphrase, created);
+        }
+        else {
+            throw std::runtime_error("DBとのコネクションが確立されていません");
+        }
+    }
+
+    std::u8string PasswordManagement::vault() {
+        if (auto conn = this->reader(); conn) {
+            for (auto e : conn.prepare(formatSyncSql("SELECT {16} FROM {0}{15};", u8"")).exec()) {
+                return std::u8string(e.get<SQLiteData::string_type>(0).value_or(u8""));
+            }
+            throw std::runtime_error("同期のための状態が存在しません");
+        }
+        else {
+            throw std::runtime_error("DBとのコネクションが確立されていません");
+        }
+    }
+
+    RekeyProgress PasswordManagement::rekey(std::u8string_view passphrase, std::size_t workers, std::int64_t chunk_width, const std::function<void(const RekeyProgress&)>& progress) {
+        using vk = table::vault_keys;
+        if (this->_pool == nullptr) {
+            // 読み取りのトランザクションを維持したまま同じコネクションで書き込むことはできない
+            throw std::invalid_argument("鍵の更新にはコネクションプールが必要です");
+        }
+        if (chunk_width <= 0) {
+            throw std::invalid_argument("チャンクの幅は1以上である必要があります");
+        }
+
+        RekeyProgress result;
+        if (auto conn = this->writer(); conn) {
+            // 新たな世代を作成する前に既存の世代とパスフレーズを照合する(一致しなければ何も書き込まない)
+            auto keys = loadVaultKeys(conn);
+            auto material = deriveVaultKeys(keys, passphrase, std::nullopt);
+            SQLiteTransaction transaction(conn, true);
+            auto latest = loadVaultKeys(conn);
+            if (latest.size() != keys.size() || (!keys.empty() && latest.back().generation != keys.back().generation)) {
+                throw std::runtime_error("鍵の情報が他で更新されました");
+            }
+            keys = std::move(latest);
+            if (!keys.empty() && keys.back().rekey_id) {
+                // 中断した鍵の更新を最新の世代のまま再開する
+                result.resumed = true;
+                result.next_id = keys.back().rekey_id.value();
+            }
+            else {
+                result.next_id = std::numeric_limits<std::int64_t>::min();
+                auto created = createVaultKey(conn, passphrase, keys.empty() ? 1 : keys.back().generation + 1, result.next_id, keys);
+                material.push_back({ .generation = keys.back().generation, .method = keys.back().method, .key = created.key, .verifier = created.verifier });
+            }
+            result.generation = keys.back().generation;
+            transaction.commit();
+            addVaultKeys(*this->_keyring, keys, material);
+        }
+        else {
+            throw std::runtime_error("DBとのコネクションが確立されていません");
+        }
+        if (auto conn = this->reader(); conn) {
+            for (auto e : conn.prepare(formatSyncSql("SELECT max({21}) FROM {1};")).exec()) {
+                result.last_id = e.get<SQLiteData::integer_type>(0).value_or(result.next_id);
+            }
+        }
+
+        auto cipher = this->_keyring->current();
+        const std::u8string method(cipher->method());
+        // 行を読み取った後に他で更新されていれば書き込まない(最後にまとめて暗号化し直す)
+        const std::u8string sql_update = formatSyncSql("UPDATE {1} SET {7}=?,{8}=?,{3}=") + nextSeqSql() + formatSyncSql(" WHERE {21}=? AND {3}=?;");
+        const std::u8string sql_mark = std::bit_cast<const char8_t*>(std::format("UPDATE {0} SET {1}=? WHERE {2}=?;",
+            // テーブル名の埋め込み
+            std::bit_cast<const char*>(vk::value.data()),
+            // 鍵の更新の進捗名の埋め込み
+            std::bit_cast<const char*>(vk::c_rekey_id::value.data()),
+            // 鍵の世代名の埋め込み
+            std::bit_cast<const char*>(vk::c_generation::value.data())
+        ).data());
+
+        // 再暗号化した行
+        struct RekeyRow {
+            std::int64_t id = 0;
+            std::int64_t seq = 0;
+            std::vector<unsigned char> password;
+        };
+        auto seal = [&cipher](SQLiteData& e, std::vector<RekeyRow>& rows) {
+            if (auto plaintext = e.get<SQLiteData::blob_type>(2); plaintext) {
+                rows.push_back({
+                    .id = e.get<SQLiteData::integer_type>(0).value_or(0),
+                    .seq = e.get<SQLiteData::integer_type>(1).value_or(0),
+                    .password = cipher->encrypt(plaintext.value())
+                });
+            }
+        };
+        auto write = [&](SQLite& conn, const std::vector<RekeyRow>& rows, std::optional<std::int64_t> next_id) {
+            std::uint64_t written = 0;
+            auto stmt = conn.prepare(sql_update);
+            stmt.bind(2, method);
+            for (const auto& row : rows) {
+                stmt.bind(1, row.password);
+                stmt.bind(3, row.id);
+                stmt.bind(4, row.seq);
+                for (const auto& x : stmt.exec()) {}
+                written += static_cast<std::uint64_t>(conn.changes());
+            }
+            // 次に再暗号化する主キーを同じトランザクションで記録する
+            auto mark = conn.prepare(sql_mark);
+            mark.bind(1, next_id);
+            mark.bind(2, static_cast<std::int64_t>(result.generation));
+            for (const auto& x : mark.exec()) {}
+            return written;
+        };
+
+        // 復号と暗号化はワーカーのスレッドで行い、書き込みはチャンクの順にチャンクごとのトランザクションで行う
+        workers = std::clamp<std::size_t>(workers, 1, this->_pool->readerCount());
+        const std::size_t window = workers * 2;
+        std::vector<std::vector<RekeyRow>> slots(window);
+        const std::vector<int> target_list = { pws::c_id::index, pws::c_seq::index, pws::c_password::index };
+        this->scanChunks(GetParam{}, target_list, result.next_id, chunk_width, workers, window,
+            [&](const ScanChunk& chunk, SQLiteView& view) {
+                auto& rows = slots[chunk.index % window];
+                rows.clear();
+                for (auto e : view) {
+                    seal(e, rows);
+                }
+            },
+            [&](const ScanChunk& chunk) {
+                auto& rows = slots[chunk.index % window];
+                auto next_id = chunk.last_id == std::numeric_limits<std::int64_t>::max() ? chunk.last_id : chunk.last_id + 1;
+                if (auto conn = this->writer(); conn) {
+                    SQLiteTransaction transaction(conn, true);
+                    result.rewritten += write(conn, rows, next_id);
+                    transaction.commit();
+                }
+                rows.clear();
+                result.next_id = next_id;
+                ++result.chunks;
+                if (progress) {
+                    progress(result);
+                }
+            });
+
+        // 他で更新された行と新たな世代で暗号化されていない行を、書き込みのロックを保持したまま暗号化し直して完了を記録する
+        if (auto conn = this->writer(); conn) {
+            SQLiteTransaction transaction(conn, true);
+            std::vector<unsigned char> header(RecordCipher::header_size);
+            for (std::size_t i = 0; i < header.size(); ++i) {
+                header[i] = static_cast<unsigned char>(result.generation >> (8 * i));
+            }
+            std::vector<RekeyRow> rows;
+            auto stmt = conn.prepare(formatSyncSql("SELECT {21},{3},") + sql_decrypt_password + formatSyncSql(" FROM {1} WHERE {8} IS NOT ? OR substr({7},1,?)!=?;"));
+            stmt.bind(1, method);
+            stmt.bind(2, static_cast<std::int64_t>(header.size()));
+            stmt.bind(3, header);
+            for (auto e : stmt.exec()) {
+                seal(e, rows);
+            }
+            result.conflicts = write(conn, rows, std::nullopt);
+            result.rewritten += result.conflicts;
+            transaction.commit();
+        }
+        else {
+            throw std::runtime_error("DBとのコネクションが確立されていません");
+        }
+        if (progress) {
+            progress(result);
+        }
+        return result;
+    }
 }
@@ -4,8 +4,14 @@
 #include <filesystem>
 #include <chrono>
 #include <vector>
+#include <span>
+#include <stdexcept>
+#include <functional>
 #include "SQLiteConnection.h"
+#include "SQLitePool.h"
 #include "SQLiteView.h"
+#include "Sha256.h"
+#include "RecordCipher.h"
 
 namespace pwm {
 
@@ -25,6 +31,80 @@ namespace pwm {
 			struct c_memo { static constexpr std::u8string_view value = u8"memo"; static constexpr int index = 5; };
 			struct c_registered_at { static constexpr std::u8string_view value = u8"registered_at"; static constexpr int index = 6; };
 			struct c_update_at { static constexpr std::u8string_view value = u8"update_at"; static constexpr int index = 7; };
+			struct c_id { static constexpr std::u8string_view value = u8"id"; static constexpr int index = 8; };
+			struct c_version { static constexpr std::u8string_view value = u8"version"; static constexpr int index = 9; };
+			struct c_uid { static constexpr std::u8string_view value = u8"uid"; static constexpr int index = 10; };
+			struct c_seq { static constexpr std::u8string_view value = u8"seq"; static constexpr int index = 11; };
+		};
+
+		/// <summary>
+		/// 同期のための状態を保持するテーブル(1行のみ)の情報の定義
+		/// </summary>
+		struct sync_state {
+			static constexpr std::u8string_view value = u8"sync_state";
+
+			struct c_vault { static constexpr std::u8string_view value = u8"vault"; };
+			struct c_seq { static constexpr std::u8string_view value = u8"seq"; };
+			struct c_merkle_seq { static constexpr std::u8string_view value = u8"merkle_seq"; };
+		};
+
+		/// <summary>
+		/// 削除したパスワード情報を同期先へ伝えるための記録(墓標)のテーブルの情報の定義
+		/// </summary>
+		struct tombstones {
+			static constexpr std::u8string_view value = u8"tombstones";
+
+			struct c_uid { static constexpr std::u8string_view value = u8"uid"; };
+			struct c_version { static constexpr std::u8string_view value = u8"version"; };
+			struct c_deleted_at { static constexpr std::u8string_view value = u8"deleted_at"; };
+			struct c_seq { static constexpr std::u8string_view value = u8"seq"; };
+		};
+
+		/// <summary>
+		/// 同期先ごとの前回の同期の位置のテーブルの情報の定義
+		/// </summary>
+		struct sync_peers {
+			static constexpr std::u8string_view value = u8"sync_peers";
+
+			struct c_vault { static constexpr std::u8string_view value = u8"vault"; };
+			struct c_local_seq { static constexpr std::u8string_view value = u8"local_seq"; };
+			struct c_peer_seq { static constexpr std::u8string_view value = u8"peer_seq"; };
+			struct c_synced_at { static constexpr std::u8string_view value = u8"synced_at"; };
+		};
+
+		/// <summary>
+		/// 主キーの範囲(バケット)ごとの行のハッシュ値によるマークル木のテーブルの情報の定義
+		/// </summary>
+		struct merkle {
+			static constexpr std::u8string_view value = u8"merkle";
+
+			struct c_level { static constexpr std::u8string_view value = u8"level"; };
+			struct c_idx { static constexpr std::u8string_view value = u8"idx"; };
+			struct c_hash { static constexpr std::u8string_view value = u8"hash"; };
+		};
+
+		/// <summary>
+		/// 行の削除によりマークル木の計算し直しが必要となったバケットのテーブルの情報の定義
+		/// </summary>
+		struct merkle_dirty {
+			static constexpr std::u8string_view value = u8"merkle_dirty";
+
+			struct c_bucket { static constexpr std::u8string_view value = u8"bucket"; };
+		};
+
+		/// <summary>
+		/// パスフレーズから導出したパスワードの暗号化の鍵の世代ごとの情報のテーブルの定義
+		/// </summary>
+		struct vault_keys {
+			static constexpr std::u8string_view value = u8"vault_keys";
+
+			struct c_generation { static constexpr std::u8string_view value = u8"generation"; };
+			struct c_method { static constexpr std::u8string_view value = u8"method"; };
+			struct c_salt { static constexpr std::u8string_view value = u8"salt"; };
+			struct c_iterations { static constexpr std::u8string_view value = u8"iterations"; };
+			struct c_verifier { static constexpr std::u8string_view value = u8"verifier"; };
+			struct c_created_at { static constexpr std::u8string_view value = u8"created_at"; };
+			struct c_rekey_id { static constexpr std::u8string_view value = u8"rekey_id"; };
 		};
 
 		/// <summary>
@@ -32,6 +112,7 @@ namespace pwm {
 		/// </summary>
 		struct encryption_method {
 			static constexpr std::u8string_view none = u8"None";
+			static constexpr std::u8string_view chacha20_poly1305 = ChaCha20Poly1305Cipher::name;
 		};
 	}
 
@@ -133,6 +214,223 @@ namespace pwm {
 		std::optional<std::optional<std::u8string>> memo = std::nullopt;
 	};
 
+	/// <summary>
+	/// 一括挿入において既存のパスワード情報と重複した場合の動作
+	/// </summary>
+	enum class ConflictPolicy {
+		/// <summary>
+		/// 挿入せずに読み飛ばす
+		/// </summary>
+		skip,
+		/// <summary>
+		/// 既存のパスワード情報を上書きする(行のバージョンを進める)
+		/// </summary>
+		overwrite,
+		/// <summary>
+		/// 例外を送出して中断する
+		/// </summary>
+		fail
+	};
+
+	/// <summary>
+	/// 一括挿入の結果
+	/// </summary>
+	struct InsertManyResult {
+		/// <summary>
+		/// 新たに挿入した件数
+		/// </summary>
+		std::uint64_t inserted = 0;
+		/// <summary>
+		/// 既存のパスワード情報を上書きした件数
+		/// </summary>
+		std::uint64_t overwritten = 0;
+		/// <summary>
+		/// 重複のため読み飛ばした件数
+		/// </summary>
+		std::uint64_t skipped = 0;
+	};
+
+	/// <summary>
+	/// 主キーの範囲で分割した取得の単位
+	/// </summary>
+	struct ScanChunk {
+		/// <summary>
+		/// 主キーの昇順での0から始まる番号
+		/// </summary>
+		std::size_t index = 0;
+		/// <summary>
+		/// 主キーの範囲の先頭
+		/// </summary>
+		std::int64_t first_id = 0;
+		/// <summary>
+		/// 主キーの範囲の末尾(範囲に含む)
+		/// </summary>
+		std::int64_t last_id = 0;
+	};
+
+	/// <summary>
+	/// ある時点以降の変更が行の挿入のみであるかを判定するための目印
+	/// </summary>
+	/// <remarks>
+	/// 主キーは再利用されず、更新した行の変更の連番はそれまでの最大値より大きくなるため、
+	/// 主キーがlast_id以下の行の数が変わらず変更の連番がseqを超えなければ既存の行は更新も削除もされていない
+	/// </remarks>
+	struct InsertionMark {
+		/// <summary>
+		/// 主キーの最大値
+		/// </summary>
+		std::int64_t last_id = 0;
+		/// <summary>
+		/// 行数
+		/// </summary>
+		std::int64_t rows = 0;
+		/// <summary>
+		/// 変更の連番の最大値
+		/// </summary>
+		std::int64_t seq = 0;
+	};
+
+	/// <summary>
+	/// 他のDBとの差分同期の結果
+	/// </summary>
+	struct SyncResult {
+		/// <summary>
+		/// 前回の同期以降に自身で変更された行数(削除を含む)
+		/// </summary>
+		std::uint64_t local_changes = 0;
+		/// <summary>
+		/// 前回の同期以降に同期先で変更された行数(削除を含む)
+		/// </summary>
+		std::uint64_t peer_changes = 0;
+		/// <summary>
+		/// 同期先の変更を自身へ反映した件数
+		/// </summary>
+		std::uint64_t pulled = 0;
+		/// <summary>
+		/// 自身の変更を同期先へ反映した件数
+		/// </summary>
+		std::uint64_t pushed = 0;
+		/// <summary>
+		/// 双方で変更されていたため一方を採用した件数
+		/// </summary>
+		std::uint64_t conflicts = 0;
+		/// <summary>
+		/// 異なる行がサービス名とユーザ名の組あるいは名称で重複したため一方を削除した件数
+		/// </summary>
+		std::uint64_t duplicates = 0;
+	};
+
+	/// <summary>
+	/// マークル木の葉が受け持つ主キーの範囲
+	/// </summary>
+	struct DigestBucket {
+		/// <summary>
+		/// バケットの番号
+		/// </summary>
+		std::int64_t index = 0;
+		/// <summary>
+		/// 主キーの範囲の先頭
+		/// </summary>
+		std::int64_t first_id = 0;
+		/// <summary>
+		/// 主キーの範囲の末尾(範囲に含む)
+		/// </summary>
+		std::int64_t last_id = 0;
+	};
+
+	/// <summary>
+	/// 他のDBとの内容の比較の結果
+	/// </summary>
+	struct DiffResult {
+		/// <summary>
+		/// 自身にのみ存在する行の主キー
+		/// </summary>
+		std::vector<std::int64_t> local_only;
+		/// <summary>
+		/// 比較先にのみ存在する行の主キー
+		/// </summary>
+		std::vector<std::int64_t> peer_only;
+		/// <summary>
+		/// 双方に存在するが内容の異なる行の主キー
+		/// </summary>
+		std::vector<std::int64_t> changed;
+		/// <summary>
+		/// ハッシュ値が異なり行を比較したバケットの数
+		/// </summary>
+		std::uint64_t buckets = 0;
+		/// <summary>
+		/// 比較したマークル木のノードの数
+		/// </summary>
+		std::uint64_t nodes = 0;
+	};
+
+	/// <summary>
+	/// パスフレーズから導出した鍵の世代ごとの鍵
+	/// </summary>
+	/// <remarks>
+	/// 鍵の導出を省略するため、導出済みの鍵を他のプロセス(エージェント)から受け渡す際に用いる
+	/// </remarks>
+	struct VaultKeyMaterial {
+		/// <summary>
+		/// 鍵の世代
+		/// </summary>
+		std::uint32_t generation = 0;
+		/// <summary>
+		/// 暗号化方式の名称
+		/// </summary>
+		std::u8string method;
+		/// <summary>
+		/// 暗号化の鍵
+		/// </summary>
+		RecordCipher::key_type key{};
+		/// <summary>
+		/// 鍵の情報と照合するための値
+		/// </summary>
+		Sha256::digest_type verifier{};
+	};
+
+	/// <summary>
+	/// 鍵の更新(すべてのパスワードの再暗号化)の進捗
+	/// </summary>
+	struct RekeyProgress {
+		/// <summary>
+		/// 新たに暗号化に用いる鍵の世代
+		/// </summary>
+		std::uint32_t generation = 0;
+		/// <summary>
+		/// 中断した鍵の更新を再開したならtrue
+		/// </summary>
+		bool resumed = false;
+		/// <summary>
+		/// 次に再暗号化する主キー(これより前の行は再暗号化を終えてコミット済み)
+		/// </summary>
+		std::int64_t next_id = 0;
+		/// <summary>
+		/// 開始時点の主キーの最大値
+		/// </summary>
+		std::int64_t last_id = 0;
+		/// <summary>
+		/// コミットを終えたチャンクの数
+		/// </summary>
+		std::uint64_t chunks = 0;
+		/// <summary>
+		/// 再暗号化した行数
+		/// </summary>
+		std::uint64_t rewritten = 0;
+		/// <summary>
+		/// 読み取った後に他で更新されたため、最後にまとめて再暗号化した行数
+		/// </summary>
+		std::uint64_t conflicts = 0;
+	};
+
+	/// <summary>
+	/// 行のバージョンが期待したものと一致しないために更新できなかったことを示す例外
+	/// </summary>
+	class version_conflict_error : public std::runtime_error {
+	public:
+		using std::runtime_error::runtime_error;
+	};
+
 	/// <summary>
 	/// パスワード管理を行うクラス
 	/// </summary>
@@ -143,12 +441,135 @@ namespace pwm {
 		std::filesystem::path _dbpath;
 
 		/// <summary>
-		/// SQLiteに関する操作の起点となるオブジェクト
+		/// SQLiteに関する操作の起点となるオブジェクト(コネクションプールを利用する場合はnullopt)
+		/// </summary>
+		std::optional<SQLite> _conn;
+
+		/// <summary>
+		/// コネクションプール(単一のコネクションを利用する場合はnullptr)
+		/// </summary>
+		SQLitePool* _pool = nullptr;
+
+		/// <summary>
+		/// パスワードの暗号化と復号に用いる鍵(空であれば暗号化せずに格納する)
+		/// </summary>
+		/// <remarks>
+		/// SQLの関数からも参照するため、コネクションに登録した関数と共有する
+		/// </remarks>
+		std::shared_ptr<RecordKeyring> _keyring;
+
+		/// <summary>
+		/// 暗号化されたパスワードを復号するSQLの関数(pwm_decrypt)
 		/// </summary>
-		SQLite& _conn;
+		std::shared_ptr<const SQLiteFunction> _decrypt;
+
+		/// <summary>
+		/// コネクションへSQLの関数を登録する
+		/// </summary>
+		SQLite& prepareConnection(SQLite& conn);
+
+		/// <summary>
+		/// 読み取りのためのコネクションを取得する
+		/// </summary>
+		[[nodiscard]] SQLite reader();
+
+		/// <summary>
+		/// 書き込みのためのコネクションを取得する
+		/// </summary>
+		[[nodiscard]] SQLite writer();
+
+		/// <summary>
+		/// テーブルを構築してスキーマを最新のバージョンへ移行する
+		/// </summary>
+		void initialize();
 	public:
 		PasswordManagement() = delete;
 		PasswordManagement(const std::filesystem::path& dbpath, SQLite& conn);
+		/// <summary>
+		/// コネクションプールを利用して複数のスレッドから並行に操作する
+		/// </summary>
+		/// <param name="dbpath">データベースへのパス</param>
+		/// <param name="pool">コネクションプール(このオブジェクトより長く存在する必要がある)</param>
+		PasswordManagement(const std::filesystem::path& dbpath, SQLitePool& pool);
+
+		/// <summary>
+		/// 一括挿入において1つのトランザクションで挿入する既定の件数
+		/// </summary>
+		static constexpr std::size_t default_chunk_size = 10000;
+
+		/// <summary>
+		/// パスフレーズから鍵を導出するPBKDF2-HMAC-SHA256の既定の反復回数
+		/// </summary>
+		static constexpr std::uint32_t default_kdf_iterations = 600000;
+
+		/// <summary>
+		/// パスフレーズから鍵を導出してパスワードの暗号化と復号を有効にする
+		/// </summary>
+		/// <remarks>
+		/// 鍵の情報が存在しなければ新たな塩で最初の世代を作成し、以降に挿入・更新するパスワードを暗号化する
+		/// (読み取り専用であれば作成しない)。既存の鍵の導出は最初にパスワードを暗号化あるいは復号するときまで遅延するため、
+		/// パスワードを取得しない操作では鍵を導出せず、鍵の情報と一致しないパスフレーズであればその時点で例外を送出する。
+		/// 暗号化・復号を行う他のスレッドが存在しない間に呼び出す必要がある。
+		/// </remarks>
+		/// <param name="passphrase">パスフレーズ</param>
+		void unlock(std::u8string_view passphrase);
+
+		/// <summary>
+		/// 導出済みの鍵によりパスワードの暗号化と復号を有効にする
+		/// </summary>
+		/// <remarks>
+		/// 鍵の情報と照合し、最新の世代の鍵が一致しなければ例外を送出する(一致しない古い世代は除外する)
+		/// </remarks>
+		/// <param name="material">導出済みの鍵</param>
+		void unlock(std::span<const VaultKeyMaterial> material);
+
+		/// <summary>
+		/// パスフレーズからすべての世代の鍵を導出する
+		/// </summary>
+		/// <remarks>
+		/// 鍵の情報が存在しなければunlockと同様に最初の世代を作成する
+		/// </remarks>
+		/// <param name="passphrase">パスフレーズ</param>
+		/// <returns>導出した鍵(パスフレーズと一致しない古い世代は含まない)</returns>
+		[[nodiscard]] std::vector<VaultKeyMaterial> deriveKeys(std::u8string_view passphrase);
+
+		/// <summary>
+		/// DBを識別する値を取得する
+		/// </summary>
+		[[nodiscard]] std::u8string vault();
+
+		/// <summary>
+		/// 鍵の更新において1つのチャンク(トランザクション)が受け持つ既定の主キーの幅
+		/// </summary>
+		static constexpr std::int64_t default_rekey_chunk_ids = 4096;
+
+		/// <summary>
+		/// 新たな世代の鍵を作成し、すべてのパスワードをその鍵で暗号化し直す(暗号化されていないパスワードも暗号化する)
+		/// </summary>
+		/// <remarks>
+		/// 主キーの範囲(チャンク)ごとにワーカーのスレッドで復号と暗号化を行い、呼び出し元のスレッドでチャンクごとの
+		/// トランザクションで書き込む。次に再暗号化する主キーを同じトランザクションで鍵の情報へ記録するため、
+		/// 中断しても次の呼び出しで続きから再開する(新たな世代は作成しない)。書き込みはチャンクごとにコミットするため
+		/// 他のコネクションからの読み取りと書き込みを長く妨げない。読み取った後に他で更新された行は、
+		/// 最後に書き込みのロックを保持したまま暗号化し直す。古い世代の鍵の情報は削除しない。
+		/// コネクションプールを利用する場合にのみ利用できる。
+		/// </remarks>
+		/// <param name="passphrase">パスフレーズ(最新の世代と一致しなければ例外を送出する)</param>
+		/// <param name="workers">ワーカーの数(読み取り用のコネクションの数が上限)</param>
+		/// <param name="chunk_width">1つのチャンクが受け持つ主キーの幅</param>
+		/// <param name="progress">チャンクをコミットするたびに呼び出し元のスレッドで呼び出す関数</param>
+		/// <returns>鍵の更新の結果</returns>
+		RekeyProgress rekey(std::u8string_view passphrase, std::size_t workers, std::int64_t chunk_width = default_rekey_chunk_ids,
+			const std::function<void(const RekeyProgress&)>& progress = {});
+
+		/// <summary>
+		/// テーブルが構築済みでスキーマが最新であるかを判定する
+		/// </summary>
+		/// <remarks>
+		/// trueであれば読み取り専用のコネクションでも構築できる
+		/// </remarks>
+		/// <param name="conn">SQLiteに関する操作の起点となるオブジェクト</param>
+		[[nodiscard]] static bool ready(SQLite& conn);
 
 		/// <summary>
 		/// パスワード情報を挿入する
@@ -156,6 +577,25 @@ namespace pwm {
 		/// <param name="obj">挿入情報</param>
 		void insert(const InsertParam& obj);
 
+		/// <summary>
+		/// 挿入情報が制約を満たすかを検証する
+		/// </summary>
+		/// <param name="obj">挿入情報</param>
+		/// <exception cref="std::invalid_argument">制約を満たさない</exception>
+		static void validate(const InsertParam& obj);
+
+		/// <summary>
+		/// パスワード情報を一括で挿入する
+		/// </summary>
+		/// <remarks>
+		/// chunk_size件ごとにコミットするため、途中で失敗した場合もそれ以前のチャンクは挿入されたままとなる
+		/// </remarks>
+		/// <param name="next">次の挿入情報を返す関数(nulloptを返すと終了する)</param>
+		/// <param name="policy">既存のパスワード情報と重複した場合の動作</param>
+		/// <param name="chunk_size">1つのトランザクションで挿入する件数</param>
+		/// <returns>一括挿入の結果</returns>
+		InsertManyResult insertMany(const std::function<std::optional<InsertParam>()>& next, ConflictPolicy policy, std::size_t chunk_size = default_chunk_size);
+
 		/// <summary>
 		/// パスワード情報を更新する
 		/// </summary>
@@ -163,6 +603,38 @@ namespace pwm {
 		/// <param name="content">更新内容</param>
 		void update(const GetParam& obj, const UpdateParam& content);
 
+		/// <summary>
+		/// 行のバージョンが一致する場合にのみパスワード情報を更新する
+		/// </summary>
+		/// <param name="obj">更新条件</param>
+		/// <param name="content">更新内容</param>
+		/// <param name="expected_version">更新条件に該当する行に期待するバージョン</param>
+		/// <exception cref="version_conflict_error">該当する行が存在しないかバージョンの異なる行が存在する</exception>
+		void update(const GetParam& obj, const UpdateParam& content, std::int64_t expected_version);
+
+		/// <summary>
+		/// 主キーを指定してパスワード情報を更新する
+		/// </summary>
+		/// <param name="id">更新対象の主キー</param>
+		/// <param name="content">更新内容</param>
+		void updateById(std::int64_t id, const UpdateParam& content);
+
+		/// <summary>
+		/// 行のバージョンが一致する場合にのみ主キーを指定してパスワード情報を更新する
+		/// </summary>
+		/// <param name="id">更新対象の主キー</param>
+		/// <param name="content">更新内容</param>
+		/// <param name="expected_version">更新対象に期待するバージョン</param>
+		/// <exception cref="version_conflict_error">該当する行が存在しないかバージョンが異なる</exception>
+		void updateById(std::int64_t id, const UpdateParam& content, std::int64_t expected_version);
+
+		/// <summary>
+		/// 主キーを指定して複数のパスワード情報を1つのトランザクションで更新する
+		/// </summary>
+		/// <param name="ids">更新対象の主キーの一覧</param>
+		/// <param name="content">更新内容</param>
+		void updateById(std::span<const std::int64_t> ids, const UpdateParam& content);
+
 		/// <summary>
 		/// パスワード情報を取得する
 		/// </summary>
@@ -171,10 +643,159 @@ namespace pwm {
 		/// <returns>SQLの実行結果の取得のためのView</returns>
 		[[nodiscard]] SQLiteView get(const GetParam& obj, const std::vector<int>& target_list);
 
+		/// <summary>
+		/// パスワード情報を主キーの範囲で分割して並列に取得する
+		/// </summary>
+		/// <remarks>
+		/// 分割した範囲ごとに読み取り用のコネクションを借りて別々のスレッドで読み取る。
+		/// スナップショットが利用可能であればすべての範囲を同一のスナップショットから読み取る。
+		/// コネクションプールを利用しない場合は分割せずに読み取る。
+		/// </remarks>
+		/// <param name="obj">取得条件</param>
+		/// <param name="target_list">取得対象(passwordsのカラムに関連付けられたインデックス)</param>
+		/// <param name="callback">取得した行ごとに呼び出し元のスレッドで呼び出す関数</param>
+		/// <param name="partitions">分割数(読み取り用のコネクションの数が上限)</param>
+		/// <param name="ordered">trueなら主キーの昇順でcallbackを呼び出す</param>
+		void scan(const GetParam& obj, const std::vector<int>& target_list, const std::function<void(SQLiteRow&)>& callback, std::size_t partitions, bool ordered = true);
+
+		/// <summary>
+		/// パスワード情報を一定の幅の主キーの範囲(チャンク)ごとにワーカーのスレッドで処理する
+		/// </summary>
+		/// <remarks>
+		/// ワーカーごとに読み取り用のコネクションを借り、スナップショットが利用可能であればすべてのチャンクを
+		/// 同一のスナップショットから読み取る。ワーカーは未処理のチャンクを主キーの昇順に取り出して処理し、
+		/// completeは呼び出し元のスレッドでチャンクの番号の順に呼び出す。completeを終えていないチャンクが
+		/// windowに達するとワーカーは待機するため、チャンクごとの結果を保持する領域はwindow個で足りる
+		/// (chunk.index % windowを結果の格納先とすればよい)。
+		/// コネクションプールを利用しない場合は呼び出し元のスレッドで順に処理する。
+		/// </remarks>
+		/// <param name="obj">取得条件</param>
+		/// <param name="target_list">取得対象(passwordsのカラムに関連付けられたインデックス)</param>
+		/// <param name="begin_id">この主キー以降を対象とする(中断した処理の再開に利用する)</param>
+		/// <param name="chunk_width">1つのチャンクが受け持つ主キーの幅</param>
+		/// <param name="workers">ワーカーの数(読み取り用のコネクションの数が上限)</param>
+		/// <param name="window">completeを終えずに処理できるチャンクの数の上限(1以上)</param>
+		/// <param name="process">チャンクとその範囲の行をワーカーのスレッドで受け取る関数</param>
+		/// <param name="complete">処理を終えたチャンクを順に受け取る関数</param>
+		void scanChunks(const GetParam& obj, const std::vector<int>& target_list, std::int64_t begin_id, std::int64_t chunk_width, std::size_t workers, std::size_t window,
+			const std::function<void(const ScanChunk&, SQLiteView&)>& process, const std::function<void(const ScanChunk&)>& complete);
+
+		/// <summary>
+		/// 名称を指定してパスワード情報をまとめて取得する
+		/// </summary>
+		/// <param name="names">名称の一覧</param>
+		/// <param name="target_list">取得対象(passwordsのカラムに関連付けられたインデックス)</param>
+		/// <returns>namesと同じ順序の取得結果(該当するパスワード情報が存在しなければnullopt)</returns>
+		[[nodiscard]] std::vector<std::optional<SQLiteRow>> getByNames(std::span<const std::u8string_view> names, const std::vector<int>& target_list);
+
+		/// <summary>
+		/// 指定したカラムの重複を除いた値を昇順で取得する(NULLは除外する)
+		/// </summary>
+		/// <param name="target">取得対象(passwordsのカラムに関連付けられたインデックス)</param>
+		/// <returns>SQLの実行結果の取得のためのView</returns>
+		[[nodiscard]] SQLiteView distinct(int target);
+
+		/// <summary>
+		/// 指定したカラムの重複を除いた値のうちlower以上の値を昇順で取得する(NULLは除外する)
+		/// </summary>
+		/// <remarks>lowerは結果を読み終えるまで保持する必要がある</remarks>
+		/// <param name="target">取得対象(passwordsのカラムに関連付けられたインデックス)</param>
+		/// <param name="lower">取得する値の下限</param>
+		/// <returns>SQLの実行結果の取得のためのView</returns>
+		[[nodiscard]] SQLiteView distinct(int target, std::u8string_view lower);
+
+		/// <summary>
+		/// 主キーがlast_idより大きい行における指定したカラムの重複を除いた値を昇順で取得する(NULLは除外する)
+		/// </summary>
+		/// <param name="target">取得対象(passwordsのカラムに関連付けられたインデックス)</param>
+		/// <param name="last_id">主キーの下限(範囲に含まない)</param>
+		/// <returns>SQLの実行結果の取得のためのView</returns>
+		[[nodiscard]] SQLiteView distinctInserted(int target, std::int64_t last_id);
+
+		/// <summary>
+		/// 現時点の挿入以外の変更を検出するための目印を取得する
+		/// </summary>
+		[[nodiscard]] InsertionMark insertionMark();
+
+		/// <summary>
+		/// 目印を取得して以降の変更が行の挿入のみであるかを判定する
+		/// </summary>
+		/// <param name="mark">以前に取得した目印</param>
+		/// <returns>既存の行が更新も削除もされていなければtrue</returns>
+		[[nodiscard]] bool insertedOnly(const InsertionMark& mark);
+
 		/// <summary>
 		/// パスワード情報を削除する
 		/// </summary>
 		/// <param name="obj">削除条件</param>
 		void remove(const GetParam& obj);
+
+		/// <summary>
+		/// 主キーを指定してパスワード情報を削除する
+		/// </summary>
+		/// <param name="id">削除対象の主キー</param>
+		void removeById(std::int64_t id);
+
+		/// <summary>
+		/// 主キーを指定して複数のパスワード情報を1つのトランザクションで削除する
+		/// </summary>
+		/// <param name="ids">削除対象の主キーの一覧</param>
+		void removeById(std::span<const std::int64_t> ids);
+
+		/// <summary>
+		/// 他のDBと前回の同期以降の差分のみを双方向に同期する
+		/// </summary>
+		/// <remarks>
+		/// 挿入・更新ではこのクラスのSQLが、削除ではトリガーがDBごとに増加する連番を行と墓標へ付与するため、
+		/// 前回の同期の位置より後の連番を持つ行と墓標のみを読み取り、DBの件数ではなく変更の件数に比例する時間で同期する
+		/// (このクラスを介さずに更新された行は検出できない)。
+		/// 同期先をATTACHして1つの書き込みトランザクションで反映する(WALモードではファイルごとにコミットされるが、
+		/// 同期の位置は双方の記録のうち古い方を用いるため中断しても次回の同期で再び反映される)。
+		/// 双方で変更された行は行のバージョン、更新日時、削除であるか、内容の順に比較して大きい方を採用するため、
+		/// どちらのDBから同期しても同じ結果となる。
+		/// 双方の鍵の情報(vault_keys)が一致すれば暗号化されたパスワードをそのまま受け渡し、異なれば同期元の鍵で復号して
+		/// 反映先の鍵で暗号化し直す(その場合は鍵の情報を持つ側の鍵がそれぞれ必要であり、鍵の情報を持たないDBへは
+		/// 暗号化されたパスワードを反映できない)。
+		/// </remarks>
+		/// <param name="peer_path">同期先のDBへのパス(スキーマが古ければ移行する)</param>
+		/// <param name="unlock_peer">同期先の鍵を設定する関数(unlockを呼び出す)</param>
+		/// <returns>同期の結果</returns>
+		/// <exception cref="std::runtime_error">鍵の情報が異なり、必要な鍵が設定されていない</exception>
+		SyncResult sync(const std::filesystem::path& peer_path, const std::function<void(PasswordManagement&)>& unlock_peer = {});
+
+		/// <summary>
+		/// 主キーの範囲を葉とするマークル木の根のハッシュ値を取得する
+		/// </summary>
+		/// <remarks>
+		/// 主キーをdigest_bucket_rows件ずつの範囲(バケット)に分け、バケットごとの行のSHA-256を葉として
+		/// 16分木で束ねた木をテーブルへ保持する。前回の更新以降に変更の連番が進んだ行と削除された行が属するバケットと
+		/// その祖先のみを計算し直すため、更新の費用は変更の件数に比例する。
+		/// </remarks>
+		/// <returns>根のハッシュ値(SHA-256)</returns>
+		[[nodiscard]] Sha256::digest_type digest();
+
+		/// <summary>
+		/// すべてのバケットのハッシュ値を行から計算し直し、保持しているマークル木と一致しないバケットを取得する
+		/// </summary>
+		/// <remarks>
+		/// 変更の連番を伴わない書き込み(このクラスを介さない改ざんや破損)を検出するため、すべての行を読み取る
+		/// </remarks>
+		/// <returns>一致しないバケットの一覧</returns>
+		[[nodiscard]] std::vector<DigestBucket> verifyDigest();
+
+		/// <summary>
+		/// 他のDBとマークル木を根から比較し、ハッシュ値の異なるバケットの行のみを比較する
+		/// </summary>
+		/// <remarks>
+		/// 主キーの範囲で比較するため、複製したDBどうし(バックアップなど)の比較を想定している
+		/// </remarks>
+		/// <param name="peer_path">比較先のDBへのパス(スキーマが古ければ移行する)</param>
+		/// <returns>比較の結果</returns>
+		[[nodiscard]] DiffResult diff(const std::filesystem::path& peer_path);
+
+		/// <summary>
+		/// マークル木の葉が受け持つ主キーの件数
+		/// </summary>
+		static constexpr std::int64_t digest_bucket_rows = 1024;
 	};
 }
@@ -0,0 +1,213 @@
+﻿#include "RecordCipher.h"
+#include <algorithm>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <cstring>
+#if defined(_MSC_VER)
+#include <windows.h>
+#include <bcrypt.h>
+#pragma comment(lib, "bcrypt.lib")
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+    /// <summary>
+    /// 名称ごとの暗号化方式を構築する関数の登録先
+    /// </summary>
+    struct Registry {
+        std::mutex mutex;
+        std::map<std::u8string, RecordCipherFactory, std::less<>> factories = {
+            { std::u8string(ChaCha20Poly1305Cipher::name), [](const RecordCipher::key_type& key, std::uint32_t generation) {
+                return std::make_unique<ChaCha20Poly1305Cipher>(key, generation);
+            } }
+        };
+    };
+
+    Registry& registry() {
+        static Registry x;
+        return x;
+    }
+
+    /// <summary>
+    /// リトルエンディアンの32ビット整数を書き込む
+    /// </summary>
+    void storeLe32(std::byte* p, std::uint32_t x) noexcept {
+        for (int i = 0; i < 4; ++i) {
+            p[i] = static_cast<std::byte>(x >> (i * 8));
+        }
+    }
+
+    /// <summary>
+    /// 方式の名称と暗号文の先頭(鍵の世代)を連結した追加データを構築する
+    /// </summary>
+    std::vector<std::byte> makeAad(std::u8string_view method, std::span<const std::byte> header) {
+        std::vector<std::byte> aad(method.size() + header.size());
+        std::memcpy(aad.data(), method.data(), method.size());
+        std::memcpy(aad.data() + method.size(), header.data(), header.size());
+        return aad;
+    }
+}
+
+std::uint32_t RecordCipher::generation(std::span<const unsigned char> ciphertext) {
+    if (ciphertext.size() < header_size) {
+        throw std::runtime_error("暗号文が短すぎます");
+    }
+    return std::uint32_t(ciphertext[0]) | (std::uint32_t(ciphertext[1]) << 8) | (std::uint32_t(ciphertext[2]) << 16) | (std::uint32_t(ciphertext[3]) << 24);
+}
+
+void registerRecordCipher(std::u8string_view method, RecordCipherFactory factory) {
+    auto& x = registry();
+    std::lock_guard lock(x.mutex);
+    x.factories.insert_or_assign(std::u8string(method), std::move(factory));
+}
+
+std::unique_ptr<RecordCipher> makeRecordCipher(std::u8string_view method, const RecordCipher::key_type& key, std::uint32_t generation) {
+    auto& x = registry();
+    std::lock_guard lock(x.mutex);
+    auto it = x.factories.find(method);
+    if (it == x.factories.end()) {
+        throw std::invalid_argument("暗号化方式 " + std::string(method.begin(), method.end()) + " は登録されていません");
+    }
+    return it->second(key, generation);
+}
+
+void secureRandom(std::span<std::byte> out) {
+#if defined(_MSC_VER)
+    if (!BCRYPT_SUCCESS(BCryptGenRandom(nullptr, reinterpret_cast<PUCHAR>(out.data()), static_cast<ULONG>(out.size()), BCRYPT_USE_SYSTEM_PREFERRED_RNG))) {
+        throw std::runtime_error("乱数の取得に失敗");
+    }
+#else
+    // getentropyは1度に256バイトまでしか取得できない
+    while (!out.empty()) {
+        auto n = std::min<std::size_t>(out.size(), 256);
+        if (::getentropy(out.data(), n) != 0) {
+            throw std::runtime_error("乱数の取得に失敗");
+        }
+        out = out.subspan(n);
+    }
+#endif
+}
+
+ChaCha20Poly1305Cipher::ChaCha20Poly1305Cipher(const key_type& key, std::uint32_t generation) : _aead(key), _generation(generation) {
+    std::array<std::byte, 12> seed;
+    secureRandom(seed);
+    std::uint64_t counter = 0;
+    std::memcpy(&this->_nonce_prefix, seed.data(), 4);
+    std::memcpy(&counter, seed.data() + 4, 8);
+    this->_nonce_counter = counter;
+}
+
+std::vector<unsigned char> ChaCha20Poly1305Cipher::encrypt(std::span<const unsigned char> plaintext) {
+    constexpr auto nonce_size = std::tuple_size_v<ChaCha20Poly1305::nonce_type>;
+    constexpr auto tag_size = std::tuple_size_v<ChaCha20Poly1305::tag_type>;
+    std::vector<unsigned char> result(plaintext.size() + overhead);
+    auto out = std::as_writable_bytes(std::span(result));
+
+    // 鍵の世代とnonceを先頭に書き込む
+    storeLe32(out.data(), this->_generation);
+    ChaCha20Poly1305::nonce_type nonce;
+    auto counter = this->_nonce_counter.fetch_add(1, std::memory_order_relaxed);
+    storeLe32(nonce.data(), this->_nonce_prefix);
+    storeLe32(nonce.data() + 4, static_cast<std::uint32_t>(counter));
+    storeLe32(nonce.data() + 8, static_cast<std::uint32_t>(counter >> 32));
+    std::ranges::copy(nonce, out.begin() + header_size);
+
+    auto aad = makeAad(name, out.first(header_size));
+    ChaCha20Poly1305::tag_type tag;
+    this->_aead.seal(nonce, aad, std::as_bytes(plaintext), out.subspan(header_size + nonce_size, plaintext.size()), tag);
+    std::ranges::copy(tag, out.end() - tag_size);
+    return result;
+}
+
+std::vector<unsigned char> ChaCha20Poly1305Cipher::decrypt(std::span<const unsigned char> ciphertext) const {
+    constexpr auto nonce_size = std::tuple_size_v<ChaCha20Poly1305::nonce_type>;
+    constexpr auto tag_size = std::tuple_size_v<ChaCha20Poly1305::tag_type>;
+    if (ciphertext.size() < overhead) {
+        throw std::runtime_error("暗号文が短すぎます");
+    }
+    auto in = std::as_bytes(ciphertext);
+    ChaCha20Poly1305::nonce_type nonce;
+    ChaCha20Poly1305::tag_type tag;
+    std::copy_n(in.begin() + header_size, nonce_size, nonce.begin());
+    std::copy_n(in.end() - tag_size, tag_size, tag.begin());
+
+    std::vector<unsigned char> result(ciphertext.size() - overhead);
+    auto aad = makeAad(name, in.first(header_size));
+    if (!this->_aead.open(nonce, aad, in.subspan(header_size + nonce_size, result.size()), tag, std::as_writable_bytes(std::span(result)))) {
+        throw std::runtime_error("暗号文の認証に失敗しました(鍵が異なるか改ざんされています)");
+    }
+    return result;
+}
+
+void RecordKeyring::add(std::uint32_t generation, std::unique_ptr<RecordCipher> cipher, bool current) {
+    auto& slot = this->_ciphers[generation];
+    if (slot.get() == this->_current) {
+        this->_current = nullptr;
+    }
+    slot = std::move(cipher);
+    if (current) {
+        this->_current = slot.get();
+    }
+}
+
+void RecordKeyring::load() {
+    if (!this->_pending.load(std::memory_order_acquire)) {
+        return;
+    }
+    std::lock_guard lock(this->_mutex);
+    if (this->_pending.load(std::memory_order_relaxed)) {
+        // 鍵の導出は高価なため失敗した場合も再試行せず、同じ例外を送出し続ける
+        auto loader = std::move(this->_loader);
+        this->_loader = nullptr;
+        try {
+            loader(*this);
+        }
+        catch (...) {
+            this->_ciphers.clear();
+            this->_current = nullptr;
+            this->_error = std::current_exception();
+        }
+        this->_pending.store(false, std::memory_order_release);
+    }
+}
+
+void RecordKeyring::defer(Loader loader) {
+    this->clear();
+    this->_loader = std::move(loader);
+    this->_pending.store(true, std::memory_order_release);
+}
+
+void RecordKeyring::clear() {
+    this->_ciphers.clear();
+    this->_current = nullptr;
+    this->_loader = nullptr;
+    this->_error = nullptr;
+    this->_pending.store(false, std::memory_order_release);
+}
+
+RecordCipher* RecordKeyring::current() {
+    this->load();
+    if (this->_error) {
+        std::rethrow_exception(this->_error);
+    }
+    return this->_current;
+}
+
+std::vector<unsigned char> RecordKeyring::decrypt(std::u8string_view method, std::span<const unsigned char> ciphertext) {
+    this->load();
+    if (this->_error) {
+        std::rethrow_exception(this->_error);
+    }
+    auto generation = RecordCipher::generation(ciphertext);
+    auto it = this->_ciphers.find(generation);
+    if (it == this->_ciphers.end()) {
+        throw std::runtime_error("暗号化された鍵の世代 " + std::to_string(generation) + " の鍵が設定されていません");
+    }
+    if (it->second->method() != method) {
+        throw std::runtime_error("暗号化方式が鍵の世代の方式と一致しません");
+    }
+    return it->second->decrypt(ciphertext);
+}
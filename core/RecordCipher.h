@@ -0,0 +1,219 @@
+﻿#pragma once
+
+#include "ChaCha20Poly1305.h"
+#include <array>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string_view>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+/// <summary>
+/// パスワードを1件ずつ認証付きで暗号化する方式の抽象クラス
+/// </summary>
+/// <remarks>
+/// 暗号文は先頭に鍵の世代(4バイトのリトルエンディアン)を持ち、以降の構造は方式ごとに定める
+/// </remarks>
+class RecordCipher {
+public:
+	/// <summary>
+	/// 鍵の型
+	/// </summary>
+	using key_type = std::array<std::byte, 32>;
+
+	/// <summary>
+	/// 暗号文の先頭の鍵の世代のバイト数
+	/// </summary>
+	static constexpr std::size_t header_size = 4;
+
+	virtual ~RecordCipher() = default;
+
+	/// <summary>
+	/// 暗号化方式の名称(encryptionカラムの値)
+	/// </summary>
+	[[nodiscard]] virtual std::u8string_view method() const noexcept = 0;
+
+	/// <summary>
+	/// 暗号化する
+	/// </summary>
+	/// <remarks>
+	/// 複数のスレッドから同時に呼び出してもよい
+	/// </remarks>
+	/// <param name="plaintext">平文</param>
+	/// <returns>暗号文</returns>
+	[[nodiscard]] virtual std::vector<unsigned char> encrypt(std::span<const unsigned char> plaintext) = 0;
+
+	/// <summary>
+	/// 認証して復号する(改ざんされていれば例外を送出する)
+	/// </summary>
+	/// <param name="ciphertext">暗号文</param>
+	/// <returns>平文</returns>
+	[[nodiscard]] virtual std::vector<unsigned char> decrypt(std::span<const unsigned char> ciphertext) const = 0;
+
+	/// <summary>
+	/// 暗号文の先頭から鍵の世代を読み取る(短すぎれば例外を送出する)
+	/// </summary>
+	[[nodiscard]] static std::uint32_t generation(std::span<const unsigned char> ciphertext);
+};
+
+/// <summary>
+/// ChaCha20-Poly1305による暗号化方式
+/// </summary>
+/// <remarks>
+/// 暗号文は[鍵の世代 4バイト][nonce 12バイト][暗号文][認証タグ 16バイト]とし、方式の名称と鍵の世代を追加データとして認証する。
+/// nonceはインスタンスごとに乱数で初期化した96ビットの値を暗号化のたびに進めて用いる
+/// </remarks>
+class ChaCha20Poly1305Cipher : public RecordCipher {
+	ChaCha20Poly1305 _aead;
+	std::uint32_t _generation;
+	/// <summary>
+	/// nonceの上位32ビット(インスタンスごとの乱数)
+	/// </summary>
+	std::uint32_t _nonce_prefix = 0;
+	/// <summary>
+	/// nonceの下位64ビット(乱数で初期化して暗号化のたびに進める)
+	/// </summary>
+	std::atomic<std::uint64_t> _nonce_counter = 0;
+
+public:
+	/// <summary>
+	/// 暗号化方式の名称
+	/// </summary>
+	static constexpr std::u8string_view name = u8"ChaCha20-Poly1305";
+
+	/// <summary>
+	/// 平文に対して増加するバイト数
+	/// </summary>
+	static constexpr std::size_t overhead = header_size + std::tuple_size_v<ChaCha20Poly1305::nonce_type> + std::tuple_size_v<ChaCha20Poly1305::tag_type>;
+
+	ChaCha20Poly1305Cipher() = delete;
+	/// <summary>
+	/// 鍵と鍵の世代を指定して構築する
+	/// </summary>
+	ChaCha20Poly1305Cipher(const key_type& key, std::uint32_t generation);
+
+	[[nodiscard]] std::u8string_view method() const noexcept override { return name; }
+	[[nodiscard]] std::vector<unsigned char> encrypt(std::span<const unsigned char> plaintext) override;
+	[[nodiscard]] std::vector<unsigned char> decrypt(std::span<const unsigned char> ciphertext) const override;
+};
+
+/// <summary>
+/// 鍵と鍵の世代から暗号化方式を構築する関数
+/// </summary>
+using RecordCipherFactory = std::function<std::unique_ptr<RecordCipher>(const RecordCipher::key_type&, std::uint32_t)>;
+
+/// <summary>
+/// 暗号化方式を名称に対して登録する(同じ名称があれば置き換える)
+/// </summary>
+/// <param name="method">暗号化方式の名称(encryptionカラムの値)</param>
+/// <param name="factory">暗号化方式を構築する関数</param>
+void registerRecordCipher(std::u8string_view method, RecordCipherFactory factory);
+
+/// <summary>
+/// 名称に対して登録された暗号化方式を構築する(ChaCha20-Poly1305は登録済み)
+/// </summary>
+/// <param name="method">暗号化方式の名称(encryptionカラムの値)</param>
+/// <param name="key">鍵</param>
+/// <param name="generation">鍵の世代</param>
+/// <returns>暗号化方式(登録されていなければ例外を送出する)</returns>
+[[nodiscard]] std::unique_ptr<RecordCipher> makeRecordCipher(std::u8string_view method, const RecordCipher::key_type& key, std::uint32_t generation);
+
+/// <summary>
+/// OSの暗号論的に安全な乱数で埋める
+/// </summary>
+/// <param name="out">書き込み先</param>
+void secureRandom(std::span<std::byte> out);
+
+/// <summary>
+/// 鍵の世代ごとの暗号化方式を保持し、暗号文の世代と方式に応じて復号するクラス
+/// </summary>
+/// <remarks>
+/// 鍵の追加と遅延の設定は暗号化と復号を行うスレッドが存在しない間に行う必要がある。
+/// 鍵の導出を遅延した場合は、最初に暗号化あるいは復号するときに1度だけ導出する(複数のスレッドから同時に呼び出してもよい)
+/// </remarks>
+class RecordKeyring {
+	/// <summary>
+	/// 鍵を追加する関数
+	/// </summary>
+	using Loader = std::function<void(RecordKeyring&)>;
+
+	/// <summary>
+	/// 鍵の世代ごとの暗号化方式
+	/// </summary>
+	std::map<std::uint32_t, std::unique_ptr<RecordCipher>> _ciphers;
+	/// <summary>
+	/// 暗号化に用いる鍵の世代(鍵が無ければnullptr)
+	/// </summary>
+	RecordCipher* _current = nullptr;
+	/// <summary>
+	/// 遅延した鍵の導出を行う関数(導出を終えれば空)
+	/// </summary>
+	Loader _loader;
+	/// <summary>
+	/// 遅延した鍵の導出で送出された例外(以降の呼び出しでも同じ例外を送出する)
+	/// </summary>
+	std::exception_ptr _error;
+	/// <summary>
+	/// 遅延した鍵の導出を終えていなければtrue
+	/// </summary>
+	std::atomic<bool> _pending = false;
+	/// <summary>
+	/// 遅延した鍵の導出を1度だけ行うための排他制御
+	/// </summary>
+	std::mutex _mutex;
+
+	/// <summary>
+	/// 遅延した鍵の導出を終えていなければ導出する
+	/// </summary>
+	void load();
+
+public:
+	/// <summary>
+	/// 鍵の世代の暗号化方式を追加する
+	/// </summary>
+	/// <param name="generation">鍵の世代</param>
+	/// <param name="cipher">暗号化方式</param>
+	/// <param name="current">trueなら以降の暗号化に用いる</param>
+	void add(std::uint32_t generation, std::unique_ptr<RecordCipher> cipher, bool current);
+
+	/// <summary>
+	/// 保持している鍵を破棄し、鍵の追加を最初に暗号化あるいは復号するときまで遅延する
+	/// </summary>
+	/// <param name="loader">鍵を追加する関数(例外を送出すると以降の暗号化と復号も同じ例外を送出する)</param>
+	void defer(Loader loader);
+
+	/// <summary>
+	/// 保持している鍵と遅延した鍵の導出を破棄する
+	/// </summary>
+	void clear();
+
+	/// <summary>
+	/// 暗号化に用いる鍵が存在しない(暗号化せずに格納する)ならtrue
+	/// </summary>
+	/// <remarks>
+	/// 鍵の導出を遅延している間は導出せずにfalseを返す
+	/// </remarks>
+	[[nodiscard]] bool empty() const noexcept { return !this->_pending.load(std::memory_order_acquire) && this->_current == nullptr; }
+
+	/// <summary>
+	/// 暗号化に用いる方式(鍵が存在しなければnullptr)
+	/// </summary>
+	/// <remarks>
+	/// 鍵の導出を遅延していれば導出する
+	/// </remarks>
+	[[nodiscard]] RecordCipher* current();
+
+	/// <summary>
+	/// 暗号化方式の名称と暗号文から復号する
+	/// </summary>
+	/// <param name="method">暗号化方式の名称(encryptionカラムの値)</param>
+	/// <param name="ciphertext">暗号文</param>
+	/// <returns>平文(鍵が存在しないか方式が一致しなければ例外を送出する)</returns>
+	[[nodiscard]] std::vector<unsigned char> decrypt(std::u8string_view method, std::span<const unsigned char> ciphertext);
+};
@@ -0,0 +1,220 @@
+﻿#include "RecordWriter.h"
+#include "Utf8.h"
+#include <bit>
+#include <charconv>
+#include <stdexcept>
+
+namespace {
+
+    /// <summary>
+    /// 符号なし整数をLEB128の可変長整数として符号化する
+    /// </summary>
+    /// <param name="p">書き込み先(10バイト以上)</param>
+    /// <param name="x">符号化する値</param>
+    /// <returns>書き込んだバイト数</returns>
+    std::size_t encodeVarint(char8_t* p, std::uint64_t x) noexcept {
+        std::size_t n = 0;
+        while (x >= 0x80) {
+            p[n++] = static_cast<char8_t>(x | 0x80);
+            x >>= 7;
+        }
+        p[n++] = static_cast<char8_t>(x);
+        return n;
+    }
+
+    void appendVarint(std::u8string& out, std::uint64_t x) {
+        char8_t buf[10];
+        out.append(buf, encodeVarint(buf, x));
+    }
+
+    void writeVarint(BufferedWriter& out, std::uint64_t x) {
+        char8_t buf[10];
+        out.write(std::u8string_view(buf, encodeVarint(buf, x)));
+    }
+
+    /// <summary>
+    /// 必要であれば引用符で囲んでCSVのフィールドを書き込む
+    /// </summary>
+    void writeCsvField(BufferedWriter& out, std::u8string_view x) {
+        if (x.find_first_of(u8",\"\r\n") == std::u8string_view::npos) {
+            out.write(x);
+            return;
+        }
+        // 引用符で囲み、内部の"は""とする
+        out.put(u8'"');
+        for (auto pos = x.find(u8'"'); pos != std::u8string_view::npos; pos = x.find(u8'"')) {
+            out.write(x.substr(0, pos + 1));
+            out.put(u8'"');
+            x.remove_prefix(pos + 1);
+        }
+        out.write(x);
+        out.put(u8'"');
+    }
+
+    /// <summary>
+    /// エスケープしてJSONの文字列を書き込む
+    /// </summary>
+    void writeJsonString(BufferedWriter& out, std::u8string_view x) {
+        out.put(u8'"');
+        std::size_t run = 0;
+        for (std::size_t i = 0; i < x.size(); ++i) {
+            char8_t c = x[i];
+            if (c >= 0x20 && c != u8'"' && c != u8'\\') {
+                continue;
+            }
+            // エスケープの不要な区間はまとめて書き込む
+            out.write(x.substr(run, i - run));
+            run = i + 1;
+            switch (c) {
+            case u8'"': out.write(u8"\\\""); break;
+            case u8'\\': out.write(u8"\\\\"); break;
+            case u8'\b': out.write(u8"\\b"); break;
+            case u8'\f': out.write(u8"\\f"); break;
+            case u8'\n': out.write(u8"\\n"); break;
+            case u8'\r': out.write(u8"\\r"); break;
+            case u8'\t': out.write(u8"\\t"); break;
+            default:
+            {
+                constexpr char8_t hex[] = u8"0123456789abcdef";
+                const char8_t escaped[] = { u8'\\', u8'u', u8'0', u8'0', hex[c >> 4], hex[c & 0xF] };
+                out.write(std::u8string_view(escaped, 6));
+                break;
+            }
+            }
+        }
+        out.write(x.substr(run));
+        out.put(u8'"');
+    }
+}
+
+pwm::RecordWriter::RecordWriter(BufferedWriter& out, RecordFormat format, std::vector<std::u8string> names) : _out(out), _format(format), _names(std::move(names)) {
+    if (this->_names.empty()) {
+        throw std::invalid_argument("列を1つ以上指定する必要があります");
+    }
+}
+
+void pwm::RecordWriter::header() {
+    switch (this->_format) {
+    case RecordFormat::csv:
+        for (std::size_t i = 0; i < this->_names.size(); ++i) {
+            if (i > 0) {
+                this->_out.put(u8',');
+            }
+            writeCsvField(this->_out, this->_names[i]);
+        }
+        this->_out.write(u8"\r\n");
+        break;
+    case RecordFormat::jsonl:
+        break;
+    case RecordFormat::binary:
+        this->_out.write(binary_magic);
+        this->_out.put(static_cast<char8_t>(binary_version));
+        writeVarint(this->_out, this->_names.size());
+        for (const auto& name : this->_names) {
+            writeVarint(this->_out, name.size());
+            this->_out.write(name);
+        }
+        break;
+    }
+}
+
+void pwm::RecordWriter::beginRow() {
+    this->_col = 0;
+    this->_row.clear();
+}
+
+void pwm::RecordWriter::field() {
+    if (this->_col >= this->_names.size()) {
+        throw std::logic_error("列数を超えて値を書き込むことはできません");
+    }
+    switch (this->_format) {
+    case RecordFormat::csv:
+        if (this->_col > 0) {
+            this->_out.put(u8',');
+        }
+        break;
+    case RecordFormat::jsonl:
+        this->_out.put(this->_col == 0 ? u8'{' : u8',');
+        writeJsonString(this->_out, this->_names[this->_col]);
+        this->_out.put(u8':');
+        break;
+    case RecordFormat::binary:
+        break;
+    }
+    ++this->_col;
+}
+
+void pwm::RecordWriter::null() {
+    this->field();
+    switch (this->_format) {
+    case RecordFormat::csv: break;
+    case RecordFormat::jsonl: this->_out.write(u8"null"); break;
+    case RecordFormat::binary: this->_row.push_back(0); break;
+    }
+}
+
+void pwm::RecordWriter::text(std::u8string_view x) {
+    this->field();
+    switch (this->_format) {
+    case RecordFormat::csv: writeCsvField(this->_out, x); break;
+    case RecordFormat::jsonl: writeJsonString(this->_out, x); break;
+    case RecordFormat::binary:
+        this->_row.push_back(2);
+        appendVarint(this->_row, x.size());
+        this->_row.append(x);
+        break;
+    }
+}
+
+void pwm::RecordWriter::blob(std::span<const unsigned char> x) {
+    std::u8string_view s(std::bit_cast<const char8_t*>(x.data()), x.size());
+    if (this->_format == RecordFormat::jsonl && !validUtf8(s)) {
+        throw std::runtime_error("UTF-8として不正なバイト列はJSONの文字列として出力できません");
+    }
+    this->field();
+    switch (this->_format) {
+    case RecordFormat::csv: writeCsvField(this->_out, s); break;
+    case RecordFormat::jsonl: writeJsonString(this->_out, s); break;
+    case RecordFormat::binary:
+        this->_row.push_back(3);
+        appendVarint(this->_row, s.size());
+        this->_row.append(s);
+        break;
+    }
+}
+
+void pwm::RecordWriter::integer(std::int64_t x) {
+    this->field();
+    if (this->_format == RecordFormat::binary) {
+        this->_row.push_back(1);
+        appendVarint(this->_row, (static_cast<std::uint64_t>(x) << 1) ^ static_cast<std::uint64_t>(x >> 63));
+        return;
+    }
+    char buf[20];
+    auto [end, ec] = std::to_chars(buf, buf + sizeof(buf), x);
+    this->_out.write(std::u8string_view(std::bit_cast<const char8_t*>(&buf[0]), static_cast<std::size_t>(end - buf)));
+}
+
+void pwm::RecordWriter::endRow() {
+    if (this->_col != this->_names.size()) {
+        throw std::logic_error("すべての列の値を書き込む必要があります");
+    }
+    switch (this->_format) {
+    case RecordFormat::csv:
+        this->_out.write(u8"\r\n");
+        break;
+    case RecordFormat::jsonl:
+        this->_out.write(u8"}\n");
+        break;
+    case RecordFormat::binary:
+        writeVarint(this->_out, this->_row.size());
+        this->_out.write(this->_row);
+        break;
+    }
+}
+
+void pwm::RecordWriter::footer() {
+    if (this->_format == RecordFormat::binary) {
+        this->_out.put(0);
+    }
+}
@@ -0,0 +1,122 @@
+﻿#pragma once
+
+#include "OutputSink.h"
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+namespace pwm {
+
+	/// <summary>
+	/// 書き出す形式の列挙
+	/// </summary>
+	enum class RecordFormat {
+		/// <summary>
+		/// 1行目を列名のヘッダとするRFC 4180形式のCSV
+		/// </summary>
+		csv,
+		/// <summary>
+		/// 1行に1つのオブジェクトを記述したJSON Lines
+		/// </summary>
+		jsonl,
+		/// <summary>
+		/// 長さを前置した独自のバイナリ形式
+		/// </summary>
+		binary
+	};
+
+	/// <summary>
+	/// レコードを1件ずつ指定の形式でバッファへ書き込むクラス
+	/// </summary>
+	/// <remarks>
+	/// 各レコードはbeginRowの後に列の順に値を書き込み、endRowで終える。
+	/// バイナリ形式は以下のとおりであり、整数はLEB128の可変長整数(符号付き整数はzigzag符号化)とする。
+	///   ファイル   : "PWMX" バージョン(1バイト) 列数 {列名のバイト数 列名}* レコード* 0
+	///   レコード   : 本体のバイト数(1以上) 本体
+	///   本体       : 列ごとに 型(1バイト) 値
+	///   型と値     : 0=NULL(値なし), 1=整数(zigzag), 2=文字列(バイト数 バイト列), 3=BLOB(バイト数 バイト列)
+	/// </remarks>
+	class RecordWriter {
+		BufferedWriter& _out;
+		RecordFormat _format;
+		/// <summary>
+		/// 列名の一覧
+		/// </summary>
+		std::vector<std::u8string> _names;
+		/// <summary>
+		/// 現在のレコードにおいて次に書き込む列
+		/// </summary>
+		std::size_t _col = 0;
+		/// <summary>
+		/// バイナリ形式で長さを前置するためのレコードの本体
+		/// </summary>
+		std::u8string _row;
+
+		/// <summary>
+		/// 列の区切りやJSONのメンバ名を書き込む
+		/// </summary>
+		void field();
+
+	public:
+		/// <summary>
+		/// バイナリ形式の先頭のマジックナンバー
+		/// </summary>
+		static constexpr std::u8string_view binary_magic = u8"PWMX";
+		/// <summary>
+		/// バイナリ形式のバージョン
+		/// </summary>
+		static constexpr std::uint8_t binary_version = 1;
+
+		RecordWriter() = delete;
+		/// <summary>
+		/// 書き込み先と形式を指定して構築する
+		/// </summary>
+		/// <param name="out">書き込み先</param>
+		/// <param name="format">書き出す形式</param>
+		/// <param name="names">列名の一覧(1つ以上)</param>
+		RecordWriter(BufferedWriter& out, RecordFormat format, std::vector<std::u8string> names);
+
+		/// <summary>
+		/// CSVのヘッダあるいはバイナリ形式の先頭を書き込む
+		/// </summary>
+		void header();
+
+		/// <summary>
+		/// レコードを開始する
+		/// </summary>
+		void beginRow();
+
+		/// <summary>
+		/// NULLを書き込む(CSVでは空のフィールドとする)
+		/// </summary>
+		void null();
+
+		/// <summary>
+		/// 文字列を書き込む
+		/// </summary>
+		void text(std::u8string_view x);
+
+		/// <summary>
+		/// BLOBを書き込む(CSVとJSONではUTF-8の文字列として書き込む)
+		/// </summary>
+		/// <exception cref="std::runtime_error">JSONでUTF-8として不正なバイト列を書き込もうとした</exception>
+		void blob(std::span<const unsigned char> x);
+
+		/// <summary>
+		/// 整数を書き込む
+		/// </summary>
+		void integer(std::int64_t x);
+
+		/// <summary>
+		/// レコードを終える
+		/// </summary>
+		void endRow();
+
+		/// <summary>
+		/// バイナリ形式の終端を書き込む
+		/// </summary>
+		void footer();
+	};
+}
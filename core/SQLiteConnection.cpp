@@ -1,8 +1,132 @@
 ﻿#include "SQLiteConnection.h"
+#include "PageCipherVfs.h"
 #include "SQLiteStmt.h"
+#include "SQLiteView.h"
+#include <algorithm>
 #include <bit>
+#include <optional>
 #include <iostream>
 #include <stdexcept>
+#include <random>
+#include <thread>
+
+namespace {
+    /// <summary>
+    /// SQLITE_BUSYとなったときに呼び出されるハンドラ
+    /// </summary>
+    /// <param name="p">SQLiteConnection</param>
+    /// <param name="count">同一のロック待ちにおいて既に呼び出された回数</param>
+    /// <returns>0ならSQLITE_BUSYを返し、それ以外なら再試行する</returns>
+    int busyHandler(void* p, int count) {
+        auto& conn = *static_cast<SQLiteConnection*>(p);
+        const auto& config = conn.busy_config;
+        auto now = std::chrono::steady_clock::now();
+        if (count == 0) {
+            conn.busy_begin = now;
+        }
+
+        // 待機時間を倍々に増加させる(オーバーフローしないよう指数を制限する)
+        auto delay = std::min(config.initial_delay * (std::int64_t(1) << std::min(count, 20)), config.max_delay);
+        // 同時に待機している他のプロセスと再試行の時機が揃わないよう[delay/2, delay]の範囲でジッタを加える
+        thread_local std::minstd_rand engine(std::random_device{}());
+        auto half = std::chrono::duration_cast<std::chrono::microseconds>(delay) / 2;
+        auto jittered = half + std::chrono::microseconds(std::uniform_int_distribution<std::int64_t>(0, half.count())(engine));
+
+        if (now - conn.busy_begin + jittered > config.timeout) {
+            // 待機時間の合計が上限を超えるときは再試行を諦める
+            conn.busy_counter.give_ups.fetch_add(1, std::memory_order_relaxed);
+            SQLiteConnection::total_busy_counter.give_ups.fetch_add(1, std::memory_order_relaxed);
+            return 0;
+        }
+
+        std::this_thread::sleep_for(jittered);
+        auto waited = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - now).count());
+        conn.busy_counter.retries.fetch_add(1, std::memory_order_relaxed);
+        conn.busy_counter.wait_us.fetch_add(waited, std::memory_order_relaxed);
+        SQLiteConnection::total_busy_counter.retries.fetch_add(1, std::memory_order_relaxed);
+        SQLiteConnection::total_busy_counter.wait_us.fetch_add(waited, std::memory_order_relaxed);
+        return 1;
+    }
+}
+
+namespace {
+    /// <summary>
+    /// 暗号化したDBを復号できないときのエラーメッセージ
+    /// </summary>
+    constexpr const char* page_cipher_error = "DBを復号できません(パスフレーズが誤っているか改ざんされています)";
+
+    /// <summary>
+    /// オプションを指定するためのURIを構築する
+    /// </summary>
+    /// <param name="path">データベースへのパス</param>
+    /// <param name="options">コネクションを確立する際のオプション</param>
+    /// <param name="cipher">ページの暗号化に用いる鍵</param>
+    /// <returns>URI(オプションの指定が不要であれば空)</returns>
+    std::u8string getUri(const std::filesystem::path& path, const SQLiteOpenOptions& options, const SQLitePageCipher* cipher) {
+        if (!options.immutable && cipher == nullptr) {
+            return u8"";
+        }
+        std::u8string uri = u8"file:";
+        auto str = path.generic_u8string();
+        if (path.has_root_name()) {
+            // Windowsのドライブレターはfile:/C:/...とする
+            uri += u8'/';
+        }
+        for (char8_t c : str) {
+            // URIとして意味を持つ文字はエスケープする
+            if (c == u8'%' || c == u8'?' || c == u8'#') {
+                uri += std::bit_cast<const char8_t*>(std::format("%{0:02X}", static_cast<unsigned>(c)).c_str());
+            }
+            else {
+                uri += c;
+            }
+        }
+        std::u8string params;
+        if (options.immutable) {
+            params += u8"&immutable=1";
+        }
+        if (cipher != nullptr) {
+            // VFSが開くファイルから鍵を参照するための識別子の埋め込み
+            params += std::bit_cast<const char8_t*>(std::format("&pwm_cipher={0}", cipher->id()).c_str());
+        }
+        params[0] = u8'?';
+        uri += params;
+        return uri;
+    }
+}
+
+namespace {
+    /// <summary>
+    /// SQLから呼び出された関数を実行する
+    /// </summary>
+    void callFunction(sqlite3_context* ctx, int argc, sqlite3_value** argv) noexcept {
+        auto& func = *static_cast<std::shared_ptr<const SQLiteFunction>*>(sqlite3_user_data(ctx));
+        try {
+            (*func)(ctx, std::span<sqlite3_value*>(argv, static_cast<std::size_t>(argc)));
+        }
+        catch (const std::bad_alloc&) {
+            sqlite3_result_error_nomem(ctx);
+        }
+        catch (const std::exception& e) {
+            sqlite3_result_error(ctx, e.what(), -1);
+        }
+    }
+
+    /// <summary>
+    /// 登録した関数をSQLiteが破棄する
+    /// </summary>
+    void destroyFunction(void* p) noexcept {
+        delete static_cast<std::shared_ptr<const SQLiteFunction>*>(p);
+    }
+}
+
+SQLiteBusyStats SQLiteBusyCounter::load() const noexcept {
+    return {
+        .retries = this->retries.load(std::memory_order_relaxed),
+        .wait_time = std::chrono::microseconds(this->wait_us.load(std::memory_order_relaxed)),
+        .give_ups = this->give_ups.load(std::memory_order_relaxed)
+    };
+}
 
 SQLiteConnection::~SQLiteConnection() {
     try {
@@ -13,31 +137,124 @@ SQLiteConnection::~SQLiteConnection() {
     }
 }
 
-void SQLiteConnection::connect(const std::filesystem::path& path) {
+void SQLiteConnection::connect(const std::filesystem::path& path, const SQLiteOpenOptions& options) {
     this->disconnect();
 
-    if (sqlite3_open(
+    // 不変なファイルは読み取り専用でのみ開ける
+    int flags = options.read_only || options.immutable ? SQLITE_OPEN_READONLY : SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+    if (options.no_mutex) {
+        flags |= SQLITE_OPEN_NOMUTEX;
+    }
+    this->page_cipher = options.page_cipher;
+    if (!this->page_cipher && SQLiteConnection::default_page_cipher_provider) {
+        this->page_cipher = SQLiteConnection::default_page_cipher_provider(path);
+    }
+    const char* vfs = nullptr;
+    if (this->page_cipher) {
+        registerPageCipher(this->page_cipher);
+        vfs = registerPageCipherVfs();
+    }
+    // 暗号化したDBを新たに作成するかは開く前に判定する
+    std::error_code ec;
+    bool create = this->page_cipher && !options.read_only && !options.immutable
+        && (!std::filesystem::exists(path, ec) || std::filesystem::file_size(path, ec) == 0);
+    auto uri = getUri(path, options, this->page_cipher.get());
+    if (!uri.empty() || SQLiteConnection::default_page_cipher_provider) {
+        // 暗号化したDBをATTACHする際にもURIを解釈させる必要がある
+        flags |= SQLITE_OPEN_URI;
+    }
+    if (sqlite3_open_v2(
         // パスはUTF8である必要がある
-        reinterpret_cast<const char*>(path.u8string().data()),
-        &this->conn
+        reinterpret_cast<const char*>(uri.empty() ? path.u8string().data() : uri.data()),
+        &this->conn,
+        flags,
+        vfs
     ) != SQLITE_OK) {
+        // 開く際に読み取る先頭ページの認証に失敗したかを切断する前に取得する
+        bool unreadable = this->conn != nullptr && sqlite3_extended_errcode(this->conn) == SQLITE_IOERR_DATA;
         this->disconnect();
-        throw std::runtime_error("SQLiteとの接続の確立に失敗");
+        throw std::runtime_error(unreadable ? page_cipher_error : "SQLiteとの接続の確立に失敗");
+    }
+    // 他のプロセスがロックを保持しているときに即座に失敗せず再試行する
+    sqlite3_busy_handler(this->conn, busyHandler, this);
+
+    if (this->page_cipher) {
+        // 一時ファイルとロールバックジャーナルは暗号化されないため、メモリ上に置きWALモードとする
+        int rc = sqlite3_exec(this->conn, "PRAGMA temp_store=MEMORY", nullptr, nullptr, nullptr);
+        if (rc == SQLITE_OK && create) {
+            // ページの末尾にnonceと認証タグの領域を確保する(最初の書き込みより前に設定する必要がある)
+            int reserve = static_cast<int>(SQLitePageCipher::reserve_size);
+            rc = sqlite3_exec(this->conn, std::format("PRAGMA page_size={0}", SQLitePageCipher::page_size).c_str(), nullptr, nullptr, nullptr);
+            if (rc == SQLITE_OK) {
+                rc = sqlite3_file_control(this->conn, "main", SQLITE_FCNTL_RESERVE_BYTES, &reserve);
+            }
+            if (rc == SQLITE_OK) {
+                rc = sqlite3_exec(this->conn, "PRAGMA journal_mode=WAL", nullptr, nullptr, nullptr);
+            }
+        }
+        if (rc == SQLITE_OK) {
+            // 先頭ページを復号できるかを検証する
+            rc = sqlite3_exec(this->conn, "PRAGMA schema_version", nullptr, nullptr, nullptr);
+        }
+        if (rc != SQLITE_OK) {
+            this->disconnect();
+            throw std::runtime_error(page_cipher_error);
+        }
     }
 }
 
 void SQLiteConnection::disconnect() {
     if (this->conn != nullptr) {
+        // 未破棄のステートメントが存在すると切断できないためキャッシュを空にする
+        for (auto& [sql, stmt] : this->stmt_cache) {
+            sqlite3_finalize(stmt);
+        }
+        this->stmt_cache.clear();
+        this->functions.clear();
+        this->attached_page_ciphers.clear();
         if (sqlite3_close(this->conn) != SQLITE_OK) {
             this->conn = nullptr;
             throw std::runtime_error("SQLiteとの接続の切断に失敗");
         }
         this->conn = nullptr;
     }
+    this->page_cipher.reset();
+}
+
+sqlite3_stmt* SQLiteConnection::acquire(const std::u8string& sql) noexcept {
+    auto itr = this->stmt_cache.find(sql);
+    if (itr == this->stmt_cache.end()) {
+        return nullptr;
+    }
+    auto stmt = itr->second;
+    this->stmt_cache.erase(itr);
+    return stmt;
+}
+
+void SQLiteConnection::release(std::u8string sql, sqlite3_stmt* stmt) noexcept {
+    // 実行途中のステートメントはロックを保持し続けるため、キャッシュする前にリセットする
+    sqlite3_reset(stmt);
+    if (this->conn == nullptr || this->stmt_cache.size() >= this->stmt_cache_capacity) {
+        sqlite3_finalize(stmt);
+        return;
+    }
+    sqlite3_clear_bindings(stmt);
+    try {
+        this->stmt_cache.emplace(std::move(sql), stmt);
+    }
+    catch (...) {
+        sqlite3_finalize(stmt);
+    }
+}
+
+SQLite::SQLite(std::shared_ptr<SQLiteConnection> conn) : _conn(std::move(conn)) {}
+
+SQLite::SQLite(const std::filesystem::path& path, const SQLiteOpenOptions& options) : _conn(new SQLiteConnection) {
+    this->_conn->connect(path, options);
 }
 
-SQLite::SQLite(const std::filesystem::path& path) : _conn(new SQLiteConnection) {
-    this->_conn->connect(path);
+bool SQLite::readOnly() const {
+    return sqlite3_db_readonly(this->_conn->conn, "main") == 1;
 }
 
 void SQLite::exec(const std::u8string& sql) {
@@ -57,15 +274,243 @@ void SQLite::exec(const std::u8string& sql) {
 }
 
 SQLiteStmt SQLite::prepare(const std::u8string& sql) {
-    sqlite3_stmt* stmt = nullptr;
-    // プリペアドステートメントを作成
-    if (sqlite3_prepare_v2(
+    if (this->_conn->stmt_cache_capacity == 0) {
+        sqlite3_stmt* stmt = nullptr;
+        // プリペアドステートメントを作成
+        if (sqlite3_prepare_v2(
+            this->_conn->conn,
+            std::bit_cast<const char*>(sql.data()),
+            -1,
+            &stmt,
+            nullptr) != SQLITE_OK) {
+            throw std::logic_error(std::string("SQL error: ") + sqlite3_errmsg(this->_conn->conn));
+        }
+        return SQLiteStmt(std::shared_ptr<SQLiteStmtControl>(new SQLiteStmtControl(this->_conn, *stmt, 0)));
+    }
+
+    // キャッシュに存在しなければ長期間利用することを前提にプリペアドステートメントを作成
+    sqlite3_stmt* stmt = this->_conn->acquire(sql);
+    if (stmt == nullptr && sqlite3_prepare_v3(
         this->_conn->conn,
         std::bit_cast<const char*>(sql.data()),
         -1,
+        SQLITE_PREPARE_PERSISTENT,
         &stmt,
         nullptr) != SQLITE_OK) {
         throw std::logic_error(std::string("SQL error: ") + sqlite3_errmsg(this->_conn->conn));
     }
-    return SQLiteStmt(std::shared_ptr<SQLiteStmtControl>(new SQLiteStmtControl(this->_conn, *stmt, 0)));
+    return SQLiteStmt(std::shared_ptr<SQLiteStmtControl>(new SQLiteStmtControl(this->_conn, *stmt, 0, sql)));
+}
+
+void SQLite::attach(const std::filesystem::path& path, const std::u8string& schema) {
+    std::shared_ptr<SQLitePageCipher> cipher;
+    if (SQLiteConnection::default_page_cipher_provider) {
+        cipher = SQLiteConnection::default_page_cipher_provider(path);
+    }
+    auto file = path.u8string();
+    if (cipher) {
+        registerPageCipher(cipher);
+        // 主となるDBが暗号化されていなければ既定のVFSで開かれているためVFSも指定する
+        file = getUri(path, {}, cipher.get()) + u8"&vfs=" + std::bit_cast<const char8_t*>(registerPageCipherVfs());
+    }
+    // バインドした文字列は実行を終えるまで保持する必要がある
+    auto stmt = this->prepare(u8"ATTACH DATABASE ? AS " + schema + u8";");
+    stmt.bind(1, file);
+    try {
+        for (const auto& x : stmt.exec()) {}
+    }
+    catch (const std::runtime_error&) {
+        if (cipher && sqlite3_extended_errcode(this->_conn->conn) == SQLITE_IOERR_DATA) {
+            throw std::runtime_error(page_cipher_error);
+        }
+        throw;
+    }
+    if (cipher) {
+        this->_conn->attached_page_ciphers.insert_or_assign(schema, std::move(cipher));
+    }
+}
+
+void SQLite::detach(const std::u8string& schema) {
+    this->exec(u8"DETACH DATABASE " + schema + u8";");
+    this->_conn->attached_page_ciphers.erase(schema);
+}
+
+std::int64_t SQLite::changes() const {
+    return static_cast<std::int64_t>(sqlite3_changes64(this->_conn->conn));
+}
+
+std::shared_ptr<sqlite3_snapshot> SQLite::snapshot() {
+#if defined(SQLITE_ENABLE_SNAPSHOT)
+    sqlite3_snapshot* snapshot = nullptr;
+    if (sqlite3_snapshot_get(this->_conn->conn, "main", &snapshot) != SQLITE_OK) {
+        throw std::runtime_error(std::string("SQL error: ") + sqlite3_errmsg(this->_conn->conn));
+    }
+    return std::shared_ptr<sqlite3_snapshot>(snapshot, sqlite3_snapshot_free);
+#else
+    throw std::logic_error("SQLITE_ENABLE_SNAPSHOTが定義されていないためスナップショットは利用できません");
+#endif
+}
+
+void SQLite::openSnapshot(sqlite3_snapshot& snapshot) {
+#if defined(SQLITE_ENABLE_SNAPSHOT)
+    if (sqlite3_snapshot_open(this->_conn->conn, "main", &snapshot) != SQLITE_OK) {
+        throw std::runtime_error(std::string("SQL error: ") + sqlite3_errmsg(this->_conn->conn));
+    }
+#else
+    throw std::logic_error("SQLITE_ENABLE_SNAPSHOTが定義されていないためスナップショットは利用できません");
+#endif
+}
+
+SQLiteBackupProgress SQLite::backup(SQLite& dest, const SQLiteBackupOptions& options, const std::function<void(const SQLiteBackupProgress&)>& progress) {
+    if (options.pages_per_step <= 0) {
+        throw std::invalid_argument("1度に複製するページ数は1以上である必要があります");
+    }
+    std::unique_ptr<sqlite3_backup, decltype(&sqlite3_backup_finish)> handle(
+        sqlite3_backup_init(dest._conn->conn, "main", this->_conn->conn, "main"), sqlite3_backup_finish);
+    if (!handle) {
+        throw std::runtime_error(std::string("SQL error: ") + sqlite3_errmsg(dest._conn->conn));
+    }
+
+    // WALモードであれば読み取りトランザクションを維持し、書き込みを妨げずに開始時点の内容を複製する
+    std::optional<SQLiteTransaction> transaction;
+    if (options.snapshot) {
+        bool wal = false;
+        for (auto e : this->prepare(u8"PRAGMA journal_mode;").exec()) {
+            wal = e.get<SQLiteData::string_type>(0).value_or(u8"") == u8"wal";
+        }
+        if (wal) {
+            transaction.emplace(*this);
+            for (auto e : this->prepare(u8"SELECT count(*) FROM sqlite_schema;").exec()) {}
+        }
+    }
+
+    SQLiteBackupProgress state;
+    // ステップが進まずに待機した時間の合計
+    std::chrono::milliseconds waited{ 0 };
+    while (true) {
+        int rc = sqlite3_backup_step(handle.get(), options.pages_per_step);
+        ++state.steps;
+        if ((rc == SQLITE_BUSY || rc == SQLITE_LOCKED) && waited < this->_conn->busy_config.timeout) {
+            // ロックが解放されるまで待機して同じステップを再試行する(合計がbusy_config.timeoutに達したら諦める)
+            ++state.busy;
+            auto delay = std::max(options.pause, std::chrono::milliseconds(1));
+            std::this_thread::sleep_for(delay);
+            waited += delay;
+            continue;
+        }
+        waited = std::chrono::milliseconds(0);
+        if (rc != SQLITE_OK && rc != SQLITE_DONE) {
+            throw std::runtime_error(std::string("SQL error: ") + sqlite3_errstr(rc));
+        }
+        int copied = sqlite3_backup_pagecount(handle.get()) - sqlite3_backup_remaining(handle.get());
+        if (state.copied != 0 && copied <= state.copied && rc != SQLITE_DONE) {
+            // 複製済みのページ数が増えなかったときは最初から複製し直している
+            ++state.restarts;
+        }
+        state.copied = copied;
+        state.total = sqlite3_backup_pagecount(handle.get());
+        if (progress) {
+            progress(state);
+        }
+        if (rc == SQLITE_DONE) {
+            break;
+        }
+        // 他のコネクションがロックを取得できるようステップの間で待機する
+        if (options.pause.count() > 0) {
+            std::this_thread::sleep_for(options.pause);
+        }
+        else {
+            std::this_thread::yield();
+        }
+    }
+    if (int rc = sqlite3_backup_finish(handle.release()); rc != SQLITE_OK) {
+        throw std::runtime_error(std::string("SQL error: ") + sqlite3_errstr(rc));
+    }
+    if (transaction) {
+        transaction->commit();
+    }
+    return state;
+}
+
+void SQLite::serialize(const std::function<void(std::span<const std::byte>)>& callback, const std::u8string& schema) {
+    auto name = reinterpret_cast<const char*>(schema.c_str());
+    sqlite3_int64 size = 0;
+    if (auto data = sqlite3_serialize(this->_conn->conn, name, &size, SQLITE_SERIALIZE_NOCOPY); data != nullptr) {
+        callback(std::as_bytes(std::span(data, static_cast<std::size_t>(size))));
+        return;
+    }
+    std::unique_ptr<unsigned char, decltype(&sqlite3_free)> copied(sqlite3_serialize(this->_conn->conn, name, &size, 0), sqlite3_free);
+    if (!copied) {
+        if (size > 0) {
+            throw std::runtime_error("DBの内容を複製するためのメモリを確保できません");
+        }
+        // ページを持たない空のDB
+        callback({});
+        return;
+    }
+    callback(std::as_bytes(std::span(copied.get(), static_cast<std::size_t>(size))));
+}
+
+void SQLite::busy(const SQLiteBusyConfig& config) {
+    this->_conn->busy_config = config;
+}
+
+void SQLite::validateUtf8(bool enable) {
+    this->_conn->validate_utf8 = enable;
+}
+
+void SQLite::function(const std::u8string& name, int args, std::shared_ptr<const SQLiteFunction> func) {
+    auto key = name + u8'/' + std::bit_cast<const char8_t*>(std::to_string(args).c_str());
+    auto& registered = this->_conn->functions[key];
+    if (registered == func) {
+        return;
+    }
+    // SQLiteが保持する複製はコネクションの切断あるいは再登録の際にdestroyFunctionで破棄される
+    auto holder = std::make_unique<std::shared_ptr<const SQLiteFunction>>(func);
+    int rc = sqlite3_create_function_v2(
+        this->_conn->conn,
+        std::bit_cast<const char*>(name.c_str()),
+        args,
+        SQLITE_UTF8 | SQLITE_DIRECTONLY,
+        holder.get(),
+        callFunction,
+        nullptr,
+        nullptr,
+        destroyFunction);
+    // 失敗した場合もSQLiteはdestroyFunctionを呼び出す
+    holder.release();
+    if (rc != SQLITE_OK) {
+        this->_conn->functions.erase(key);
+        throw std::runtime_error(std::string("SQL error: ") + sqlite3_errmsg(this->_conn->conn));
+    }
+    registered = std::move(func);
+}
+
+SQLiteBusyStats SQLite::busyStats() const {
+    return this->_conn->busy_counter.load();
+}
+
+SQLiteBusyStats SQLite::totalBusyStats() {
+    return SQLiteConnection::total_busy_counter.load();
+}
+
+SQLiteTransaction::SQLiteTransaction(SQLite& conn, bool immediate) : _conn(conn) {
+    this->_conn.exec(immediate ? u8"BEGIN IMMEDIATE;" : u8"BEGIN;");
+    this->_active = true;
+}
+
+SQLiteTransaction::~SQLiteTransaction() {
+    if (this->_active) {
+        try {
+            this->_conn.exec(u8"ROLLBACK;");
+        }
+        catch (const std::runtime_error& e) {
+            std::cerr << e.what() << std::endl;
+        }
+    }
+}
+
+void SQLiteTransaction::commit() {
+    this->_conn.exec(u8"COMMIT;");
+    this->_active = false;
 }
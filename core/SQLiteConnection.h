@@ -3,8 +3,102 @@
 #include "sqlite3.h"
 #include <filesystem>
 #include <variant>
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <span>
+#include <string>
+#include <unordered_map>
 
 class SQLiteStmt;
+class SQLitePageCipher;
+
+/// <summary>
+/// DBへのパスからページの暗号化に用いる鍵を取得する関数(暗号化しなければnullptrを返す)
+/// </summary>
+using SQLitePageCipherProvider = std::function<std::shared_ptr<SQLitePageCipher>(const std::filesystem::path&)>;
+
+/// <summary>
+/// SQLから呼び出す関数(結果はsqlite3_result_*で設定し、例外はSQLのエラーとして報告される)
+/// </summary>
+using SQLiteFunction = std::function<void(sqlite3_context*, std::span<sqlite3_value*>)>;
+
+/// <summary>
+/// SQLITE_BUSYとなったときの再試行に関する設定
+/// </summary>
+/// <remarks>
+/// 再試行の間隔はinitial_delayから倍々にmax_delayまで増加させ、各間隔にはジッタを加える
+/// </remarks>
+struct SQLiteBusyConfig {
+	/// <summary>
+	/// 最初の再試行までの待機時間
+	/// </summary>
+	std::chrono::milliseconds initial_delay{ 1 };
+	/// <summary>
+	/// 再試行までの待機時間の上限
+	/// </summary>
+	std::chrono::milliseconds max_delay{ 100 };
+	/// <summary>
+	/// 再試行を諦めるまでの待機時間の合計(0なら再試行しない)
+	/// </summary>
+	std::chrono::milliseconds timeout{ 5000 };
+};
+
+/// <summary>
+/// SQLITE_BUSYとなったときの再試行に関する統計
+/// </summary>
+struct SQLiteBusyStats {
+	/// <summary>
+	/// 再試行の回数
+	/// </summary>
+	std::uint64_t retries = 0;
+	/// <summary>
+	/// 再試行のために待機した時間の合計
+	/// </summary>
+	std::chrono::microseconds wait_time{ 0 };
+	/// <summary>
+	/// 再試行を諦めてSQLITE_BUSYとなった回数
+	/// </summary>
+	std::uint64_t give_ups = 0;
+};
+
+/// <summary>
+/// SQLiteBusyStatsをスレッド安全に集計するためのカウンタ
+/// </summary>
+struct SQLiteBusyCounter {
+	std::atomic<std::uint64_t> retries = 0;
+	std::atomic<std::uint64_t> wait_us = 0;
+	std::atomic<std::uint64_t> give_ups = 0;
+
+	/// <summary>
+	/// 現在の統計を取得する
+	/// </summary>
+	[[nodiscard]] SQLiteBusyStats load() const noexcept;
+};
+
+/// <summary>
+/// SQLiteとのコネクションを確立する際のオプション
+/// </summary>
+struct SQLiteOpenOptions {
+	/// <summary>
+	/// 読み取り専用で開く(DBが存在しなければ作成せずに失敗する)
+	/// </summary>
+	bool read_only = false;
+	/// <summary>
+	/// 不変なファイルとして開く(ロックや変更の検知を一切行わないため、他から書き込まれるファイルには利用できない)
+	/// </summary>
+	bool immutable = false;
+	/// <summary>
+	/// コネクション単位の排他制御を行わない(複数のスレッドから同時に利用しない場合に限る)
+	/// </summary>
+	bool no_mutex = false;
+	/// <summary>
+	/// ページの暗号化に用いる鍵(nullptrならSQLiteConnection::default_page_cipher_providerから取得する)
+	/// </summary>
+	std::shared_ptr<SQLitePageCipher> page_cipher = nullptr;
+};
 
 /// <summary>
 /// SQLiteのコネクションを管理するクラス
@@ -14,6 +108,59 @@ struct SQLiteConnection {
 	/// SQLiteとのコネクションのハンドラ
 	/// </summary>
 	sqlite3* conn = nullptr;
+	/// <summary>
+	/// SQLITE_BUSYとなったときの再試行に関する設定
+	/// </summary>
+	SQLiteBusyConfig busy_config = SQLiteConnection::default_busy_config;
+	/// <summary>
+	/// このコネクションにおける再試行に関する統計
+	/// </summary>
+	SQLiteBusyCounter busy_counter;
+	/// <summary>
+	/// 現在のロック待ちの開始時刻
+	/// </summary>
+	std::chrono::steady_clock::time_point busy_begin;
+	/// <summary>
+	/// 利用されていないプリペアドステートメントのキャッシュ(キーはSQL)
+	/// </summary>
+	std::unordered_multimap<std::u8string, sqlite3_stmt*> stmt_cache;
+	/// <summary>
+	/// キャッシュに保持するステートメントの上限(0ならキャッシュしない)
+	/// </summary>
+	std::size_t stmt_cache_capacity = 0;
+	/// <summary>
+	/// バインドする文字列がUTF-8として正しいかを検証するか
+	/// </summary>
+	bool validate_utf8 = SQLiteConnection::default_validate_utf8;
+	/// <summary>
+	/// 登録済みのSQLから呼び出す関数(キーは関数名と引数の数)
+	/// </summary>
+	std::unordered_map<std::u8string, std::shared_ptr<const SQLiteFunction>> functions;
+	/// <summary>
+	/// ページの暗号化に用いる鍵(暗号化していなければnullptr)
+	/// </summary>
+	std::shared_ptr<SQLitePageCipher> page_cipher;
+	/// <summary>
+	/// ATTACHしたDBのページの暗号化に用いる鍵(キーはスキーマ名)
+	/// </summary>
+	std::unordered_map<std::u8string, std::shared_ptr<SQLitePageCipher>> attached_page_ciphers;
+
+	/// <summary>
+	/// 新しく確立するコネクションに適用する再試行に関する設定
+	/// </summary>
+	static inline SQLiteBusyConfig default_busy_config;
+	/// <summary>
+	/// 新しく確立するコネクションでバインドする文字列を検証するか
+	/// </summary>
+	static inline bool default_validate_utf8 = false;
+	/// <summary>
+	/// 新しく確立するコネクションでページの暗号化に用いる鍵を取得する関数(空なら暗号化しない)
+	/// </summary>
+	static inline SQLitePageCipherProvider default_page_cipher_provider;
+	/// <summary>
+	/// プロセス内のすべてのコネクションにおける再試行に関する統計
+	/// </summary>
+	static inline SQLiteBusyCounter total_busy_counter;
 
 	~SQLiteConnection();
 
@@ -21,12 +168,75 @@ struct SQLiteConnection {
 	/// SQLiteとのコネクションを確立する
 	/// </summary>
 	/// <param name="path">データベースへのパス</param>
-	void connect(const std::filesystem::path& path);
+	/// <param name="options">コネクションを確立する際のオプション</param>
+	void connect(const std::filesystem::path& path, const SQLiteOpenOptions& options = {});
 
 	/// <summary>
 	/// SQLiteとのコネクションを切断する
 	/// </summary>
 	void disconnect();
+
+	/// <summary>
+	/// キャッシュからステートメントを取り出す
+	/// </summary>
+	/// <param name="sql">ステートメントのSQL</param>
+	/// <returns>キャッシュされたステートメント(存在しなければnullptr)</returns>
+	[[nodiscard]] sqlite3_stmt* acquire(const std::u8string& sql) noexcept;
+
+	/// <summary>
+	/// 利用を終えたステートメントをキャッシュへ返却する(上限を超える場合は破棄する)
+	/// </summary>
+	/// <param name="sql">ステートメントのSQL</param>
+	/// <param name="stmt">返却するステートメント</param>
+	void release(std::u8string sql, sqlite3_stmt* stmt) noexcept;
+};
+
+/// <summary>
+/// オンラインバックアップに関する設定
+/// </summary>
+struct SQLiteBackupOptions {
+	/// <summary>
+	/// 1度のステップで複製するページ数
+	/// </summary>
+	int pages_per_step = 256;
+	/// <summary>
+	/// 他のコネクションがロックを取得できるようステップの間で待機する時間(0ならスレッドを譲るのみ)
+	/// </summary>
+	std::chrono::milliseconds pause{ 1 };
+	/// <summary>
+	/// 複製元がWALモードであれば読み取りトランザクションを維持して開始時点の内容を複製する
+	/// </summary>
+	/// <remarks>
+	/// 他のコネクションの書き込みによる複製し直しが起きなくなる一方、複製中はチェックポイントが
+	/// 維持したスナップショットより先へ進めないためWALのファイルが大きくなりうる
+	/// </remarks>
+	bool snapshot = true;
+};
+
+/// <summary>
+/// オンラインバックアップの進捗
+/// </summary>
+struct SQLiteBackupProgress {
+	/// <summary>
+	/// 複製を終えたページ数
+	/// </summary>
+	int copied = 0;
+	/// <summary>
+	/// 複製元のページ数
+	/// </summary>
+	int total = 0;
+	/// <summary>
+	/// 実行したステップの数
+	/// </summary>
+	std::uint64_t steps = 0;
+	/// <summary>
+	/// 複製元が他のコネクションから更新されたため最初から複製し直した回数
+	/// </summary>
+	std::uint64_t restarts = 0;
+	/// <summary>
+	/// ロックを取得できずに再試行したステップの数
+	/// </summary>
+	std::uint64_t busy = 0;
 };
 
 /// <summary>
@@ -38,14 +248,26 @@ class SQLite {
 	/// </summary>
 	std::shared_ptr<SQLiteConnection> _conn;
 
+	/// <summary>
+	/// 確立済みのコネクションから構築する
+	/// </summary>
+	/// <param name="conn">SQLiteとのコネクションのハンドラ</param>
+	SQLite(std::shared_ptr<SQLiteConnection> conn);
+
+	friend class SQLitePool;
 public:
-	SQLite(const std::filesystem::path& path);
+	SQLite(const std::filesystem::path& path, const SQLiteOpenOptions& options = {});
 
 	/// <summary>
 	/// trueならSQLiteとのコネクションが存在する
 	/// </summary>
 	operator bool() const { return this->_conn->conn != nullptr; }
 
+	/// <summary>
+	/// trueなら読み取り専用で開かれている
+	/// </summary>
+	[[nodiscard]] bool readOnly() const;
+
 	/// <summary>
 	/// SQLを実行する
 	/// </summary>
@@ -57,4 +279,152 @@ public:
 	/// </summary>
 	/// <param name="sql">実行するSQL</param>
 	[[nodiscard]] SQLiteStmt prepare(const std::u8string& sql);
+
+	/// <summary>
+	/// 直前に実行したINSERT, UPDATEあるいはDELETEにより変更された行数を取得する
+	/// </summary>
+	[[nodiscard]] std::int64_t changes() const;
+
+	/// <summary>
+	/// スナップショットを利用可能か(SQLITE_ENABLE_SNAPSHOTを定義してビルドした場合にのみ利用可能)
+	/// </summary>
+#if defined(SQLITE_ENABLE_SNAPSHOT)
+	static constexpr bool snapshot_supported = true;
+#else
+	static constexpr bool snapshot_supported = false;
+#endif
+
+	/// <summary>
+	/// 現在の読み取りトランザクションが参照しているスナップショットを取得する
+	/// </summary>
+	/// <remarks>
+	/// WALモードでトランザクションを開始し、1度以上読み取りを行った状態で呼び出す必要がある
+	/// </remarks>
+	[[nodiscard]] std::shared_ptr<sqlite3_snapshot> snapshot();
+
+	/// <summary>
+	/// 開始したトランザクションが参照するスナップショットを指定する
+	/// </summary>
+	/// <remarks>
+	/// BEGINの直後、読み取りを行う前に呼び出す必要がある
+	/// </remarks>
+	/// <param name="snapshot">参照するスナップショット</param>
+	void openSnapshot(sqlite3_snapshot& snapshot);
+
+	/// <summary>
+	/// DBの内容を他のコネクションへオンラインで複製する
+	/// </summary>
+	/// <remarks>
+	/// sqlite3_backup_stepにより一定のページ数ずつ複製し、ステップの間はロックを解放して待機するため、
+	/// 複製中も他のコネクションは読み書きを継続できる。複製元が他のコネクションから更新されると
+	/// SQLiteは最初から複製し直すため、書き込みが頻繁であれば完了までの時間は延びる
+	/// (WALモードでoptions.snapshotを指定した場合を除く)。
+	/// ロックによりステップが進まないときは複製元のbusy_config.timeoutまで再試行する。
+	/// </remarks>
+	/// <param name="dest">複製先のコネクション(既存の内容は置き換えられる)</param>
+	/// <param name="options">バックアップに関する設定</param>
+	/// <param name="progress">ステップごとに進捗を受け取る関数</param>
+	/// <returns>完了時の進捗</returns>
+	/// <exception cref="std::runtime_error">ロックの待機がbusy_config.timeoutを超えた、またはSQLiteのエラー</exception>
+	SQLiteBackupProgress backup(SQLite& dest, const SQLiteBackupOptions& options = {}, const std::function<void(const SQLiteBackupProgress&)>& progress = {});
+
+	/// <summary>
+	/// DBの内容をDBファイルと同じバイト列として取得する(sqlite3_serialize)
+	/// </summary>
+	/// <remarks>
+	/// 連続したメモリ上のDBでなければSQLiteがDB全体を複製するため、DBのサイズと同程度のメモリを使用する
+	/// </remarks>
+	/// <param name="callback">DBの内容を受け取る関数(引数は呼び出しの間のみ有効)</param>
+	/// <param name="schema">スキーマ名</param>
+	void serialize(const std::function<void(std::span<const std::byte>)>& callback, const std::u8string& schema = u8"main");
+
+	/// <summary>
+	/// 他のDBをATTACHする
+	/// </summary>
+	/// <remarks>
+	/// SQLiteConnection::default_page_cipher_providerからDBの鍵を取得できれば、鍵をVFSへ受け渡すURIとしてATTACHし、
+	/// DETACHするまで鍵を保持する。トランザクションの外で呼び出す必要がある
+	/// </remarks>
+	/// <param name="path">データベースへのパス</param>
+	/// <param name="schema">スキーマ名</param>
+	void attach(const std::filesystem::path& path, const std::u8string& schema);
+
+	/// <summary>
+	/// ATTACHしたDBを切り離す
+	/// </summary>
+	/// <param name="schema">スキーマ名</param>
+	void detach(const std::u8string& schema);
+
+	/// <summary>
+	/// SQLITE_BUSYとなったときの再試行に関する設定を変更する
+	/// </summary>
+	/// <param name="config">再試行に関する設定</param>
+	void busy(const SQLiteBusyConfig& config);
+
+	/// <summary>
+	/// このコネクションにおける再試行に関する統計を取得する
+	/// </summary>
+	[[nodiscard]] SQLiteBusyStats busyStats() const;
+
+	/// <summary>
+	/// バインドする文字列がUTF-8として正しいかの検証の有無を変更する
+	/// </summary>
+	/// <remarks>
+	/// 有効な場合は不正なバイト列をバインドしようとするとinvalid_argumentを送出する
+	/// </remarks>
+	/// <param name="enable">trueなら検証する</param>
+	void validateUtf8(bool enable);
+
+	/// <summary>
+	/// SQLから呼び出す関数を登録する(同じ関数が登録済みであれば何もしない)
+	/// </summary>
+	/// <remarks>
+	/// 関数はコネクションが切断されるまで保持される。スキーマから参照されないよう直接の呼び出しに限定する
+	/// (SQLITE_DIRECTONLY)
+	/// </remarks>
+	/// <param name="name">関数名</param>
+	/// <param name="args">引数の数</param>
+	/// <param name="func">関数</param>
+	void function(const std::u8string& name, int args, std::shared_ptr<const SQLiteFunction> func);
+
+	/// <summary>
+	/// プロセス内のすべてのコネクションにおける再試行に関する統計を取得する
+	/// </summary>
+	[[nodiscard]] static SQLiteBusyStats totalBusyStats();
+};
+
+/// <summary>
+/// トランザクションを管理するクラス
+/// </summary>
+/// <remarks>
+/// commitされずに破棄された場合はロールバックする
+/// </remarks>
+class SQLiteTransaction {
+	/// <summary>
+	/// SQLiteに関する操作の起点となるオブジェクト
+	/// </summary>
+	SQLite& _conn;
+	/// <summary>
+	/// トランザクションが継続中であるかを示すフラグ
+	/// </summary>
+	bool _active = false;
+
+public:
+	SQLiteTransaction() = delete;
+	/// <summary>
+	/// トランザクションを開始する
+	/// </summary>
+	/// <param name="conn">SQLiteに関する操作の起点となるオブジェクト</param>
+	/// <param name="immediate">trueなら開始時に書き込みのためのロックを取得する</param>
+	SQLiteTransaction(SQLite& conn, bool immediate = false);
+	~SQLiteTransaction();
+
+	/// <summary>
+	/// トランザクションをコミットする
+	/// </summary>
+	void commit();
+
+	// コピーによる構築を禁止する
+	SQLiteTransaction(const SQLiteTransaction&) = delete;
+	SQLiteTransaction& operator=(const SQLiteTransaction&) = delete;
 };
@@ -0,0 +1,56 @@
+﻿#include "SQLitePool.h"
+#include <stdexcept>
+
+SQLitePool::SQLitePool(const std::filesystem::path& path, std::size_t reader_count, std::size_t stmt_cache_capacity) : _state(std::make_shared<State>()) {
+    if (reader_count == 0) {
+        throw std::invalid_argument("読み取り用のコネクションの数は1以上である必要があります");
+    }
+
+    // 貸し出したコネクションは同時に1つのスレッドからのみ利用されるためコネクション単位の排他制御は不要である
+    this->_state->writer = std::make_unique<SQLiteConnection>();
+    this->_state->writer->connect(path, { .no_mutex = true });
+    this->_state->writer->stmt_cache_capacity = stmt_cache_capacity;
+    // 書き込みの最中も読み取りを並行できるようにWALとする(設定はDBファイルに保存される)
+    SQLite(std::shared_ptr<SQLiteConnection>(this->_state->writer.get(), [](SQLiteConnection*) {})).exec(u8"PRAGMA journal_mode=WAL;");
+
+    for (std::size_t i = 0; i < reader_count; ++i) {
+        auto& reader = this->_state->readers.emplace_back(std::make_unique<SQLiteConnection>());
+        // 読み取り用のコネクションから誤って書き込まないようにする
+        reader->connect(path, { .read_only = true, .no_mutex = true });
+        reader->stmt_cache_capacity = stmt_cache_capacity;
+        this->_state->idle_readers.push_back(reader.get());
+    }
+}
+
+SQLite SQLitePool::reader() {
+    std::unique_lock lock(this->_state->mutex);
+    this->_state->cv.wait(lock, [this] { return !this->_state->idle_readers.empty(); });
+    auto conn = this->_state->idle_readers.back();
+    this->_state->idle_readers.pop_back();
+    lock.unlock();
+
+    // 最後の参照が破棄されたときにプールへ返却する
+    return SQLite(std::shared_ptr<SQLiteConnection>(conn, [state = this->_state](SQLiteConnection* conn) {
+        {
+            std::lock_guard lock(state->mutex);
+            state->idle_readers.push_back(conn);
+        }
+        state->cv.notify_all();
+    }));
+}
+
+SQLite SQLitePool::writer() {
+    std::unique_lock lock(this->_state->mutex);
+    this->_state->cv.wait(lock, [this] { return this->_state->idle_writer; });
+    this->_state->idle_writer = false;
+    lock.unlock();
+
+    // 最後の参照が破棄されたときにプールへ返却する
+    return SQLite(std::shared_ptr<SQLiteConnection>(this->_state->writer.get(), [state = this->_state](SQLiteConnection*) {
+        {
+            std::lock_guard lock(state->mutex);
+            state->idle_writer = true;
+        }
+        state->cv.notify_all();
+    }));
+}
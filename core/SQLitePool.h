@@ -0,0 +1,81 @@
+﻿#pragma once
+
+#include "SQLiteConnection.h"
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+/// <summary>
+/// 複数のスレッドから利用するためのSQLiteのコネクションプール
+/// </summary>
+/// <remarks>
+/// 読み取り用のコネクションをN個、書き込み用のコネクションを1個保持する。
+/// 貸し出したSQLiteおよびそこから生成したステートメントやViewがすべて破棄されるとコネクションはプールへ返却される。
+/// 同一のスレッドで同じ種類のコネクションを返却せずに重ねて借りると、空きが無い場合にデッドロックする。
+/// </remarks>
+class SQLitePool {
+	/// <summary>
+	/// プールの状態(貸し出し中のコネクションが存在する間はプールが破棄されても保持される)
+	/// </summary>
+	struct State {
+		std::mutex mutex;
+		std::condition_variable cv;
+		/// <summary>
+		/// 読み取り用のコネクション
+		/// </summary>
+		std::vector<std::unique_ptr<SQLiteConnection>> readers;
+		/// <summary>
+		/// 貸し出し可能な読み取り用のコネクション
+		/// </summary>
+		std::vector<SQLiteConnection*> idle_readers;
+		/// <summary>
+		/// 書き込み用のコネクション
+		/// </summary>
+		std::unique_ptr<SQLiteConnection> writer;
+		/// <summary>
+		/// 書き込み用のコネクションが貸し出し可能であるか
+		/// </summary>
+		bool idle_writer = true;
+	};
+
+	/// <summary>
+	/// プールの状態
+	/// </summary>
+	std::shared_ptr<State> _state;
+
+public:
+	/// <summary>
+	/// 各コネクションが保持するステートメントキャッシュの既定の上限
+	/// </summary>
+	static constexpr std::size_t default_stmt_cache_capacity = 32;
+
+	SQLitePool() = delete;
+	/// <summary>
+	/// コネクションを確立してプールを構築する
+	/// </summary>
+	/// <param name="path">データベースへのパス</param>
+	/// <param name="reader_count">読み取り用のコネクションの数</param>
+	/// <param name="stmt_cache_capacity">各コネクションが保持するステートメントキャッシュの上限</param>
+	SQLitePool(const std::filesystem::path& path, std::size_t reader_count, std::size_t stmt_cache_capacity = default_stmt_cache_capacity);
+
+	/// <summary>
+	/// 読み取り用のコネクションを借りる(空きが無ければ返却されるまで待機する)
+	/// </summary>
+	[[nodiscard]] SQLite reader();
+
+	/// <summary>
+	/// 書き込み用のコネクションを借りる(空きが無ければ返却されるまで待機する)
+	/// </summary>
+	[[nodiscard]] SQLite writer();
+
+	/// <summary>
+	/// 読み取り用のコネクションの数
+	/// </summary>
+	[[nodiscard]] std::size_t readerCount() const noexcept { return this->_state->readers.size(); }
+
+	// コピーによる構築を禁止する
+	SQLitePool(const SQLitePool&) = delete;
+	SQLitePool& operator=(const SQLitePool&) = delete;
+};
@@ -1,5 +1,7 @@
 ﻿#include "SQLiteStmt.h"
 #include "SQLiteView.h"
+#include "SQLiteConnection.h"
+#include "Utf8.h"
 #include <bit>
 #include <iostream>
 #include <stdexcept>
@@ -12,14 +14,21 @@ void SQLiteStmtControl::dispose(std::size_t mask) noexcept {
     if (this->stmt != nullptr) {
         this->control &= ~mask;
         if (this->control == 0) {
-            // 他で利用されていない場合でのみ開放(SQLITE_ERRORを返すとしてもエラーとは限らないため無視)
-            sqlite3_finalize(this->stmt);
+            if (this->cache_key.empty()) {
+                // 他で利用されていない場合でのみ開放(SQLITE_ERRORを返すとしてもエラーとは限らないため無視)
+                sqlite3_finalize(this->stmt);
+            }
+            else {
+                // キャッシュ可能なステートメントはコネクションへ返却する
+                this->conn->release(std::move(this->cache_key), this->stmt);
+                this->cache_key.clear();
+            }
             this->stmt = nullptr;
         }
     }
 }
 
-SQLiteStmtControl::SQLiteStmtControl(std::shared_ptr<SQLiteConnection> conn, sqlite3_stmt& stmt, std::size_t control) : conn(conn), stmt(std::addressof(stmt)), control(control) {}
+SQLiteStmtControl::SQLiteStmtControl(std::shared_ptr<SQLiteConnection> conn, sqlite3_stmt& stmt, std::size_t control, std::u8string cache_key) : conn(conn), stmt(std::addressof(stmt)), control(control), cache_key(std::move(cache_key)) {}
 
 SQLiteStmtControl::~SQLiteStmtControl() {
     this->dispose(~0);
@@ -34,6 +43,7 @@ SQLiteStmtControl& SQLiteStmtControl::operator=(SQLiteStmtControl&& x) noexcept
     this->conn = std::move(x.conn);
     this->stmt = x.stmt;
     this->control = x.control;
+    this->cache_key = std::move(x.cache_key);
     x.stmt = nullptr;
     x.control = 0;
     return *this;
@@ -47,27 +57,53 @@ SQLiteStmt::~SQLiteStmt() {
     this->_control->dispose(SQLiteStmtControl::ENABLE_SQLITE_STMT);
 }
 
+void SQLiteStmt::prepareBind() {
+    if ((this->_control->control & (SQLiteStmtControl::ENABLE_SQLITE_VIEW | SQLiteStmtControl::ENABLE_SQLITE_ITERATOR)) != 0) {
+        throw std::logic_error("有効なSQLiteViewあるいはSQLiteIteratorが存在しているためバインド変数を設定することはできません");
+    }
+    // 実行済みあるいは実行途中のステートメントにはバインドできないためリセットする(バインド変数は保持される)
+    sqlite3_reset(this->_control->stmt);
+}
+
+void SQLiteStmt::validateText(std::u8string_view data) const {
+    if (this->_control->conn->validate_utf8 && !validUtf8(data)) {
+        throw std::invalid_argument(std::format("UTF-8として不正なバイト列はバインドできません({0}バイト目)", invalidUtf8Offset(data) + 1));
+    }
+}
+
 void SQLiteStmt::bind(int index, std::u8string_view data) {
+    this->prepareBind();
+    this->validateText(data);
     sqlite3_bind_text(this->_control->stmt, index, std::bit_cast<const char*>(data.data()), static_cast<int>(data.size()), SQLITE_STATIC);
 }
 
 void SQLiteStmt::bind(int index, const std::u8string& data) {
+    this->prepareBind();
+    this->validateText(data);
     sqlite3_bind_text(this->_control->stmt, index, std::bit_cast<const char*>(data.data()), -1, SQLITE_STATIC);
 }
 
 void SQLiteStmt::bind(int index, const std::chrono::utc_seconds& data) {
+    this->prepareBind();
     // 明示的にコピーをバインドする
     sqlite3_bind_text(this->_control->stmt, index, std::format("{:%Y-%m-%d %H:%M:%S}", data).c_str(), -1, SQLITE_TRANSIENT);
 }
 
 void SQLiteStmt::bind(int index, nullptr_t) {
+    this->prepareBind();
     sqlite3_bind_null(this->_control->stmt, index);
 }
 
 void SQLiteStmt::bind(int index, const std::vector<unsigned char>& data) {
+    this->prepareBind();
     sqlite3_bind_blob64(this->_control->stmt, index, data.data(), static_cast<sqlite3_uint64>(data.size()), SQLITE_STATIC);
 }
 
+void SQLiteStmt::bind(int index, std::int64_t data) {
+    this->prepareBind();
+    sqlite3_bind_int64(this->_control->stmt, index, static_cast<sqlite3_int64>(data));
+}
+
 SQLiteView SQLiteStmt::exec() {
     if ((this->_control->control & (SQLiteStmtControl::ENABLE_SQLITE_VIEW | SQLiteStmtControl::ENABLE_SQLITE_ITERATOR)) != 0) {
         throw std::logic_error("有効なSQLiteViewあるいはSQLiteIteratorが存在しているためSQLiteViewを生成することはできません");
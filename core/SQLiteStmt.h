@@ -6,6 +6,8 @@
 #include <vector>
 #include <optional>
 #include <chrono>
+#include <cstdint>
+#include <memory>
 
 struct SQLiteConnection;
 
@@ -18,7 +20,8 @@ concept bind_value = std::disjunction_v<
 	std::is_same<T, std::u8string>,
 	std::is_same<T, std::chrono::utc_seconds>,
 	std::is_same<T, nullptr_t>,
-	std::is_same<T, std::vector<unsigned char>>
+	std::is_same<T, std::vector<unsigned char>>,
+	std::is_same<T, std::int64_t>
 >;
 
 /// <summary>
@@ -37,6 +40,10 @@ struct SQLiteStmtControl {
 	/// sqlite3_stmtの制御のための変数
 	/// </summary>
 	std::size_t control = 0;
+	/// <summary>
+	/// ステートメントキャッシュのキー(空であればキャッシュせずに破棄する)
+	/// </summary>
+	std::u8string cache_key;
 
 	/// <summary>
 	/// sqlite3_stmtを保持する
@@ -48,7 +55,7 @@ struct SQLiteStmtControl {
 	/// </summary>
 	void dispose(std::size_t mask) noexcept;
 
-	SQLiteStmtControl(std::shared_ptr<SQLiteConnection> conn, sqlite3_stmt& stmt, std::size_t control);
+	SQLiteStmtControl(std::shared_ptr<SQLiteConnection> conn, sqlite3_stmt& stmt, std::size_t control, std::u8string cache_key = {});
 	~SQLiteStmtControl();
 
 	SQLiteStmtControl(SQLiteStmtControl&& x) noexcept;
@@ -79,6 +86,16 @@ class SQLiteStmt {
 	/// </summary>
 	std::shared_ptr<SQLiteStmtControl> _control;
 
+	/// <summary>
+	/// バインド変数を設定可能な状態にする
+	/// </summary>
+	void prepareBind();
+
+	/// <summary>
+	/// コネクションで検証が有効であればバインドする文字列がUTF-8として正しいかを検証する
+	/// </summary>
+	void validateText(std::u8string_view data) const;
+
 public:
 	SQLiteStmt() = delete;
 	SQLiteStmt(std::shared_ptr<SQLiteStmtControl> control);
@@ -89,6 +106,7 @@ public:
 	void bind(int index, const std::chrono::utc_seconds& data);
 	void bind(int index, nullptr_t);
 	void bind(int index, const std::vector<unsigned char>& data);
+	void bind(int index, std::int64_t data);
 	template <bind_value T>
 	void bind(int index, const std::optional<T>& data) {
 		if (data) {
@@ -60,6 +60,106 @@ std::optional<SQLiteData::blob_type> SQLiteData::get<SQLiteData::blob_type>(int
 	);
 }
 
+template <>
+std::optional<SQLiteData::integer_type> SQLiteData::get<SQLiteData::integer_type>(int col) {
+	int maxCols = sqlite3_column_count(this->_stmt);
+	if (col >= maxCols) {
+		throw std::invalid_argument(
+			std::format("{0}番目のカラムは存在しません。カラムの最大数は{1}です", col, maxCols)
+		);
+	}
+
+	switch (sqlite3_column_type(this->_stmt, col)) {
+	case SQLITE_INTEGER:
+		return static_cast<SQLiteData::integer_type>(sqlite3_column_int64(this->_stmt, col));
+	case SQLITE_NULL:
+		return std::nullopt;
+	}
+	auto colstr = std::to_string(col);
+	throw std::invalid_argument(
+		std::format("{0}番目のカラムの型はINTEGERもしくはNULLではありません。{0}番目のカラムの型は{1}です",
+			colstr,
+			sqlite3_column_decltype(this->_stmt, col)
+		)
+	);
+}
+
+SQLiteRow::SQLiteRow(const SQLiteData& data) {
+	int cols = sqlite3_column_count(data._stmt);
+	this->_cols.reserve(cols);
+	for (int col = 0; col < cols; ++col) {
+		switch (sqlite3_column_type(data._stmt, col)) {
+		case SQLITE_NULL:
+			this->_cols.emplace_back(nullptr);
+			break;
+		case SQLITE_BLOB:
+		{
+			auto p = static_cast<const unsigned char*>(sqlite3_column_blob(data._stmt, col));
+			int len = sqlite3_column_bytes(data._stmt, col);
+			this->_cols.emplace_back(std::vector<unsigned char>(p, p + len));
+			break;
+		}
+		case SQLITE_INTEGER:
+			this->_cols.emplace_back(static_cast<std::int64_t>(sqlite3_column_int64(data._stmt, col)));
+			break;
+		default:
+		{
+			// それ以外の値はTEXTとして複製する
+			auto p = std::bit_cast<const char8_t*>(sqlite3_column_text(data._stmt, col));
+			int len = sqlite3_column_bytes(data._stmt, col);
+			this->_cols.emplace_back(std::u8string(p, len));
+			break;
+		}
+		}
+	}
+}
+
+template <>
+std::optional<SQLiteRow::string_type> SQLiteRow::get<SQLiteRow::string_type>(int col) {
+	if (col < 0 || static_cast<std::size_t>(col) >= this->_cols.size()) {
+		throw std::invalid_argument(
+			std::format("{0}番目のカラムは存在しません。カラムの最大数は{1}です", col, this->_cols.size())
+		);
+	}
+	if (auto p = std::get_if<std::u8string>(&this->_cols[col]); p) {
+		return SQLiteRow::string_type{ *p };
+	}
+	if (std::holds_alternative<std::nullptr_t>(this->_cols[col])) {
+		return std::nullopt;
+	}
+	throw std::invalid_argument(std::format("{0}番目のカラムの型はTEXTもしくはNULLではありません", col));
+}
+template <>
+std::optional<SQLiteRow::blob_type> SQLiteRow::get<SQLiteRow::blob_type>(int col) {
+	if (col < 0 || static_cast<std::size_t>(col) >= this->_cols.size()) {
+		throw std::invalid_argument(
+			std::format("{0}番目のカラムは存在しません。カラムの最大数は{1}です", col, this->_cols.size())
+		);
+	}
+	if (auto p = std::get_if<std::vector<unsigned char>>(&this->_cols[col]); p) {
+		return SQLiteRow::blob_type{ *p };
+	}
+	if (std::holds_alternative<std::nullptr_t>(this->_cols[col])) {
+		return std::nullopt;
+	}
+	throw std::invalid_argument(std::format("{0}番目のカラムの型はBLOBもしくはNULLではありません", col));
+}
+template <>
+std::optional<SQLiteRow::integer_type> SQLiteRow::get<SQLiteRow::integer_type>(int col) {
+	if (col < 0 || static_cast<std::size_t>(col) >= this->_cols.size()) {
+		throw std::invalid_argument(
+			std::format("{0}番目のカラムは存在しません。カラムの最大数は{1}です", col, this->_cols.size())
+		);
+	}
+	if (auto p = std::get_if<std::int64_t>(&this->_cols[col]); p) {
+		return *p;
+	}
+	if (std::holds_alternative<std::nullptr_t>(this->_cols[col])) {
+		return std::nullopt;
+	}
+	throw std::invalid_argument(std::format("{0}番目のカラムの型はINTEGERもしくはNULLではありません", col));
+}
+
 SQLiteIterator::SQLiteIterator(std::shared_ptr<SQLiteStmtControl> control, int prevStep) : _control(control), _prevStep(prevStep) {
 	this->_control->keep(SQLiteStmtControl::ENABLE_SQLITE_ITERATOR);
 }
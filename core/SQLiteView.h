@@ -4,6 +4,7 @@
 #include <span>
 #include <string_view>
 #include <ranges>
+#include <variant>
 
 /// <summary>
 /// データとして得る型(今回は利用するやつだけ定義する)
@@ -11,7 +12,8 @@
 template <class T>
 concept data_value = std::disjunction_v<
     std::is_same<T, std::u8string_view>,
-    std::is_same<T, std::span<unsigned char>>
+    std::is_same<T, std::span<unsigned char>>,
+    std::is_same<T, std::int64_t>
 >;
 
 /// <summary>
@@ -22,6 +24,8 @@ class SQLiteData {
 	/// 実行するSQLについてのステートメント
 	/// </summary>
 	sqlite3_stmt* _stmt = nullptr;
+
+	friend class SQLiteRow;
 public:
 	SQLiteData() = delete;
 	SQLiteData(sqlite3_stmt& stmt);
@@ -29,11 +33,40 @@ public:
  
 	using string_type = std::u8string_view;
 	using blob_type = std::span<unsigned char>;
+	using integer_type = std::int64_t;
 
 	template <data_value T>
     [[nodiscard]] std::optional<T> get(int col);
 };
 
+/// <summary>
+/// SQLiteでSQLを実行した結果の1行を複製して保持する型
+/// </summary>
+/// <remarks>
+/// SQLiteDataはsqlite3_stepにより無効となるため、行を保持し続ける場合に利用する
+/// </remarks>
+class SQLiteRow {
+	/// <summary>
+	/// 各カラムの値
+	/// </summary>
+	std::vector<std::variant<std::nullptr_t, std::u8string, std::vector<unsigned char>, std::int64_t>> _cols;
+public:
+	SQLiteRow() = default;
+	SQLiteRow(const SQLiteData& data);
+
+	using string_type = SQLiteData::string_type;
+	using blob_type = SQLiteData::blob_type;
+	using integer_type = SQLiteData::integer_type;
+
+	template <data_value T>
+	[[nodiscard]] std::optional<T> get(int col);
+
+	/// <summary>
+	/// カラムの数
+	/// </summary>
+	[[nodiscard]] std::size_t size() const noexcept { return this->_cols.size(); }
+};
+
 /// <summary>
 /// SQLiteViewのための番兵
 /// </summary>
@@ -0,0 +1,183 @@
+﻿#include "Sha256.h"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+namespace {
+    /// <summary>
+    /// 初期のハッシュ値(最初の8つの素数の平方根の小数部)
+    /// </summary>
+    constexpr std::array<std::uint32_t, 8> initial_state = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+
+    /// <summary>
+    /// ラウンド定数(最初の64個の素数の立方根の小数部)
+    /// </summary>
+    constexpr std::uint32_t round_constants[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+    };
+
+    /// <summary>
+    /// ビッグエンディアンの32ビット整数を読み取る
+    /// </summary>
+    std::uint32_t loadBe32(const std::byte* p) noexcept {
+        return (std::to_integer<std::uint32_t>(p[0]) << 24) | (std::to_integer<std::uint32_t>(p[1]) << 16)
+            | (std::to_integer<std::uint32_t>(p[2]) << 8) | std::to_integer<std::uint32_t>(p[3]);
+    }
+
+    /// <summary>
+    /// ビッグエンディアンの32ビット整数を書き込む
+    /// </summary>
+    void storeBe32(std::byte* p, std::uint32_t x) noexcept {
+        p[0] = static_cast<std::byte>(x >> 24);
+        p[1] = static_cast<std::byte>(x >> 16);
+        p[2] = static_cast<std::byte>(x >> 8);
+        p[3] = static_cast<std::byte>(x);
+    }
+}
+
+Sha256::Sha256() noexcept : _state(initial_state) {}
+
+void Sha256::compress(std::span<const std::byte> blocks) noexcept {
+    for (std::size_t offset = 0; offset < blocks.size(); offset += block_size) {
+        // メッセージスケジュールの展開
+        std::uint32_t w[64];
+        for (int i = 0; i < 16; ++i) {
+            w[i] = loadBe32(blocks.data() + offset + i * 4);
+        }
+        for (int i = 16; i < 64; ++i) {
+            auto s0 = std::rotr(w[i - 15], 7) ^ std::rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            auto s1 = std::rotr(w[i - 2], 17) ^ std::rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        auto [a, b, c, d, e, f, g, h] = this->_state;
+        for (int i = 0; i < 64; ++i) {
+            auto t1 = h + (std::rotr(e, 6) ^ std::rotr(e, 11) ^ std::rotr(e, 25)) + ((e & f) ^ (~e & g)) + round_constants[i] + w[i];
+            auto t2 = (std::rotr(a, 2) ^ std::rotr(a, 13) ^ std::rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        this->_state[0] += a;
+        this->_state[1] += b;
+        this->_state[2] += c;
+        this->_state[3] += d;
+        this->_state[4] += e;
+        this->_state[5] += f;
+        this->_state[6] += g;
+        this->_state[7] += h;
+    }
+}
+
+void Sha256::update(std::span<const std::byte> data) noexcept {
+    this->_length += data.size();
+    if (this->_size != 0) {
+        // 前回の残りとあわせて1ブロックになるまで蓄える
+        auto n = std::min(data.size(), block_size - this->_size);
+        std::memcpy(this->_buf.data() + this->_size, data.data(), n);
+        this->_size += n;
+        data = data.subspan(n);
+        if (this->_size < block_size) {
+            return;
+        }
+        this->compress(this->_buf);
+        this->_size = 0;
+    }
+    // ブロック単位の部分は複製せずに処理する
+    auto whole = data.size() / block_size * block_size;
+    this->compress(data.first(whole));
+    data = data.subspan(whole);
+    std::memcpy(this->_buf.data(), data.data(), data.size());
+    this->_size = data.size();
+}
+
+Sha256::digest_type Sha256::finish() noexcept {
+    // 0x80、0の詰め物、ビット長(64ビットのビッグエンディアン)を付して最後のブロックとする
+    const std::uint64_t bits = this->_length * 8;
+    this->_buf[this->_size++] = std::byte{ 0x80 };
+    if (this->_size > block_size - 8) {
+        std::memset(this->_buf.data() + this->_size, 0, block_size - this->_size);
+        this->compress(this->_buf);
+        this->_size = 0;
+    }
+    std::memset(this->_buf.data() + this->_size, 0, block_size - 8 - this->_size);
+    storeBe32(this->_buf.data() + block_size - 8, static_cast<std::uint32_t>(bits >> 32));
+    storeBe32(this->_buf.data() + block_size - 4, static_cast<std::uint32_t>(bits));
+    this->compress(this->_buf);
+
+    digest_type result;
+    for (int i = 0; i < 8; ++i) {
+        storeBe32(result.data() + i * 4, this->_state[i]);
+    }
+    *this = Sha256();
+    return result;
+}
+
+HmacSha256::HmacSha256(std::span<const std::byte> key) noexcept {
+    // ブロック長へ0で詰めた鍵とipad(0x36)、opad(0x5c)の排他的論理和をそれぞれの先頭に入力する
+    std::array<std::byte, Sha256::block_size> block{};
+    if (key.size() > block.size()) {
+        auto hash = Sha256::digest(key);
+        std::ranges::copy(hash, block.begin());
+    }
+    else {
+        std::ranges::copy(key, block.begin());
+    }
+    for (auto& x : block) {
+        x ^= std::byte{ 0x36 };
+    }
+    this->_inner_init.update(block);
+    for (auto& x : block) {
+        x ^= std::byte{ 0x36 ^ 0x5c };
+    }
+    this->_outer_init.update(block);
+    block.fill(std::byte{ 0 });
+    this->_inner = this->_inner_init;
+}
+
+Sha256::digest_type HmacSha256::finish() noexcept {
+    auto inner = this->_inner.finish();
+    auto outer = this->_outer_init;
+    outer.update(inner);
+    this->_inner = this->_inner_init;
+    return outer.finish();
+}
+
+void pbkdf2HmacSha256(std::span<const std::byte> password, std::span<const std::byte> salt, std::uint32_t iterations, std::span<std::byte> out) noexcept {
+    // パスワードを取り込んだ状態を使い回し、繰り返しごとのハッシュの計算を2ブロック分に抑える
+    HmacSha256 prf(password);
+    for (std::uint32_t index = 1; !out.empty(); ++index) {
+        const std::byte counter[4] = {
+            static_cast<std::byte>(index >> 24), static_cast<std::byte>(index >> 16),
+            static_cast<std::byte>(index >> 8), static_cast<std::byte>(index)
+        };
+        prf.update(salt);
+        prf.update(counter);
+        auto u = prf.finish();
+        auto t = u;
+        for (std::uint32_t i = 1; i < iterations; ++i) {
+            prf.update(u);
+            u = prf.finish();
+            for (std::size_t j = 0; j < t.size(); ++j) {
+                t[j] ^= u[j];
+            }
+        }
+        auto n = std::min(out.size(), t.size());
+        std::copy_n(t.begin(), n, out.begin());
+        out = out.subspan(n);
+    }
+}
@@ -0,0 +1,125 @@
+﻿#pragma once
+
+#include <array>
+#include <span>
+#include <cstddef>
+#include <cstdint>
+
+/// <summary>
+/// SHA-256のハッシュ値を逐次的に計算するクラス
+/// </summary>
+class Sha256 {
+public:
+	/// <summary>
+	/// ハッシュ値の型
+	/// </summary>
+	using digest_type = std::array<std::byte, 32>;
+
+	/// <summary>
+	/// 1度に処理するブロックのバイト数
+	/// </summary>
+	static constexpr std::size_t block_size = 64;
+
+private:
+	std::array<std::uint32_t, 8> _state;
+	std::array<std::byte, block_size> _buf{};
+	/// <summary>
+	/// _bufに蓄えたバイト数
+	/// </summary>
+	std::size_t _size = 0;
+	/// <summary>
+	/// これまでに入力したバイト数
+	/// </summary>
+	std::uint64_t _length = 0;
+
+	/// <summary>
+	/// ブロックを圧縮関数により状態へ取り込む
+	/// </summary>
+	/// <param name="blocks">block_sizeの倍数のバイト列</param>
+	void compress(std::span<const std::byte> blocks) noexcept;
+
+public:
+	Sha256() noexcept;
+
+	/// <summary>
+	/// データを入力する
+	/// </summary>
+	/// <param name="data">入力するデータ</param>
+	void update(std::span<const std::byte> data) noexcept;
+
+	/// <summary>
+	/// 入力を終えてハッシュ値を取得する(以降は再び初期状態から入力できる)
+	/// </summary>
+	[[nodiscard]] digest_type finish() noexcept;
+
+	/// <summary>
+	/// データのハッシュ値を計算する
+	/// </summary>
+	/// <param name="data">対象のバイト列</param>
+	[[nodiscard]] static digest_type digest(std::span<const std::byte> data) noexcept {
+		Sha256 sha;
+		sha.update(data);
+		return sha.finish();
+	}
+};
+
+/// <summary>
+/// HMAC-SHA-256(RFC 2104)を逐次的に計算するクラス
+/// </summary>
+/// <remarks>
+/// 鍵を取り込んだ内側と外側の状態を保持するため、同じ鍵で繰り返し計算する場合は鍵の処理を省略できる
+/// </remarks>
+class HmacSha256 {
+	/// <summary>
+	/// 鍵を取り込んだ内側の状態
+	/// </summary>
+	Sha256 _inner_init;
+	/// <summary>
+	/// 鍵を取り込んだ外側の状態
+	/// </summary>
+	Sha256 _outer_init;
+	/// <summary>
+	/// 入力中の内側の状態
+	/// </summary>
+	Sha256 _inner;
+
+public:
+	HmacSha256() = delete;
+	/// <summary>
+	/// 鍵を指定して構築する
+	/// </summary>
+	/// <param name="key">鍵(ブロック長を超えればハッシュ値を鍵とする)</param>
+	explicit HmacSha256(std::span<const std::byte> key) noexcept;
+
+	/// <summary>
+	/// データを入力する
+	/// </summary>
+	void update(std::span<const std::byte> data) noexcept {
+		this->_inner.update(data);
+	}
+
+	/// <summary>
+	/// 入力を終えて認証符号を取得する(以降は再び同じ鍵で入力できる)
+	/// </summary>
+	[[nodiscard]] Sha256::digest_type finish() noexcept;
+
+	/// <summary>
+	/// データの認証符号を計算する
+	/// </summary>
+	/// <param name="key">鍵</param>
+	/// <param name="data">対象のバイト列</param>
+	[[nodiscard]] static Sha256::digest_type digest(std::span<const std::byte> key, std::span<const std::byte> data) noexcept {
+		HmacSha256 mac(key);
+		mac.update(data);
+		return mac.finish();
+	}
+};
+
+/// <summary>
+/// PBKDF2-HMAC-SHA-256(RFC 8018)により鍵を導出する
+/// </summary>
+/// <param name="password">パスワード</param>
+/// <param name="salt">ソルト</param>
+/// <param name="iterations">繰り返しの回数(1以上)</param>
+/// <param name="out">導出した鍵の書き込み先</param>
+void pbkdf2HmacSha256(std::span<const std::byte> password, std::span<const std::byte> salt, std::uint32_t iterations, std::span<std::byte> out) noexcept;
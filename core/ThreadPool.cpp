@@ -0,0 +1,51 @@
+﻿#include "ThreadPool.h"
+#include <stdexcept>
+
+ThreadPool::ThreadPool(std::size_t size) {
+    if (size == 0) {
+        throw std::invalid_argument("ワーカスレッドの数は1以上である必要があります");
+    }
+    this->_workers.reserve(size);
+    for (std::size_t i = 0; i < size; ++i) {
+        this->_workers.emplace_back([this] { this->run(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(this->_mutex);
+        this->_stop = true;
+    }
+    this->_cv.notify_all();
+    for (auto& worker : this->_workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::post(std::function<void()> task) {
+    {
+        std::lock_guard lock(this->_mutex);
+        if (this->_stop) {
+            throw std::logic_error("停止したスレッドプールにはタスクを投入できません");
+        }
+        this->_tasks.push_back(std::move(task));
+    }
+    this->_cv.notify_one();
+}
+
+void ThreadPool::run() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock lock(this->_mutex);
+            this->_cv.wait(lock, [this] { return this->_stop || !this->_tasks.empty(); });
+            if (this->_tasks.empty()) {
+                // 停止が要求されて実行待ちのタスクも存在しない
+                return;
+            }
+            task = std::move(this->_tasks.front());
+            this->_tasks.pop_front();
+        }
+        task();
+    }
+}
@@ -0,0 +1,89 @@
+﻿#pragma once
+
+#include "AsyncResult.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/// <summary>
+/// 固定数のワーカスレッドでタスクを実行するスレッドプール
+/// </summary>
+class ThreadPool {
+	std::mutex _mutex;
+	std::condition_variable _cv;
+	/// <summary>
+	/// 実行待ちのタスク
+	/// </summary>
+	std::deque<std::function<void()>> _tasks;
+	/// <summary>
+	/// 停止が要求されたか
+	/// </summary>
+	bool _stop = false;
+	/// <summary>
+	/// ワーカスレッド
+	/// </summary>
+	std::vector<std::thread> _workers;
+
+	/// <summary>
+	/// ワーカスレッドの処理
+	/// </summary>
+	void run();
+
+public:
+	ThreadPool() = delete;
+	/// <summary>
+	/// ワーカスレッドを起動する
+	/// </summary>
+	/// <param name="size">ワーカスレッドの数</param>
+	ThreadPool(std::size_t size);
+	/// <summary>
+	/// 実行待ちのタスクをすべて実行してからワーカスレッドを停止する
+	/// </summary>
+	~ThreadPool();
+
+	/// <summary>
+	/// タスクを投入する
+	/// </summary>
+	/// <param name="task">実行するタスク</param>
+	void post(std::function<void()> task);
+
+	/// <summary>
+	/// 関数をワーカスレッドで実行する
+	/// </summary>
+	/// <param name="f">実行する関数</param>
+	/// <returns>関数の戻り値を表す非同期処理の結果</returns>
+	template <class F>
+	[[nodiscard]] auto async(F f) -> AsyncResult<std::invoke_result_t<F&>> {
+		using R = std::invoke_result_t<F&>;
+		AsyncPromise<R> promise;
+		auto result = promise.result();
+		this->post([f = std::move(f), promise = std::move(promise)]() mutable {
+			try {
+				if constexpr (std::is_void_v<R>) {
+					f();
+					promise.setValue();
+				}
+				else {
+					promise.setValue(f());
+				}
+			}
+			catch (...) {
+				promise.setException(std::current_exception());
+			}
+		});
+		return result;
+	}
+
+	/// <summary>
+	/// ワーカスレッドの数
+	/// </summary>
+	[[nodiscard]] std::size_t size() const noexcept { return this->_workers.size(); }
+
+	// コピーによる構築を禁止する
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+};
@@ -0,0 +1,411 @@
+﻿#include "UringSink.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#if defined(_MSC_VER)
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+#if defined(PWM_IO_URING)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+namespace {
+
+    /// <summary>
+    /// ブロックの整列の単位
+    /// </summary>
+    constexpr std::size_t block_alignment = 4096;
+
+    /// <summary>
+    /// 永続化の完了を示すuser_data
+    /// </summary>
+    constexpr std::uint64_t sync_tag = ~std::uint64_t(0);
+
+    /// <summary>
+    /// 整列した領域を解放する
+    /// </summary>
+    struct AlignedDelete {
+        void operator()(std::byte* p) const noexcept {
+            ::operator delete[](p, std::align_val_t(block_alignment));
+        }
+    };
+}
+
+struct UringSink::Block {
+    std::unique_ptr<std::byte[], AlignedDelete> data;
+    /// <summary>
+    /// 蓄えたバイト数
+    /// </summary>
+    std::size_t size = 0;
+    /// <summary>
+    /// 書き込み先の位置
+    /// </summary>
+    std::uint64_t offset = 0;
+    /// <summary>
+    /// 書き込み中であるか
+    /// </summary>
+    bool busy = false;
+#if !defined(_MSC_VER)
+    /// <summary>
+    /// 投入した書き込みの範囲(完了まで保持する必要がある)
+    /// </summary>
+    iovec iov{};
+#endif
+};
+
+#if defined(PWM_IO_URING)
+/// <summary>
+/// io_uringの投入と完了のキュー
+/// </summary>
+/// <remarks>
+/// liburingを用いずにシステムコールとmmapにより直接操作する。投入側と完了側はいずれも
+/// このオブジェクトを所有するスレッドのみが操作するため、カーネルとの間でのみ順序を保証すればよい。
+/// </remarks>
+struct UringSink::Ring {
+    int fd = -1;
+    void* sq_ptr = MAP_FAILED;
+    std::size_t sq_size = 0;
+    void* cq_ptr = MAP_FAILED;
+    std::size_t cq_size = 0;
+    io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    std::size_t sqes_size = 0;
+    unsigned* sq_head = nullptr;
+    unsigned* sq_tail = nullptr;
+    unsigned* sq_mask = nullptr;
+    unsigned* sq_array = nullptr;
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    unsigned* cq_mask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+    /// <summary>
+    /// 完了していない投入の数
+    /// </summary>
+    std::size_t inflight = 0;
+
+    /// <summary>
+    /// キューを構築する(io_uringを利用できなければ例外を送出する)
+    /// </summary>
+    explicit Ring(unsigned entries) {
+        io_uring_params params{};
+        this->fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+        if (this->fd < 0) {
+            throw std::runtime_error("io_uringを利用できません");
+        }
+        this->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        this->cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single) {
+            this->sq_size = this->cq_size = std::max(this->sq_size, this->cq_size);
+        }
+        this->sq_ptr = ::mmap(nullptr, this->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->fd, IORING_OFF_SQ_RING);
+        if (this->sq_ptr == MAP_FAILED) {
+            this->release();
+            throw std::runtime_error("io_uringを利用できません");
+        }
+        this->cq_ptr = single ? this->sq_ptr
+            : ::mmap(nullptr, this->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->fd, IORING_OFF_CQ_RING);
+        this->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqes_ptr = ::mmap(nullptr, this->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->fd, IORING_OFF_SQES);
+        this->sqes = static_cast<io_uring_sqe*>(sqes_ptr);
+        if (this->cq_ptr == MAP_FAILED || sqes_ptr == MAP_FAILED) {
+            this->release();
+            throw std::runtime_error("io_uringを利用できません");
+        }
+        auto* sq = static_cast<char*>(this->sq_ptr);
+        this->sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        this->sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        this->sq_mask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        this->sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        auto* cq = static_cast<char*>(this->cq_ptr);
+        this->cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        this->cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        this->cq_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        this->cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    }
+
+    ~Ring() {
+        this->release();
+    }
+
+    void release() noexcept {
+        if (this->sqes != MAP_FAILED) {
+            ::munmap(this->sqes, this->sqes_size);
+        }
+        if (this->cq_ptr != MAP_FAILED && this->cq_ptr != this->sq_ptr) {
+            ::munmap(this->cq_ptr, this->cq_size);
+        }
+        if (this->sq_ptr != MAP_FAILED) {
+            ::munmap(this->sq_ptr, this->sq_size);
+        }
+        if (this->fd >= 0) {
+            ::close(this->fd);
+        }
+        this->sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+        this->cq_ptr = this->sq_ptr = MAP_FAILED;
+        this->fd = -1;
+    }
+
+    /// <summary>
+    /// 投入キューの末尾の要素を初期化して取得する
+    /// </summary>
+    io_uring_sqe& next() noexcept {
+        unsigned tail = *this->sq_tail;
+        unsigned index = tail & *this->sq_mask;
+        io_uring_sqe& sqe = this->sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        this->sq_array[index] = index;
+        return sqe;
+    }
+
+    /// <summary>
+    /// nextで取得した要素をカーネルへ投入する
+    /// </summary>
+    void enter() {
+        std::atomic_ref<unsigned>(*this->sq_tail).store(*this->sq_tail + 1, std::memory_order_release);
+        ++this->inflight;
+        while (::syscall(__NR_io_uring_enter, this->fd, 1, 0, 0, nullptr, 0) < 0) {
+            if (errno != EINTR) {
+                throw std::runtime_error("io_uringへの投入に失敗");
+            }
+        }
+    }
+
+    /// <summary>
+    /// 完了を1つ取り出す(無ければ待機する)
+    /// </summary>
+    io_uring_cqe pop() {
+        while (true) {
+            unsigned head = *this->cq_head;
+            if (head != std::atomic_ref<unsigned>(*this->cq_tail).load(std::memory_order_acquire)) {
+                io_uring_cqe cqe = this->cqes[head & *this->cq_mask];
+                std::atomic_ref<unsigned>(*this->cq_head).store(head + 1, std::memory_order_release);
+                --this->inflight;
+                return cqe;
+            }
+            if (::syscall(__NR_io_uring_enter, this->fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR) {
+                throw std::runtime_error("io_uringの完了の待機に失敗");
+            }
+        }
+    }
+};
+#else
+/// <summary>
+/// io_uringを利用できない環境では構築しない
+/// </summary>
+struct UringSink::Ring {};
+#endif
+
+UringSink::UringSink(const std::filesystem::path& path, bool append, const UringOptions& options) : _options(options) {
+    if (options.queue_depth == 0 || options.block_size == 0) {
+        throw std::invalid_argument("キューの深さとブロックのサイズは1以上である必要があります");
+    }
+    this->_options.block_size = (options.block_size + block_alignment - 1) / block_alignment * block_alignment;
+#if defined(_MSC_VER)
+    this->_handle = CreateFileW(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, append ? OPEN_ALWAYS : CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (this->_handle == INVALID_HANDLE_VALUE) {
+        this->_handle = nullptr;
+        throw std::runtime_error("ファイルのオープンに失敗");
+    }
+    LARGE_INTEGER size{};
+    if (append && GetFileSizeEx(this->_handle, &size)) {
+        this->_offset = static_cast<std::uint64_t>(size.QuadPart);
+    }
+#else
+    // 位置を指定して書き込むためO_APPENDは用いず、既存のサイズを起点とする
+    this->_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | (append ? 0 : O_TRUNC) | O_CLOEXEC, 0600);
+    if (this->_fd < 0) {
+        throw std::runtime_error("ファイルのオープンに失敗");
+    }
+    struct stat st{};
+    if (append && ::fstat(this->_fd, &st) == 0) {
+        this->_offset = static_cast<std::uint64_t>(st.st_size);
+    }
+#endif
+
+#if defined(PWM_IO_URING)
+    try {
+        // 永続化の分だけ余分に確保する
+        this->_ring = std::make_unique<Ring>(options.queue_depth + 1);
+    }
+    catch (const std::runtime_error&) {
+        // ブロックごとの同期的な書き込みへ切り替える
+        this->_ring.reset();
+    }
+#endif
+    // 同期的に書き込む場合はブロックを1つだけ用いる
+    this->_blocks.resize(this->_ring ? options.queue_depth : 1);
+    for (auto& block : this->_blocks) {
+        block.data.reset(static_cast<std::byte*>(::operator new[](this->_options.block_size, std::align_val_t(block_alignment))));
+    }
+}
+
+UringSink::~UringSink() {
+    try {
+        this->wait(0);
+    }
+    catch (...) {
+        // 破棄時の失敗は無視する
+    }
+    this->_ring.reset();
+#if defined(_MSC_VER)
+    if (this->_handle != nullptr) {
+        CloseHandle(this->_handle);
+    }
+#else
+    if (this->_fd >= 0) {
+        ::close(this->_fd);
+    }
+#endif
+}
+
+void UringSink::write(std::span<const std::byte> data) {
+    while (!data.empty()) {
+        Block& block = this->_blocks[this->_current];
+        std::size_t n = std::min(data.size(), this->_options.block_size - block.size);
+        std::memcpy(block.data.get() + block.size, data.data(), n);
+        block.size += n;
+        data = data.subspan(n);
+        if (block.size == this->_options.block_size) {
+            this->submit();
+        }
+    }
+}
+
+void UringSink::writeAt(std::span<const std::byte> data, std::uint64_t offset) {
+    while (!data.empty()) {
+#if defined(_MSC_VER)
+        OVERLAPPED overlapped{};
+        overlapped.Offset = static_cast<DWORD>(offset);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        DWORD request = static_cast<DWORD>(std::min<std::size_t>(data.size(), 1u << 30));
+        DWORD n = 0;
+        if (!WriteFile(this->_handle, data.data(), request, &n, &overlapped)) {
+            throw std::runtime_error("ファイルへの書き込みに失敗");
+        }
+#else
+        auto n = ::pwrite(this->_fd, data.data(), data.size(), static_cast<off_t>(offset));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("ファイルへの書き込みに失敗");
+        }
+#endif
+        data = data.subspan(static_cast<std::size_t>(n));
+        offset += static_cast<std::uint64_t>(n);
+    }
+}
+
+void UringSink::submit() {
+    Block& block = this->_blocks[this->_current];
+    if (block.size == 0) {
+        return;
+    }
+    block.offset = this->_offset;
+    this->_offset += block.size;
+    this->_unsynced += block.size;
+#if defined(PWM_IO_URING)
+    if (this->_ring) {
+        // 完了を取り出す前に完了キューが溢れないよう書き込み中のものをキューの深さ以下に保つ
+        this->wait(this->_blocks.size() - 1);
+        block.iov.iov_base = block.data.get();
+        block.iov.iov_len = block.size;
+        io_uring_sqe& sqe = this->_ring->next();
+        sqe.opcode = IORING_OP_WRITEV;
+        sqe.fd = this->_fd;
+        sqe.addr = reinterpret_cast<std::uint64_t>(&block.iov);
+        sqe.len = 1;
+        sqe.off = block.offset;
+        sqe.user_data = this->_current;
+        block.busy = true;
+        this->_ring->enter();
+
+        if (this->_options.sync_interval != 0 && this->_unsynced >= this->_options.sync_interval) {
+            this->sync();
+        }
+        // 空いたブロックが無ければ最も古い書き込みの完了を待つ
+        this->_current = (this->_current + 1) % this->_blocks.size();
+        while (this->_blocks[this->_current].busy) {
+            this->wait(this->_ring->inflight - 1);
+        }
+        return;
+    }
+#endif
+    this->writeAt(std::span(block.data.get(), block.size), block.offset);
+    block.size = 0;
+    if (this->_options.sync_interval != 0 && this->_unsynced >= this->_options.sync_interval) {
+        this->sync();
+    }
+}
+
+void UringSink::wait(std::size_t limit) {
+#if defined(PWM_IO_URING)
+    if (!this->_ring) {
+        return;
+    }
+    while (this->_ring->inflight > limit) {
+        io_uring_cqe cqe = this->_ring->pop();
+        if (cqe.user_data == sync_tag) {
+            if (cqe.res < 0 && cqe.res != -EINVAL && cqe.res != -EROFS) {
+                throw std::runtime_error("ファイルの永続化に失敗");
+            }
+            continue;
+        }
+        Block& block = this->_blocks[static_cast<std::size_t>(cqe.user_data)];
+        block.busy = false;
+        if (cqe.res < 0) {
+            block.size = 0;
+            throw std::runtime_error("ファイルへの書き込みに失敗");
+        }
+        // 一部のみ書き込まれた場合は残りを同期的に書き込む
+        auto written = static_cast<std::size_t>(cqe.res);
+        if (written < block.size) {
+            this->writeAt(std::span(block.data.get() + written, block.size - written), block.offset + written);
+        }
+        block.size = 0;
+    }
+#endif
+}
+
+void UringSink::sync() {
+    this->_unsynced = 0;
+#if defined(PWM_IO_URING)
+    if (this->_ring) {
+        // IOSQE_IO_DRAINにより投入済みの書き込みの完了後に永続化する
+        this->wait(this->_blocks.size());
+        io_uring_sqe& sqe = this->_ring->next();
+        sqe.opcode = IORING_OP_FSYNC;
+        sqe.fd = this->_fd;
+        sqe.flags = IOSQE_IO_DRAIN;
+        sqe.user_data = sync_tag;
+        this->_ring->enter();
+        return;
+    }
+#endif
+#if defined(_MSC_VER)
+    if (!FlushFileBuffers(this->_handle)) {
+        throw std::runtime_error("ファイルの永続化に失敗");
+    }
+#else
+    // パイプやデバイスなど永続化に対応しない出力先は無視する
+    if (::fsync(this->_fd) != 0 && errno != EINVAL && errno != EROFS) {
+        throw std::runtime_error("ファイルの永続化に失敗");
+    }
+#endif
+}
+
+void UringSink::flush() {
+    this->submit();
+    this->sync();
+    this->wait(0);
+}
@@ -0,0 +1,123 @@
+﻿#pragma once
+
+#include "OutputSink.h"
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <span>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define PWM_IO_URING 1
+#endif
+
+/// <summary>
+/// UringSinkの設定
+/// </summary>
+struct UringOptions {
+	/// <summary>
+	/// 同時に書き込み中とするブロックの数
+	/// </summary>
+	unsigned queue_depth = 8;
+	/// <summary>
+	/// 1度に書き込むブロックのバイト数(4096の倍数に切り上げる)
+	/// </summary>
+	std::size_t block_size = 1 << 20;
+	/// <summary>
+	/// このバイト数を書き込むごとにそれまでの書き込みを永続化する(0ならflushでのみ永続化する)
+	/// </summary>
+	std::uint64_t sync_interval = 0;
+};
+
+/// <summary>
+/// ファイルへio_uringにより非同期に書き込むクラス
+/// </summary>
+/// <remarks>
+/// 書き込むデータを4096バイト境界に整列したブロックへ複製し、満たしたブロックを位置を指定して
+/// io_uringへ投入する。空いたブロックが無ければ最も古い書き込みの完了を待つため、書き込み中の
+/// データはqueue_depth個のブロックに制限される。io_uringを利用できない環境(Linux以外、カーネルが
+/// 対応しない、seccompで禁止されている等)ではブロックごとに同期的に書き込む。
+/// </remarks>
+class UringSink : public OutputSink {
+	struct Ring;
+	struct Block;
+
+	/// <summary>
+	/// io_uringの状態(利用できなければnullptr)
+	/// </summary>
+	std::unique_ptr<Ring> _ring;
+	/// <summary>
+	/// 書き込み用のブロック
+	/// </summary>
+	std::vector<Block> _blocks;
+	/// <summary>
+	/// データを蓄えているブロック
+	/// </summary>
+	std::size_t _current = 0;
+	/// <summary>
+	/// 次に書き込むファイル内の位置
+	/// </summary>
+	std::uint64_t _offset = 0;
+	/// <summary>
+	/// 前回の永続化以降に投入したバイト数
+	/// </summary>
+	std::uint64_t _unsynced = 0;
+	UringOptions _options;
+#if defined(_MSC_VER)
+	void* _handle = nullptr;
+#else
+	int _fd = -1;
+#endif
+
+	/// <summary>
+	/// 現在のブロックの内容の書き込みを開始して次の空いたブロックへ移る
+	/// </summary>
+	void submit();
+
+	/// <summary>
+	/// ブロックを同期的に書き込む
+	/// </summary>
+	void writeAt(std::span<const std::byte> data, std::uint64_t offset);
+
+	/// <summary>
+	/// 書き込み中のものが指定の数以下となるまで完了を待つ
+	/// </summary>
+	/// <param name="limit">書き込み中のままとしてよい数</param>
+	void wait(std::size_t limit);
+
+	/// <summary>
+	/// それまでに投入した書き込みの完了後に永続化する
+	/// </summary>
+	void sync();
+
+public:
+	UringSink() = delete;
+	/// <summary>
+	/// ファイルを作成して開く
+	/// </summary>
+	/// <param name="path">ファイルのパス</param>
+	/// <param name="append">trueなら既存の内容の末尾へ追記し、falseなら切り詰める</param>
+	/// <param name="options">設定</param>
+	UringSink(const std::filesystem::path& path, bool append = false, const UringOptions& options = {});
+	/// <summary>
+	/// 書き込み中のものの完了を待って閉じる(flushしていないデータは失われる)
+	/// </summary>
+	~UringSink();
+
+	void write(std::span<const std::byte> data) override;
+	/// <summary>
+	/// すべての書き込みの完了を待ってストレージへ永続化する
+	/// </summary>
+	void flush() override;
+
+	/// <summary>
+	/// io_uringにより書き込んでいるか(falseなら同期的な書き込みへ切り替えている)
+	/// </summary>
+	bool async() const noexcept { return static_cast<bool>(this->_ring); }
+
+	// コピーによる構築を禁止する
+	UringSink(const UringSink&) = delete;
+	UringSink& operator=(const UringSink&) = delete;
+};
@@ -0,0 +1,354 @@
+﻿#include "Utf8.h"
+#include "CpuFeatures.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#define PWM_UTF8_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#define PWM_TARGET_SSSE3
+#define PWM_TARGET_AVX2
+#else
+#define PWM_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define PWM_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace {
+
+    /// <summary>
+    /// 1度に判定するブロックのバイト数
+    /// </summary>
+    constexpr std::size_t block_size = 64;
+
+#if defined(PWM_UTF8_X86)
+    // 連続する2バイトの組に対する誤りの種類(3つの表引きの論理積が0でなければ不正)
+    constexpr std::uint8_t too_short = 1 << 0;
+    constexpr std::uint8_t too_long = 1 << 1;
+    constexpr std::uint8_t overlong_3 = 1 << 2;
+    constexpr std::uint8_t too_large = 1 << 3;
+    constexpr std::uint8_t surrogate = 1 << 4;
+    constexpr std::uint8_t overlong_2 = 1 << 5;
+    constexpr std::uint8_t too_large_1000 = 1 << 6;
+    constexpr std::uint8_t overlong_4 = 1 << 6;
+    constexpr std::uint8_t two_conts = 1 << 7;
+    // 1バイト目の下位4ビットに依存しない誤り
+    constexpr std::uint8_t carry = too_short | too_long | two_conts;
+
+    /// <summary>
+    /// 1バイト目の上位4ビットによる表
+    /// </summary>
+    alignas(16) constexpr std::uint8_t byte_1_high_table[16] = {
+        // 0___: ASCII
+        too_long, too_long, too_long, too_long, too_long, too_long, too_long, too_long,
+        // 10__: 継続バイト
+        two_conts, two_conts, two_conts, two_conts,
+        // 1100: 2バイト文字の先頭
+        too_short | overlong_2,
+        // 1101: 2バイト文字の先頭
+        too_short,
+        // 1110: 3バイト文字の先頭
+        too_short | overlong_3 | surrogate,
+        // 1111: 4バイト文字の先頭
+        too_short | too_large | too_large_1000 | overlong_4
+    };
+
+    /// <summary>
+    /// 1バイト目の下位4ビットによる表
+    /// </summary>
+    alignas(16) constexpr std::uint8_t byte_1_low_table[16] = {
+        carry | overlong_3 | overlong_2 | overlong_4,
+        carry | overlong_2,
+        carry,
+        carry,
+        carry | too_large,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000 | surrogate,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000
+    };
+
+    /// <summary>
+    /// 2バイト目の上位4ビットによる表
+    /// </summary>
+    alignas(16) constexpr std::uint8_t byte_2_high_table[16] = {
+        // 0___: ASCII
+        too_short, too_short, too_short, too_short, too_short, too_short, too_short, too_short,
+        // 1000
+        too_long | overlong_2 | two_conts | overlong_3 | too_large_1000 | overlong_4,
+        // 1001
+        too_long | overlong_2 | two_conts | overlong_3 | too_large,
+        // 101_
+        too_long | overlong_2 | two_conts | surrogate | too_large,
+        too_long | overlong_2 | two_conts | surrogate | too_large,
+        // 11__: 先頭バイト
+        too_short, too_short, too_short, too_short
+    };
+
+    /// <summary>
+    /// 末尾の3バイトが途中で途切れた文字の先頭であるかを判定するための上限値
+    /// </summary>
+    alignas(32) constexpr std::uint8_t incomplete_max[32] = {
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xF0 - 1, 0xE0 - 1, 0xC0 - 1
+    };
+
+    /// <summary>
+    /// SSSE3による判定の状態
+    /// </summary>
+    struct Ssse3State {
+        __m128i high_1;
+        __m128i low_1;
+        __m128i high_2;
+        __m128i error;
+        __m128i prev_input;
+        __m128i prev_incomplete;
+    };
+
+    /// <summary>
+    /// 直前の16バイトに続く16バイトを判定する
+    /// </summary>
+    PWM_TARGET_SSSE3 inline void checkSsse3(Ssse3State& s, __m128i input) {
+        const auto nibble = _mm_set1_epi8(0x0F);
+        auto prev1 = _mm_alignr_epi8(input, s.prev_input, 16 - 1);
+        auto sc = _mm_and_si128(
+            _mm_and_si128(
+                _mm_shuffle_epi8(s.high_1, _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble)),
+                _mm_shuffle_epi8(s.low_1, _mm_and_si128(prev1, nibble))),
+            _mm_shuffle_epi8(s.high_2, _mm_and_si128(_mm_srli_epi16(input, 4), nibble)));
+        // 3バイト目と4バイト目は2つ前、3つ前の先頭バイトから継続バイトであるべきことが決まる
+        auto prev2 = _mm_alignr_epi8(input, s.prev_input, 16 - 2);
+        auto prev3 = _mm_alignr_epi8(input, s.prev_input, 16 - 3);
+        auto must23 = _mm_or_si128(_mm_subs_epu8(prev2, _mm_set1_epi8(static_cast<char>(0xE0 - 0x80))), _mm_subs_epu8(prev3, _mm_set1_epi8(static_cast<char>(0xF0 - 0x80))));
+        auto must23_80 = _mm_and_si128(must23, _mm_set1_epi8(static_cast<char>(0x80)));
+        s.error = _mm_or_si128(s.error, _mm_xor_si128(must23_80, sc));
+        s.prev_input = input;
+    }
+
+    /// <summary>
+    /// 64バイトのブロックを判定する
+    /// </summary>
+    PWM_TARGET_SSSE3 inline void blockSsse3(Ssse3State& s, const char8_t* p) {
+        auto v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        auto v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16));
+        auto v2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 32));
+        auto v3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 48));
+        if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(v0, v1), _mm_or_si128(v2, v3))) == 0) {
+            // ASCIIのみであれば直前の文字が途切れていないことのみ確認する
+            s.error = _mm_or_si128(s.error, s.prev_incomplete);
+            s.prev_incomplete = _mm_setzero_si128();
+            s.prev_input = v3;
+            return;
+        }
+        checkSsse3(s, v0);
+        checkSsse3(s, v1);
+        checkSsse3(s, v2);
+        checkSsse3(s, v3);
+        s.prev_incomplete = _mm_subs_epu8(v3, _mm_loadu_si128(reinterpret_cast<const __m128i*>(incomplete_max + 16)));
+    }
+
+    PWM_TARGET_SSSE3 bool validSsse3(const char8_t* p, std::size_t n) {
+        Ssse3State s = {
+            .high_1 = _mm_load_si128(reinterpret_cast<const __m128i*>(byte_1_high_table)),
+            .low_1 = _mm_load_si128(reinterpret_cast<const __m128i*>(byte_1_low_table)),
+            .high_2 = _mm_load_si128(reinterpret_cast<const __m128i*>(byte_2_high_table)),
+            .error = _mm_setzero_si128(),
+            .prev_input = _mm_setzero_si128(),
+            .prev_incomplete = _mm_setzero_si128()
+        };
+        std::size_t i = 0;
+        for (; i + block_size <= n; i += block_size) {
+            blockSsse3(s, p + i);
+        }
+        if (i < n) {
+            // 末尾の端数は0で埋めたブロックとして判定する
+            char8_t tail[block_size] = {};
+            std::memcpy(tail, p + i, n - i);
+            blockSsse3(s, tail);
+        }
+        auto error = _mm_or_si128(s.error, s.prev_incomplete);
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) == 0xFFFF;
+    }
+
+    /// <summary>
+    /// AVX2による判定の状態
+    /// </summary>
+    struct Avx2State {
+        __m256i high_1;
+        __m256i low_1;
+        __m256i high_2;
+        __m256i error;
+        __m256i prev_input;
+        __m256i prev_incomplete;
+    };
+
+    /// <summary>
+    /// 直前の32バイトに続く32バイトを判定する
+    /// </summary>
+    PWM_TARGET_AVX2 inline void checkAvx2(Avx2State& s, __m256i input) {
+        const auto nibble = _mm256_set1_epi8(0x0F);
+        // 128ビットのレーンを跨いでずらすため直前の入力の上位レーンを連結する
+        auto shifted = _mm256_permute2x128_si256(s.prev_input, input, 0x21);
+        auto prev1 = _mm256_alignr_epi8(input, shifted, 16 - 1);
+        auto sc = _mm256_and_si256(
+            _mm256_and_si256(
+                _mm256_shuffle_epi8(s.high_1, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+                _mm256_shuffle_epi8(s.low_1, _mm256_and_si256(prev1, nibble))),
+            _mm256_shuffle_epi8(s.high_2, _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble)));
+        auto prev2 = _mm256_alignr_epi8(input, shifted, 16 - 2);
+        auto prev3 = _mm256_alignr_epi8(input, shifted, 16 - 3);
+        auto must23 = _mm256_or_si256(_mm256_subs_epu8(prev2, _mm256_set1_epi8(static_cast<char>(0xE0 - 0x80))), _mm256_subs_epu8(prev3, _mm256_set1_epi8(static_cast<char>(0xF0 - 0x80))));
+        auto must23_80 = _mm256_and_si256(must23, _mm256_set1_epi8(static_cast<char>(0x80)));
+        s.error = _mm256_or_si256(s.error, _mm256_xor_si256(must23_80, sc));
+        s.prev_input = input;
+    }
+
+    /// <summary>
+    /// 64バイトのブロックを判定する
+    /// </summary>
+    PWM_TARGET_AVX2 inline void blockAvx2(Avx2State& s, const char8_t* p) {
+        auto lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        auto hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32));
+        if (_mm256_movemask_epi8(_mm256_or_si256(lo, hi)) == 0) {
+            // ASCIIのみであれば直前の文字が途切れていないことのみ確認する
+            s.error = _mm256_or_si256(s.error, s.prev_incomplete);
+            s.prev_incomplete = _mm256_setzero_si256();
+            s.prev_input = hi;
+            return;
+        }
+        checkAvx2(s, lo);
+        checkAvx2(s, hi);
+        s.prev_incomplete = _mm256_subs_epu8(hi, _mm256_load_si256(reinterpret_cast<const __m256i*>(incomplete_max)));
+    }
+
+    PWM_TARGET_AVX2 bool validAvx2(const char8_t* p, std::size_t n) {
+        Avx2State s = {
+            .high_1 = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(byte_1_high_table))),
+            .low_1 = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(byte_1_low_table))),
+            .high_2 = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(byte_2_high_table))),
+            .error = _mm256_setzero_si256(),
+            .prev_input = _mm256_setzero_si256(),
+            .prev_incomplete = _mm256_setzero_si256()
+        };
+        std::size_t i = 0;
+        for (; i + block_size <= n; i += block_size) {
+            blockAvx2(s, p + i);
+        }
+        if (i < n) {
+            // 末尾の端数は0で埋めたブロックとして判定する
+            char8_t tail[block_size] = {};
+            std::memcpy(tail, p + i, n - i);
+            blockAvx2(s, tail);
+        }
+        auto error = _mm256_or_si256(s.error, s.prev_incomplete);
+        return _mm256_testz_si256(error, error) != 0;
+    }
+#endif
+
+    bool validScalar(std::u8string_view x) noexcept {
+        // ASCIIのみの8バイトは読み飛ばす
+        std::size_t i = 0;
+        for (; i + 8 <= x.size(); i += 8) {
+            std::uint64_t v;
+            std::memcpy(&v, x.data() + i, 8);
+            if ((v & 0x8080808080808080) != 0) {
+                break;
+            }
+        }
+        return i == x.size() || invalidUtf8Offset(x.substr(i)) == std::u8string_view::npos;
+    }
+}
+
+Utf8Mode bestUtf8Mode() noexcept {
+#if defined(PWM_UTF8_X86)
+    const auto& cpu = CpuFeatures::current();
+    return cpu.avx2 ? Utf8Mode::avx2 : cpu.ssse3 ? Utf8Mode::ssse3 : Utf8Mode::scalar;
+#else
+    return Utf8Mode::scalar;
+#endif
+}
+
+bool validUtf8(std::u8string_view x, Utf8Mode mode) noexcept {
+    if (x.size() < block_size) {
+        // ブロックに満たないASCIIのみの文字列はベクトル化せずに判定する
+        std::size_t i = 0;
+        for (; i + 8 <= x.size(); i += 8) {
+            std::uint64_t v;
+            std::memcpy(&v, x.data() + i, 8);
+            if ((v & 0x8080808080808080) != 0) {
+                break;
+            }
+        }
+        while (i < x.size() && x[i] < 0x80) {
+            ++i;
+        }
+        if (i == x.size()) {
+            return true;
+        }
+    }
+    static const Utf8Mode best = bestUtf8Mode();
+    if (mode == Utf8Mode::automatic || mode > best) {
+        mode = best;
+    }
+    switch (mode) {
+#if defined(PWM_UTF8_X86)
+    case Utf8Mode::avx2: return validAvx2(x.data(), x.size());
+    case Utf8Mode::ssse3: return validSsse3(x.data(), x.size());
+#endif
+    default: return validScalar(x);
+    }
+}
+
+std::size_t invalidUtf8Offset(std::u8string_view x) noexcept {
+    std::size_t i = 0;
+    while (i < x.size()) {
+        std::uint32_t c = x[i];
+        if (c < 0x80) {
+            ++i;
+            continue;
+        }
+        // 先頭バイトから文字のバイト数と冗長でない最小値を決定する
+        std::size_t len;
+        std::uint32_t min_cp;
+        if ((c & 0xE0) == 0xC0) {
+            len = 2;
+            min_cp = 0x80;
+            c &= 0x1F;
+        }
+        else if ((c & 0xF0) == 0xE0) {
+            len = 3;
+            min_cp = 0x800;
+            c &= 0x0F;
+        }
+        else if ((c & 0xF8) == 0xF0) {
+            len = 4;
+            min_cp = 0x10000;
+            c &= 0x07;
+        }
+        else {
+            return i;
+        }
+        if (x.size() - i < len) {
+            return i;
+        }
+        for (std::size_t k = 1; k < len; ++k) {
+            if ((x[i + k] & 0xC0) != 0x80) {
+                return i;
+            }
+            c = (c << 6) | (x[i + k] & 0x3F);
+        }
+        if (c < min_cp || c > 0x10FFFF || (c >= 0xD800 && c < 0xE000)) {
+            return i;
+        }
+        i += len;
+    }
+    return std::u8string_view::npos;
+}
@@ -0,0 +1,51 @@
+﻿#pragma once
+
+#include <string_view>
+#include <cstddef>
+
+/// <summary>
+/// UTF-8の検証に用いる命令セットの列挙
+/// </summary>
+enum class Utf8Mode {
+	/// <summary>
+	/// 実行環境で利用可能な最速の命令セット
+	/// </summary>
+	automatic,
+	/// <summary>
+	/// 1文字ずつ復号して判定する(比較の基準)
+	/// </summary>
+	scalar,
+	/// <summary>
+	/// SSSE3により16バイトずつ判定する
+	/// </summary>
+	ssse3,
+	/// <summary>
+	/// AVX2により32バイトずつ判定する
+	/// </summary>
+	avx2
+};
+
+/// <summary>
+/// バイト列が正しいUTF-8であるかを判定する
+/// </summary>
+/// <remarks>
+/// ベクトル化した実装では64バイトのブロックごとに、ASCIIのみであれば読み飛ばし、
+/// そうでなければ連続する2バイトの上位・下位4ビットの表引きにより不正な並びを検出する(Keiser, Lemire)。
+/// 冗長な表現、サロゲート、U+10FFFFを超える値および途中で途切れた文字を不正とする。
+/// </remarks>
+/// <param name="x">判定するバイト列</param>
+/// <param name="mode">判定に用いる命令セット</param>
+/// <returns>正しいUTF-8であればtrue</returns>
+[[nodiscard]] bool validUtf8(std::u8string_view x, Utf8Mode mode = Utf8Mode::automatic) noexcept;
+
+/// <summary>
+/// バイト列のうちUTF-8として不正な最初の文字の位置を取得する
+/// </summary>
+/// <param name="x">判定するバイト列</param>
+/// <returns>不正な文字の先頭の位置(正しいUTF-8であればnpos)</returns>
+[[nodiscard]] std::size_t invalidUtf8Offset(std::u8string_view x) noexcept;
+
+/// <summary>
+/// 実行環境で利用可能な最速の命令セットを取得する
+/// </summary>
+[[nodiscard]] Utf8Mode bestUtf8Mode() noexcept;
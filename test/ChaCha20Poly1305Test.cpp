@@ -0,0 +1,146 @@
+﻿#include "Test.h"
+#include "ChaCha20Poly1305.h"
+#include <algorithm>
+#include <format>
+#include <random>
+#include <string>
+
+namespace {
+    const char* toString(ChaChaMode mode) {
+        switch (mode) {
+            case ChaChaMode::scalar: return "scalar";
+            case ChaChaMode::sse2: return "sse2";
+            case ChaChaMode::avx2: return "avx2";
+            default: return "auto";
+        }
+    }
+
+    /// <summary>
+    /// 16進数の文字列をバイト列へ変換する
+    /// </summary>
+    std::vector<std::byte> fromHex(std::string_view hex) {
+        std::vector<std::byte> result;
+        for (std::size_t i = 0; i + 1 < hex.size(); i += 2) {
+            result.push_back(static_cast<std::byte>(std::stoi(std::string(hex.substr(i, 2)), nullptr, 16)));
+        }
+        return result;
+    }
+
+    /// <summary>
+    /// 利用できない命令セットは他の実装へ切り替わるため、CPUが対応する実装のみを列挙する
+    /// </summary>
+    std::vector<ChaChaMode> supportedModes() {
+        std::vector<ChaChaMode> modes;
+        for (auto mode : { ChaChaMode::scalar, ChaChaMode::sse2, ChaChaMode::avx2 }) {
+            if (mode <= bestChaChaMode()) {
+                modes.push_back(mode);
+            }
+            else {
+                std::cout << "  " << toString(mode) << ": skipped (not supported by this CPU)" << std::endl;
+            }
+        }
+        return modes;
+    }
+
+    /// <summary>
+    /// RFC 8439 2.8.2のテストベクタ
+    /// </summary>
+    struct Rfc8439Vector {
+        ChaCha20Poly1305::key_type key;
+        ChaCha20Poly1305::nonce_type nonce;
+        std::vector<std::byte> aad = fromHex("50515253c0c1c2c3c4c5c6c7");
+        std::string_view text = "Ladies and Gentlemen of the class of '99: If I could offer you only one tip for the future, sunscreen would be it.";
+        std::vector<std::byte> ciphertext = fromHex(
+            "d31a8d34648e60db7b86afbc53ef7ec2a4aded51296e08fea9e2b5a736ee62d63dbea45e8ca9671282fafb69da92728b"
+            "1a71de0a9e060b2905d6a5b67ecd3b3692ddbd7f2d778b8c9803aee328091b58fab324e4fad675945585808b4831d7bc"
+            "3ff4def08e4b7a9de576d26586cec64b6116");
+        std::vector<std::byte> tag = fromHex("1ae10b594f09e26a7e902ecbd0600691");
+
+        Rfc8439Vector() {
+            for (std::size_t i = 0; i < this->key.size(); ++i) {
+                this->key[i] = static_cast<std::byte>(0x80 + i);
+            }
+            auto nonce = fromHex("070000004041424344454647");
+            std::ranges::copy(nonce, this->nonce.begin());
+        }
+
+        std::span<const std::byte> plaintext() const { return std::as_bytes(std::span(this->text)); }
+    };
+}
+
+PWM_TEST(chachaRfc8439Vector) {
+    const Rfc8439Vector v;
+    for (auto mode : supportedModes()) {
+        ChaCha20Poly1305 aead(v.key, mode);
+        std::vector<std::byte> ciphertext(v.plaintext().size());
+        ChaCha20Poly1305::tag_type tag;
+        aead.seal(v.nonce, v.aad, v.plaintext(), ciphertext, tag);
+        PWM_CHECK(ciphertext == v.ciphertext);
+        PWM_CHECK(std::ranges::equal(tag, v.tag));
+
+        std::vector<std::byte> decrypted(ciphertext.size());
+        PWM_CHECK(aead.open(v.nonce, v.aad, ciphertext, tag, decrypted));
+        PWM_CHECK(std::ranges::equal(decrypted, v.plaintext()));
+    }
+}
+
+PWM_TEST(chachaModesMatchScalar) {
+    const Rfc8439Vector v;
+    std::mt19937_64 rng(1);
+    // ベクトル化した実装が4ブロックおよび8ブロックずつ処理する長さとその端数を含める
+    std::vector<std::byte> in(1200), expected(in.size()), actual(in.size());
+    for (auto& x : in) {
+        x = static_cast<std::byte>(rng());
+    }
+    for (auto mode : supportedModes()) {
+        std::size_t mismatches = 0;
+        for (std::size_t len = 0; len <= in.size(); len += 1 + len / 16) {
+            auto counter = static_cast<std::uint32_t>(rng());
+            chacha20Xor(v.key, v.nonce, counter, std::span(in).first(len), std::span(expected).first(len), ChaChaMode::scalar);
+            chacha20Xor(v.key, v.nonce, counter, std::span(in).first(len), std::span(actual).first(len), mode);
+            if (!std::ranges::equal(std::span(expected).first(len), std::span(actual).first(len)) && mismatches++ == 0) {
+                std::cout << "  " << toString(mode) << " first mismatch at length " << len << std::endl;
+            }
+        }
+        PWM_CHECK(mismatches == 0);
+    }
+}
+
+PWM_TEST(chachaRejectsTampering) {
+    const Rfc8439Vector v;
+    for (auto mode : supportedModes()) {
+        ChaCha20Poly1305 aead(v.key, mode);
+        ChaCha20Poly1305::tag_type tag;
+        std::ranges::copy(v.tag, tag.begin());
+        std::vector<std::byte> decrypted(v.ciphertext.size());
+
+        auto tampered_tag = tag;
+        tampered_tag[0] ^= std::byte{ 1 };
+        PWM_CHECK(!aead.open(v.nonce, v.aad, v.ciphertext, tampered_tag, decrypted));
+
+        auto tampered = v.ciphertext;
+        tampered.back() ^= std::byte{ 0x80 };
+        PWM_CHECK(!aead.open(v.nonce, v.aad, tampered, tag, decrypted));
+
+        auto aad = v.aad;
+        aad[0] ^= std::byte{ 1 };
+        PWM_CHECK(!aead.open(v.nonce, aad, v.ciphertext, tag, decrypted));
+    }
+}
+
+PWM_BENCHMARK(chachaSealThroughput) {
+    // DBのページと同じ4096バイトを暗号化する速度
+    const Rfc8439Vector v;
+    std::vector<std::byte> page(4096);
+    ChaCha20Poly1305::tag_type tag;
+    constexpr std::size_t pages = 16384;
+    for (auto mode : supportedModes()) {
+        ChaCha20Poly1305 aead(v.key, mode);
+        auto elapsed = pwm::test::measure([&] {
+            for (std::size_t i = 0; i < pages; ++i) {
+                aead.seal(v.nonce, {}, page, page, tag);
+            }
+        });
+        std::cout << "  " << toString(mode) << ": " << std::format("{0:.1f} MiB/s", pages * page.size() / elapsed / (1 << 20)) << std::endl;
+    }
+}
@@ -0,0 +1,168 @@
+﻿#include "Test.h"
+#include "CsvTokenizer.h"
+#include <format>
+#include <iomanip>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+namespace {
+    const char* toString(pwm::CsvScanMode mode) {
+        switch (mode) {
+            case pwm::CsvScanMode::scalar: return "scalar";
+            case pwm::CsvScanMode::sse2: return "sse2";
+            case pwm::CsvScanMode::avx2: return "avx2";
+            default: return "auto";
+        }
+    }
+
+    /// <summary>
+    /// CSVを分割した結果(失敗したときはそのメッセージ)
+    /// </summary>
+    struct Tokenized {
+        std::vector<std::vector<std::u8string>> records;
+        std::string error;
+
+        friend bool operator==(const Tokenized&, const Tokenized&) = default;
+    };
+
+    Tokenized tokenize(const std::string& input, pwm::CsvScanMode mode) {
+        std::istringstream is(input, std::ios::binary);
+        pwm::CsvTokenizer tokenizer(is, mode);
+        Tokenized result;
+        std::vector<std::u8string_view> fields;
+        try {
+            while (tokenizer.next(fields)) {
+                result.records.emplace_back(fields.begin(), fields.end());
+            }
+        }
+        catch (const std::runtime_error& e) {
+            result.error = e.what();
+        }
+        return result;
+    }
+
+    /// <summary>
+    /// 区切り文字、引用符、改行および複数バイトの文字を偏って含むCSVを生成する
+    /// </summary>
+    /// <remarks>
+    /// 8件に1件は不正な形式を含みうる任意の並びとし、残りは引用符で囲んだフィールドを含む正しい形式のレコードの並びとする。
+    /// </remarks>
+    std::string generateCsv(std::mt19937_64& rng) {
+        constexpr std::string_view alphabet[] = { "a", "b", ",", ",", "\"", "\"\"", "\n", "\r\n", "\xe3\x81\x82", "x y" };
+        auto text = [&](std::size_t n, bool quoted) {
+            std::string x;
+            for (std::size_t i = 0; i < n; ++i) {
+                auto c = alphabet[rng() % std::size(alphabet)];
+                if (!quoted && c.find_first_of(",\"\r\n") != std::string_view::npos) {
+                    c = "z";
+                }
+                x += c == "\"" ? "\"\"" : c;
+            }
+            return x;
+        };
+        std::string input;
+        if (rng() % 8 == 0) {
+            auto len = rng() % 400;
+            while (input.size() < len) {
+                input += alphabet[rng() % std::size(alphabet)];
+            }
+            return input;
+        }
+        auto records = 1 + rng() % 8;
+        for (std::size_t r = 0; r < records; ++r) {
+            auto fields = 1 + rng() % 6;
+            for (std::size_t f = 0; f < fields; ++f) {
+                if (f != 0) {
+                    input += ',';
+                }
+                bool quoted = rng() % 2 == 0;
+                auto value = text(rng() % 24, quoted);
+                input += quoted ? "\"" + value + "\"" : value;
+            }
+            if (r + 1 < records || rng() % 2 == 0) {
+                input += rng() % 4 == 0 ? "\r\n" : "\n";
+            }
+        }
+        return input;
+    }
+
+    /// <summary>
+    /// 利用できない命令セットは他の実装へ切り替わるため、CPUが対応するSIMDの実装のみを列挙する
+    /// </summary>
+    std::vector<pwm::CsvScanMode> simdModes() {
+        std::vector<pwm::CsvScanMode> modes;
+        for (auto mode : { pwm::CsvScanMode::sse2, pwm::CsvScanMode::avx2 }) {
+            if (mode <= pwm::CsvTokenizer::bestMode()) {
+                modes.push_back(mode);
+            }
+            else {
+                std::cout << "  " << toString(mode) << ": skipped (not supported by this CPU)" << std::endl;
+            }
+        }
+        return modes;
+    }
+}
+
+PWM_TEST(csvTokenizerKnownInputs) {
+    const Tokenized quoted = {
+        .records = { { u8"a", u8"b,c", u8"d\"e" }, { u8"", u8"x\r\ny" } }
+    };
+    const std::string input = "a,\"b,c\",\"d\"\"e\"\r\n,\"x\r\ny\"\n";
+    PWM_CHECK(tokenize(input, pwm::CsvScanMode::scalar) == quoted);
+    for (auto mode : simdModes()) {
+        PWM_CHECK(tokenize(input, mode) == quoted);
+    }
+    // 閉じられていない引用符は全ての実装で失敗する
+    for (auto mode : { pwm::CsvScanMode::scalar, pwm::CsvScanMode::automatic }) {
+        PWM_CHECK(!tokenize("a,\"b\n", mode).error.empty());
+    }
+}
+
+PWM_TEST(csvTokenizerSimdMatchesScalar) {
+    std::mt19937_64 rng(1);
+    std::vector<std::string> inputs(20000);
+    for (auto& input : inputs) {
+        input = generateCsv(rng);
+    }
+    for (auto mode : simdModes()) {
+        std::size_t mismatches = 0, malformed = 0;
+        for (const auto& input : inputs) {
+            auto expected = tokenize(input, pwm::CsvScanMode::scalar);
+            if (tokenize(input, mode) != expected && mismatches++ == 0) {
+                std::cout << "  " << toString(mode) << " first mismatch: " << std::quoted(input) << std::endl;
+            }
+            malformed += expected.error.empty() ? 0 : 1;
+        }
+        std::cout << "  " << toString(mode) << ": " << inputs.size() << " inputs (" << malformed << " malformed)" << std::endl;
+        PWM_CHECK(mismatches == 0);
+        // 不正な形式の入力も比較の対象に含まれること
+        PWM_CHECK(malformed != 0 && malformed < inputs.size() / 2);
+    }
+}
+
+PWM_BENCHMARK(csvTokenizerThroughput) {
+    // importで読み込む形式に近い、一部を引用符で囲んだ5列のレコードを約64MiB生成する
+    std::mt19937_64 rng(1);
+    std::string input;
+    while (input.size() < (64 << 20)) {
+        auto i = rng();
+        input += std::format("service{0},user{1},\"name, {2}\",\"pass\"\"{3:x}\",memo {4}\n", i % 1000, i % 100000, i, i, i % 7);
+    }
+    for (auto mode : { pwm::CsvScanMode::scalar, pwm::CsvScanMode::sse2, pwm::CsvScanMode::avx2 }) {
+        if (mode > pwm::CsvTokenizer::bestMode()) {
+            continue;
+        }
+        std::size_t records = 0;
+        auto elapsed = pwm::test::measure([&] {
+            std::istringstream is(input, std::ios::binary);
+            pwm::CsvTokenizer tokenizer(is, mode);
+            std::vector<std::u8string_view> fields;
+            while (tokenizer.next(fields)) {
+                ++records;
+            }
+        });
+        std::cout << "  " << toString(mode) << ": " << std::format("{0:.1f} MiB/s, {1:.0f} records/s", input.size() / elapsed / (1 << 20), records / elapsed) << std::endl;
+    }
+}
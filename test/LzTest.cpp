@@ -0,0 +1,54 @@
+﻿#include "Test.h"
+#include "Lz.h"
+#include <random>
+#include <stdexcept>
+
+namespace {
+    /// <summary>
+    /// 圧縮して展開した結果が元のデータと一致するか判定する
+    /// </summary>
+    bool roundTrip(const std::vector<std::byte>& src) {
+        std::vector<std::byte> compressed;
+        lzCompress(src, compressed);
+        std::vector<std::byte> decompressed(src.size());
+        lzDecompress(compressed, decompressed);
+        return decompressed == src;
+    }
+}
+
+PWM_TEST(lzEmptyRoundTrip) {
+    // 展開先が空の領域(data()がnull)であってもよい
+    PWM_CHECK(roundTrip({}));
+    std::vector<std::byte> compressed;
+    lzCompress({}, compressed);
+    PWM_CHECK(!compressed.empty());
+    lzDecompress(compressed, std::span<std::byte>());
+}
+
+PWM_TEST(lzRoundTrip) {
+    std::mt19937_64 rng(1);
+    for (std::size_t len : { 1, 4, 12, 13, 255, 4096, 70000 }) {
+        // 一致を含むように小さなアルファベットから生成する
+        std::vector<std::byte> src(len);
+        for (auto& x : src) {
+            x = static_cast<std::byte>('a' + rng() % 4);
+        }
+        PWM_CHECK(roundTrip(src));
+    }
+}
+
+PWM_TEST(lzRejectsCorruptData) {
+    std::vector<std::byte> src(1000, std::byte{ 'x' });
+    std::vector<std::byte> compressed;
+    lzCompress(src, compressed);
+    // 展開後のバイト数が一致しないものは拒否する
+    std::vector<std::byte> shorter(src.size() - 1);
+    bool rejected = false;
+    try {
+        lzDecompress(compressed, shorter);
+    }
+    catch (const std::runtime_error&) {
+        rejected = true;
+    }
+    PWM_CHECK(rejected);
+}
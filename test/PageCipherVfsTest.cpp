@@ -0,0 +1,147 @@
+﻿#include "Test.h"
+#include "PageCipherVfs.h"
+#include "PasswordManagement.h"
+#include "SQLiteView.h"
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+namespace {
+    /// <summary>
+    /// 既定のページの鍵の取得方法を差し替え、破棄時に戻すクラス
+    /// </summary>
+    class ScopedPageCipherProvider {
+        SQLitePageCipherProvider _saved = SQLiteConnection::default_page_cipher_provider;
+    public:
+        ScopedPageCipherProvider(SQLitePageCipherProvider provider) {
+            SQLiteConnection::default_page_cipher_provider = std::move(provider);
+        }
+        ~ScopedPageCipherProvider() {
+            SQLiteConnection::default_page_cipher_provider = this->_saved;
+        }
+        ScopedPageCipherProvider(const ScopedPageCipherProvider&) = delete;
+        ScopedPageCipherProvider& operator=(const ScopedPageCipherProvider&) = delete;
+    };
+
+    pwm::InsertParam makeParam(std::size_t i) {
+        auto password = std::format("password-{0:08}", i);
+        return pwm::InsertParam{
+            .service = std::bit_cast<const char8_t*>(std::format("service{0}", i % 1000).c_str()),
+            .user = std::bit_cast<const char8_t*>(std::format("user{0}", i).c_str()),
+            .name = std::bit_cast<const char8_t*>(std::format("name{0:08}", i).c_str()),
+            .password = std::vector<unsigned char>(password.begin(), password.end())
+        };
+    }
+
+    void insertRows(pwm::PasswordManagement& pm, std::size_t rows) {
+        std::size_t i = 0;
+        auto result = pm.insertMany([&]() -> std::optional<pwm::InsertParam> {
+            return i < rows ? std::optional(makeParam(i++)) : std::nullopt;
+        }, pwm::ConflictPolicy::fail);
+    }
+
+    /// <summary>
+    /// 名称を指定して1件ずつ取得し、見つかった件数を返す
+    /// </summary>
+    std::size_t countByName(pwm::PasswordManagement& pm, std::size_t rows) {
+        std::size_t found = 0;
+        for (std::size_t i = 0; i < rows; ++i) {
+            for (auto e : pm.get(pwm::GetParam{ .name = makeParam(i).name }, { pwm::table::passwords::c_password::index })) {
+                ++found;
+            }
+        }
+        return found;
+    }
+
+    /// <summary>
+    /// ファイルが文字列をそのまま含むかを判定する
+    /// </summary>
+    bool fileContains(const std::filesystem::path& path, std::string_view text) {
+        std::ifstream ifs(path, std::ios::binary);
+        std::string content((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+        return content.find(text) != std::string::npos;
+    }
+}
+
+PWM_TEST(pageCipherRoundTrip) {
+    pwm::test::TemporaryDirectory dir;
+    constexpr std::size_t rows = 2000;
+    for (bool encrypted : { false, true }) {
+        ScopedPageCipherProvider provider(encrypted ? makePageCipherProvider(u8"test") : nullptr);
+        auto path = dir.path() / (encrypted ? "cipher.db" : "plain.db");
+        {
+            SQLite conn(path);
+            pwm::PasswordManagement pm(path, conn);
+            insertRows(pm, rows);
+            PWM_CHECK(countByName(pm, rows) == rows);
+            // チェックポイントによりWALの内容をDBのファイルへ書き出す
+            conn.exec(u8"PRAGMA wal_checkpoint(TRUNCATE);");
+        }
+        PWM_CHECK(isPlainDatabase(path) != encrypted);
+        PWM_CHECK(fileContains(path, "user1999") != encrypted);
+    }
+}
+
+PWM_TEST(pageCipherRejectsWrongPassphrase) {
+    pwm::test::TemporaryDirectory dir;
+    auto path = dir.path() / "cipher.db";
+    {
+        ScopedPageCipherProvider provider(makePageCipherProvider(u8"right"));
+        SQLite conn(path);
+        pwm::PasswordManagement pm(path, conn);
+        insertRows(pm, 1);
+    }
+    ScopedPageCipherProvider provider(makePageCipherProvider(u8"wrong"));
+    bool thrown = false;
+    try {
+        SQLite conn(path);
+    }
+    catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    PWM_CHECK(thrown);
+}
+
+PWM_TEST(pageCipherSyncAndDiff) {
+    // 暗号化したDB同士の同期と比較は同期先をVFSを介してATTACHする
+    pwm::test::TemporaryDirectory dir;
+    ScopedPageCipherProvider provider(makePageCipherProvider(u8"test"));
+    auto local_path = dir.path() / "local.db";
+    auto peer_path = dir.path() / "peer.db";
+    {
+        SQLite conn(peer_path);
+        pwm::PasswordManagement pm(peer_path, conn);
+        pm.insert(makeParam(1));
+    }
+    SQLite conn(local_path);
+    pwm::PasswordManagement pm(local_path, conn);
+    pm.insert(makeParam(0));
+    auto synced = pm.sync(peer_path);
+    PWM_CHECK(synced.pulled == 1);
+    PWM_CHECK(synced.pushed == 1);
+    PWM_CHECK(countByName(pm, 2) == 2);
+    auto diff = pm.diff(peer_path);
+    PWM_CHECK(diff.local_only.empty());
+    PWM_CHECK(diff.peer_only.empty());
+    PWM_CHECK(!isPlainDatabase(peer_path));
+}
+
+PWM_BENCHMARK(pageCipherInsertAndGet) {
+    pwm::test::TemporaryDirectory dir;
+    constexpr std::size_t rows = 50000;
+    for (bool encrypted : { false, true }) {
+        const char* kind = encrypted ? "cipher" : "plain";
+        ScopedPageCipherProvider provider(encrypted ? makePageCipherProvider(u8"test") : nullptr);
+        auto path = dir.path() / std::format("{0}.db", kind);
+        // 鍵の導出を計測に含めないよう先に開く
+        SQLite conn(path);
+        pwm::PasswordManagement pm(path, conn);
+        auto elapsed = pwm::test::measure([&] { insertRows(pm, rows); });
+        std::cout << "  " << kind << " insert: " << std::format("{0:.0f} rows/s", rows / elapsed) << std::endl;
+        std::size_t found = 0;
+        elapsed = pwm::test::measure([&] { found = countByName(pm, rows); });
+        std::cout << "  " << kind << " get by name: " << std::format("{0:.0f} rows/s", rows / elapsed) << std::endl;
+        PWM_CHECK(found == rows);
+    }
+}
@@ -0,0 +1,80 @@
+﻿#include "Test.h"
+#include "RecordCipher.h"
+#include <algorithm>
+#include <format>
+#include <random>
+#include <stdexcept>
+
+namespace {
+    std::unique_ptr<RecordCipher> makeCipher(std::uint32_t generation) {
+        RecordCipher::key_type key;
+        secureRandom(key);
+        return makeRecordCipher(ChaCha20Poly1305Cipher::name, key, generation);
+    }
+
+    /// <summary>
+    /// 復号が例外により拒否されるか判定する
+    /// </summary>
+    bool rejects(const RecordCipher& cipher, std::span<const unsigned char> ciphertext) {
+        try {
+            auto x = cipher.decrypt(ciphertext);
+        }
+        catch (const std::exception&) {
+            return true;
+        }
+        return false;
+    }
+}
+
+PWM_TEST(recordCipherRoundTrip) {
+    auto cipher = makeCipher(3);
+    for (std::size_t len : { 0, 1, 32, 1000 }) {
+        std::vector<unsigned char> plaintext(len, static_cast<unsigned char>('p'));
+        auto ciphertext = cipher->encrypt(plaintext);
+        PWM_CHECK(ciphertext.size() == plaintext.size() + ChaCha20Poly1305Cipher::overhead);
+        PWM_CHECK(RecordCipher::generation(ciphertext) == 3);
+        PWM_CHECK(cipher->decrypt(ciphertext) == plaintext);
+        // 同じ平文でもnonceが異なるため暗号文は一致しない
+        PWM_CHECK(cipher->encrypt(plaintext) != ciphertext);
+    }
+}
+
+PWM_TEST(recordCipherRejectsTampering) {
+    auto cipher = makeCipher(1);
+    std::vector<unsigned char> plaintext(32, static_cast<unsigned char>('p'));
+    auto ciphertext = cipher->encrypt(plaintext);
+    // 先頭の世代、nonce、本文、認証タグのどのバイトを改ざんしても拒否する
+    for (std::size_t i = 0; i < ciphertext.size(); ++i) {
+        auto tampered = ciphertext;
+        tampered[i] ^= 1;
+        PWM_CHECK(rejects(*cipher, tampered));
+    }
+    PWM_CHECK(rejects(*cipher, std::span(ciphertext).first(ciphertext.size() - 1)));
+    // 異なる鍵では復号できない
+    PWM_CHECK(rejects(*makeCipher(1), ciphertext));
+}
+
+PWM_BENCHMARK(recordCipherThroughput) {
+    std::mt19937_64 rng(1);
+    auto cipher = makeCipher(1);
+    constexpr std::size_t records = 500000;
+    std::vector<std::vector<unsigned char>> plaintexts(4096, std::vector<unsigned char>(32));
+    for (auto& x : plaintexts) {
+        std::ranges::generate(x, [&] { return static_cast<unsigned char>(rng()); });
+    }
+    std::vector<std::vector<unsigned char>> ciphertexts(records);
+    auto elapsed = pwm::test::measure([&] {
+        for (std::size_t i = 0; i < records; ++i) {
+            ciphertexts[i] = cipher->encrypt(plaintexts[i % plaintexts.size()]);
+        }
+    });
+    std::cout << "  encrypt: " << std::format("{0:.0f} records/s", records / elapsed) << std::endl;
+    bool ok = true;
+    elapsed = pwm::test::measure([&] {
+        for (std::size_t i = 0; i < records; ++i) {
+            ok = ok && cipher->decrypt(ciphertexts[i]) == plaintexts[i % plaintexts.size()];
+        }
+    });
+    std::cout << "  decrypt: " << std::format("{0:.0f} records/s", records / elapsed) << std::endl;
+    PWM_CHECK(ok);
+}
@@ -0,0 +1,47 @@
+﻿#include "Test.h"
+#include "SQLiteConnection.h"
+#include "SQLiteStmt.h"
+#include "SQLiteView.h"
+#include <stdexcept>
+
+PWM_TEST(sqliteBackupCopiesDatabase) {
+    pwm::test::TemporaryDirectory dir;
+    SQLite src(dir.path() / "src.db");
+    src.exec(u8"CREATE TABLE t(x INTEGER); INSERT INTO t VALUES (1), (2), (3);");
+    SQLite dest(dir.path() / "dest.db");
+    auto progress = src.backup(dest, { .pages_per_step = 1 });
+    PWM_CHECK(progress.copied == progress.total && progress.total > 0);
+    std::int64_t sum = 0;
+    for (auto e : dest.prepare(u8"SELECT sum(x) FROM t;").exec()) {
+        sum = e.get<SQLiteData::integer_type>(0).value_or(0);
+    }
+    PWM_CHECK(sum == 6);
+}
+
+PWM_TEST(sqliteBackupGivesUpAfterBusyTimeout) {
+    pwm::test::TemporaryDirectory dir;
+    SQLite src(dir.path() / "src.db");
+    src.exec(u8"CREATE TABLE t(x INTEGER); INSERT INTO t VALUES (1);");
+    src.busy({ .timeout = std::chrono::milliseconds(50) });
+    // 他のコネクションが排他ロックを保持し続けるため複製元を読み取れない
+    SQLite locker(dir.path() / "src.db");
+    locker.exec(u8"BEGIN EXCLUSIVE; INSERT INTO t VALUES (2);");
+    SQLite dest(dir.path() / "dest.db");
+
+    bool thrown = false;
+    auto elapsed = pwm::test::measure([&] {
+        try {
+            auto progress = src.backup(dest);
+        }
+        catch (const std::runtime_error&) {
+            thrown = true;
+        }
+    });
+    PWM_CHECK(thrown);
+    PWM_CHECK(elapsed < 5.0);
+
+    // ロックが解放されれば複製できる
+    locker.exec(u8"ROLLBACK;");
+    auto progress = src.backup(dest);
+    PWM_CHECK(progress.copied == progress.total);
+}
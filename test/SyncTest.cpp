@@ -0,0 +1,117 @@
+﻿#include "Test.h"
+#include "PasswordManagement.h"
+#include "SQLiteView.h"
+#include <format>
+#include <stdexcept>
+
+namespace {
+    pwm::InsertParam makeParam(std::string_view name, std::string_view password) {
+        auto str = std::u8string(std::bit_cast<const char8_t*>(name.data()), name.size());
+        return pwm::InsertParam{
+            .service = u8"service-" + str,
+            .user = u8"user-" + str,
+            .name = str,
+            .password = std::vector<unsigned char>(password.begin(), password.end())
+        };
+    }
+
+    /// <summary>
+    /// 名称を指定してパスワードを取得する(存在しなければnullopt)
+    /// </summary>
+    std::optional<std::string> readPassword(pwm::PasswordManagement& pm, std::string_view name) {
+        pwm::GetParam param{ .name = std::u8string(std::bit_cast<const char8_t*>(name.data()), name.size()) };
+        for (auto e : pm.get(param, { pwm::table::passwords::c_password::index })) {
+            auto blob = e.get<SQLiteData::blob_type>(0).value_or(SQLiteData::blob_type{});
+            return std::string(blob.begin(), blob.end());
+        }
+        return std::nullopt;
+    }
+
+    /// <summary>
+    /// 暗号化されたまま格納されているパスワードの件数を取得する
+    /// </summary>
+    std::int64_t countEncrypted(SQLite& conn) {
+        std::int64_t count = 0;
+        for (auto e : conn.prepare(u8"SELECT count(*) FROM passwords WHERE encryption<>'None';").exec()) {
+            count = e.get<SQLiteData::integer_type>(0).value_or(0);
+        }
+        return count;
+    }
+}
+
+PWM_TEST(syncResealsBetweenEncryptedVaults) {
+    pwm::test::TemporaryDirectory dir;
+    auto local_path = dir.path() / "local.db";
+    auto peer_path = dir.path() / "peer.db";
+    // 双方が異なる塩(および異なるパスフレーズ)で最初の世代の鍵を作成する
+    {
+        SQLite conn(peer_path);
+        pwm::PasswordManagement pm(peer_path, conn);
+        pm.unlock(u8"peer passphrase");
+        pm.insert(makeParam("from-peer", "peer secret"));
+    }
+    SQLite conn(local_path);
+    pwm::PasswordManagement pm(local_path, conn);
+    pm.unlock(u8"local passphrase");
+    pm.insert(makeParam("from-local", "local secret"));
+
+    auto result = pm.sync(peer_path, [](pwm::PasswordManagement& peer) { peer.unlock(u8"peer passphrase"); });
+    PWM_CHECK(result.pulled == 1);
+    PWM_CHECK(result.pushed == 1);
+    PWM_CHECK(readPassword(pm, "from-local") == "local secret");
+    PWM_CHECK(readPassword(pm, "from-peer") == "peer secret");
+    PWM_CHECK(countEncrypted(conn) == 2);
+
+    SQLite peer_conn(peer_path);
+    pwm::PasswordManagement peer(peer_path, peer_conn);
+    peer.unlock(u8"peer passphrase");
+    PWM_CHECK(readPassword(peer, "from-local") == "local secret");
+    PWM_CHECK(readPassword(peer, "from-peer") == "peer secret");
+    PWM_CHECK(countEncrypted(peer_conn) == 2);
+
+    // 同期した後の更新も他方の鍵で暗号化し直して反映する
+    peer.update(pwm::GetParam{ .name = u8"from-local" }, pwm::UpdateParam{ .password = std::vector<unsigned char>{ 'n', 'e', 'w' } });
+    result = pm.sync(peer_path, [](pwm::PasswordManagement& peer) { peer.unlock(u8"peer passphrase"); });
+    PWM_CHECK(result.pulled == 1);
+    PWM_CHECK(readPassword(pm, "from-local") == "new");
+}
+
+PWM_TEST(syncRequiresKeysWhenKeyMaterialDiffers) {
+    pwm::test::TemporaryDirectory dir;
+    auto local_path = dir.path() / "local.db";
+    auto peer_path = dir.path() / "peer.db";
+    {
+        SQLite conn(peer_path);
+        pwm::PasswordManagement pm(peer_path, conn);
+        pm.unlock(u8"passphrase");
+        pm.insert(makeParam("from-peer", "peer secret"));
+    }
+    SQLite conn(local_path);
+    pwm::PasswordManagement pm(local_path, conn);
+    pm.unlock(u8"passphrase");
+
+    // 同期先の鍵が設定されていなければ復号できないため同期しない
+    bool thrown = false;
+    try {
+        auto result = pm.sync(peer_path);
+    }
+    catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    PWM_CHECK(thrown);
+    PWM_CHECK(!readPassword(pm, "from-peer"));
+
+    // 暗号化されたパスワードは鍵の情報を持たないDBへ反映しない
+    auto plain_path = dir.path() / "plain.db";
+    SQLite plain_conn(plain_path);
+    pwm::PasswordManagement plain(plain_path, plain_conn);
+    thrown = false;
+    try {
+        auto result = plain.sync(peer_path, [](pwm::PasswordManagement& peer) { peer.unlock(u8"passphrase"); });
+    }
+    catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    PWM_CHECK(thrown);
+    PWM_CHECK(!readPassword(plain, "from-peer"));
+}
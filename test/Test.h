@@ -0,0 +1,92 @@
+﻿#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <string_view>
+#include <vector>
+
+namespace pwm::test {
+	/// <summary>
+	/// 登録されたテストまたは計測
+	/// </summary>
+	struct TestCase {
+		std::string_view name;
+		void (*body)();
+		/// <summary>
+		/// 計測であれば--benchを指定したときのみ実行する
+		/// </summary>
+		bool benchmark;
+	};
+
+	/// <summary>
+	/// 登録されたテストの一覧を取得する
+	/// </summary>
+	std::vector<TestCase>& testCases();
+
+	/// <summary>
+	/// 静的な初期化によりテストを登録するクラス
+	/// </summary>
+	struct TestRegistrar {
+		TestRegistrar(std::string_view name, void (*body)(), bool benchmark) {
+			testCases().push_back({ name, body, benchmark });
+		}
+	};
+
+	/// <summary>
+	/// 検証の失敗を記録して出力する
+	/// </summary>
+	/// <param name="expr">失敗した式</param>
+	/// <param name="file">ファイル名</param>
+	/// <param name="line">行番号</param>
+	void reportFailure(std::string_view expr, std::string_view file, int line);
+
+	/// <summary>
+	/// テストの間だけ存在する一時ディレクトリ
+	/// </summary>
+	class TemporaryDirectory {
+		std::filesystem::path _path;
+	public:
+		TemporaryDirectory();
+		TemporaryDirectory(const TemporaryDirectory&) = delete;
+		TemporaryDirectory& operator=(const TemporaryDirectory&) = delete;
+		/// <summary>
+		/// ディレクトリとその内容を削除する
+		/// </summary>
+		~TemporaryDirectory();
+
+		const std::filesystem::path& path() const noexcept { return this->_path; }
+	};
+
+	/// <summary>
+	/// 処理の経過時間を秒で計測する
+	/// </summary>
+	template <class F>
+	double measure(F&& f) {
+		auto begin = std::chrono::steady_clock::now();
+		f();
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+		return elapsed.count();
+	}
+}
+
+#define PWM_TEST_REGISTER(name, benchmark) \
+	static void name(); \
+	static const ::pwm::test::TestRegistrar name##_registrar(#name, &name, benchmark); \
+	static void name()
+
+/// <summary>
+/// テストを定義する
+/// </summary>
+#define PWM_TEST(name) PWM_TEST_REGISTER(name, false)
+
+/// <summary>
+/// 計測を定義する
+/// </summary>
+#define PWM_BENCHMARK(name) PWM_TEST_REGISTER(name, true)
+
+/// <summary>
+/// 式が真であることを検証し、偽であれば失敗を記録して続行する
+/// </summary>
+#define PWM_CHECK(expr) \
+	((expr) ? static_cast<void>(0) : ::pwm::test::reportFailure(#expr, __FILE__, __LINE__))
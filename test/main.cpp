@@ -0,0 +1,84 @@
+﻿#include "Test.h"
+#include <algorithm>
+#include <exception>
+#include <format>
+#include <random>
+#include <string>
+#if defined(_MSC_VER)
+#include <windows.h>
+#endif
+
+namespace {
+    /// <summary>
+    /// 実行中のテストで記録された失敗の数
+    /// </summary>
+    std::size_t current_failures = 0;
+}
+
+std::vector<pwm::test::TestCase>& pwm::test::testCases() {
+    static std::vector<TestCase> cases;
+    return cases;
+}
+
+void pwm::test::reportFailure(std::string_view expr, std::string_view file, int line) {
+    ++current_failures;
+    std::cout << "  " << file << "(" << line << "): check failed: " << expr << std::endl;
+}
+
+pwm::test::TemporaryDirectory::TemporaryDirectory()
+    : _path(std::filesystem::temp_directory_path() / std::format("pwm-test-{0}", std::random_device{}())) {
+    std::filesystem::create_directories(this->_path);
+}
+
+pwm::test::TemporaryDirectory::~TemporaryDirectory() {
+    std::error_code ec;
+    std::filesystem::remove_all(this->_path, ec);
+}
+
+/// <summary>
+/// 登録されたテストを実行する
+/// </summary>
+/// <remarks>
+/// pwm_test [--bench] [name...]
+/// 名称を指定したときはその文字列を含むものだけを実行し、--benchを指定したときは計測も実行する。
+/// </remarks>
+int main(int argc, const char* argv[]) {
+#if defined(_MSC_VER)
+    // UTF-8でコンソールに出力するための設定
+    SetConsoleOutputCP(CP_UTF8);
+#endif
+    bool benchmark = false;
+    std::vector<std::string_view> filters;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg == "--bench") {
+            benchmark = true;
+        }
+        else {
+            filters.push_back(arg);
+        }
+    }
+
+    std::size_t passed = 0, failed = 0;
+    for (const auto& test : pwm::test::testCases()) {
+        if (test.benchmark && !benchmark) {
+            continue;
+        }
+        if (!filters.empty() && std::ranges::none_of(filters, [&](auto x) { return test.name.find(x) != std::string_view::npos; })) {
+            continue;
+        }
+        std::cout << "[ RUN  ] " << test.name << std::endl;
+        current_failures = 0;
+        try {
+            test.body();
+        }
+        catch (const std::exception& e) {
+            std::cout << "  unexpected exception: " << e.what() << std::endl;
+            ++current_failures;
+        }
+        std::cout << (current_failures == 0 ? "[  OK  ] " : "[ FAIL ] ") << test.name << std::endl;
+        ++(current_failures == 0 ? passed : failed);
+    }
+    std::cout << passed << " passed, " << failed << " failed" << std::endl;
+    return failed == 0 ? 0 : 1;
+}